@@ -35,69 +35,53 @@
 #define PAGE "<html><head><title>libmicrohttpd demo</title></head><body>libmicrohttpd demo</body></html>"
 
 
-#define SMALL (1024 * 128)
-
 /**
  * Number of threads to run in the thread pool.  Should (roughly) match
  * the number of cores on your system.
  */
 #define NUMBER_OF_THREADS CPU_COUNT
 
-static unsigned int small_deltas[SMALL];
-
 static struct MHD_Response *response;
 
 
-
 /**
- * Signature of the callback used by MHD to notify the
- * application about completed requests.
+ * Print a summary of the latency histogram of one phase of request
+ * processing and, if @a detail is set, the non-empty buckets.
  *
- * @param cls client-defined closure
- * @param connection connection handle
- * @param con_cls value as set by the last call to
- *        the MHD_AccessHandlerCallback
- * @param toe reason for request termination
- * @see MHD_OPTION_NOTIFY_COMPLETED
+ * @param d daemon to get the histogram from
+ * @param phase phase to print
+ * @param name name of the phase
+ * @param detail non-zero to print all non-empty buckets
  */
 static void
-completed_callback (void *cls,
-		    struct MHD_Connection *connection,
-		    void **con_cls,
-		    enum MHD_RequestTerminationCode toe)
+print_latency (struct MHD_Daemon *d,
+               enum MHD_LatencyPhase phase,
+               const char *name,
+               int detail)
 {
-  struct timeval *tv = *con_cls;
-  struct timeval tve;
-  uint64_t delta;
+  const union MHD_DaemonInfo *info;
+  const struct MHD_LatencyHistogram *h;
+  unsigned int i;
 
-  if (NULL == tv)
+  info = MHD_get_daemon_info (d, MHD_DAEMON_INFO_LATENCY_HISTOGRAM, phase);
+  if (NULL == info)
     return;
-  gettimeofday (&tve, NULL);
-
-  delta = 0;
-  if (tve.tv_usec >= tv->tv_usec)
-    delta += (tve.tv_sec - tv->tv_sec) * 1000000LL
-      + (tve.tv_usec - tv->tv_usec);
-  else
-    delta += (tve.tv_sec - tv->tv_sec) * 1000000LL
-      - tv->tv_usec + tve.tv_usec;
-  if (delta < SMALL)
-    small_deltas[delta]++;
-  else
-    fprintf (stdout, "D: %llu 1\n", (unsigned long long) delta);
-  free (tv);
-}
-
-
-static void *
-uri_logger_cb (void *cls,
-	       const char *uri)
-{
-  struct timeval *tv = malloc (sizeof (struct timeval));
-
-  if (NULL != tv)
-    gettimeofday (tv, NULL);
-  return tv;
+  h = info->latency_histogram;
+  fprintf (stdout,
+           "%s: %llu requests, p50 %llu us, p90 %llu us, p99 %llu us, max %llu us\n",
+           name,
+           (unsigned long long) h->count,
+           (unsigned long long) MHD_latency_histogram_percentile (h, 50.0),
+           (unsigned long long) MHD_latency_histogram_percentile (h, 90.0),
+           (unsigned long long) MHD_latency_histogram_percentile (h, 99.0),
+           (unsigned long long) h->max);
+  if (! detail)
+    return;
+  for (i = 0; i < MHD_LATENCY_HISTOGRAM_BUCKETS; i++)
+    if (0 != h->buckets[i])
+      fprintf (stdout, "D: %llu %llu\n",
+               (unsigned long long) MHD_latency_histogram_bucket_limit (i),
+               (unsigned long long) h->buckets[i]);
 }
 
 
@@ -119,7 +103,6 @@ int
 main (int argc, char *const *argv)
 {
   struct MHD_Daemon *d;
-  unsigned int i;
 
   if (argc != 2)
     {
@@ -143,17 +126,20 @@ main (int argc, char *const *argv)
                         NULL, NULL, &ahc_echo, NULL,
 			MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int) 120,
 			MHD_OPTION_THREAD_POOL_SIZE, (unsigned int) NUMBER_OF_THREADS,
-			MHD_OPTION_URI_LOG_CALLBACK, &uri_logger_cb, NULL,
-			MHD_OPTION_NOTIFY_COMPLETED, &completed_callback, NULL,
+			MHD_OPTION_LATENCY_HISTOGRAMS, (unsigned int) 1,
 			MHD_OPTION_CONNECTION_LIMIT, (unsigned int) 1000,
 			MHD_OPTION_END);
   if (d == NULL)
     return 1;
   (void) getc (stdin);
+  print_latency (d, MHD_LATENCY_PHASE_WAIT, "wait", 0);
+  print_latency (d, MHD_LATENCY_PHASE_RECEIVE_HEADERS, "headers", 0);
+  print_latency (d, MHD_LATENCY_PHASE_DISPATCH, "dispatch", 0);
+  print_latency (d, MHD_LATENCY_PHASE_HANDLER, "handler", 0);
+  print_latency (d, MHD_LATENCY_PHASE_SEND_HEADERS, "send headers", 0);
+  print_latency (d, MHD_LATENCY_PHASE_SEND_BODY, "send body", 0);
+  print_latency (d, MHD_LATENCY_PHASE_REQUEST, "request", 1);
   MHD_stop_daemon (d);
   MHD_destroy_response (response);
-  for (i=0;i<SMALL;i++)
-    if (0 != small_deltas[i])
-      fprintf (stdout, "D: %d %u\n", i, small_deltas[i]);
   return 0;
 }
@@ -130,7 +130,7 @@ typedef intptr_t ssize_t;
  * Current version of the library.
  * 0x01093001 = 1.9.30-1.
  */
-#define MHD_VERSION 0x00093802
+#define MHD_VERSION 0x00093803
 
 /**
  * MHD-internal return code for "YES".
@@ -416,6 +416,12 @@ struct MHD_Response;
  */
 struct MHD_PostProcessor;
 
+/**
+ * @brief Handle for serving files from a directory.
+ * @ingroup response
+ */
+struct MHD_StaticFiles;
+
 
 /**
  * @brief Flags for the `struct MHD_Daemon`.
@@ -564,7 +570,20 @@ enum MHD_FLAG
    * kernel >= 3.6.  On other systems, using this option cases #MHD_start_daemon
    * to fail.
    */
-  MHD_USE_TCP_FASTOPEN = 16384
+  MHD_USE_TCP_FASTOPEN = 16384,
+
+  /**
+   * Use io_uring (Linux only) instead of `epoll()`: accepting,
+   * receiving and waiting for sockets to become writable are done by
+   * the kernel and only their completions are collected, which saves
+   * most of the system calls per request.  Must be combined with
+   * #MHD_USE_SELECT_INTERNALLY (optionally with a thread pool); does
+   * not work with #MHD_USE_SSL.  If io_uring cannot be used (not
+   * compiled in, not supported by the kernel or not applicable to the
+   * given flags), MHD falls back to `epoll()` (or `select()` where
+   * epoll is not available either).
+   */
+  MHD_USE_IO_URING = 32768
 
 };
 
@@ -856,6 +875,124 @@ enum MHD_OPTION
    * This option must be followed by a `unsigned int` argument.
    */
   MHD_OPTION_LISTENING_ADDRESS_REUSE = 25,
+
+  /**
+   * When using #MHD_OPTION_THREAD_POOL_SIZE, give every worker thread
+   * its own listen socket instead of having all workers poll (and
+   * race to accept on) the same socket.  The sockets are bound with
+   * SO_REUSEPORT to the same address, so the kernel distributes new
+   * connections among the workers and wakes up only one of them.
+   * This option must be followed by an `unsigned int` argument:
+   * 0 (default) to share one listen socket, 1 to use one socket per
+   * worker, 2 to additionally hand each connection to the worker
+   * with index "receiving CPU modulo pool size" (Linux only, requires
+   * SO_ATTACH_REUSEPORT_CBPF; falls back to the kernel's hashing if
+   * not available).  Values other than 0 set SO_REUSEPORT on the
+   * listen socket and cannot be combined with disallowing address
+   * reuse via #MHD_OPTION_LISTENING_ADDRESS_REUSE.  If a listen socket is given
+   * with #MHD_OPTION_LISTEN_SOCKET, it must have SO_REUSEPORT set.
+   * #MHD_quiesce_daemon only returns the socket of the master; each
+   * worker accepts the connections still queued on its own socket
+   * and then closes it.
+   */
+  MHD_OPTION_THREAD_POOL_REUSEPORT = 26,
+
+  /**
+   * After how many milliseconds of inactivity should a
+   * connection automatically be timed out?  Like
+   * #MHD_OPTION_CONNECTION_TIMEOUT, but with millisecond
+   * resolution (the later of the two options given wins).
+   * This option must be followed by an `unsigned int` argument.
+   * Use zero for no timeout.
+   */
+  MHD_OPTION_CONNECTION_TIMEOUT_MS = 27,
+
+  /**
+   * Maximum number of closed connections whose data structures
+   * (including the memory pool of #MHD_OPTION_CONNECTION_MEMORY_LIMIT
+   * bytes) are kept for reuse by new connections instead of being
+   * released.  With a thread pool, this limit applies to each
+   * worker thread.  This option must be followed by an `unsigned int`
+   * argument; the default is zero (no recycling).
+   */
+  MHD_OPTION_CONNECTION_CACHE_SIZE = 28,
+
+  /**
+   * Keep histograms of the time spent in each phase of processing
+   * a request (see `enum MHD_LatencyPhase`), which can then be
+   * obtained with #MHD_get_daemon_info() and
+   * #MHD_DAEMON_INFO_LATENCY_HISTOGRAM.  Each worker thread keeps
+   * its own histograms; enabling this costs a few clock readings
+   * per request.  This option must be followed by an `unsigned int`
+   * argument, non-zero to enable the histograms (default: disabled).
+   */
+  MHD_OPTION_LATENCY_HISTOGRAMS = 29,
+
+  /**
+   * After the TLS handshake, pass the keys for the records we send
+   * to the kernel (Linux kernel TLS), so that responses created
+   * from file descriptors are sent with `sendfile()` and encrypted
+   * by the kernel instead of being copied through GnuTLS.  Incoming
+   * data is still decrypted by GnuTLS.  Connections for which the
+   * kernel does not support the negotiated cipher (AES-GCM and
+   * ChaCha20-Poly1305 with TLS 1.2 or 1.3) continue to use GnuTLS.
+   * Clients that request a TLS 1.3 key update are disconnected.
+   * This option must be followed by an `unsigned int` argument,
+   * non-zero to enable kernel TLS (default: disabled).  Requires
+   * #MHD_USE_SSL, see also #MHD_FEATURE_KTLS.
+   */
+  MHD_OPTION_HTTPS_KTLS = 30,
+
+  /**
+   * Issue TLS session tickets, so that clients can resume their
+   * session without a full handshake.  The key that encrypts the
+   * tickets is shared by all threads and replaced with a new random
+   * key after the given lifetime; tickets encrypted with an older
+   * key are no longer accepted.  This option must be followed by
+   * an `unsigned int` argument, the lifetime of the key (and of
+   * the tickets) in seconds, or zero to disable tickets (default).
+   * Requires #MHD_USE_SSL.
+   */
+  MHD_OPTION_HTTPS_SESSION_TICKETS = 31,
+
+  /**
+   * Keep TLS sessions in memory, so that clients can resume them
+   * by session ID without a full handshake (for clients that do
+   * not use session tickets).  The cache is shared by all threads
+   * of a thread pool.  This option must be followed by an
+   * `unsigned int` argument, the maximum number of sessions to
+   * keep, or zero to disable the cache (default).  Requires
+   * #MHD_USE_SSL.
+   */
+  MHD_OPTION_HTTPS_SESSION_CACHE_SIZE = 32,
+
+  /**
+   * Run the TLS handshakes on a separate pool of threads instead of
+   * the threads that run the event loops, so that a burst of new
+   * clients does not delay the requests of established connections.
+   * Whenever the client sent handshake data, the connection is taken
+   * out of the event loop until one of the handshake threads has
+   * processed it.  This option must be followed by an `unsigned int`
+   * argument, the number of handshake threads, or zero to run the
+   * handshakes in the event loops (default).  Requires #MHD_USE_SSL
+   * and #MHD_USE_SELECT_INTERNALLY, and is ignored with
+   * #MHD_USE_THREAD_PER_CONNECTION.
+   */
+  MHD_OPTION_HTTPS_HANDSHAKE_THREADS = 33,
+
+  /**
+   * Give the memory of the pool of a keep-alive connection back to
+   * the operating system once a response is complete and the client
+   * did not send its next request yet, and likewise for connections
+   * kept with #MHD_OPTION_CONNECTION_CACHE_SIZE.  The pool keeps its
+   * size and grows back as the next request is read; this trades a
+   * system call per request and a few page faults for not keeping
+   * up to #MHD_OPTION_CONNECTION_MEMORY_LIMIT bytes resident for
+   * every idle connection.  Only supported on Linux.  This option
+   * must be followed by an `unsigned int` argument, non-zero to
+   * enable it (default: disabled).
+   */
+  MHD_OPTION_CONNECTION_MEMORY_RELEASE = 34,
 };
 
 
@@ -1125,7 +1262,121 @@ enum MHD_DaemonInfoType
    * Request the number of current connections handled by the daemon.
    * No extra arguments should be passed.
    */
-  MHD_DAEMON_INFO_CURRENT_CONNECTIONS
+  MHD_DAEMON_INFO_CURRENT_CONNECTIONS,
+
+  /**
+   * Request the latency histogram of one phase of request processing,
+   * summed up over all worker threads.  The phase must be passed as
+   * an extra argument of type `enum MHD_LatencyPhase`.  Only available
+   * if the daemon was started with #MHD_OPTION_LATENCY_HISTOGRAMS.
+   * The histogram is stored in the daemon and only valid until the
+   * next request for a latency histogram (from any thread), so copy
+   * it if it is needed for longer.
+   */
+  MHD_DAEMON_INFO_LATENCY_HISTOGRAM
+};
+
+
+/**
+ * Phases of processing a request for which latency histograms
+ * are kept, see #MHD_OPTION_LATENCY_HISTOGRAMS.
+ */
+enum MHD_LatencyPhase
+{
+
+  /**
+   * From accepting the connection (or from sending the previous
+   * response on a persistent connection) until the first byte of
+   * the request is received.
+   */
+  MHD_LATENCY_PHASE_WAIT = 0,
+
+  /**
+   * From the first byte of the request until all request headers
+   * were received.
+   */
+  MHD_LATENCY_PHASE_RECEIVE_HEADERS = 1,
+
+  /**
+   * From receiving the request headers until the access handler
+   * is first called; time spent in the event loop.
+   */
+  MHD_LATENCY_PHASE_DISPATCH = 2,
+
+  /**
+   * From the first call of the access handler (including the
+   * upload of the request body, if any, and the time the request
+   * was suspended) until a response was queued.
+   */
+  MHD_LATENCY_PHASE_HANDLER = 3,
+
+  /**
+   * From queueing the response until the response headers were
+   * sent.
+   */
+  MHD_LATENCY_PHASE_SEND_HEADERS = 4,
+
+  /**
+   * From sending the response headers until the response body
+   * (and footers) were sent.
+   */
+  MHD_LATENCY_PHASE_SEND_BODY = 5,
+
+  /**
+   * From the first byte of the request until the response was
+   * sent completely.
+   */
+  MHD_LATENCY_PHASE_REQUEST = 6,
+
+  /**
+   * From accepting the connection until it was closed.
+   */
+  MHD_LATENCY_PHASE_CONNECTION = 7
+};
+
+
+/**
+ * Number of values in `enum MHD_LatencyPhase`.
+ */
+#define MHD_LATENCY_PHASE_COUNT 8
+
+/**
+ * Number of buckets of a `struct MHD_LatencyHistogram`.  Values
+ * below 16 microseconds have one bucket each; every power of two
+ * above is split into 16 buckets, so each bucket covers about 6%
+ * of its values.  Values of 2^36 microseconds (about 19 hours) and
+ * more are counted in the last bucket.
+ */
+#define MHD_LATENCY_HISTOGRAM_BUCKETS 528
+
+
+/**
+ * Histogram of the latency of a phase of request processing, see
+ * #MHD_DAEMON_INFO_LATENCY_HISTOGRAM.  All times are in microseconds.
+ */
+struct MHD_LatencyHistogram
+{
+  /**
+   * Number of values recorded.
+   */
+  uint64_t count;
+
+  /**
+   * Sum of all values recorded.
+   */
+  uint64_t sum;
+
+  /**
+   * Largest value recorded.
+   */
+  uint64_t max;
+
+  /**
+   * Number of values per bucket; use
+   * #MHD_latency_histogram_bucket_limit() to find the range
+   * of values of a bucket.
+   */
+  uint64_t buckets[MHD_LATENCY_HISTOGRAM_BUCKETS];
 };
 
 
@@ -1705,6 +1956,14 @@ MHD_lookup_connection_value (struct MHD_Connection *connection,
  * Queue a response to be transmitted to the client (as soon as
  * possible but after #MHD_AccessHandlerCallback returns).
  *
+ * If a response for a buffer or a file descriptor is queued with
+ * #MHD_HTTP_OK for a "GET" request that has a "Range" header (and
+ * no "If-Range" header that does not match the "ETag" or
+ * "Last-Modified" header of the response), MHD sends the requested
+ * range(s) with #MHD_HTTP_PARTIAL_CONTENT ("multipart/byteranges"
+ * for several ranges), or #MHD_HTTP_REQUESTED_RANGE_NOT_SATISFIABLE.
+ * The response can still be shared by all requests.
+ *
  * @param connection the connection identifying the client
  * @param status_code HTTP status code (i.e. #MHD_HTTP_OK)
  * @param response response to transmit
@@ -1761,6 +2020,20 @@ _MHD_EXTERN void
 MHD_resume_connection (struct MHD_Connection *connection);
 
 
+/**
+ * Resume handling of network data for a set of suspended connections.
+ * Equivalent to calling #MHD_resume_connection() on each of them,
+ * except that the event loop of each daemon involved is only woken
+ * up once.
+ *
+ * @param connections array of connections to resume
+ * @param num_connections number of entries in @a connections
+ */
+_MHD_EXTERN void
+MHD_resume_connections (struct MHD_Connection *const *connections,
+                        unsigned int num_connections);
+
+
 /* **************** Response manipulation functions ***************** */
 
 
@@ -1779,7 +2052,22 @@ enum MHD_ResponseFlags
    * do not (automatically) sent "Connection" headers and always
    * close the connection after generating the response.
    */
-  MHD_RF_HTTP_VERSION_1_0_ONLY = 1
+  MHD_RF_HTTP_VERSION_1_0_ONLY = 1,
+
+  /**
+   * Compress the body with gzip or deflate if the client accepts
+   * it (as indicated by its "Accept-Encoding" header).  For
+   * responses created from a buffer, the compressed body is computed
+   * once and kept with the response for all later requests; bodies
+   * from a content reader callback are compressed on the fly and
+   * sent with chunked encoding.  Responses for a file descriptor,
+   * responses that already have a "Content-Encoding" header and
+   * bodies that do not get smaller are sent unchanged.  Setting this
+   * flag adds a "Vary: Accept-Encoding" header unless the response
+   * already has a "Vary" header.  Only effective if
+   * #MHD_FEATURE_COMPRESSION is supported.
+   */
+  MHD_RF_COMPRESS = 2
 
 };
 
@@ -2233,6 +2521,82 @@ _MHD_EXTERN int
 MHD_destroy_post_processor (struct MHD_PostProcessor *pp);
 
 
+/* ********************** Static file functions ********************** */
+
+/**
+ * Create a `struct MHD_StaticFiles` for serving the files below
+ * @a root with #MHD_static_files_handler().
+ *
+ * Up to @a cache_size files are kept open, together with their
+ * size, modification time and the responses for them, so that
+ * serving a file again does not cost an `open()`, `fstat()` and
+ * `close()`.  Conditional requests ("If-None-Match",
+ * "If-Modified-Since") for cached files are answered with 304
+ * from the cached metadata without any file I/O.  Where inotify is
+ * available, cached files are dropped from the cache as soon as
+ * they are changed, replaced or removed; elsewhere, cached files
+ * are checked with `stat()` before they are served.
+ *
+ * @param root directory with the files to serve
+ * @param cache_size maximum number of files to keep open,
+ *        0 to open the file for every request
+ * @return NULL on error (out of memory)
+ * @ingroup response
+ */
+_MHD_EXTERN struct MHD_StaticFiles *
+MHD_static_files_create (const char *root,
+                         unsigned int cache_size);
+
+
+/**
+ * Answer a "GET" or "HEAD" request for @a url with the file
+ * "root/url" (for URLs that end with a '/', the "index.html" in
+ * that directory).  Responses carry "Content-Type" (guessed from
+ * the file name extension), "ETag" and "Last-Modified" headers.
+ * Missing files and URLs with ".." segments are answered with 404,
+ * other methods with 405.
+ *
+ * This function is an #MHD_AccessHandlerCallback and can be passed
+ * to #MHD_start_daemon() directly (with the `struct MHD_StaticFiles`
+ * as its closure), or be called by the application's own handler
+ * for the requests that it wants to answer with a file.  It may be
+ * called from several threads at the same time.
+ *
+ * @param cls the `struct MHD_StaticFiles`
+ * @param connection connection with the request
+ * @param url URL of the request
+ * @param method method of the request
+ * @param version ignored
+ * @param upload_data ignored
+ * @param upload_data_size ignored
+ * @param con_cls ignored
+ * @return #MHD_YES if a response was queued, #MHD_NO on error
+ * @ingroup response
+ */
+_MHD_EXTERN int
+MHD_static_files_handler (void *cls,
+                          struct MHD_Connection *connection,
+                          const char *url,
+                          const char *method,
+                          const char *version,
+                          const char *upload_data,
+                          size_t *upload_data_size,
+                          void **con_cls);
+
+
+/**
+ * Release a `struct MHD_StaticFiles` and close the cached files
+ * (files that are still being sent are closed once they have been
+ * sent).  Must not be called while #MHD_static_files_handler() may
+ * still be running for it.
+ *
+ * @param sf the handle to destroy
+ * @ingroup response
+ */
+_MHD_EXTERN void
+MHD_static_files_destroy (struct MHD_StaticFiles *sf);
+
+
 /* ********************* Digest Authentication functions *************** */
 
 
@@ -2361,7 +2725,52 @@ enum MHD_CONNECTION_OPTION
    * as the number of seconds, given as an `unsigned int`.  Use
    * zero for no timeout.
    */
-  MHD_CONNECTION_OPTION_TIMEOUT
+  MHD_CONNECTION_OPTION_TIMEOUT,
+
+  /**
+   * Set a custom timeout for the given connection.  Specified
+   * as the number of milliseconds, given as an `unsigned int`.  Use
+   * zero for no timeout.
+   */
+  MHD_CONNECTION_OPTION_TIMEOUT_MS,
+
+  /**
+   * Write the rest of the request body to a file descriptor
+   * instead of passing it to the #MHD_AccessHandlerCallback.
+   * Specified as an `int`.  Only valid while the handler is being
+   * called for a request whose body has not been received completely;
+   * body bytes the handler leaves unprocessed (in
+   * `*upload_data_size`) are written to the file descriptor as well.
+   * MHD removes chunked encoding and stops at the end of the body.
+   * On Linux, without HTTPS and without #MHD_USE_IO_URING, the body
+   * is moved from the socket to the file descriptor with splice(),
+   * so that it is never copied to user space.  The file descriptor
+   * is not closed by MHD; it should be a regular file or block if
+   * it cannot take the data right away.  Once the body is complete,
+   * the handler is called one last time with an `*upload_data_size`
+   * of zero as usual.  If writing fails, the connection is closed
+   * with #MHD_REQUEST_TERMINATED_WITH_ERROR.
+   */
+  MHD_CONNECTION_OPTION_UPLOAD_FD,
+
+  /**
+   * Receive the rest of the request body directly into a buffer of
+   * the application, given as a `void *` followed by its size as a
+   * `size_t`, instead of into the read buffer of the connection.
+   * This allows larger reads than the memory pool does, and the
+   * access handler is then passed `upload_data` pointing into this
+   * buffer.  Bytes the handler leaves in `*upload_data_size` are
+   * moved to the beginning of the buffer; if the buffer is full and
+   * the handler processes nothing, the same rules apply as for a full
+   * read buffer.  Only valid while the access handler is being called
+   * for a request whose body has not been received completely, and
+   * not while the buffer still holds unprocessed bytes.  Bytes that
+   * MHD had already received into its read buffer, and chunk headers,
+   * still go through the read buffer.  The buffer must remain valid
+   * until the body is complete or the request was terminated.  Pass
+   * NULL and zero to go back to the read buffer.
+   */
+  MHD_CONNECTION_OPTION_UPLOAD_BUFFER
 
 };
 
@@ -2408,6 +2817,13 @@ union MHD_DaemonInfo
    * Number of active connections, for #MHD_DAEMON_INFO_CURRENT_CONNECTIONS.
    */
   unsigned int num_connections;
+
+  /**
+   * Latency histogram, for #MHD_DAEMON_INFO_LATENCY_HISTOGRAM.  Points
+   * to memory of the daemon that is overwritten by the next request
+   * for a latency histogram.
+   */
+  const struct MHD_LatencyHistogram *latency_histogram;
 };
 
 
@@ -2428,6 +2844,180 @@ MHD_get_daemon_info (struct MHD_Daemon *daemon,
 		     ...);
 
 
+/**
+ * Runtime statistics of a daemon, see #MHD_get_daemon_stats().
+ * Unless noted otherwise, the values are totals since the daemon
+ * was started, summed up over all threads of the thread pool.
+ */
+struct MHD_DaemonStats
+{
+  /**
+   * Number of connections accepted (or added with
+   * #MHD_add_connection()) and handed to a worker.
+   */
+  uint64_t connections_accepted;
+
+  /**
+   * Number of failed calls to accept(), not counting the cases
+   * where another thread was faster.
+   */
+  uint64_t accept_failures;
+
+  /**
+   * Number of connections that were closed right away because of
+   * the connection limits, the acceptance policy callback or a
+   * lack of resources.
+   */
+  uint64_t connections_rejected;
+
+  /**
+   * Number of requests for which the request headers were received.
+   */
+  uint64_t requests;
+
+  /**
+   * Number of times a connection was kept alive for another request.
+   */
+  uint64_t keepalive_reuses;
+
+  /**
+   * Number of connections closed because of their timeout.
+   */
+  uint64_t timeouts;
+
+  /**
+   * Number of connections that are currently suspended.
+   */
+  uint64_t suspended_connections;
+
+  /**
+   * Number of requests answered with 413 "Request Entity Too Large",
+   * usually because the memory pool of the connection was exhausted
+   * (see #MHD_OPTION_CONNECTION_MEMORY_LIMIT).
+   */
+  uint64_t requests_too_large;
+
+  /**
+   * Number of requests answered with 414 "Request-URI Too Long".
+   */
+  uint64_t uris_too_long;
+
+  /**
+   * Number of bytes received from the network.
+   */
+  uint64_t bytes_received;
+
+  /**
+   * Number of bytes sent with send() and sendmsg().
+   */
+  uint64_t bytes_sent;
+
+  /**
+   * Number of bytes sent with sendfile().
+   */
+  uint64_t bytes_sendfile;
+
+  /**
+   * Number of completed TLS handshakes that established a new
+   * session.
+   */
+  uint64_t tls_handshakes_full;
+
+  /**
+   * Number of completed TLS handshakes that resumed a session
+   * (see #MHD_OPTION_HTTPS_SESSION_TICKETS and
+   * #MHD_OPTION_HTTPS_SESSION_CACHE_SIZE).
+   */
+  uint64_t tls_handshakes_resumed;
+
+  /**
+   * Number of times a connection was handed to a handshake thread
+   * (see #MHD_OPTION_HTTPS_HANDSHAKE_THREADS); usually twice for
+   * a full handshake, once for each message flight of the client.
+   */
+  uint64_t tls_handshakes_offloaded;
+
+  /**
+   * Number of connections currently waiting for a handshake thread.
+   */
+  uint64_t tls_handshake_queue_length;
+
+  /**
+   * Largest number of connections that ever waited for a handshake
+   * thread at the same time.
+   */
+  uint64_t tls_handshake_queue_max;
+
+  /**
+   * Number of bytes of request bodies moved from the network to
+   * the file descriptor given with #MHD_CONNECTION_OPTION_UPLOAD_FD
+   * with splice(), without passing through our buffers.
+   */
+  uint64_t bytes_spliced;
+
+  /**
+   * Number of bytes of request bodies received directly into the
+   * buffers given with #MHD_CONNECTION_OPTION_UPLOAD_BUFFER.
+   */
+  uint64_t bytes_received_direct;
+
+  /**
+   * Number of bytes of connection memory pools given back to the
+   * operating system (see #MHD_OPTION_CONNECTION_MEMORY_RELEASE).
+   */
+  uint64_t pool_bytes_released;
+};
+
+
+/**
+ * Obtain the runtime statistics of the given daemon.  The counters
+ * are kept per worker thread without locking and are summed up by
+ * this call, so the result is only a consistent snapshot if the
+ * daemon is idle.  May be called from any thread.
+ *
+ * @param daemon daemon to get the statistics of
+ * @param stats where to store the statistics
+ * @return #MHD_YES on success, #MHD_NO if @a daemon or @a stats
+ *         is NULL
+ * @ingroup specialized
+ */
+_MHD_EXTERN int
+MHD_get_daemon_stats (struct MHD_Daemon *daemon,
+                      struct MHD_DaemonStats *stats);
+
+
+/**
+ * Obtain the largest value that is counted in the given bucket
+ * of a `struct MHD_LatencyHistogram`.  The smallest value of
+ * the bucket is one more than the limit of the previous bucket
+ * (or zero for the first bucket).
+ *
+ * @param bucket index of the bucket
+ * @return largest value (in microseconds) of the bucket,
+ *         UINT64_MAX for the last bucket
+ * @ingroup specialized
+ */
+_MHD_EXTERN uint64_t
+MHD_latency_histogram_bucket_limit (unsigned int bucket);
+
+
+/**
+ * Estimate a percentile of the values recorded in a latency
+ * histogram.  The result is the upper limit of the bucket that
+ * contains the percentile (but never more than the largest value
+ * recorded).
+ *
+ * @param histogram histogram to evaluate
+ * @param percentile percentile to compute, between 0 and 100
+ * @return estimated value in microseconds, 0 if the histogram
+ *         is empty
+ * @ingroup specialized
+ */
+_MHD_EXTERN uint64_t
+MHD_latency_histogram_percentile (const struct MHD_LatencyHistogram *histogram,
+                                  double percentile);
+
+
 /**
  * Obtain the version of this library
  *
@@ -2533,7 +3123,26 @@ enum MHD_FEATURE
    * #MHD_destroy_post_processor, #MHD_destroy_post_processor can
    * be used.
    */
-  MHD_FEATURE_POSTPROCESSOR = 13
+  MHD_FEATURE_POSTPROCESSOR = 13,
+
+  /**
+   * Get whether io_uring is supported by this build and the running
+   * kernel.  If not, flag #MHD_USE_IO_URING falls back to `epoll()`.
+   */
+  MHD_FEATURE_IO_URING = 14,
+
+  /**
+   * Get whether MHD was built with zlib, so that flag
+   * #MHD_RF_COMPRESS compresses response bodies.
+   */
+  MHD_FEATURE_COMPRESSION = 15,
+
+  /**
+   * Get whether MHD was built with support for Linux kernel TLS,
+   * see #MHD_OPTION_HTTPS_KTLS.  Whether the running kernel supports
+   * it (the `tls` module) is only known once a connection uses it.
+   */
+  MHD_FEATURE_KTLS = 16
 };
 
 
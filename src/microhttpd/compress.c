@@ -0,0 +1,603 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file compress.c
+ * @brief gzip/deflate compression of response bodies
+ * @author Christian Grothoff
+ *
+ * A buffer response is compressed once per coding; the result is
+ * an ordinary buffer response (the "variant") that is kept with the
+ * original and queued in its place, so the compressed body is sent
+ * with the usual (vectored) writes and its header block is built
+ * only once as well.  For callback responses, every request gets a
+ * fresh callback response that pulls data from the original callback
+ * and deflates it as it goes.
+ */
+
+#include "compress.h"
+#include "response.h"
+#include <limits.h>
+#include <zlib.h>
+
+/**
+ * Bodies smaller than this are not worth compressing.
+ */
+#define MHD_COMPRESS_MIN_SIZE 256
+
+/**
+ * How much data we obtain from the original content reader
+ * callback at a time when compressing on the fly.
+ */
+#define MHD_COMPRESS_BUFFER_SIZE (16 * 1024)
+
+
+/**
+ * Names of the codings for the "Content-Encoding" header.
+ */
+static const char *const coding_names[MHD_CODING_COUNT] =
+  {
+    "identity",
+    "gzip",
+    "deflate"
+  };
+
+
+/**
+ * State for compressing the body of a callback response
+ * on the fly.
+ */
+struct DeflateSource
+{
+
+  /**
+   * Response with the original body (we hold a reference).
+   */
+  struct MHD_Response *source;
+
+  /**
+   * Compressor state.
+   */
+  z_stream strm;
+
+  /**
+   * Position of the next byte to obtain from @e source.
+   */
+  uint64_t source_pos;
+
+  /**
+   * #MHD_YES once @e source has no more data.
+   */
+  int source_done;
+
+  /**
+   * #MHD_YES if data was given to the compressor since the last
+   * flush (and may still be held back by it).
+   */
+  int pending;
+
+  /**
+   * #MHD_YES once all of the compressed data was returned.
+   */
+  int finished;
+
+  /**
+   * Data obtained from @e source that is being compressed.
+   */
+  char in[MHD_COMPRESS_BUFFER_SIZE];
+};
+
+
+/**
+ * Parse a quality value ("0", "0.5", "1.000", ...) of the
+ * "Accept-Encoding" header.
+ *
+ * @param s start of the value
+ * @return the value in thousandths, 0 if malformed
+ */
+static int
+parse_qvalue (const char *s)
+{
+  int q;
+  int scale;
+
+  if ( ('0' != *s) && ('1' != *s) )
+    return 0;
+  q = (*s - '0') * 1000;
+  s++;
+  if ('.' != *s)
+    return q;
+  s++;
+  for (scale = 100; (scale > 0) && (*s >= '0') && (*s <= '9'); scale /= 10)
+    q += (*s++ - '0') * scale;
+  return (q > 1000) ? 1000 : q;
+}
+
+
+/**
+ * Pick the content coding to use for a client that sent
+ * the given "Accept-Encoding" header.
+ *
+ * @param accept_encoding value of the header
+ * @return coding to use, #MHD_CODING_IDENTITY if the client
+ *         accepts neither gzip nor deflate
+ */
+enum MHD_ContentCoding
+MHD_compress_negotiate_ (const char *accept_encoding)
+{
+  const char *pos;
+  const char *name;
+  size_t len;
+  int q;
+  int gzip_q;
+  int deflate_q;
+  int any_q;
+
+  gzip_q = -1;
+  deflate_q = -1;
+  any_q = -1;
+  pos = accept_encoding;
+  while ('\0' != *pos)
+    {
+      while ( (' ' == *pos) || ('\t' == *pos) || (',' == *pos) )
+        pos++;
+      name = pos;
+      while ( ('\0' != *pos) && (',' != *pos) && (';' != *pos) &&
+              (' ' != *pos) && ('\t' != *pos) )
+        pos++;
+      len = pos - name;
+      q = 1000;
+      while ( ('\0' != *pos) && (',' != *pos) )
+        {
+          if (';' != *pos)
+            {
+              pos++;
+              continue;
+            }
+          pos++;
+          while ( (' ' == *pos) || ('\t' == *pos) )
+            pos++;
+          if ( ( ('q' == *pos) || ('Q' == *pos) ) &&
+               ('=' == pos[1]) )
+            q = parse_qvalue (&pos[2]);
+        }
+      if ( ( (4 == len) && (0 == strncasecmp (name, "gzip", 4)) ) ||
+           ( (6 == len) && (0 == strncasecmp (name, "x-gzip", 6)) ) )
+        gzip_q = q;
+      else if ( (7 == len) && (0 == strncasecmp (name, "deflate", 7)) )
+        deflate_q = q;
+      else if ( (1 == len) && ('*' == name[0]) )
+        any_q = q;
+    }
+  if (gzip_q < 0)
+    gzip_q = any_q;
+  if (deflate_q < 0)
+    deflate_q = any_q;
+  if ( (gzip_q > 0) && (gzip_q >= deflate_q) )
+    return MHD_CODING_GZIP;
+  if (deflate_q > 0)
+    return MHD_CODING_DEFLATE;
+  return MHD_CODING_IDENTITY;
+}
+
+
+/**
+ * Set up a compressor for the given coding.
+ *
+ * @param strm stream to initialize
+ * @param coding #MHD_CODING_GZIP or #MHD_CODING_DEFLATE
+ * @return #MHD_YES on success
+ */
+static int
+init_stream (z_stream *strm,
+             enum MHD_ContentCoding coding)
+{
+  memset (strm, 0, sizeof (z_stream));
+  if (Z_OK != deflateInit2 (strm,
+                            Z_DEFAULT_COMPRESSION,
+                            Z_DEFLATED,
+                            (MHD_CODING_GZIP == coding) ? 16 + 15 : 15,
+                            8,
+                            Z_DEFAULT_STRATEGY))
+    return MHD_NO;
+  return MHD_YES;
+}
+
+
+/**
+ * Copy the headers and footers of the original response to its
+ * compressed variant, preserving their order.  A "Content-Length"
+ * set by the application does not apply to the variant and an
+ * "ETag" must change with the representation.
+ *
+ * @param variant response to add the headers to
+ * @param pos remaining headers to copy (in inverse order)
+ * @param coding coding of @a variant
+ * @return #MHD_YES on success, #MHD_NO on failure (out of memory)
+ */
+static int
+copy_headers (struct MHD_Response *variant,
+              const struct MHD_HTTP_Header *pos,
+              enum MHD_ContentCoding coding)
+{
+  char *etag;
+  size_t len;
+  int ret;
+
+  if (NULL == pos)
+    return MHD_YES;
+  if (MHD_YES != copy_headers (variant, pos->next, coding))
+    return MHD_NO;
+  if (MHD_FOOTER_KIND == pos->kind)
+    return MHD_add_response_footer (variant, pos->header, pos->value);
+  if (0 == strcasecmp (pos->header, MHD_HTTP_HEADER_CONTENT_LENGTH))
+    return MHD_YES;
+  len = strlen (pos->value);
+  if ( (0 != strcasecmp (pos->header, MHD_HTTP_HEADER_ETAG)) ||
+       (len < 2) ||
+       ('"' != pos->value[len - 1]) )
+    return MHD_add_response_header (variant, pos->header, pos->value);
+  /* "xyz" becomes "xyz-gzip" */
+  if (NULL == (etag = malloc (len + strlen (coding_names[coding]) + 2)))
+    return MHD_NO;
+  sprintf (etag,
+           "%.*s-%s\"",
+           (int) (len - 1),
+           pos->value,
+           coding_names[coding]);
+  ret = MHD_add_response_header (variant, pos->header, etag);
+  free (etag);
+  return ret;
+}
+
+
+/**
+ * Give a compressed variant the flags and headers of the
+ * original response.
+ *
+ * @param variant the compressed variant
+ * @param response the original response
+ * @param coding coding of @a variant
+ * @return #MHD_YES on success, #MHD_NO on failure (out of memory)
+ */
+static int
+init_variant (struct MHD_Response *variant,
+              struct MHD_Response *response,
+              enum MHD_ContentCoding coding)
+{
+  variant->flags = (enum MHD_ResponseFlags) (response->flags & ~MHD_RF_COMPRESS);
+  if (MHD_YES != copy_headers (variant, response->first_header, coding))
+    return MHD_NO;
+  return MHD_add_response_header (variant,
+                                  MHD_HTTP_HEADER_CONTENT_ENCODING,
+                                  coding_names[coding]);
+}
+
+
+/**
+ * Compress the body of a buffer response.  Must be called
+ * with the mutex of @a response held.
+ *
+ * @param response response with the body in memory
+ * @param coding coding to use
+ * @return the compressed variant, NULL on error or if the body
+ *         does not get smaller
+ */
+static struct MHD_Response *
+compress_buffer (struct MHD_Response *response,
+                 enum MHD_ContentCoding coding)
+{
+  struct MHD_Response *variant;
+  z_stream strm;
+  char *out;
+  char *shrunk;
+  size_t size;
+  int zret;
+
+  if (MHD_YES != init_stream (&strm, coding))
+    return NULL;
+  size = deflateBound (&strm, (uLong) response->total_size);
+  if (NULL == (out = malloc (size)))
+    {
+      (void) deflateEnd (&strm);
+      return NULL;
+    }
+  strm.next_in = (Bytef *) response->data;
+  strm.avail_in = (uInt) response->total_size;
+  strm.next_out = (Bytef *) out;
+  strm.avail_out = (uInt) size;
+  zret = deflate (&strm, Z_FINISH);
+  size = strm.total_out;
+  (void) deflateEnd (&strm);
+  if (Z_STREAM_END != zret)
+    {
+      free (out);
+      return NULL;
+    }
+  if (size >= response->total_size)
+    {
+      free (out);
+      response->compress_useless |= 1U << coding;
+      return NULL;
+    }
+  if (NULL != (shrunk = realloc (out, size)))
+    out = shrunk;
+  variant = MHD_create_response_from_buffer (size,
+                                             out,
+                                             MHD_RESPMEM_MUST_FREE);
+  if (NULL == variant)
+    {
+      free (out);
+      return NULL;
+    }
+  if (MHD_YES != init_variant (variant, response, coding))
+    {
+      MHD_destroy_response (variant);
+      return NULL;
+    }
+  return variant;
+}
+
+
+/**
+ * Content reader callback of a response that compresses the body of
+ * another (callback) response on the fly.  If the original callback
+ * has no data for now, whatever the compressor holds back is flushed
+ * so that the client is not kept waiting for it.
+ *
+ * @param cls our `struct DeflateSource`
+ * @param pos position in the compressed body (unused, we are
+ *        only ever asked for the data in sequence)
+ * @param buf where to write the compressed data
+ * @param max maximum number of bytes to write
+ * @return number of bytes written, or
+ *         #MHD_CONTENT_READER_END_OF_STREAM /
+ *         #MHD_CONTENT_READER_END_WITH_ERROR
+ */
+static ssize_t
+deflate_reader (void *cls,
+                uint64_t pos,
+                char *buf,
+                size_t max)
+{
+  struct DeflateSource *ds = cls;
+  struct MHD_Response *source = ds->source;
+  ssize_t ret;
+  size_t want;
+  int flush;
+  int zret;
+
+  if (MHD_YES == ds->finished)
+    return MHD_CONTENT_READER_END_OF_STREAM;
+  if (max > UINT_MAX)
+    max = UINT_MAX;
+  ds->strm.next_out = (Bytef *) buf;
+  ds->strm.avail_out = (uInt) max;
+  while (ds->strm.avail_out == max)
+    {
+      flush = Z_NO_FLUSH;
+      if ( (0 == ds->strm.avail_in) &&
+           (MHD_NO == ds->source_done) )
+        {
+          want = sizeof (ds->in);
+          if ( (MHD_SIZE_UNKNOWN != source->total_size) &&
+               (source->total_size - ds->source_pos < want) )
+            want = (size_t) (source->total_size - ds->source_pos);
+          if (0 == want)
+            ret = MHD_CONTENT_READER_END_OF_STREAM;
+          else
+            {
+              (void) MHD_mutex_lock_ (&source->mutex);
+              ret = source->crc (source->crc_cls,
+                                 ds->source_pos,
+                                 ds->in,
+                                 want);
+              (void) MHD_mutex_unlock_ (&source->mutex);
+            }
+          if (((ssize_t) MHD_CONTENT_READER_END_WITH_ERROR) == ret)
+            return MHD_CONTENT_READER_END_WITH_ERROR;
+          if (((ssize_t) MHD_CONTENT_READER_END_OF_STREAM) == ret)
+            {
+              ds->source_done = MHD_YES;
+            }
+          else if (0 == ret)
+            {
+              /* no data for now, pass on what we have */
+              if (MHD_NO == ds->pending)
+                return 0;
+              flush = Z_SYNC_FLUSH;
+            }
+          else
+            {
+              ds->strm.next_in = (Bytef *) ds->in;
+              ds->strm.avail_in = (uInt) ret;
+              ds->source_pos += ret;
+              ds->pending = MHD_YES;
+            }
+        }
+      if (MHD_YES == ds->source_done)
+        flush = Z_FINISH;
+      zret = deflate (&ds->strm, flush);
+      if (Z_STREAM_END == zret)
+        {
+          ds->finished = MHD_YES;
+          break;
+        }
+      if ( (Z_OK != zret) &&
+           (Z_BUF_ERROR != zret) )
+        return MHD_CONTENT_READER_END_WITH_ERROR;
+      if ( (Z_SYNC_FLUSH == flush) &&
+           (0 != ds->strm.avail_out) )
+        ds->pending = MHD_NO;   /* flush complete */
+    }
+  return max - ds->strm.avail_out;
+}
+
+
+/**
+ * Release the state of an on-the-fly compression.
+ *
+ * @param cls our `struct DeflateSource`
+ */
+static void
+deflate_free (void *cls)
+{
+  struct DeflateSource *ds = cls;
+
+  (void) deflateEnd (&ds->strm);
+  MHD_destroy_response (ds->source);
+  free (ds);
+}
+
+
+/**
+ * Create a response that compresses the body of a callback
+ * response on the fly.
+ *
+ * @param response response with a content reader callback
+ * @param coding coding to use
+ * @return the new response, NULL on error
+ */
+static struct MHD_Response *
+compress_stream (struct MHD_Response *response,
+                 enum MHD_ContentCoding coding)
+{
+  struct MHD_Response *variant;
+  struct DeflateSource *ds;
+
+  if (NULL == (ds = malloc (sizeof (struct DeflateSource))))
+    return NULL;
+  if (MHD_YES != init_stream (&ds->strm, coding))
+    {
+      free (ds);
+      return NULL;
+    }
+  ds->source = response;
+  ds->source_pos = 0;
+  ds->source_done = MHD_NO;
+  ds->pending = MHD_NO;
+  ds->finished = MHD_NO;
+  variant = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN,
+                                               MHD_COMPRESS_BUFFER_SIZE,
+                                               &deflate_reader,
+                                               ds,
+                                               &deflate_free);
+  if (NULL == variant)
+    {
+      (void) deflateEnd (&ds->strm);
+      free (ds);
+      return NULL;
+    }
+  MHD_increment_response_rc (response);
+  if (MHD_YES != init_variant (variant, response, coding))
+    {
+      MHD_destroy_response (variant);
+      return NULL;
+    }
+  return variant;
+}
+
+
+/**
+ * Find the response to send instead of @a response (which has
+ * #MHD_RF_COMPRESS set) for the request on @a connection.  For a
+ * buffer response, this is the compressed variant cached with the
+ * response (created on first use); for a callback response, a new
+ * response that compresses the body of @a response on the fly.
+ *
+ * @param connection connection the response is queued for
+ * @param response response queued by the application
+ * @param status_code HTTP status code of the response
+ * @return response to send, with a reference for the
+ *         connection; NULL to send @a response as it is
+ */
+struct MHD_Response *
+MHD_compress_select_ (struct MHD_Connection *connection,
+                      struct MHD_Response *response,
+                      unsigned int status_code)
+{
+  struct MHD_Response *variant;
+  const char *accept_encoding;
+  enum MHD_ContentCoding coding;
+
+  if ( (status_code < 200) ||
+       (MHD_HTTP_NO_CONTENT == status_code) ||
+       (MHD_HTTP_NOT_MODIFIED == status_code) ||
+       (MHD_INVALID_SOCKET != response->fd) ||
+       (0 == response->total_size) ||
+       ( (MHD_SIZE_UNKNOWN != response->total_size) &&
+         (response->total_size < MHD_COMPRESS_MIN_SIZE) ) ||
+       (NULL != MHD_get_response_header (response,
+                                         MHD_HTTP_HEADER_CONTENT_ENCODING)) )
+    return NULL;
+  accept_encoding = MHD_lookup_connection_value (connection,
+                                                 MHD_HEADER_KIND,
+                                                 MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  if (NULL == accept_encoding)
+    return NULL;
+  coding = MHD_compress_negotiate_ (accept_encoding);
+  if (MHD_CODING_IDENTITY == coding)
+    return NULL;
+  if (NULL != response->crc)
+    {
+      /* the length of the compressed body is only known once
+         it was produced, which does not work for HEAD */
+      if ( (NULL != connection->method) &&
+           (0 == strcasecmp (connection->method, MHD_HTTP_METHOD_HEAD)) )
+        return NULL;
+      return compress_stream (response, coding);
+    }
+  if (response->total_size > UINT_MAX)
+    return NULL;
+  (void) MHD_mutex_lock_ (&response->mutex);
+  variant = response->compressed[coding];
+  if ( (NULL == variant) &&
+       (0 == (response->compress_useless & (1U << coding))) )
+    {
+      variant = compress_buffer (response, coding);
+      response->compressed[coding] = variant;
+    }
+  if (NULL != variant)
+    MHD_increment_response_rc (variant);
+  (void) MHD_mutex_unlock_ (&response->mutex);
+  return variant;
+}
+
+
+/**
+ * Release the compressed variants cached with a response
+ * that is being destroyed.
+ *
+ * @param response the response
+ */
+void
+MHD_compress_release_ (struct MHD_Response *response)
+{
+  unsigned int i;
+
+  for (i = 0; i < MHD_CODING_COUNT; i++)
+    {
+      if (NULL == response->compressed[i])
+        continue;
+      MHD_destroy_response (response->compressed[i]);
+      response->compressed[i] = NULL;
+    }
+}
+
+/* end of compress.c */
@@ -0,0 +1,73 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file compress.h
+ * @brief gzip/deflate compression of response bodies
+ * @author Christian Grothoff
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "internal.h"
+
+
+/**
+ * Pick the content coding to use for a client that sent
+ * the given "Accept-Encoding" header.
+ *
+ * @param accept_encoding value of the header
+ * @return coding to use, #MHD_CODING_IDENTITY if the client
+ *         accepts neither gzip nor deflate
+ */
+enum MHD_ContentCoding
+MHD_compress_negotiate_ (const char *accept_encoding);
+
+
+/**
+ * Find the response to send instead of @a response (which has
+ * #MHD_RF_COMPRESS set) for the request on @a connection.  For a
+ * buffer response, this is the compressed variant cached with the
+ * response (created on first use); for a callback response, a new
+ * response that compresses the body of @a response on the fly.
+ *
+ * @param connection connection the response is queued for
+ * @param response response queued by the application
+ * @param status_code HTTP status code of the response
+ * @return response to send, with a reference for the
+ *         connection; NULL to send @a response as it is
+ */
+struct MHD_Response *
+MHD_compress_select_ (struct MHD_Connection *connection,
+                      struct MHD_Response *response,
+                      unsigned int status_code);
+
+
+/**
+ * Release the compressed variants cached with a response
+ * that is being destroyed.
+ *
+ * @param response the response
+ */
+void
+MHD_compress_release_ (struct MHD_Response *response);
+
+
+#endif
@@ -31,10 +31,13 @@
 #include "memorypool.h"
 #include "response.h"
 #include "reason_phrase.h"
-
-#if HAVE_NETINET_TCP_H
-/* for TCP_CORK */
-#include <netinet/tcp.h>
+#include "timerwheel.h"
+#include "linescan.h"
+#include "uring.h"
+#include "latency.h"
+#include "range.h"
+#if COMPRESSION_SUPPORT
+#include "compress.h"
 #endif
 
 #if defined(_WIN32) && defined(MHD_W32_MUTEX_)
@@ -113,6 +116,31 @@
 #define DEBUG_SEND_DATA MHD_NO
 
 
+/**
+ * Compute the (case-insensitive) hash of a header name
+ * for the header index.
+ *
+ * @param key header name to hash
+ * @return hash of @a key
+ */
+static uint32_t
+header_hash (const char *key)
+{
+  uint32_t hash;
+  unsigned char c;
+
+  /* FNV-1a over the lower-cased name */
+  hash = 2166136261U;
+  while ('\0' != (c = (unsigned char) *key++))
+    {
+      if ( (c >= 'A') && (c <= 'Z') )
+        c += 'a' - 'A';
+      hash = (hash ^ c) * 16777619U;
+    }
+  return hash;
+}
+
+
 /**
  * Get all of the headers from the request.
  *
@@ -179,7 +207,19 @@ MHD_set_connection_value (struct MHD_Connection *connection,
                           const char *key, const char *value)
 {
   struct MHD_HTTP_Header *pos;
+  struct MHD_HeaderIndex *index;
+  unsigned int bucket;
 
+  if (NULL == connection->headers_received)
+    {
+      /* first value of this request; the index must cover all
+         values, so this is the only chance to create it */
+      connection->header_index
+        = MHD_pool_allocate (connection->pool,
+                             sizeof (struct MHD_HeaderIndex), MHD_YES);
+      if (NULL != connection->header_index)
+        memset (connection->header_index, 0, sizeof (struct MHD_HeaderIndex));
+    }
   pos = MHD_pool_allocate (connection->pool,
                            sizeof (struct MHD_HTTP_Header), MHD_YES);
   if (NULL == pos)
@@ -188,6 +228,8 @@ MHD_set_connection_value (struct MHD_Connection *connection,
   pos->value = (char *) value;
   pos->kind = kind;
   pos->next = NULL;
+  pos->next_hash = NULL;
+  pos->hash = (NULL != key) ? header_hash (key) : 0;
   /* append 'pos' to the linked list of headers */
   if (NULL == connection->headers_received_tail)
     {
@@ -199,6 +241,17 @@ MHD_set_connection_value (struct MHD_Connection *connection,
       connection->headers_received_tail->next = pos;
       connection->headers_received_tail = pos;
     }
+  /* and to its bucket in the index */
+  if ( (NULL != (index = connection->header_index)) &&
+       (NULL != key) )
+    {
+      bucket = pos->hash & (MHD_HEADER_INDEX_BUCKETS - 1);
+      if (NULL == index->tail[bucket])
+        index->head[bucket] = pos;
+      else
+        index->tail[bucket]->next_hash = pos;
+      index->tail[bucket] = pos;
+    }
   return MHD_YES;
 }
 
@@ -218,9 +271,24 @@ MHD_lookup_connection_value (struct MHD_Connection *connection,
                              enum MHD_ValueKind kind, const char *key)
 {
   struct MHD_HTTP_Header *pos;
+  uint32_t hash;
 
   if (NULL == connection)
     return NULL;
+  if ( (NULL != connection->header_index) &&
+       (NULL != key) )
+    {
+      hash = header_hash (key);
+      for (pos = connection->header_index->head[hash & (MHD_HEADER_INDEX_BUCKETS - 1)];
+           NULL != pos;
+           pos = pos->next_hash)
+        if ( (hash == pos->hash) &&
+             (0 != (pos->kind & kind)) &&
+             ( (key == pos->header) ||
+               (0 == strcasecmp (key, pos->header)) ) )
+          return pos->value;
+      return NULL;
+    }
   for (pos = connection->headers_received; NULL != pos; pos = pos->next)
     if ((0 != (pos->kind & kind)) &&
 	( (key == pos->header) ||
@@ -257,6 +325,150 @@ need_100_continue (struct MHD_Connection *connection)
 }
 
 
+/**
+ * Feed the time from @a stamp of @a connection until @a end into
+ * the latency histogram for @a phase.  Does nothing if the stamp
+ * was not taken.
+ *
+ * @param connection connection to record the latency of
+ * @param phase phase to record
+ * @param stamp start of the phase
+ * @param end end of the phase (in microseconds)
+ */
+static void
+record_latency (struct MHD_Connection *connection,
+                enum MHD_LatencyPhase phase,
+                enum MHD_LatencyStamp stamp,
+                uint64_t end)
+{
+  uint64_t start = connection->latency_stamps[stamp];
+
+  if ( (0 == start) ||
+       (0 == end) ||
+       (end < start) )
+    return;
+  MHD_latency_record_ (&connection->daemon->latency[phase],
+                       end - start);
+}
+
+
+/**
+ * A response was sent completely; record the latencies of the
+ * phases of the request and prepare the stamps for the next
+ * request on the connection.
+ *
+ * @param connection connection that sent a response
+ */
+static void
+record_request_latency (struct MHD_Connection *connection)
+{
+  uint64_t *stamps = connection->latency_stamps;
+  uint64_t now;
+  unsigned int i;
+
+  if (NULL == connection->daemon->latency)
+    return;
+  now = MHD_monotonic_time_us ();
+  record_latency (connection, MHD_LATENCY_PHASE_WAIT,
+                  MHD_LATENCY_STAMP_IDLE,
+                  stamps[MHD_LATENCY_STAMP_FIRST_BYTE]);
+  record_latency (connection, MHD_LATENCY_PHASE_RECEIVE_HEADERS,
+                  MHD_LATENCY_STAMP_FIRST_BYTE,
+                  stamps[MHD_LATENCY_STAMP_HEADERS_RECEIVED]);
+  record_latency (connection, MHD_LATENCY_PHASE_DISPATCH,
+                  MHD_LATENCY_STAMP_HEADERS_RECEIVED,
+                  stamps[MHD_LATENCY_STAMP_HANDLER_CALLED]);
+  record_latency (connection, MHD_LATENCY_PHASE_HANDLER,
+                  MHD_LATENCY_STAMP_HANDLER_CALLED,
+                  stamps[MHD_LATENCY_STAMP_RESPONSE_QUEUED]);
+  record_latency (connection, MHD_LATENCY_PHASE_SEND_HEADERS,
+                  MHD_LATENCY_STAMP_RESPONSE_QUEUED,
+                  stamps[MHD_LATENCY_STAMP_HEADERS_SENT]);
+  record_latency (connection, MHD_LATENCY_PHASE_SEND_BODY,
+                  MHD_LATENCY_STAMP_HEADERS_SENT,
+                  now);
+  record_latency (connection, MHD_LATENCY_PHASE_REQUEST,
+                  MHD_LATENCY_STAMP_FIRST_BYTE,
+                  now);
+  for (i = MHD_LATENCY_STAMP_FIRST_BYTE; i < MHD_LATENCY_STAMP_COUNT; i++)
+    stamps[i] = 0;
+  stamps[MHD_LATENCY_STAMP_IDLE] = now;
+  /* a pipelined request may already be waiting in the buffer */
+  if (0 != connection->read_buffer_offset)
+    stamps[MHD_LATENCY_STAMP_FIRST_BYTE] = now;
+}
+
+
+/**
+ * Send (some of) the responses collected in the pipeline buffer.
+ *
+ * @param connection connection to send for
+ * @return result of the send operation
+ */
+static ssize_t
+send_pipeline_buffer (struct MHD_Connection *connection)
+{
+  ssize_t ret;
+
+  ret = connection->send_cls (connection,
+                              &connection->pipeline_buffer
+                              [connection->pipeline_buffer_send_offset],
+                              connection->pipeline_buffer_append_offset -
+                              connection->pipeline_buffer_send_offset);
+  if (ret > 0)
+    connection->pipeline_buffer_send_offset += ret;
+  if (connection->pipeline_buffer_send_offset ==
+      connection->pipeline_buffer_append_offset)
+    {
+      connection->pipeline_buffer_send_offset = 0;
+      connection->pipeline_buffer_append_offset = 0;
+    }
+  return ret;
+}
+
+
+/**
+ * Try to send the responses to pipelined requests that were
+ * collected but not yet written, without blocking.  Used before the
+ * connection stops being polled for writing (suspend or close).
+ *
+ * @param connection connection to flush
+ */
+void
+MHD_connection_flush_pipeline_ (struct MHD_Connection *connection)
+{
+  while (connection->pipeline_buffer_send_offset !=
+         connection->pipeline_buffer_append_offset)
+    {
+      if (send_pipeline_buffer (connection) <= 0)
+        break;
+    }
+}
+
+
+/**
+ * Stop writing the request body to the file descriptor given
+ * with #MHD_CONNECTION_OPTION_UPLOAD_FD or receiving it into the
+ * buffer given with #MHD_CONNECTION_OPTION_UPLOAD_BUFFER.
+ *
+ * @param connection connection to update
+ */
+static void
+release_upload_target (struct MHD_Connection *connection)
+{
+  if (MHD_YES == connection->upload_splice)
+    {
+      (void) close (connection->upload_pipe[0]);
+      (void) close (connection->upload_pipe[1]);
+      connection->upload_splice = MHD_NO;
+    }
+  connection->upload_to_fd = MHD_NO;
+  connection->upload_buffer = NULL;
+  connection->upload_buffer_size = 0;
+  connection->upload_buffer_offset = 0;
+}
+
+
 /**
  * Close the given connection and give the
  * specified termination code to the user.
@@ -271,11 +483,24 @@ MHD_connection_close (struct MHD_Connection *connection,
   struct MHD_Daemon *daemon;
 
   daemon = connection->daemon;
+  release_upload_target (connection);
+  /* responses to earlier pipelined requests are complete, try
+     to get them out before we shut the socket down */
+  MHD_connection_flush_pipeline_ (connection);
+  connection->pipeline_buffer_send_offset = 0;
+  connection->pipeline_buffer_append_offset = 0;
   if (0 == (connection->daemon->options & MHD_USE_EPOLL_TURBO))
     shutdown (connection->socket_fd,
 	      (MHD_YES == connection->read_closed) ? SHUT_WR : SHUT_RDWR);
   connection->state = MHD_CONNECTION_CLOSED;
   connection->event_loop_info = MHD_EVENT_LOOP_INFO_CLEANUP;
+  if (NULL != daemon->latency)
+    {
+      record_latency (connection, MHD_LATENCY_PHASE_CONNECTION,
+                      MHD_LATENCY_STAMP_ACCEPTED,
+                      MHD_monotonic_time_us ());
+      connection->latency_stamps[MHD_LATENCY_STAMP_ACCEPTED] = 0;
+    }
   if ( (NULL != daemon->notify_completed) &&
        (MHD_YES == connection->client_aware) )
     daemon->notify_completed (daemon->notify_completed_cls,
@@ -346,7 +571,7 @@ try_ready_normal_body (struct MHD_Connection *connection)
     return MHD_YES; /* response already ready */
 #if LINUX
   if ( (MHD_INVALID_SOCKET != response->fd) &&
-       (0 == (connection->daemon->options & MHD_USE_SSL)) )
+       (MHD_SENDS_PLAIN_ (connection)) )
     {
       /* will use sendfile, no need to bother response crc */
       return MHD_YES;
@@ -546,50 +771,57 @@ keepalive_possible (struct MHD_Connection *connection)
  * Produce HTTP "Date:" header.
  *
  * @param date where to write the header, with
- *        at least 128 bytes available space.
+ *        at least 64 bytes available space.
+ * @param t time to produce the header for
  */
 static void
-get_date_string (char *date)
+format_date_string (char *date,
+                    time_t t)
+{
+  char buf[MHD_HTTP_DATE_SIZE];
+
+  MHD_format_http_date_ (buf, t);
+  if ('\0' == buf[0])
+    date[0] = 0;
+  else
+    sprintf (date, "Date: %s\r\n", buf);
+}
+
+
+/**
+ * Produce HTTP "Date:" header, using the line cached by the
+ * daemon unless the time moved on to the next second.
+ *
+ * @param connection connection to produce the header for
+ * @param date where to write the header, with
+ *        at least 64 bytes available space.
+ * @return number of bytes written to @a date
+ */
+static size_t
+get_date_string (struct MHD_Connection *connection,
+                 char *date)
 {
-  static const char *const days[] =
-    { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
-  static const char *const mons[] =
-    { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct",
-    "Nov", "Dec"
-  };
-  struct tm now;
+  struct MHD_Daemon *daemon = connection->daemon;
   time_t t;
-#if defined(_WIN32) && !defined(HAVE_GMTIME_S) && !defined(__CYGWIN__)
-  struct tm* pNow;
-#endif
+  size_t len;
 
-  date[0] = 0;
   time (&t);
-#if !defined(_WIN32)
-  if (NULL != gmtime_r (&t, &now))
-    {
-#elif defined(HAVE_GMTIME_S)
-  if (0 == gmtime_s (&now, &t))
-    {
-#elif defined(__CYGWIN__)
-  if (NULL != gmtime_r (&t, &now))
-    {
-#else
-  pNow = gmtime(&t);
-  if (NULL != pNow)
+  if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
+       (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
+    MHD_PANIC ("Failed to acquire cleanup mutex\n");
+  if ( (t != daemon->date_line_time) ||
+       (0 == daemon->date_line_len) )
     {
-      now = *pNow;
-#endif
-      sprintf (date,
-             "Date: %3s, %02u %3s %04u %02u:%02u:%02u GMT\r\n",
-             days[now.tm_wday % 7],
-             (unsigned int) now.tm_mday,
-             mons[now.tm_mon % 12],
-             (unsigned int) (1900 + now.tm_year),
-             (unsigned int) now.tm_hour,
-             (unsigned int) now.tm_min,
-             (unsigned int) now.tm_sec);
+      format_date_string (daemon->date_line, t);
+      daemon->date_line_len = strlen (daemon->date_line);
+      daemon->date_line_time = t;
     }
+  len = daemon->date_line_len;
+  memcpy (date, daemon->date_line, len + 1);
+  if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
+       (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
+    MHD_PANIC ("Failed to release cleanup mutex\n");
+  return len;
 }
 
 
@@ -627,38 +859,146 @@ try_grow_read_buffer (struct MHD_Connection *connection)
 }
 
 
+/**
+ * Write the status line for the response of the connection
+ * to @a code.
+ *
+ * @param connection the connection
+ * @param code where to write the status line, must have room
+ *        for at least 256 bytes
+ * @return number of bytes written to @a code
+ */
+static size_t
+build_status_line (struct MHD_Connection *connection,
+                   char *code)
+{
+  uint32_t rc;
+  const char *reason_phrase;
+  const char *version;
+  size_t version_len;
+  size_t reason_len;
+  size_t off;
+
+  rc = connection->responseCode & (~MHD_ICY_FLAG);
+  reason_phrase = MHD_get_reason_phrase_for (rc);
+  if (0 != (connection->responseCode & MHD_ICY_FLAG))
+    version = "ICY";
+  else if (0 == strcasecmp (MHD_HTTP_VERSION_1_0,
+                            connection->version))
+    version = MHD_HTTP_VERSION_1_0;
+  else
+    version = MHD_HTTP_VERSION_1_1;
+  version_len = strlen (version);
+  reason_len = strlen (reason_phrase);
+  if ( (rc < 100) ||
+       (rc > 999) ||
+       (version_len + reason_len + 7 > 256) )
+    return sprintf (code,
+                    "%s %u %s\r\n",
+                    version,
+                    rc,
+                    reason_phrase);
+  memcpy (code, version, version_len);
+  off = version_len;
+  code[off++] = ' ';
+  code[off++] = '0' + rc / 100;
+  code[off++] = '0' + (rc / 10) % 10;
+  code[off++] = '0' + rc % 10;
+  code[off++] = ' ';
+  memcpy (&code[off], reason_phrase, reason_len);
+  off += reason_len;
+  code[off++] = '\r';
+  code[off++] = '\n';
+  return off;
+}
+
+
+/**
+ * Allocate the connection's write buffer and fill it with all of the
+ * footers from the HTTPd's response (and the final CRLF of a
+ * Chunked-Body).
+ *
+ * @param connection the connection
+ * @return #MHD_YES on success, #MHD_NO on failure (out of memory)
+ */
+static int
+build_footer_response (struct MHD_Connection *connection)
+{
+  size_t size;
+  size_t off;
+  struct MHD_HTTP_Header *pos;
+  char *data;
+
+  /* 2 bytes for final CRLF of a Chunked-Body */
+  size = 2;
+  for (pos = connection->response->first_header; NULL != pos; pos = pos->next)
+    if (MHD_FOOTER_KIND == pos->kind)
+      size += strlen (pos->header) + strlen (pos->value) + 4; /* colon, space, linefeeds */
+  data = MHD_pool_allocate (connection->pool, size + 1, MHD_NO);
+  if (NULL == data)
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (connection->daemon,
+                "Not enough memory for write!\n");
+#endif
+      return MHD_NO;
+    }
+  off = 0;
+  for (pos = connection->response->first_header; NULL != pos; pos = pos->next)
+    if (MHD_FOOTER_KIND == pos->kind)
+      off += sprintf (&data[off],
+		      "%s: %s\r\n",
+		      pos->header,
+		      pos->value);
+  memcpy (&data[off], "\r\n", 2);
+  off += 2;
+
+  if (off != size)
+    mhd_panic (mhd_panic_cls, __FILE__, __LINE__, NULL);
+  connection->write_buffer = data;
+  connection->write_buffer_append_offset = size;
+  connection->write_buffer_send_offset = 0;
+  connection->write_buffer_size = size + 1;
+  return MHD_YES;
+}
+
+
 /**
  * Allocate the connection's write buffer and fill it with all of the
  * headers (or footers, if we have already sent the body) from the
  * HTTPd's response.  If headers are missing in the response supplied
  * by the application, additional headers may be added here.
  *
+ * The headers set by the application are taken from the header block
+ * that is built once per response (see
+ * #MHD_response_build_header_block()), so only the status line and the
+ * "Date", "Connection", "Transfer-Encoding" and "Content-Length" lines
+ * depend on the individual request.
+ *
  * @param connection the connection
  * @return #MHD_YES on success, #MHD_NO on failure (out of memory)
  */
 static int
 build_header_response (struct MHD_Connection *connection)
 {
+  struct MHD_Response *response = connection->response;
   size_t size;
   size_t off;
-  struct MHD_HTTP_Header *pos;
   char code[256];
-  char date[128];
+  char date[64];
+  size_t code_len;
+  size_t date_len;
   char content_length_buf[128];
+  const char *content_length_line;
   size_t content_length_len;
   char *data;
-  enum MHD_ValueKind kind;
-  const char *reason_phrase;
-  uint32_t rc;
   const char *client_requested_close;
-  const char *response_has_close;
-  const char *response_has_keepalive;
-  const char *have_encoding;
-  const char *have_content_length;
+  enum MHD_ResponseHeaderFlags flags;
   int must_add_close;
   int must_add_chunked_encoding;
   int must_add_keep_alive;
   int must_add_content_length;
+  int skip_keep_alive;
 
   EXTRA_CHECK (NULL != connection->version);
   if (0 == strlen (connection->version))
@@ -670,39 +1010,24 @@ build_header_response (struct MHD_Connection *connection)
       connection->write_buffer_size = 0;
       return MHD_YES;
     }
-  if (MHD_CONNECTION_FOOTERS_RECEIVED == connection->state)
-    {
-      rc = connection->responseCode & (~MHD_ICY_FLAG);
-      reason_phrase = MHD_get_reason_phrase_for (rc);
-      sprintf (code,
-               "%s %u %s\r\n",
-	       (0 != (connection->responseCode & MHD_ICY_FLAG))
-	       ? "ICY"
-	       : ( (0 == strcasecmp (MHD_HTTP_VERSION_1_0,
-				     connection->version))
-		   ? MHD_HTTP_VERSION_1_0
-		   : MHD_HTTP_VERSION_1_1),
-	       rc,
-	       reason_phrase);
-      off = strlen (code);
-      /* estimate size */
-      size = off + 2;           /* +2 for extra "\r\n" at the end */
-      kind = MHD_HEADER_KIND;
-      if ( (0 == (connection->daemon->options & MHD_SUPPRESS_DATE_NO_CLOCK)) &&
-	   (NULL == MHD_get_response_header (connection->response,
-					     MHD_HTTP_HEADER_DATE)) )
-        get_date_string (date);
-      else
-        date[0] = '\0';
-      size += strlen (date);
-    }
-  else
+  if (MHD_CONNECTION_BODY_SENT == connection->state)
+    return build_footer_response (connection);
+  EXTRA_CHECK (MHD_CONNECTION_FOOTERS_RECEIVED == connection->state);
+  if (MHD_YES != MHD_response_build_header_block (response))
     {
-      /* 2 bytes for final CRLF of a Chunked-Body */
-      size = 2;
-      kind = MHD_FOOTER_KIND;
-      off = 0;
+#if HAVE_MESSAGES
+      MHD_DLOG (connection->daemon,
+                "Not enough memory for write!\n");
+#endif
+      return MHD_NO;
     }
+  flags = response->header_flags;
+  code_len = build_status_line (connection, code);
+  if ( (0 == (connection->daemon->options & MHD_SUPPRESS_DATE_NO_CLOCK)) &&
+       (0 == (flags & MHD_RHF_HAS_DATE)) )
+    date_len = get_date_string (connection, date);
+  else
+    date_len = 0;
 
   /* calculate extra headers we need to add, such as 'Connection: close',
      first see what was explicitly requested by the application */
@@ -710,117 +1035,112 @@ build_header_response (struct MHD_Connection *connection)
   must_add_chunked_encoding = MHD_NO;
   must_add_keep_alive = MHD_NO;
   must_add_content_length = MHD_NO;
-  switch (connection->state)
-    {
-    case MHD_CONNECTION_FOOTERS_RECEIVED:
-      response_has_close = MHD_get_response_header (connection->response,
-                                                    MHD_HTTP_HEADER_CONNECTION);
-      response_has_keepalive = response_has_close;
-      if ( (NULL != response_has_close) &&
-           (0 != strcasecmp (response_has_close, "close")) )
-        response_has_close = NULL;
-      if ( (NULL != response_has_keepalive) &&
-           (0 != strcasecmp (response_has_keepalive, "Keep-Alive")) )
-        response_has_keepalive = NULL;
-      client_requested_close = MHD_lookup_connection_value (connection,
-                                                            MHD_HEADER_KIND,
-                                                            MHD_HTTP_HEADER_CONNECTION);
-      if ( (NULL != client_requested_close) &&
-           (0 != strcasecmp (client_requested_close, "close")) )
-        client_requested_close = NULL;
-
-      /* now analyze chunked encoding situation */
-      connection->have_chunked_upload = MHD_NO;
-
-      if ( (MHD_SIZE_UNKNOWN == connection->response->total_size) &&
-           (NULL == response_has_close) &&
-           (NULL == client_requested_close) )
+  content_length_line = NULL;
+  content_length_len = 0;
+  client_requested_close = MHD_lookup_connection_value (connection,
+                                                        MHD_HEADER_KIND,
+                                                        MHD_HTTP_HEADER_CONNECTION);
+  if ( (NULL != client_requested_close) &&
+       (0 != strcasecmp (client_requested_close, "close")) )
+    client_requested_close = NULL;
+
+  /* now analyze chunked encoding situation */
+  connection->have_chunked_upload = MHD_NO;
+
+  if ( (MHD_SIZE_UNKNOWN == response->total_size) &&
+       (0 == (flags & MHD_RHF_HAS_CLOSE)) &&
+       (NULL == client_requested_close) )
+    {
+      /* size is unknown, and close was not explicitly requested;
+         need to either to HTTP 1.1 chunked encoding or
+         close the connection */
+      /* 'close' header doesn't exist yet, see if we need to add one;
+         if the client asked for a close, no need to start chunk'ing */
+      if (MHD_YES == keepalive_possible (connection))
         {
-          /* size is unknown, and close was not explicitly requested;
-             need to either to HTTP 1.1 chunked encoding or
-             close the connection */
-          /* 'close' header doesn't exist yet, see if we need to add one;
-             if the client asked for a close, no need to start chunk'ing */
-          if (MHD_YES == keepalive_possible (connection))
+          if (0 == (flags & MHD_RHF_HAS_ENCODING))
             {
-              have_encoding = MHD_get_response_header (connection->response,
-                                                       MHD_HTTP_HEADER_TRANSFER_ENCODING);
-              if (NULL == have_encoding)
-                {
-                  must_add_chunked_encoding = MHD_YES;
-                  connection->have_chunked_upload = MHD_YES;
-                }
-              else if (0 == strcasecmp (have_encoding, "identity"))
-                {
-                  /* application forced identity encoding, can't do 'chunked' */
-                  must_add_close = MHD_YES;
-                }
-              else
-                {
-                  connection->have_chunked_upload = MHD_YES;
-                }
+              must_add_chunked_encoding = MHD_YES;
+              connection->have_chunked_upload = MHD_YES;
+            }
+          else if (0 != (flags & MHD_RHF_ENCODING_IDENTITY))
+            {
+              /* application forced identity encoding, can't do 'chunked' */
+              must_add_close = MHD_YES;
             }
           else
             {
-              /* Keep alive not possible => set close header if not present */
-              if (NULL == response_has_close)
-                must_add_close = MHD_YES;
+              connection->have_chunked_upload = MHD_YES;
             }
         }
+      else
+        {
+          /* Keep alive not possible => set close header if not present */
+          if (0 == (flags & MHD_RHF_HAS_CLOSE))
+            must_add_close = MHD_YES;
+        }
+    }
 
-      /* check for other reasons to add 'close' header */
-      if ( ( (NULL != client_requested_close) ||
-             (MHD_YES == connection->read_closed) ) &&
-           (NULL == response_has_close) &&
-           (0 != (connection->response->flags & MHD_RF_HTTP_VERSION_1_0_ONLY) ) )
-        must_add_close = MHD_YES;
-
-      /* check if we should add a 'content length' header */
-      have_content_length = MHD_get_response_header (connection->response,
-                                                     MHD_HTTP_HEADER_CONTENT_LENGTH);
-
-      if ( (MHD_SIZE_UNKNOWN != connection->response->total_size) &&
-           (NULL == have_content_length) &&
-           ( (NULL == connection->method) ||
-             (0 != strcasecmp (connection->method,
-                               MHD_HTTP_METHOD_CONNECT)) ) )
+  /* check for other reasons to add 'close' header */
+  if ( ( (NULL != client_requested_close) ||
+         (MHD_YES == connection->read_closed) ) &&
+       (0 == (flags & MHD_RHF_HAS_CLOSE)) &&
+       (0 != (response->flags & MHD_RF_HTTP_VERSION_1_0_ONLY) ) )
+    must_add_close = MHD_YES;
+
+  /* check if we should add a 'content length' header */
+  if ( (MHD_SIZE_UNKNOWN != response->total_size) &&
+       (0 == (flags & MHD_RHF_HAS_CONTENT_LENGTH)) &&
+       ( (NULL == connection->method) ||
+         (0 != strcasecmp (connection->method,
+                           MHD_HTTP_METHOD_CONNECT)) ) )
+    {
+      /*
+        Here we add a content-length if one is missing; however,
+        for 'connect' methods, the responses MUST NOT include a
+        content-length header *if* the response code is 2xx (in
+        which case we expect there to be no body).  Still,
+        as we don't know the response code here in some cases, we
+        simply only force adding a content-length header if this
+        is not a 'connect' or if the response is not empty
+        (which is kind of more sane, because if some crazy
+        application did return content with a 2xx status code,
+        then having a content-length might again be a good idea).
+
+        Note that the change from 'SHOULD NOT' to 'MUST NOT' is
+        a recent development of the HTTP 1.1 specification.
+      */
+      if (response->content_length_size == response->total_size)
+        {
+          content_length_line = response->content_length_line;
+          content_length_len = response->content_length_len;
+        }
+      else
         {
-          /*
-            Here we add a content-length if one is missing; however,
-            for 'connect' methods, the responses MUST NOT include a
-            content-length header *if* the response code is 2xx (in
-            which case we expect there to be no body).  Still,
-            as we don't know the response code here in some cases, we
-            simply only force adding a content-length header if this
-            is not a 'connect' or if the response is not empty
-            (which is kind of more sane, because if some crazy
-            application did return content with a 2xx status code,
-            then having a content-length might again be a good idea).
-
-            Note that the change from 'SHOULD NOT' to 'MUST NOT' is
-            a recent development of the HTTP 1.1 specification.
-          */
+          /* size changed since the header block was built */
           content_length_len
             = sprintf (content_length_buf,
                        MHD_HTTP_HEADER_CONTENT_LENGTH ": " MHD_UNSIGNED_LONG_LONG_PRINTF "\r\n",
-                       (MHD_UNSIGNED_LONG_LONG) connection->response->total_size);
-          must_add_content_length = MHD_YES;
+                       (MHD_UNSIGNED_LONG_LONG) response->total_size);
+          content_length_line = content_length_buf;
         }
-
-      /* check for adding keep alive */
-      if ( (NULL == response_has_keepalive) &&
-           (NULL == response_has_close) &&
-           (MHD_NO == must_add_close) &&
-           (0 == (connection->response->flags & MHD_RF_HTTP_VERSION_1_0_ONLY) ) &&
-           (MHD_YES == keepalive_possible (connection)) )
-        must_add_keep_alive = MHD_YES;
-      break;
-    case MHD_CONNECTION_BODY_SENT:
-      break;
-    default:
-      EXTRA_CHECK (0);
+      must_add_content_length = MHD_YES;
     }
 
+  /* check for adding keep alive */
+  if ( (0 == (flags & (MHD_RHF_HAS_KEEP_ALIVE | MHD_RHF_HAS_CLOSE))) &&
+       (MHD_NO == must_add_close) &&
+       (0 == (response->flags & MHD_RF_HTTP_VERSION_1_0_ONLY) ) &&
+       (MHD_YES == keepalive_possible (connection)) )
+    must_add_keep_alive = MHD_YES;
+
+  /* the application's 'Connection: Keep-Alive' must go if we close */
+  skip_keep_alive = ( (MHD_YES == must_add_close) &&
+                      (0 != response->keep_alive_len) );
+
+  EXTRA_CHECK (! (must_add_close && must_add_keep_alive) );
+  EXTRA_CHECK (! (must_add_chunked_encoding && must_add_content_length) );
+  size = code_len + response->header_block_size + date_len + 2;
   if (must_add_close)
     size += strlen ("Connection: close\r\n");
   if (must_add_keep_alive)
@@ -829,16 +1149,9 @@ build_header_response (struct MHD_Connection *connection)
     size += strlen ("Transfer-Encoding: chunked\r\n");
   if (must_add_content_length)
     size += content_length_len;
-  EXTRA_CHECK (! (must_add_close && must_add_keep_alive) );
-  EXTRA_CHECK (! (must_add_chunked_encoding && must_add_content_length) );
+  if (skip_keep_alive)
+    size -= response->keep_alive_len;
 
-  for (pos = connection->response->first_header; NULL != pos; pos = pos->next)
-    if ( (pos->kind == kind) &&
-         (! ( (pos->value == response_has_keepalive) &&
-              (MHD_YES == must_add_close) &&
-              (0 == strcasecmp (pos->header,
-                                MHD_HTTP_HEADER_CONNECTION) ) ) ) )
-      size += strlen (pos->header) + strlen (pos->value) + 4; /* colon, space, linefeeds */
   /* produce data */
   data = MHD_pool_allocate (connection->pool, size + 1, MHD_NO);
   if (NULL == data)
@@ -849,10 +1162,8 @@ build_header_response (struct MHD_Connection *connection)
 #endif
       return MHD_NO;
     }
-  if (MHD_CONNECTION_FOOTERS_RECEIVED == connection->state)
-    {
-      memcpy (data, code, off);
-    }
+  memcpy (data, code, code_len);
+  off = code_len;
   if (must_add_close)
     {
       /* we must add the 'Connection: close' header */
@@ -881,25 +1192,33 @@ build_header_response (struct MHD_Connection *connection)
     {
       /* we must add the 'Content-Length' header */
       memcpy (&data[off],
-              content_length_buf,
+              content_length_line,
 	      content_length_len);
       off += content_length_len;
     }
-  for (pos = connection->response->first_header; NULL != pos; pos = pos->next)
-    if ( (pos->kind == kind) &&
-         (! ( (pos->value == response_has_keepalive) &&
-              (MHD_YES == must_add_close) &&
-              (0 == strcasecmp (pos->header,
-                                MHD_HTTP_HEADER_CONNECTION) ) ) ) )
-      off += sprintf (&data[off],
-		      "%s: %s\r\n",
-		      pos->header,
-		      pos->value);
-  if (MHD_CONNECTION_FOOTERS_RECEIVED == connection->state)
+  if (skip_keep_alive)
+    {
+      memcpy (&data[off],
+              response->header_block,
+              response->keep_alive_off);
+      off += response->keep_alive_off;
+      memcpy (&data[off],
+              &response->header_block[response->keep_alive_off
+                                      + response->keep_alive_len],
+              response->header_block_size
+              - response->keep_alive_off - response->keep_alive_len);
+      off += response->header_block_size
+        - response->keep_alive_off - response->keep_alive_len;
+    }
+  else
     {
-      strcpy (&data[off], date);
-      off += strlen (date);
+      memcpy (&data[off],
+              response->header_block,
+              response->header_block_size);
+      off += response->header_block_size;
     }
+  memcpy (&data[off], date, date_len);
+  off += date_len;
   memcpy (&data[off], "\r\n", 2);
   off += 2;
 
@@ -929,6 +1248,10 @@ transmit_error_response (struct MHD_Connection *connection,
 {
   struct MHD_Response *response;
 
+  if (MHD_HTTP_REQUEST_ENTITY_TOO_LARGE == status_code)
+    MHD_STATS_INC_ (connection->daemon, requests_too_large);
+  else if (MHD_HTTP_REQUEST_URI_TOO_LONG == status_code)
+    MHD_STATS_INC_ (connection->daemon, uris_too_long);
   if (NULL == connection->version)
     {
       /* we were unable to process the full header line, so we don't
@@ -1045,6 +1368,23 @@ MHD_connection_update_event_loop_info (struct MHD_Connection *connection)
                   continue;
                 }
             }
+          if ( (NULL != connection->upload_buffer) &&
+               (connection->upload_buffer_offset ==
+                connection->upload_buffer_size) )
+            {
+              /* same for the buffer of the application */
+              if (0 != (connection->daemon->options &
+                        (MHD_USE_SELECT_INTERNALLY |
+                         MHD_USE_THREAD_PER_CONNECTION)))
+                {
+                  transmit_error_response (connection,
+                                           MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                           INTERNAL_ERROR);
+                  continue;
+                }
+              connection->event_loop_info = MHD_EVENT_LOOP_INFO_BLOCK;
+              break;
+            }
           if ( (connection->read_buffer_offset < connection->read_buffer_size) &&
 	       (MHD_NO == connection->read_closed) )
 	    connection->event_loop_info = MHD_EVENT_LOOP_INFO_READ;
@@ -1104,6 +1444,14 @@ MHD_connection_update_event_loop_info (struct MHD_Connection *connection)
         }
       break;
     }
+  if ( (connection->pipeline_buffer_send_offset !=
+        connection->pipeline_buffer_append_offset) &&
+       (MHD_EVENT_LOOP_INFO_CLEANUP != connection->event_loop_info) )
+    {
+      /* cannot make progress without the client, time to
+         send the responses to the pipelined requests */
+      connection->event_loop_info = MHD_EVENT_LOOP_INFO_WRITE;
+    }
 }
 
 
@@ -1116,21 +1464,22 @@ MHD_connection_update_event_loop_info (struct MHD_Connection *connection)
  * return NULL.  Otherwise return a pointer to the line.
  *
  * @param connection connection we're processing
+ * @param line_len set to the length of the line returned
  * @return NULL if no full line is available
  */
 static char *
-get_next_header_line (struct MHD_Connection *connection)
+get_next_header_line (struct MHD_Connection *connection,
+                      size_t *line_len)
 {
   char *rbuf;
   size_t pos;
 
   if (0 == connection->read_buffer_offset)
     return NULL;
-  pos = 0;
   rbuf = connection->read_buffer;
-  while ((pos < connection->read_buffer_offset - 1) &&
-         ('\r' != rbuf[pos]) && ('\n' != rbuf[pos]))
-    pos++;
+  pos = MHD_linescan_find2 (rbuf,
+                            connection->read_buffer_offset - 1,
+                            '\r', '\n');
   if ( (pos == connection->read_buffer_offset - 1) &&
        ('\n' != rbuf[pos]) )
     {
@@ -1148,6 +1497,7 @@ get_next_header_line (struct MHD_Connection *connection)
       return NULL;
     }
   /* found, check if we have proper LFCR */
+  *line_len = pos;
   if (('\r' == rbuf[pos]) && ('\n' == rbuf[pos + 1]))
     rbuf[pos++] = '\0';         /* skip both r and n */
   rbuf[pos++] = '\0';
@@ -1382,35 +1732,52 @@ parse_cookie_header (struct MHD_Connection *connection)
  *
  * @param connection the connection (updated)
  * @param line the first line
+ * @param line_len length of @a line
  * @return #MHD_YES if the line is ok, #MHD_NO if it is malformed
  */
 static int
 parse_initial_message_line (struct MHD_Connection *connection,
-                            char *line)
+                            char *line,
+                            size_t line_len)
 {
   char *uri;
   char *http_version;
   char *args;
+  size_t pos;
+  size_t uri_len;
 
-  if (NULL == (uri = strchr (line, ' ')))
+  /* the scans stop at a 0-byte, just like strchr() would */
+  pos = MHD_linescan_find2 (line, line_len, ' ', '\0');
+  if ( (pos == line_len) ||
+       (' ' != line[pos]) )
     return MHD_NO;              /* serious error */
+  uri = &line[pos];
   uri[0] = '\0';
   connection->method = line;
   uri++;
   while (' ' == uri[0])
     uri++;
-  http_version = strchr (uri, ' ');
-  if (NULL != http_version)
+  uri_len = line_len - (uri - line);
+  pos = MHD_linescan_find2 (uri, uri_len, ' ', '\0');
+  if ( (pos < uri_len) &&
+       (' ' == uri[pos]) )
     {
+      http_version = &uri[pos];
       http_version[0] = '\0';
       http_version++;
+      uri_len = pos;
+    }
+  else
+    {
+      http_version = NULL;
     }
   if (NULL != connection->daemon->uri_log_callback)
     connection->client_context
       = connection->daemon->uri_log_callback (connection->daemon->uri_log_callback_cls,
 					      uri,
 					      connection);
-  args = strchr (uri, '?');
+  pos = MHD_linescan_find2 (uri, uri_len, '?', '\0');
+  args = ( (pos < uri_len) && ('?' == uri[pos]) ) ? &uri[pos] : NULL;
   if (NULL != args)
     {
       args[0] = '\0';
@@ -1464,49 +1831,147 @@ call_connection_handler (struct MHD_Connection *connection)
 
 
 /**
- * Call the handler of the application for this
- * connection.  Handles chunking of the upload
- * as well as normal uploads.
+ * Write request body bytes from our read buffer to the file
+ * descriptor given with #MHD_CONNECTION_OPTION_UPLOAD_FD.
  *
  * @param connection connection we're processing
+ * @param data body bytes to write
+ * @param size number of bytes in @a data
+ * @return #MHD_YES on success, #MHD_NO if we closed the connection
  */
-static void
-process_request_body (struct MHD_Connection *connection)
+static int
+write_upload (struct MHD_Connection *connection,
+              const char *data,
+              size_t size)
 {
-  size_t processed;
-  size_t available;
-  size_t used;
-  size_t i;
-  int instant_retry;
-  int malformed;
-  char *buffer_head;
-  char *end;
-
-  if (NULL != connection->response)
-    return;                     /* already queued a response */
+  ssize_t ret;
 
-  buffer_head = connection->read_buffer;
-  available = connection->read_buffer_offset;
-  do
+  while (size > 0)
     {
-      instant_retry = MHD_NO;
-      if ( (MHD_YES == connection->have_chunked_upload) &&
-           (MHD_SIZE_UNKNOWN == connection->remaining_upload_size) )
+      ret = write (connection->upload_fd, data, size);
+      if (ret < 0)
         {
-          if ( (connection->current_chunk_offset == connection->current_chunk_size) &&
-               (0 != connection->current_chunk_offset) &&
-               (available >= 2) )
-            {
-              /* skip new line at the *end* of a chunk */
-              i = 0;
-              if ((buffer_head[i] == '\r') || (buffer_head[i] == '\n'))
-                i++;            /* skip 1st part of line feed */
-              if ((buffer_head[i] == '\r') || (buffer_head[i] == '\n'))
-                i++;            /* skip 2nd part of line feed */
-              if (i == 0)
-                {
-                  /* malformed encoding */
-                  CONNECTION_CLOSE_ERROR (connection,
+          if (EINTR == errno)
+            continue;
+#if HAVE_MESSAGES
+          MHD_DLOG (connection->daemon,
+                    "Failed to write upload data: %s\n",
+                    MHD_strerror_ (errno));
+#endif
+          CONNECTION_CLOSE_ERROR (connection, NULL);
+          return MHD_NO;
+        }
+      data += ret;
+      size -= ret;
+    }
+  return MHD_YES;
+}
+
+
+/**
+ * Pass the request body bytes we received into the buffer given
+ * with #MHD_CONNECTION_OPTION_UPLOAD_BUFFER to the access handler,
+ * and move those it leaves to the beginning of the buffer.
+ *
+ * @param connection connection we're processing
+ * @return #MHD_YES if the buffer is now empty,
+ *         #MHD_NO if bytes are left or if we closed the connection
+ */
+static int
+process_upload_buffer (struct MHD_Connection *connection)
+{
+  char *buffer = connection->upload_buffer;
+  size_t available = connection->upload_buffer_offset;
+  size_t processed;
+  size_t used;
+
+  processed = available;
+  connection->client_aware = MHD_YES;
+  if (MHD_NO ==
+      connection->daemon->default_handler (connection->daemon->default_handler_cls,
+                                           connection,
+                                           connection->url,
+                                           connection->method,
+                                           connection->version,
+                                           buffer,
+                                           &processed,
+                                           &connection->client_context))
+    {
+      /* serious internal error, close connection */
+      CONNECTION_CLOSE_ERROR (connection,
+                              "Internal application error, closing connection.\n");
+      return MHD_NO;
+    }
+  if (processed > available)
+    mhd_panic (mhd_panic_cls, __FILE__, __LINE__
+#if HAVE_MESSAGES
+               , "API violation"
+#else
+               , NULL
+#endif
+               );
+  used = available - processed;
+  if (MHD_YES == connection->upload_to_fd)
+    {
+      /* the handler wants the rest in a file, starting with these */
+      if (MHD_NO == write_upload (connection, &buffer[used], processed))
+        return MHD_NO;
+      connection->upload_buffer = NULL;
+      connection->upload_buffer_size = 0;
+      processed = 0;
+    }
+  else if ( (0 != processed) &&
+            (0 != used) )
+    memmove (buffer, &buffer[used], processed);
+  connection->upload_buffer_offset = processed;
+  return (0 == processed) ? MHD_YES : MHD_NO;
+}
+
+
+/**
+ * Call the handler of the application for this
+ * connection.  Handles chunking of the upload
+ * as well as normal uploads.
+ *
+ * @param connection connection we're processing
+ */
+static void
+process_request_body (struct MHD_Connection *connection)
+{
+  size_t processed;
+  size_t available;
+  size_t used;
+  size_t i;
+  int instant_retry;
+  int malformed;
+  char *buffer_head;
+  char *end;
+
+  if (NULL != connection->response)
+    return;                     /* already queued a response */
+
+  buffer_head = connection->read_buffer;
+  available = connection->read_buffer_offset;
+  do
+    {
+      instant_retry = MHD_NO;
+      if ( (MHD_YES == connection->have_chunked_upload) &&
+           (MHD_SIZE_UNKNOWN == connection->remaining_upload_size) )
+        {
+          if ( (connection->current_chunk_offset == connection->current_chunk_size) &&
+               (0 != connection->current_chunk_offset) &&
+               (available >= 2) )
+            {
+              /* skip new line at the *end* of a chunk */
+              i = 0;
+              if ((buffer_head[i] == '\r') || (buffer_head[i] == '\n'))
+                i++;            /* skip 1st part of line feed */
+              if ((buffer_head[i] == '\r') || (buffer_head[i] == '\n'))
+                i++;            /* skip 2nd part of line feed */
+              if (i == 0)
+                {
+                  /* malformed encoding */
+                  CONNECTION_CLOSE_ERROR (connection,
 					  "Received malformed HTTP request (bad chunked encoding), closing connection.\n");
                   return;
                 }
@@ -1600,21 +2065,31 @@ process_request_body (struct MHD_Connection *connection)
 	    }
         }
       used = processed;
-      connection->client_aware = MHD_YES;
-      if (MHD_NO ==
-          connection->daemon->default_handler (connection->daemon->default_handler_cls,
-                                               connection,
-                                               connection->url,
-                                               connection->method,
-                                               connection->version,
-                                               buffer_head,
-                                               &processed,
-                                               &connection->client_context))
+      if (MHD_YES == connection->upload_to_fd)
         {
-          /* serious internal error, close connection */
-	  CONNECTION_CLOSE_ERROR (connection,
-				  "Internal application error, closing connection.\n");
-          return;
+          /* the application wants the body in a file */
+          if (MHD_NO == write_upload (connection, buffer_head, processed))
+            return;
+          processed = 0;
+        }
+      else
+        {
+          connection->client_aware = MHD_YES;
+          if (MHD_NO ==
+              connection->daemon->default_handler (connection->daemon->default_handler_cls,
+                                                   connection,
+                                                   connection->url,
+                                                   connection->method,
+                                                   connection->version,
+                                                   buffer_head,
+                                                   &processed,
+                                                   &connection->client_context))
+            {
+              /* serious internal error, close connection */
+              CONNECTION_CLOSE_ERROR (connection,
+                                      "Internal application error, closing connection.\n");
+              return;
+            }
         }
       if (processed > used)
         mhd_panic (mhd_panic_cls, __FILE__, __LINE__
@@ -1625,7 +2100,11 @@ process_request_body (struct MHD_Connection *connection)
 #endif
 		   );
       if (0 != processed)
-        instant_retry = MHD_NO; /* client did not process everything */
+        {
+          /* client did not process everything; unless it asked
+             for the rest to go to a file, which we do right away */
+          instant_retry = connection->upload_to_fd;
+        }
       used -= processed;
       if (connection->have_chunked_upload == MHD_YES)
         connection->current_chunk_offset += used;
@@ -1636,33 +2115,41 @@ process_request_body (struct MHD_Connection *connection)
         connection->remaining_upload_size -= used;
     }
   while (MHD_YES == instant_retry);
-  if (available > 0)
+  if ( (0 == connection->remaining_upload_size) &&
+       (buffer_head != connection->read_buffer) )
+    {
+      /* upload complete, anything left belongs to the next pipelined
+         request; skip over the body like we do for header lines, the
+         keep-alive reset moves the rest to the front of the pool */
+      connection->read_buffer_size -= buffer_head - connection->read_buffer;
+      connection->read_buffer = buffer_head;
+    }
+  else if (available > 0)
     memmove (connection->read_buffer, buffer_head, available);
   connection->read_buffer_offset = available;
 }
 
 
 /**
- * Try reading data from the socket into the
- * read buffer of the connection.
+ * Try reading data from the socket into the given buffer.
  *
  * @param connection connection we're processing
+ * @param buf where to store the data
+ * @param size number of bytes available in @a buf, must not be zero
+ * @param got set to the number of bytes we received
  * @return #MHD_YES if something changed,
- *         #MHD_NO if we were interrupted or if
- *                no space was available
+ *         #MHD_NO if we were interrupted
  */
 static int
-do_read (struct MHD_Connection *connection)
+recv_into (struct MHD_Connection *connection,
+           char *buf,
+           size_t size,
+           size_t *got)
 {
   int bytes_read;
 
-  if (connection->read_buffer_size == connection->read_buffer_offset)
-    return MHD_NO;
-  bytes_read = connection->recv_cls (connection,
-                                     &connection->read_buffer
-                                     [connection->read_buffer_offset],
-                                     connection->read_buffer_size -
-                                     connection->read_buffer_offset);
+  *got = 0;
+  bytes_read = connection->recv_cls (connection, buf, size);
   if (bytes_read < 0)
     {
       const int err = MHD_socket_errno_;
@@ -1697,11 +2184,40 @@ do_read (struct MHD_Connection *connection)
 			    MHD_REQUEST_TERMINATED_CLIENT_ABORT);
       return MHD_YES;
     }
-  connection->read_buffer_offset += bytes_read;
+  *got = bytes_read;
+  if (0 == connection->latency_stamps[MHD_LATENCY_STAMP_FIRST_BYTE])
+    MHD_LATENCY_STAMP_ (connection, MHD_LATENCY_STAMP_FIRST_BYTE);
   return MHD_YES;
 }
 
 
+/**
+ * Try reading data from the socket into the
+ * read buffer of the connection.
+ *
+ * @param connection connection we're processing
+ * @return #MHD_YES if something changed,
+ *         #MHD_NO if we were interrupted or if
+ *                no space was available
+ */
+static int
+do_read (struct MHD_Connection *connection)
+{
+  size_t got;
+  int ret;
+
+  if (connection->read_buffer_size == connection->read_buffer_offset)
+    return MHD_NO;
+  ret = recv_into (connection,
+                   &connection->read_buffer[connection->read_buffer_offset],
+                   connection->read_buffer_size -
+                   connection->read_buffer_offset,
+                   &got);
+  connection->read_buffer_offset += got;
+  return ret;
+}
+
+
 /**
  * Try writing data to the socket from the
  * write buffer of the connection.
@@ -1755,6 +2271,84 @@ do_write (struct MHD_Connection *connection)
 }
 
 
+#if HAVE_SENDMSG
+/**
+ * Try writing the response header from the write buffer of the
+ * connection to the socket.  If the response body is in memory, it
+ * is sent directly from the response in the same system call.
+ * Otherwise, the kernel is told that the body follows, so that the
+ * header can go out in the same frame as the start of the body.
+ *
+ * @param connection connection we're processing
+ * @return #MHD_YES if something changed,
+ *         #MHD_NO if we were interrupted
+ */
+static int
+do_write_header (struct MHD_Connection *connection)
+{
+  struct MHD_Response *response = connection->response;
+  struct iovec iov[2];
+  unsigned int iovcnt;
+  size_t hlen;
+  size_t blen;
+  int more;
+  ssize_t ret;
+
+  hlen = connection->write_buffer_append_offset - connection->write_buffer_send_offset;
+  iov[0].iov_base = &connection->write_buffer[connection->write_buffer_send_offset];
+  iov[0].iov_len = hlen;
+  iovcnt = 1;
+  blen = 0;
+  if ( (NULL == response->crc) &&
+       (MHD_INVALID_SOCKET == response->fd) &&
+       (MHD_NO == connection->have_chunked_upload) )
+    {
+      /* body is in memory, send it without copying */
+      blen = response->total_size - connection->response_write_position;
+      iov[1].iov_base = &response->data[connection->response_write_position
+                                        - response->data_start];
+      iov[1].iov_len = blen;
+      if (0 != blen)
+        iovcnt = 2;
+      more = MHD_NO;
+    }
+  else
+    {
+      more = ( (MHD_YES == connection->have_chunked_upload) ||
+               (connection->response_write_position < response->total_size) )
+        ? MHD_YES : MHD_NO;
+    }
+  ret = connection->sendv_cls (connection, iov, iovcnt, more);
+  if (ret < 0)
+    {
+      const int err = MHD_socket_errno_;
+      if ((EINTR == err) || (EAGAIN == err) || (EWOULDBLOCK == err))
+        return MHD_NO;
+#if HAVE_MESSAGES
+      MHD_DLOG (connection->daemon,
+                "Failed to send data: %s\n", MHD_socket_last_strerr_ ());
+#endif
+      CONNECTION_CLOSE_ERROR (connection, NULL);
+      return MHD_YES;
+    }
+#if DEBUG_SEND_DATA
+  fprintf (stderr,
+           "Sent response: `%.*s'\n",
+           (int) MHD_MIN ((size_t) ret, hlen),
+           &connection->write_buffer[connection->write_buffer_send_offset]);
+#endif
+  if ((size_t) ret <= hlen)
+    {
+      connection->write_buffer_send_offset += ret;
+      return MHD_YES;
+    }
+  connection->write_buffer_send_offset += hlen;
+  connection->response_write_position += ret - hlen;
+  return MHD_YES;
+}
+#endif
+
+
 /**
  * Check if we are done sending the write-buffer.
  * If so, transition into "next_state".
@@ -1772,6 +2366,8 @@ check_write_done (struct MHD_Connection *connection,
     return MHD_NO;
   connection->write_buffer_append_offset = 0;
   connection->write_buffer_send_offset = 0;
+  if (MHD_CONNECTION_HEADERS_SENDING == connection->state)
+    MHD_LATENCY_STAMP_ (connection, MHD_LATENCY_STAMP_HEADERS_SENT);
   connection->state = next_state;
   MHD_pool_reallocate (connection->pool,
 		       connection->write_buffer,
@@ -1782,6 +2378,67 @@ check_write_done (struct MHD_Connection *connection,
 }
 
 
+/**
+ * If further pipelined requests are waiting in the read buffer (or
+ * responses to earlier ones were not sent yet), append the complete
+ * response (headers and body) to the pipeline buffer instead of
+ * writing it out.  The batch is written with a single send once no
+ * further request can be processed without the client.
+ *
+ * @param connection connection in state #MHD_CONNECTION_HEADERS_SENDING
+ * @return #MHD_YES if the response was batched (and the connection
+ *         moved on to #MHD_CONNECTION_FOOTERS_SENT), #MHD_NO if it
+ *         has to be sent the normal way
+ */
+static int
+batch_pipelined_response (struct MHD_Connection *connection)
+{
+  struct MHD_Response *response = connection->response;
+  size_t hlen;
+  uint64_t blen;
+
+  if ( (0 == connection->read_buffer_offset) &&
+       (connection->pipeline_buffer_send_offset ==
+        connection->pipeline_buffer_append_offset) )
+    return MHD_NO;              /* nothing pipelined */
+  if ( (MHD_YES == connection->read_closed) ||
+       (MHD_NO == keepalive_possible (connection)) )
+    return MHD_NO;              /* connection will be closed after this */
+  if ( (NULL != response->crc) ||
+       (MHD_INVALID_SOCKET != response->fd) ||
+       (MHD_YES == connection->have_chunked_upload) )
+    return MHD_NO;              /* body is not (entirely) in memory */
+  hlen = connection->write_buffer_append_offset -
+    connection->write_buffer_send_offset;
+  blen = response->total_size - connection->response_write_position;
+  if ( (blen > MHD_PIPELINE_BATCH_SIZE) ||
+       (hlen + blen > MHD_PIPELINE_BATCH_SIZE -
+        connection->pipeline_buffer_append_offset) )
+    return MHD_NO;              /* does not fit, send the usual way */
+  if ( (NULL == connection->pipeline_buffer) &&
+       (NULL == (connection->pipeline_buffer
+                 = malloc (MHD_PIPELINE_BATCH_SIZE))) )
+    return MHD_NO;
+  memcpy (&connection->pipeline_buffer
+          [connection->pipeline_buffer_append_offset],
+          &connection->write_buffer[connection->write_buffer_send_offset],
+          hlen);
+  connection->pipeline_buffer_append_offset += hlen;
+  if (0 != blen)
+    memcpy (&connection->pipeline_buffer
+            [connection->pipeline_buffer_append_offset],
+            &response->data[connection->response_write_position -
+                            response->data_start],
+            (size_t) blen);
+  connection->pipeline_buffer_append_offset += (size_t) blen;
+  connection->write_buffer_send_offset = connection->write_buffer_append_offset;
+  connection->response_write_position = response->total_size;
+  check_write_done (connection,
+                    MHD_CONNECTION_FOOTERS_SENT);
+  return MHD_YES;
+}
+
+
 /**
  * We have received (possibly the beginning of) a line in the
  * header (or footer).  Validate (check for ":") and prepare
@@ -1789,15 +2446,21 @@ check_write_done (struct MHD_Connection *connection,
  *
  * @param connection connection we're processing
  * @param line line from the header to process
+ * @param line_len length of @a line
  * @return #MHD_YES on success, #MHD_NO on error (malformed @a line)
  */
 static int
-process_header_line (struct MHD_Connection *connection, char *line)
+process_header_line (struct MHD_Connection *connection,
+                     char *line,
+                     size_t line_len)
 {
   char *colon;
+  size_t pos;
 
-  /* line should be normal header line, find colon */
-  colon = strchr (line, ':');
+  /* line should be normal header line, find colon (but do
+     not look beyond a 0-byte, just like strchr() would) */
+  pos = MHD_linescan_find2 (line, line_len, ':', '\0');
+  colon = ( (pos < line_len) && (':' == line[pos]) ) ? &line[pos] : NULL;
   if (NULL == colon)
     {
       /* error in header line, die hard */
@@ -1827,13 +2490,16 @@ process_header_line (struct MHD_Connection *connection, char *line)
  *
  * @param connection connection we're processing
  * @param line the current input line
+ * @param line_len length of @a line
  * @param kind if the line is complete, add a header
  *        of the given kind
  * @return #MHD_YES if the line was processed successfully
  */
 static int
 process_broken_line (struct MHD_Connection *connection,
-                     char *line, enum MHD_ValueKind kind)
+                     char *line,
+                     size_t line_len,
+                     enum MHD_ValueKind kind)
 {
   char *last;
   char *tmp;
@@ -1850,7 +2516,7 @@ process_broken_line (struct MHD_Connection *connection,
       tmp = line;
       while ((tmp[0] == ' ') || (tmp[0] == '\t'))
         tmp++;
-      tmp_len = strlen (tmp);
+      tmp_len = line_len - (tmp - line);
       /* FIXME: we might be able to do this better (faster!), as most
 	 likely 'last' and 'line' should already be adjacent in
 	 memory; however, doing this right gets tricky if we have a
@@ -1884,9 +2550,9 @@ process_broken_line (struct MHD_Connection *connection,
       return MHD_NO;
     }
   /* we still have the current line to deal with... */
-  if (0 != strlen (line))
+  if ('\0' != line[0])
     {
-      if (MHD_NO == process_header_line (connection, line))
+      if (MHD_NO == process_header_line (connection, line, line_len))
         {
           transmit_error_response (connection,
                                    MHD_HTTP_BAD_REQUEST, REQUEST_MALFORMED);
@@ -1977,35 +2643,193 @@ parse_connection_headers (struct MHD_Connection *connection)
 
 
 /**
- * Update the 'last_activity' field of the connection to the current time
- * and move the connection to the head of the 'normal_timeout' list if
- * the timeout for the connection uses the default value.
+ * Update the 'last_activity' field of the connection to the current time.
+ * The timer wheel is not touched here; the daemon re-files the connection
+ * under its new deadline when the old one is reached.
  *
  * @param connection the connection that saw some activity
  */
 static void
 update_last_activity (struct MHD_Connection *connection)
 {
-  struct MHD_Daemon *daemon = connection->daemon;
+  connection->last_activity = MHD_monotonic_time_ms ();
+}
 
-  connection->last_activity = MHD_monotonic_time();
-  if (connection->connection_timeout != daemon->connection_timeout)
-    return; /* custom timeout, no need to move it in "normal" DLL */
 
-  /* move connection to head of timeout list (by remove + add operation) */
-  if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
-       (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
-    MHD_PANIC ("Failed to acquire cleanup mutex\n");
-  XDLL_remove (daemon->normal_timeout_head,
-	       daemon->normal_timeout_tail,
-	       connection);
-  XDLL_insert (daemon->normal_timeout_head,
-	       daemon->normal_timeout_tail,
-	       connection);
-  if  ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
-	(MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
-    MHD_PANIC ("Failed to release cleanup mutex\n");
+/**
+ * Determine how many of the next bytes on the socket belong to the
+ * request body and can bypass our read buffer, which is the case if
+ * nothing is buffered and we are not waiting for chunk framing.
+ *
+ * @param connection connection we're processing
+ * @return number of such bytes, #MHD_SIZE_UNKNOWN if the body
+ *         extends to the end of the stream, 0 if the next bytes
+ *         have to go through our read buffer
+ */
+static uint64_t
+direct_upload_left (struct MHD_Connection *connection)
+{
+  if ( (MHD_CONNECTION_CONTINUE_SENT != connection->state) ||
+       (0 != connection->read_buffer_offset) ||
+       (NULL != connection->response) )
+    return 0;
+  if (MHD_YES == connection->have_chunked_upload)
+    {
+      if ( (MHD_SIZE_UNKNOWN != connection->remaining_upload_size) ||
+           (connection->current_chunk_offset >=
+            connection->current_chunk_size) )
+        return 0;
+      return connection->current_chunk_size - connection->current_chunk_offset;
+    }
+  return connection->remaining_upload_size;
+}
+
+
+/**
+ * Account for @a got request body bytes that bypassed our
+ * read buffer.
+ *
+ * @param connection connection we're processing
+ * @param got number of bytes received
+ */
+static void
+direct_upload_received (struct MHD_Connection *connection,
+                        size_t got)
+{
+  if (MHD_YES == connection->have_chunked_upload)
+    connection->current_chunk_offset += got;
+  else if (MHD_SIZE_UNKNOWN != connection->remaining_upload_size)
+    connection->remaining_upload_size -= got;
+}
+
+
+/**
+ * Receive request body bytes from the socket directly into the
+ * buffer given with #MHD_CONNECTION_OPTION_UPLOAD_BUFFER, after
+ * those the access handler did not process yet.
+ *
+ * @param connection connection we're processing
+ * @return #MHD_YES if we handled the read event,
+ *         #MHD_NO if the next bytes have to go through our
+ *         read buffer (such as chunk headers)
+ */
+static int
+read_upload_buffer (struct MHD_Connection *connection)
+{
+  uint64_t left;
+  size_t want;
+  size_t got;
+
+  if ( (NULL == connection->upload_buffer) ||
+       (MHD_YES == connection->upload_to_fd) ||
+       (0 == (left = direct_upload_left (connection))) )
+    return MHD_NO;
+  want = connection->upload_buffer_size - connection->upload_buffer_offset;
+  if (0 == want)
+    return MHD_YES;             /* wait for the handler to make room */
+  if (left < want)
+    want = (size_t) left;
+  if (MHD_NO == recv_into (connection,
+                           &connection->upload_buffer
+                           [connection->upload_buffer_offset],
+                           want,
+                           &got))
+    return MHD_YES;
+  connection->upload_buffer_offset += got;
+  MHD_STATS_ADD_ (connection->daemon, bytes_received_direct, got);
+  direct_upload_received (connection, got);
+  return MHD_YES;
+}
+
+
+#if LINUX
+/**
+ * Move request body bytes from the socket to the file descriptor
+ * given with #MHD_CONNECTION_OPTION_UPLOAD_FD with splice(),
+ * without copying them to our read buffer.
+ *
+ * @param connection connection we're processing
+ * @return #MHD_YES if we handled the read event,
+ *         #MHD_NO if the next bytes have to go through our
+ *         read buffer (such as chunk headers)
+ */
+static int
+splice_upload (struct MHD_Connection *connection)
+{
+  uint64_t left;
+  ssize_t got;
+  ssize_t put;
+  size_t want;
+
+  if ( (MHD_NO == connection->upload_splice) ||
+       (0 == (left = direct_upload_left (connection))) )
+    return MHD_NO;
+  want = (left > MHD_UPLOAD_SPLICE_SIZE) ? MHD_UPLOAD_SPLICE_SIZE : (size_t) left;
+  got = splice (connection->socket_fd, NULL,
+                connection->upload_pipe[1], NULL,
+                want,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (got < 0)
+    {
+      const int err = errno;
+
+      if ((EINTR == err) || (EAGAIN == err) || (EWOULDBLOCK == err))
+        {
+#if EPOLL_SUPPORT
+          connection->epoll_state &= ~MHD_EPOLL_STATE_READ_READY;
+#endif
+          return MHD_YES;
+        }
+#if HAVE_MESSAGES
+      MHD_DLOG (connection->daemon,
+                "Failed to receive data: %s\n",
+                MHD_strerror_ (err));
+#endif
+      CONNECTION_CLOSE_ERROR (connection, NULL);
+      return MHD_YES;
+    }
+  if (0 == got)
+    {
+      /* other side closed connection */
+      connection->read_closed = MHD_YES;
+      MHD_connection_close (connection,
+                            MHD_REQUEST_TERMINATED_CLIENT_ABORT);
+      return MHD_YES;
+    }
+#if EPOLL_SUPPORT
+  if ((size_t) got < want)
+    {
+      /* partial read --- no longer read-ready */
+      connection->epoll_state &= ~MHD_EPOLL_STATE_READ_READY;
+    }
+#endif
+  MHD_STATS_ADD_ (connection->daemon, bytes_spliced, got);
+  direct_upload_received (connection, got);
+  /* empty the pipe, so that it is ready for the next splice() */
+  while (got > 0)
+    {
+      put = splice (connection->upload_pipe[0], NULL,
+                    connection->upload_fd, NULL,
+                    got,
+                    SPLICE_F_MOVE);
+      if ( (put < 0) &&
+           (EINTR == errno) )
+        continue;
+      if (put <= 0)
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (connection->daemon,
+                    "Failed to write upload data: %s\n",
+                    (0 == put) ? "short write" : MHD_strerror_ (errno));
+#endif
+          CONNECTION_CLOSE_ERROR (connection, NULL);
+          return MHD_YES;
+        }
+      got -= put;
+    }
+  return MHD_YES;
 }
+#endif
 
 
 /**
@@ -2022,6 +2846,12 @@ MHD_connection_handle_read (struct MHD_Connection *connection)
   update_last_activity (connection);
   if (MHD_CONNECTION_CLOSED == connection->state)
     return MHD_YES;
+#if LINUX
+  if (MHD_YES == splice_upload (connection))
+    return MHD_YES;
+#endif
+  if (MHD_YES == read_upload_buffer (connection))
+    return MHD_YES;
   /* make sure "read" has a reasonable number of bytes
      in buffer to use per system call (if possible) */
   if (connection->read_buffer_offset + connection->daemon->pool_increment >
@@ -2086,6 +2916,39 @@ MHD_connection_handle_write (struct MHD_Connection *connection)
   ssize_t ret;
 
   update_last_activity (connection);
+  if (connection->pipeline_buffer_send_offset !=
+      connection->pipeline_buffer_append_offset)
+    {
+      /* responses to earlier pipelined requests go first */
+      ret = send_pipeline_buffer (connection);
+      if (ret < 0)
+        {
+          const int err = MHD_socket_errno_;
+          if ((EINTR == err) || (EAGAIN == err) || (EWOULDBLOCK == err))
+            return MHD_YES;
+#if HAVE_MESSAGES
+          MHD_DLOG (connection->daemon,
+                    "Failed to send data: %s\n",
+                    MHD_socket_last_strerr_ ());
+#endif
+          CONNECTION_CLOSE_ERROR (connection, NULL);
+          return MHD_YES;
+        }
+      if (connection->pipeline_buffer_send_offset !=
+          connection->pipeline_buffer_append_offset)
+        return MHD_YES;
+      switch (connection->state)
+        {
+        case MHD_CONNECTION_CONTINUE_SENDING:
+        case MHD_CONNECTION_HEADERS_SENDING:
+        case MHD_CONNECTION_NORMAL_BODY_READY:
+        case MHD_CONNECTION_CHUNKED_BODY_READY:
+        case MHD_CONNECTION_FOOTERS_SENDING:
+          break;                /* have more to write */
+        default:
+          return MHD_YES;
+        }
+    }
   while (1)
     {
 #if DEBUG_STATES
@@ -2137,6 +3000,24 @@ MHD_connection_handle_write (struct MHD_Connection *connection)
           EXTRA_CHECK (0);
           break;
         case MHD_CONNECTION_HEADERS_SENDING:
+#if HAVE_SENDMSG
+          if (NULL != connection->sendv_cls)
+            {
+              do_write_header (connection);
+              if (connection->state != MHD_CONNECTION_HEADERS_SENDING)
+                break;
+              response = connection->response;
+              check_write_done (connection,
+                                ( (NULL == response->crc) &&
+                                  (MHD_INVALID_SOCKET == response->fd) &&
+                                  (MHD_NO == connection->have_chunked_upload) &&
+                                  (connection->response_write_position ==
+                                   response->total_size) )
+                                ? MHD_CONNECTION_FOOTERS_SENT /* have no footers */
+                                : MHD_CONNECTION_HEADERS_SENT);
+              break;
+            }
+#endif
           do_write (connection);
 	  if (connection->state != MHD_CONNECTION_HEADERS_SENDING)
  	     break;
@@ -2240,6 +3121,7 @@ cleanup_connection (struct MHD_Connection *connection)
 {
   struct MHD_Daemon *daemon = connection->daemon;
 
+  release_upload_target (connection);
   if (NULL != connection->response)
     {
       MHD_destroy_response (connection->response);
@@ -2248,14 +3130,8 @@ cleanup_connection (struct MHD_Connection *connection)
   if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
        (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
     MHD_PANIC ("Failed to acquire cleanup mutex\n");
-  if (connection->connection_timeout == daemon->connection_timeout)
-    XDLL_remove (daemon->normal_timeout_head,
-		 daemon->normal_timeout_tail,
-		 connection);
-  else
-    XDLL_remove (daemon->manual_timeout_head,
-		 daemon->manual_timeout_tail,
-		 connection);
+  MHD_timer_wheel_remove (&daemon->timer_wheel,
+                          connection);
   if (MHD_YES == connection->suspended)
     DLL_remove (daemon->suspended_connections_head,
                 daemon->suspended_connections_tail,
@@ -2276,6 +3152,30 @@ cleanup_connection (struct MHD_Connection *connection)
 }
 
 
+/**
+ * Set or clear TCP_CORK for connections that cannot pass the header
+ * and the body to the kernel in one sendmsg() call (TLS, or no
+ * sendmsg()), so that the header does not go out in a segment of its
+ * own and the body is not held back by Nagle's algorithm.
+ *
+ * @param connection connection to (un)cork
+ * @param val 1 to cork, 0 to uncork
+ */
+static void
+cork_connection (struct MHD_Connection *connection,
+                 int val)
+{
+#if HAVE_DECL_TCP_CORK
+#if HAVE_SENDMSG
+  if (NULL != connection->sendv_cls)
+    return; /* header is sent with the body or with MSG_MORE */
+#endif
+  setsockopt (connection->socket_fd, IPPROTO_TCP, TCP_CORK, &val,
+              sizeof (val));
+#endif
+}
+
+
 /**
  * This function was created to handle per-connection processing that
  * has to happen even if the socket cannot be read or written to.
@@ -2288,9 +3188,10 @@ int
 MHD_connection_handle_idle (struct MHD_Connection *connection)
 {
   struct MHD_Daemon *daemon = connection->daemon;
-  unsigned int timeout;
+  uint64_t timeout;
   const char *end;
   char *line;
+  size_t line_len;
 
   connection->in_idle = MHD_YES;
   while (1)
@@ -2304,7 +3205,7 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
       switch (connection->state)
         {
         case MHD_CONNECTION_INIT:
-          line = get_next_header_line (connection);
+          line = get_next_header_line (connection, &line_len);
           if (NULL == line)
             {
               if (MHD_CONNECTION_INIT != connection->state)
@@ -2317,13 +3218,13 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
                 }
               break;
             }
-          if (MHD_NO == parse_initial_message_line (connection, line))
+          if (MHD_NO == parse_initial_message_line (connection, line, line_len))
             CONNECTION_CLOSE_ERROR (connection, NULL);
           else
             connection->state = MHD_CONNECTION_URL_RECEIVED;
           continue;
         case MHD_CONNECTION_URL_RECEIVED:
-          line = get_next_header_line (connection);
+          line = get_next_header_line (connection, &line_len);
           if (NULL == line)
             {
               if (MHD_CONNECTION_URL_RECEIVED != connection->state)
@@ -2336,12 +3237,12 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
                 }
               break;
             }
-          if (strlen (line) == 0)
+          if ('\0' == line[0])
             {
               connection->state = MHD_CONNECTION_HEADERS_RECEIVED;
               continue;
             }
-          if (MHD_NO == process_header_line (connection, line))
+          if (MHD_NO == process_header_line (connection, line, line_len))
             {
               transmit_error_response (connection,
                                        MHD_HTTP_BAD_REQUEST,
@@ -2351,7 +3252,7 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
           connection->state = MHD_CONNECTION_HEADER_PART_RECEIVED;
           continue;
         case MHD_CONNECTION_HEADER_PART_RECEIVED:
-          line = get_next_header_line (connection);
+          line = get_next_header_line (connection, &line_len);
           if (NULL == line)
             {
               if (connection->state != MHD_CONNECTION_HEADER_PART_RECEIVED)
@@ -2365,21 +3266,24 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
               break;
             }
           if (MHD_NO ==
-              process_broken_line (connection, line, MHD_HEADER_KIND))
+              process_broken_line (connection, line, line_len, MHD_HEADER_KIND))
             continue;
-          if (0 == strlen (line))
+          if ('\0' == line[0])
             {
               connection->state = MHD_CONNECTION_HEADERS_RECEIVED;
               continue;
             }
           continue;
         case MHD_CONNECTION_HEADERS_RECEIVED:
+          MHD_STATS_INC_ (daemon, requests);
+          MHD_LATENCY_STAMP_ (connection, MHD_LATENCY_STAMP_HEADERS_RECEIVED);
           parse_connection_headers (connection);
           if (MHD_CONNECTION_CLOSED == connection->state)
             continue;
           connection->state = MHD_CONNECTION_HEADERS_PROCESSED;
           continue;
         case MHD_CONNECTION_HEADERS_PROCESSED:
+          MHD_LATENCY_STAMP_ (connection, MHD_LATENCY_STAMP_HANDLER_CALLED);
           call_connection_handler (connection); /* first call */
           if (MHD_CONNECTION_CLOSED == connection->state)
             continue;
@@ -2411,6 +3315,15 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
             }
           break;
         case MHD_CONNECTION_CONTINUE_SENT:
+          /* what we received into the buffer of the application
+             comes before anything in our read buffer */
+          if ( (0 != connection->upload_buffer_offset) &&
+               (MHD_YES != process_upload_buffer (connection)) )
+            {
+              if (MHD_CONNECTION_CLOSED == connection->state)
+                continue;
+              break;
+            }
           if (0 != connection->read_buffer_offset)
             {
               process_request_body (connection);     /* loop call */
@@ -2422,6 +3335,7 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
                (0 == connection->read_buffer_offset) &&
                (MHD_YES == connection->read_closed)))
             {
+              release_upload_target (connection);
               if ((MHD_YES == connection->have_chunked_upload) &&
                   (MHD_NO == connection->read_closed))
                 connection->state = MHD_CONNECTION_BODY_RECEIVED;
@@ -2431,7 +3345,7 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
             }
           break;
         case MHD_CONNECTION_BODY_RECEIVED:
-          line = get_next_header_line (connection);
+          line = get_next_header_line (connection, &line_len);
           if (NULL == line)
             {
               if (connection->state != MHD_CONNECTION_BODY_RECEIVED)
@@ -2444,12 +3358,12 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
                 }
               break;
             }
-          if (0 == strlen (line))
+          if ('\0' == line[0])
             {
               connection->state = MHD_CONNECTION_FOOTERS_RECEIVED;
               continue;
             }
-          if (MHD_NO == process_header_line (connection, line))
+          if (MHD_NO == process_header_line (connection, line, line_len))
             {
               transmit_error_response (connection,
                                        MHD_HTTP_BAD_REQUEST,
@@ -2459,7 +3373,7 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
           connection->state = MHD_CONNECTION_FOOTER_PART_RECEIVED;
           continue;
         case MHD_CONNECTION_FOOTER_PART_RECEIVED:
-          line = get_next_header_line (connection);
+          line = get_next_header_line (connection, &line_len);
           if (NULL == line)
             {
               if (connection->state != MHD_CONNECTION_FOOTER_PART_RECEIVED)
@@ -2473,9 +3387,9 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
               break;
             }
           if (MHD_NO ==
-              process_broken_line (connection, line, MHD_FOOTER_KIND))
+              process_broken_line (connection, line, line_len, MHD_FOOTER_KIND))
             continue;
-          if (0 == strlen (line))
+          if ('\0' == line[0])
             {
               connection->state = MHD_CONNECTION_FOOTERS_RECEIVED;
               continue;
@@ -2495,15 +3409,10 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
               continue;
             }
           connection->state = MHD_CONNECTION_HEADERS_SENDING;
-
-#if HAVE_DECL_TCP_CORK
           /* starting header send, set TCP cork */
-          {
-            const int val = 1;
-            setsockopt (connection->socket_fd, IPPROTO_TCP, TCP_CORK, &val,
-                        sizeof (val));
-          }
-#endif
+          cork_connection (connection, 1);
+          if (MHD_YES == batch_pipelined_response (connection))
+            continue;
           break;
         case MHD_CONNECTION_HEADERS_SENDING:
           /* no default action */
@@ -2578,14 +3487,9 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
           /* no default action */
           break;
         case MHD_CONNECTION_FOOTERS_SENT:
-#if HAVE_DECL_TCP_CORK
           /* done sending, uncork */
-          {
-            const int val = 0;
-            setsockopt (connection->socket_fd, IPPROTO_TCP, TCP_CORK, &val,
-                        sizeof (val));
-          }
-#endif
+          cork_connection (connection, 0);
+          record_request_latency (connection);
           end =
             MHD_get_response_header (connection->response,
 				     MHD_HTTP_HEADER_CONNECTION);
@@ -2616,8 +3520,13 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
               /* have to close for some reason */
               MHD_connection_close (connection,
                                     MHD_REQUEST_TERMINATED_COMPLETED_OK);
-              MHD_pool_destroy (connection->pool);
-              connection->pool = NULL;
+              if (0 == connection->daemon->connection_cache_size)
+                {
+                  /* release the memory early, the pool will not
+                     be recycled */
+                  MHD_pool_destroy (connection->pool);
+                  connection->pool = NULL;
+                }
               connection->read_buffer = NULL;
               connection->read_buffer_size = 0;
               connection->read_buffer_offset = 0;
@@ -2625,12 +3534,30 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
           else
             {
               /* can try to keep-alive */
+              MHD_STATS_INC_ (daemon, keepalive_reuses);
               connection->version = NULL;
               connection->state = MHD_CONNECTION_INIT;
-              connection->read_buffer
-                = MHD_pool_reset (connection->pool,
-                                  connection->read_buffer,
-                                  connection->read_buffer_size);
+              if ( (0 != daemon->pool_release) &&
+                   (0 == connection->read_buffer_offset) )
+                {
+                  /* the client did not send the next request yet and
+                     may stay idle for long; drop the read buffer and
+                     give the memory back, reading grows it again */
+                  connection->read_buffer
+                    = MHD_pool_reset (connection->pool,
+                                      connection->read_buffer,
+                                      0,
+                                      0);
+                  connection->read_buffer_size = 0;
+                  MHD_STATS_ADD_ (daemon, pool_bytes_released,
+                                  MHD_pool_release_unused (connection->pool));
+                }
+              else
+                connection->read_buffer
+                  = MHD_pool_reset (connection->pool,
+                                    connection->read_buffer,
+                                    connection->read_buffer_offset,
+                                    connection->read_buffer_size);
             }
 	  connection->client_aware = MHD_NO;
           connection->client_context = NULL;
@@ -2638,6 +3565,7 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
           connection->responseCode = 0;
           connection->headers_received = NULL;
 	  connection->headers_received_tail = NULL;
+          connection->header_index = NULL;
           connection->response_write_position = 0;
           connection->have_chunked_upload = MHD_NO;
           connection->method = NULL;
@@ -2658,8 +3586,9 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
     }
   timeout = connection->connection_timeout;
   if ( (0 != timeout) &&
-       (timeout <= (MHD_monotonic_time() - connection->last_activity)) )
+       (timeout <= (MHD_monotonic_time_ms () - connection->last_activity)) )
     {
+      MHD_STATS_INC_ (daemon, timeouts);
       MHD_connection_close (connection, MHD_REQUEST_TERMINATED_TIMEOUT_REACHED);
       connection->in_idle = MHD_NO;
       return MHD_YES;
@@ -2737,6 +3666,21 @@ MHD_connection_epoll_update_ (struct MHD_Connection *connection)
 {
   struct MHD_Daemon *daemon = connection->daemon;
 
+#if IO_URING_SUPPORT
+  if ( (0 != (daemon->options & MHD_USE_IO_URING)) &&
+       (0 == (connection->epoll_state & MHD_EPOLL_STATE_SUSPENDED)) &&
+       (MHD_YES != MHD_uring_connection_update_ (connection)) )
+    {
+#if HAVE_MESSAGES
+      if (0 != (daemon->options & MHD_USE_DEBUG))
+        MHD_DLOG (daemon,
+                  "Failed to queue io_uring operations\n");
+#endif
+      connection->state = MHD_CONNECTION_CLOSED;
+      cleanup_connection (connection);
+      return MHD_NO;
+    }
+#endif
   if ( (0 != (daemon->options & MHD_USE_EPOLL_LINUX_ONLY)) &&
        (0 == (connection->epoll_state & MHD_EPOLL_STATE_IN_EPOLL_SET)) &&
        (0 == (connection->epoll_state & MHD_EPOLL_STATE_SUSPENDED)) &&
@@ -2848,40 +3792,79 @@ MHD_set_connection_option (struct MHD_Connection *connection,
 {
   va_list ap;
   struct MHD_Daemon *daemon;
+  uint64_t timeout;
+  int fd;
+  void *buf;
+  size_t size;
 
   daemon = connection->daemon;
   switch (option)
     {
     case MHD_CONNECTION_OPTION_TIMEOUT:
-      if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
-	   (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
-	MHD_PANIC ("Failed to acquire cleanup mutex\n");
-      if (MHD_YES != connection->suspended) {
-        if (connection->connection_timeout == daemon->connection_timeout)
-          XDLL_remove (daemon->normal_timeout_head,
-                       daemon->normal_timeout_tail,
-                       connection);
-        else
-          XDLL_remove (daemon->manual_timeout_head,
-                       daemon->manual_timeout_tail,
-                       connection);
-      }
+    case MHD_CONNECTION_OPTION_TIMEOUT_MS:
       va_start (ap, option);
-      connection->connection_timeout = va_arg (ap, unsigned int);
+      timeout = va_arg (ap, unsigned int);
       va_end (ap);
-      if (MHD_YES != connection->suspended) {
-        if (connection->connection_timeout == daemon->connection_timeout)
-          XDLL_insert (daemon->normal_timeout_head,
-                       daemon->normal_timeout_tail,
-                       connection);
-        else
-          XDLL_insert (daemon->manual_timeout_head,
-                       daemon->manual_timeout_tail,
-                       connection);
-      }
-      if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
-	   (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
-	MHD_PANIC ("Failed to release cleanup mutex\n");
+      if (MHD_CONNECTION_OPTION_TIMEOUT == option)
+        timeout *= 1000;
+      connection->connection_timeout = timeout;
+      /* thread-per-connection threads check their own timeout,
+         suspended connections are re-filed when resumed */
+      if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) ||
+           (MHD_YES == connection->suspended) )
+        return MHD_YES;
+      MHD_timer_wheel_remove (&daemon->timer_wheel,
+                              connection);
+      if (0 != timeout)
+        MHD_timer_wheel_insert (&daemon->timer_wheel,
+                                connection,
+                                connection->last_activity + timeout);
+      return MHD_YES;
+    case MHD_CONNECTION_OPTION_UPLOAD_FD:
+      va_start (ap, option);
+      fd = va_arg (ap, int);
+      va_end (ap);
+      if ( (fd < 0) ||
+           (NULL != connection->response) ||
+           (0 == connection->remaining_upload_size) ||
+           ( (MHD_CONNECTION_HEADERS_PROCESSED != connection->state) &&
+             (MHD_CONNECTION_CONTINUE_SENDING != connection->state) &&
+             (MHD_CONNECTION_CONTINUE_SENT != connection->state) ) )
+        return MHD_NO;
+      connection->upload_fd = fd;
+      connection->upload_to_fd = MHD_YES;
+      /* bytes left in the buffer of the application are written
+         once the handler returns (see process_upload_buffer()) */
+      if (0 == connection->upload_buffer_offset)
+        {
+          connection->upload_buffer = NULL;
+          connection->upload_buffer_size = 0;
+        }
+#if LINUX
+      /* TLS records have to be decrypted, and io_uring receives
+         into its own buffers, so we can only splice() plain sockets */
+      if ( (MHD_NO == connection->upload_splice) &&
+           (0 == (daemon->options & (MHD_USE_SSL | MHD_USE_IO_URING))) &&
+           (0 == pipe2 (connection->upload_pipe, O_CLOEXEC)) )
+        connection->upload_splice = MHD_YES;
+#endif
+      return MHD_YES;
+    case MHD_CONNECTION_OPTION_UPLOAD_BUFFER:
+      va_start (ap, option);
+      buf = va_arg (ap, void *);
+      size = va_arg (ap, size_t);
+      va_end (ap);
+      if ( ( (NULL == buf) != (0 == size) ) ||
+           (MHD_YES == connection->upload_to_fd) ||
+           (0 != connection->upload_buffer_offset) ||
+           (NULL != connection->response) ||
+           (0 == connection->remaining_upload_size) ||
+           ( (MHD_CONNECTION_HEADERS_PROCESSED != connection->state) &&
+             (MHD_CONNECTION_CONTINUE_SENDING != connection->state) &&
+             (MHD_CONNECTION_CONTINUE_SENT != connection->state) ) )
+        return MHD_NO;
+      connection->upload_buffer = buf;
+      connection->upload_buffer_size = size;
       return MHD_YES;
     default:
       return MHD_NO;
@@ -2905,15 +3888,35 @@ MHD_queue_response (struct MHD_Connection *connection,
                     unsigned int status_code,
                     struct MHD_Response *response)
 {
+  struct MHD_Response *variant;
+
   if ( (NULL == connection) ||
        (NULL == response) ||
        (NULL != connection->response) ||
        ( (MHD_CONNECTION_HEADERS_PROCESSED != connection->state) &&
 	 (MHD_CONNECTION_FOOTERS_RECEIVED != connection->state) ) )
     return MHD_NO;
-  MHD_increment_response_rc (response);
+  variant = NULL;
+#if COMPRESSION_SUPPORT
+  if (0 != (response->flags & MHD_RF_COMPRESS))
+    variant = MHD_compress_select_ (connection, response, status_code);
+#endif
+  if (NULL != variant)
+    response = variant; /* comes with a reference for us */
+  else
+    MHD_increment_response_rc (response);
+  if ( (MHD_HTTP_OK == status_code) &&
+       (NULL != (variant = MHD_range_select_ (connection,
+                                              response,
+                                              &status_code))) )
+    {
+      /* the partial response holds its own reference */
+      MHD_destroy_response (response);
+      response = variant;
+    }
   connection->response = response;
   connection->responseCode = status_code;
+  MHD_LATENCY_STAMP_ (connection, MHD_LATENCY_STAMP_RESPONSE_QUEUED);
   if ( (NULL != connection->method) &&
        (0 == strcasecmp (connection->method, MHD_HTTP_METHOD_HEAD)) )
     {
@@ -93,6 +93,17 @@ MHD_connection_close (struct MHD_Connection *connection,
 		      enum MHD_RequestTerminationCode termination_code);
 
 
+/**
+ * Try to send the responses to pipelined requests that were
+ * collected but not yet written, without blocking.  Used before the
+ * connection stops being polled for writing (suspend or close).
+ *
+ * @param connection connection to flush
+ */
+void
+MHD_connection_flush_pipeline_ (struct MHD_Connection *connection);
+
+
 #if EPOLL_SUPPORT
 /**
  * Perform epoll processing, possibly moving the connection back into
@@ -32,6 +32,226 @@
 #include "response.h"
 #include "reason_phrase.h"
 #include <gnutls/gnutls.h>
+#if KTLS_SUPPORT
+#include <linux/tls.h>
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
+
+#if KTLS_SUPPORT
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+/**
+ * Called by GnuTLS for TLS 1.3 key update messages received after
+ * we passed our record keys to the kernel.  A peer asking us to
+ * update our keys as well would need GnuTLS to send records, which
+ * it can no longer do, so we refuse and the connection fails.
+ *
+ * @param session the TLS session
+ * @param htype handshake message type (#GNUTLS_HANDSHAKE_KEY_UPDATE)
+ * @param when #GNUTLS_HOOK_PRE
+ * @param incoming non-zero for received messages
+ * @param msg body of the message
+ * @return 0 to continue, a GnuTLS error to fail the connection
+ */
+static int
+ktls_key_update_hook (gnutls_session_t session,
+                      unsigned int htype,
+                      unsigned when,
+                      unsigned int incoming,
+                      const gnutls_datum_t *msg)
+{
+  if (0 == incoming)
+    return 0;
+  /* the body is a single byte, the KeyUpdateRequest (RFC 8446,
+     4.6.3): 0 is 'update_not_requested', 1 'update_requested' */
+  if ( (NULL != msg) &&
+       (1 == msg->size) &&
+       (0 == msg->data[0]) )
+    return 0;
+  return GNUTLS_E_UNEXPECTED_HANDSHAKE_PACKET;
+}
+#endif
+
+
+/**
+ * Split the IV GnuTLS gives us into the salt and IV of a kernel
+ * crypto info.  For TLS 1.2 AES-GCM GnuTLS only has the implicit
+ * part (the salt), the explicit nonce is the record sequence number.
+ *
+ * @param iv IV from gnutls_record_get_state()
+ * @param seq record sequence number
+ * @param salt where to write the salt
+ * @param salt_size size of @a salt
+ * @param kiv where to write the IV
+ * @param kiv_size size of @a kiv
+ * @return #MHD_YES on success, #MHD_NO if the sizes do not fit
+ */
+static int
+split_iv (const gnutls_datum_t *iv,
+          const unsigned char *seq,
+          unsigned char *salt,
+          size_t salt_size,
+          unsigned char *kiv,
+          size_t kiv_size)
+{
+  if (iv->size == salt_size + kiv_size)
+    {
+      memcpy (salt, iv->data, salt_size);
+      memcpy (kiv, &iv->data[salt_size], kiv_size);
+      return MHD_YES;
+    }
+  if ( (iv->size == salt_size) &&
+       (8 == kiv_size) )
+    {
+      memcpy (salt, iv->data, salt_size);
+      memcpy (kiv, seq, kiv_size);
+      return MHD_YES;
+    }
+  return MHD_NO;
+}
+
+
+/**
+ * Hand the encryption of the records we send to the kernel
+ * (`TLS_TX`), so that response bodies from file descriptors can be
+ * sent with `sendfile()`.  Received records are still decrypted by
+ * GnuTLS.  If the kernel or the negotiated cipher do not support
+ * this, we simply continue to send with GnuTLS.
+ *
+ * @param connection connection that just completed its handshake
+ */
+static void
+enable_ktls (struct MHD_Connection *connection)
+{
+  union
+  {
+    struct tls12_crypto_info_aes_gcm_128 aes128;
+    struct tls12_crypto_info_aes_gcm_256 aes256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    struct tls12_crypto_info_chacha20_poly1305 chacha;
+#endif
+  } info;
+  struct MHD_Daemon *daemon = connection->daemon;
+  gnutls_session_t session = connection->tls_session;
+  gnutls_datum_t mac;
+  gnutls_datum_t iv;
+  gnutls_datum_t key;
+  unsigned char seq[8];
+  unsigned int version;
+  socklen_t len;
+  int ok;
+
+  switch (gnutls_protocol_get_version (session))
+    {
+    case GNUTLS_TLS1_2:
+      version = TLS_1_2_VERSION;
+      break;
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+    case GNUTLS_TLS1_3:
+      version = TLS_1_3_VERSION;
+      break;
+#endif
+    default:
+      return;
+    }
+  if (GNUTLS_E_SUCCESS !=
+      gnutls_record_get_state (session, 0, &mac, &iv, &key, seq))
+    return;
+  memset (&info, 0, sizeof (info));
+  ok = MHD_NO;
+  len = 0;
+  switch (gnutls_cipher_get (session))
+    {
+    case GNUTLS_CIPHER_AES_128_GCM:
+      info.aes128.info.version = version;
+      info.aes128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+      if ( (TLS_CIPHER_AES_GCM_128_KEY_SIZE == key.size) &&
+           (MHD_YES == (ok = split_iv (&iv, seq,
+                                       info.aes128.salt,
+                                       TLS_CIPHER_AES_GCM_128_SALT_SIZE,
+                                       info.aes128.iv,
+                                       TLS_CIPHER_AES_GCM_128_IV_SIZE))) )
+        {
+          memcpy (info.aes128.key, key.data, key.size);
+          memcpy (info.aes128.rec_seq, seq, sizeof (seq));
+          len = sizeof (info.aes128);
+        }
+      break;
+    case GNUTLS_CIPHER_AES_256_GCM:
+      info.aes256.info.version = version;
+      info.aes256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+      if ( (TLS_CIPHER_AES_GCM_256_KEY_SIZE == key.size) &&
+           (MHD_YES == (ok = split_iv (&iv, seq,
+                                       info.aes256.salt,
+                                       TLS_CIPHER_AES_GCM_256_SALT_SIZE,
+                                       info.aes256.iv,
+                                       TLS_CIPHER_AES_GCM_256_IV_SIZE))) )
+        {
+          memcpy (info.aes256.key, key.data, key.size);
+          memcpy (info.aes256.rec_seq, seq, sizeof (seq));
+          len = sizeof (info.aes256);
+        }
+      break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case GNUTLS_CIPHER_CHACHA20_POLY1305:
+      info.chacha.info.version = version;
+      info.chacha.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+      if ( (TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE == key.size) &&
+           (TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE == iv.size) )
+        {
+          ok = MHD_YES;
+          memcpy (info.chacha.key, key.data, key.size);
+          memcpy (info.chacha.iv, iv.data, iv.size);
+          memcpy (info.chacha.rec_seq, seq, sizeof (seq));
+          len = sizeof (info.chacha);
+        }
+      break;
+#endif
+    default:
+      break;
+    }
+  if (MHD_YES != ok)
+    return;
+  if (0 != setsockopt (connection->socket_fd, IPPROTO_TCP, TCP_ULP,
+                       "tls", sizeof ("tls")))
+    {
+      /* no 'tls' module, do not try again for every connection;
+         handshakes may run in several threads at once */
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Kernel TLS is not available, using GnuTLS: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+#if HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+      (void) __sync_fetch_and_and (&daemon->https_ktls, 0);
+#else
+      daemon->https_ktls = 0;
+#endif
+      memset (&info, 0, sizeof (info));
+      return;
+    }
+  /* if this fails (i.e. cipher not supported by the kernel), the
+     socket continues to work as before */
+  if (0 == setsockopt (connection->socket_fd, SOL_TLS, TLS_TX,
+                       &info, len))
+    {
+      connection->tls_ktls = MHD_YES;
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+      gnutls_handshake_set_hook_function (session,
+                                          GNUTLS_HANDSHAKE_KEY_UPDATE,
+                                          GNUTLS_HOOK_PRE,
+                                          &ktls_key_update_hook);
+#endif
+    }
+  memset (&info, 0, sizeof (info));
+}
+#endif
+
 
 
 /**
@@ -47,12 +267,31 @@ run_tls_handshake (struct MHD_Connection *connection)
 {
   int ret;
 
-  connection->last_activity = MHD_monotonic_time();
+  connection->last_activity = MHD_monotonic_time_ms ();
   if (connection->state == MHD_TLS_CONNECTION_INIT)
     {
-      ret = gnutls_handshake (connection->tls_session);
+      if (MHD_YES == connection->tls_handshake_offloaded)
+        {
+          /* back from a handshake thread; if it needs more data,
+             wait for the socket before offloading again */
+          connection->tls_handshake_offloaded = MHD_NO;
+          ret = connection->tls_handshake_result;
+        }
+      else if ( (NULL != connection->daemon->tls_handshake_pool) &&
+                (MHD_YES == MHD_tls_handshake_offload_ (connection)) )
+        return MHD_YES;
+      else
+        ret = gnutls_handshake (connection->tls_session);
       if (ret == GNUTLS_E_SUCCESS)
 	{
+	  if (gnutls_session_is_resumed (connection->tls_session))
+	    MHD_STATS_INC_ (connection->daemon, tls_handshakes_resumed);
+	  else
+	    MHD_STATS_INC_ (connection->daemon, tls_handshakes_full);
+#if KTLS_SUPPORT
+	  if (0 != connection->daemon->https_ktls)
+	    enable_ktls (connection);
+#endif
 	  /* set connection state to enable HTTP processing */
 	  connection->state = MHD_CONNECTION_INIT;
 	  return MHD_YES;
@@ -131,7 +370,7 @@ MHD_tls_connection_handle_write (struct MHD_Connection *connection)
 static int
 MHD_tls_connection_handle_idle (struct MHD_Connection *connection)
 {
-  unsigned int timeout;
+  uint64_t timeout;
 
 #if DEBUG_STATES
   MHD_DLOG (connection->daemon,
@@ -139,10 +378,20 @@ MHD_tls_connection_handle_idle (struct MHD_Connection *connection)
             __FUNCTION__,
             MHD_state_to_string (connection->state));
 #endif
+  if (MHD_YES == connection->tls_handshake_offloaded)
+    {
+      /* a handshake thread still owns the connection */
+      if (MHD_YES == connection->suspended)
+        return MHD_YES;
+      run_tls_handshake (connection);
+    }
   timeout = connection->connection_timeout;
-  if ( (timeout != 0) && (timeout <= (MHD_monotonic_time() - connection->last_activity)))
-    MHD_connection_close (connection,
-			  MHD_REQUEST_TERMINATED_TIMEOUT_REACHED);
+  if ( (timeout != 0) && (timeout <= (MHD_monotonic_time_ms () - connection->last_activity)))
+    {
+      MHD_STATS_INC_ (connection->daemon, timeouts);
+      MHD_connection_close (connection,
+                            MHD_REQUEST_TERMINATED_TIMEOUT_REACHED);
+    }
   switch (connection->state)
     {
       /* on newly created connections we might reach here before any reply has been received */
@@ -150,7 +399,9 @@ MHD_tls_connection_handle_idle (struct MHD_Connection *connection)
       break;
       /* close connection if necessary */
     case MHD_CONNECTION_CLOSED:
-      gnutls_bye (connection->tls_session, GNUTLS_SHUT_RDWR);
+      /* with kernel TLS, GnuTLS no longer knows our record sequence */
+      if (MHD_YES != connection->tls_ktls)
+        gnutls_bye (connection->tls_session, GNUTLS_SHUT_RDWR);
       return MHD_connection_handle_idle (connection);
     default:
       if ( (0 != gnutls_record_check_pending (connection->tls_session)) &&
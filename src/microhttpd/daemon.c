@@ -36,16 +36,14 @@
 #include "response.h"
 #include "connection.h"
 #include "memorypool.h"
+#include "timerwheel.h"
+#include "uring.h"
+#include "latency.h"
 #include <limits.h>
 
-#if HAVE_SEARCH_H
-#include <search.h>
-#else
-#include "tsearch.h"
-#endif
-
 #if HTTPS_SUPPORT
 #include "connection_https.h"
+#include "tlscache.h"
 #include <gcrypt.h>
 #endif
 
@@ -57,6 +55,10 @@
 #include <sys/sendfile.h>
 #endif
 
+#ifdef HAVE_LINUX_FILTER_H
+#include <linux/filter.h>
+#endif
+
 #ifdef _WIN32
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN 1
@@ -107,6 +109,10 @@
 #endif
 #endif
 
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
 #ifndef SOCK_CLOEXEC
 #define SOCK_CLOEXEC 0
 #endif
@@ -115,6 +121,23 @@
 #define EPOLL_CLOEXEC 0
 #endif
 
+#ifndef SO_REUSEPORT
+#ifdef LINUX
+/* Supported since Linux 3.9, but often not present (or commented out)
+   in the headers at this time; but 15 is reserved for this and
+   thus should be safe to use. */
+#define SO_REUSEPORT 15
+#endif
+#endif
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#ifdef LINUX
+/* Supported since Linux 4.5; the value is reserved for this
+   on all architectures. */
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#endif
+
 
 /**
  * Default implementation of the panic function,
@@ -173,9 +196,103 @@ MHD_get_master (struct MHD_Daemon *daemon)
 
 
 /**
- * Maintain connection count for single address.
+ * Number of shards of the per-IP connection count table.  Each
+ * shard has its own lock, which is only taken when an address is
+ * not yet in the table (or the kernel lacks atomic operations).
+ */
+#define MHD_IP_SHARDS 16
+
+/**
+ * Minimum number of slots per shard.
+ */
+#define MHD_IP_SHARD_MIN 16
+
+/**
+ * Maximum number of slots of the whole table; as each slot is for
+ * an address with connections, the table is still big enough for
+ * any realistic number of clients connected at the same time.
+ */
+#define MHD_IP_TABLE_MAX (1U << 18)
+
+/**
+ * Bits of `state` of a `struct MHD_IPCount` used for the counter.
+ * No address can have more than 2^20 - 1 (about a million)
+ * connections at the same time.
+ */
+#define MHD_IP_COUNT_BITS 20
+
+/**
+ * Mask for the counter in `state`.
+ */
+#define MHD_IP_COUNT_MASK ((1U << MHD_IP_COUNT_BITS) - 1)
+
+/**
+ * Bit of `state` that is set while the address of the slot is
+ * moved to another slot; the count may then only be changed
+ * with the lock of the shard.
+ */
+#define MHD_IP_MOVING (1U << MHD_IP_COUNT_BITS)
+
+/**
+ * Increment of the generation in the remaining bits of `state`,
+ * which changes whenever the slot is emptied or filled.
+ */
+#define MHD_IP_GENERATION (MHD_IP_MOVING << 1)
+
+/**
+ * Returned by #MHD_ip_slot_increment() if the slot does not hold
+ * the address (anymore).
+ */
+#define MHD_IP_SLOT_STALE -1
+
+
+/**
+ * Slot of the table with the connection counts per address.
  */
 struct MHD_IPCount
+{
+  /**
+   * Generation (upper bits), #MHD_IP_MOVING and number of
+   * connections (lower #MHD_IP_COUNT_BITS).  Only changed with
+   * compare-and-swap.  Once the count drops to zero, the slot is
+   * emptied (under the lock of the shard).
+   */
+  volatile unsigned int state;
+
+  /**
+   * Address family. AF_INET or AF_INET6 for now; 0 if the slot
+   * is empty (which ends a probe sequence).
+   */
+  int family;
+
+  /**
+   * Hash of the address, see `struct MHD_IPKey`.
+   */
+  uint32_t hash;
+
+  /**
+   * Actual address.
+   */
+  union
+  {
+    /**
+     * IPv4 address.
+     */
+    struct in_addr ipv4;
+#if HAVE_INET6
+    /**
+     * IPv6 address.
+     */
+    struct in6_addr ipv6;
+#endif
+  } addr;
+};
+
+
+/**
+ * Parsed address, used as the key to the table.
+ */
+struct MHD_IPKey
 {
   /**
    * Address family. AF_INET or AF_INET6 for now.
@@ -200,95 +317,198 @@ struct MHD_IPCount
   } addr;
 
   /**
-   * Counter.
+   * Hash of the address.
    */
-  unsigned int count;
+  uint32_t hash;
 };
 
 
 /**
- * Lock shared structure for IP connection counts and connection DLLs.
+ * Parse address and initialize 'key' using the address.
  *
- * @param daemon handle to daemon where lock is
+ * @param daemon master daemon (for the hash seed)
+ * @param addr address to parse
+ * @param addrlen number of bytes in addr
+ * @param key where to store the parsed address
+ * @return #MHD_YES on success and #MHD_NO otherwise (e.g., invalid address type)
  */
-static void
-MHD_ip_count_lock (struct MHD_Daemon *daemon)
+static int
+MHD_ip_addr_to_key (const struct MHD_Daemon *daemon,
+                    const struct sockaddr *addr,
+		    socklen_t addrlen,
+		    struct MHD_IPKey *key)
 {
-  if (MHD_YES != MHD_mutex_lock_(&daemon->per_ip_connection_mutex))
+  const unsigned char *pos;
+  uint32_t hash;
+  size_t i;
+
+  memset(key, 0, sizeof(*key));
+
+  /* IPv4 addresses */
+  if (sizeof (struct sockaddr_in) == addrlen)
     {
-      MHD_PANIC ("Failed to acquire IP connection limit mutex\n");
+      const struct sockaddr_in *addr4 = (const struct sockaddr_in*) addr;
+      key->family = AF_INET;
+      memcpy (&key->addr.ipv4, &addr4->sin_addr, sizeof(addr4->sin_addr));
+    }
+#if HAVE_INET6
+  /* IPv6 addresses */
+  else if (sizeof (struct sockaddr_in6) == addrlen)
+    {
+      const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6*) addr;
+      key->family = AF_INET6;
+      memcpy (&key->addr.ipv6, &addr6->sin6_addr, sizeof(addr6->sin6_addr));
+    }
+#endif
+  else
+    {
+      /* Some other address */
+      return MHD_NO;
+    }
+  /* FNV-1a, seeded per daemon so that clients cannot pick
+     addresses that all end up in the same probe sequence */
+  hash = 2166136261U ^ daemon->per_ip_seed;
+  pos = (const unsigned char *) &key->addr;
+  for (i = 0; i < sizeof (key->addr); i++)
+    {
+      hash ^= pos[i];
+      hash *= 16777619U;
     }
+  key->hash = hash ^ (uint32_t) key->family;
+  return MHD_YES;
 }
 
 
 /**
- * Unlock shared structure for IP connection counts and connection DLLs.
+ * Check if the slot holds the address of @a key.
  *
- * @param daemon handle to daemon where lock is
+ * @param slot slot to check
+ * @param key address to look for
+ * @return non-zero if the addresses match
  */
-static void
-MHD_ip_count_unlock (struct MHD_Daemon *daemon)
+static int
+MHD_ip_slot_matches (const struct MHD_IPCount *slot,
+                     const struct MHD_IPKey *key)
 {
-  if (MHD_YES != MHD_mutex_unlock_(&daemon->per_ip_connection_mutex))
-    {
-      MHD_PANIC ("Failed to release IP connection limit mutex\n");
-    }
+  return (slot->family == key->family) &&
+    (0 == memcmp (&slot->addr, &key->addr, sizeof (key->addr)));
 }
 
 
 /**
- * Tree comparison function for IP addresses (supplied to tsearch() family).
- * We compare everything in the struct up through the beginning of the
- * 'count' field.
+ * Atomically replace the state of a slot.
  *
- * @param a1 first address to compare
- * @param a2 second address to compare
- * @return -1, 0 or 1 depending on result of compare
+ * @param slot slot to update
+ * @param old expected current state
+ * @param val new state
+ * @return #MHD_YES if the state was @a old and is now @a val
  */
 static int
-MHD_ip_addr_compare (const void *a1, const void *a2)
+MHD_ip_slot_cas (struct MHD_IPCount *slot,
+                 unsigned int old,
+                 unsigned int val)
 {
-  return memcmp (a1, a2, offsetof (struct MHD_IPCount, count));
+#if HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  return __sync_bool_compare_and_swap (&slot->state, old, val) ? MHD_YES : MHD_NO;
+#else
+  /* only called with the lock of the shard held */
+  if (slot->state != old)
+    return MHD_NO;
+  slot->state = val;
+  return MHD_YES;
+#endif
 }
 
 
 /**
- * Parse address and initialize 'key' using the address.
+ * Read the state of a slot, ordered before any later reads.
  *
- * @param addr address to parse
- * @param addrlen number of bytes in addr
- * @param key where to store the parsed address
- * @return #MHD_YES on success and #MHD_NO otherwise (e.g., invalid address type)
+ * @param slot slot to read
+ * @return current state
  */
-static int
-MHD_ip_addr_to_key (const struct sockaddr *addr,
-		    socklen_t addrlen,
-		    struct MHD_IPCount *key)
+static unsigned int
+MHD_ip_slot_state (struct MHD_IPCount *slot)
 {
-  memset(key, 0, sizeof(*key));
+#if HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  return __sync_fetch_and_add (&slot->state, 0);
+#else
+  return slot->state;
+#endif
+}
 
-  /* IPv4 addresses */
-  if (sizeof (struct sockaddr_in) == addrlen)
+
+/**
+ * Lock a shard of the table of connection counts.
+ *
+ * @param daemon handle to daemon where lock is
+ * @param shard shard to lock
+ */
+static void
+MHD_ip_count_lock (struct MHD_Daemon *daemon,
+                   unsigned int shard)
+{
+  if (MHD_YES != MHD_mutex_lock_(&daemon->per_ip_locks[shard]))
     {
-      const struct sockaddr_in *addr4 = (const struct sockaddr_in*) addr;
-      key->family = AF_INET;
-      memcpy (&key->addr.ipv4, &addr4->sin_addr, sizeof(addr4->sin_addr));
-      return MHD_YES;
+      MHD_PANIC ("Failed to acquire IP connection limit mutex\n");
     }
+}
 
-#if HAVE_INET6
-  /* IPv6 addresses */
-  if (sizeof (struct sockaddr_in6) == addrlen)
+
+/**
+ * Unlock a shard of the table of connection counts.
+ *
+ * @param daemon handle to daemon where lock is
+ * @param shard shard to unlock
+ */
+static void
+MHD_ip_count_unlock (struct MHD_Daemon *daemon,
+                     unsigned int shard)
+{
+  if (MHD_YES != MHD_mutex_unlock_(&daemon->per_ip_locks[shard]))
     {
-      const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6*) addr;
-      key->family = AF_INET6;
-      memcpy (&key->addr.ipv6, &addr6->sin6_addr, sizeof(addr6->sin6_addr));
-      return MHD_YES;
+      MHD_PANIC ("Failed to release IP connection limit mutex\n");
     }
-#endif
+}
 
-  /* Some other address */
-  return MHD_NO;
+
+/**
+ * Try to take one more connection for the address in the slot.
+ *
+ * @param daemon daemon with the limit
+ * @param slot slot of the address
+ * @param key address, to check that the slot was not reused
+ * @param from_zero #MHD_YES if a count of zero may be incremented
+ *        (only with the lock of the shard held)
+ * @return #MHD_YES if below the limit (and incremented),
+ *         #MHD_NO if at the limit, #MHD_IP_SLOT_STALE if the slot
+ *         does not (or no longer) hold the address
+ */
+static int
+MHD_ip_slot_increment (struct MHD_Daemon *daemon,
+                       struct MHD_IPCount *slot,
+                       const struct MHD_IPKey *key,
+                       int from_zero)
+{
+  unsigned int state;
+
+  while (1)
+    {
+      state = MHD_ip_slot_state (slot);
+      /* the address may only change while the count is zero, and
+         the generation changes with it; so if the state is still
+         the same when we increment, the address was the one we
+         compared */
+      if ( ( (0 == (state & MHD_IP_COUNT_MASK)) &&
+             (MHD_YES != from_zero) ) ||
+           (0 != (state & MHD_IP_MOVING)) ||
+           (! MHD_ip_slot_matches (slot, key)) )
+        return MHD_IP_SLOT_STALE;
+      if ( ((state & MHD_IP_COUNT_MASK) >= daemon->per_ip_connection_limit) ||
+           ((state & MHD_IP_COUNT_MASK) == MHD_IP_COUNT_MASK) )
+        return MHD_NO;
+      if (MHD_YES == MHD_ip_slot_cas (slot, state, state + 1))
+        return MHD_YES;
+    }
 }
 
 
@@ -299,16 +519,21 @@ MHD_ip_addr_to_key (const struct sockaddr *addr,
  * @param addr address to add (or increment counter)
  * @param addrlen number of bytes in addr
  * @return Return #MHD_YES if IP below limit, #MHD_NO if IP has surpassed limit.
- *   Also returns #MHD_NO if fails to allocate memory.
+ *   Also returns #MHD_NO if the table is full.
  */
 static int
 MHD_ip_limit_add (struct MHD_Daemon *daemon,
 		  const struct sockaddr *addr,
 		  socklen_t addrlen)
 {
-  struct MHD_IPCount *key;
-  void **nodep;
-  void *node;
+  struct MHD_IPKey key;
+  struct MHD_IPCount *slots;
+  struct MHD_IPCount *slot;
+  unsigned int shard;
+  unsigned int mask;
+  unsigned int idx;
+  unsigned int i;
+  unsigned int state;
   int result;
 
   daemon = MHD_get_master (daemon);
@@ -316,50 +541,138 @@ MHD_ip_limit_add (struct MHD_Daemon *daemon,
   if (0 == daemon->per_ip_connection_limit)
     return MHD_YES;
 
-  if (NULL == (key = malloc (sizeof(*key))))
-    return MHD_NO;
-
   /* Initialize key */
-  if (MHD_NO == MHD_ip_addr_to_key (addr, addrlen, key))
+  if (MHD_NO == MHD_ip_addr_to_key (daemon, addr, addrlen, &key))
     {
       /* Allow unhandled address types through */
-      free (key);
       return MHD_YES;
     }
-  MHD_ip_count_lock (daemon);
+  shard = key.hash & (MHD_IP_SHARDS - 1);
+  mask = daemon->per_ip_shard_size - 1;
+  slots = &daemon->per_ip_slots[shard * daemon->per_ip_shard_size];
+  idx = (key.hash >> 8) & mask;
+
+#if HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  /* fast path: address already has connections */
+  for (i = 0; i <= mask; i++)
+    {
+      slot = &slots[(idx + i) & mask];
+      if (0 == slot->family)
+        break; /* end of the probe sequence, not in the table */
+      if (! MHD_ip_slot_matches (slot, &key))
+        continue;
+      result = MHD_ip_slot_increment (daemon, slot, &key, MHD_NO);
+      if (MHD_IP_SLOT_STALE != result)
+        return result;
+      break; /* slot is being emptied or moved */
+    }
+#endif
 
-  /* Search for the IP address */
-  if (NULL == (nodep = tsearch (key,
-				&daemon->per_ip_connection_count,
-				&MHD_ip_addr_compare)))
+  /* slow path: new address (or no atomics, or the slot of the
+     address is changing), look again and insert under the lock */
+  MHD_ip_count_lock (daemon, shard);
+  result = MHD_IP_SLOT_STALE;
+  for (i = 0; i <= mask; i++)
+    {
+      slot = &slots[(idx + i) & mask];
+      if (0 == slot->family)
+        {
+          /* bump the generation first, so that lookups that compared
+             the old address do not count the new one */
+          state = slot->state;
+          if (MHD_YES != MHD_ip_slot_cas (slot, state, state + MHD_IP_GENERATION))
+            MHD_PANIC ("Unused IP connection count slot changed\n");
+          slot->family = key.family;
+          slot->hash = key.hash;
+          memcpy (&slot->addr, &key.addr, sizeof (key.addr));
+          state += MHD_IP_GENERATION;
+          if (MHD_YES != MHD_ip_slot_cas (slot, state, state + 1))
+            MHD_PANIC ("Unused IP connection count slot changed\n");
+          result = MHD_YES;
+          break;
+        }
+      if (MHD_ip_slot_matches (slot, &key))
+        {
+          result = MHD_ip_slot_increment (daemon, slot, &key, MHD_YES);
+          break;
+        }
+    }
+  MHD_ip_count_unlock (daemon, shard);
+  if (MHD_IP_SLOT_STALE == result)
     {
 #if HAVE_MESSAGES
       MHD_DLOG (daemon,
 		"Failed to add IP connection count node\n");
 #endif
-      MHD_ip_count_unlock (daemon);
-      free (key);
-      return MHD_NO;
+      result = MHD_NO;
     }
-  node = *nodep;
-  /* If we got an existing node back, free the one we created */
-  if (node != key)
-    free(key);
-  key = (struct MHD_IPCount *) node;
-  /* Test if there is room for another connection; if so,
-   * increment count */
-  result = (key->count < daemon->per_ip_connection_limit);
-  if (MHD_YES == result)
-    ++key->count;
-
-  MHD_ip_count_unlock (daemon);
   return result;
 }
 
 
 /**
- * Decrement connection count for IP address, removing from table
- * count reaches 0.
+ * Empty a slot whose count dropped to zero.  Entries after it in
+ * the probe sequence that would no longer be found are moved back
+ * (backward-shift deletion), so that no probe sequence ever needs
+ * to skip unused slots.  Must be called with the lock of the shard.
+ *
+ * @param slots slots of the shard
+ * @param mask size of the shard minus one
+ * @param hole index of the slot to empty
+ */
+static void
+MHD_ip_shard_remove (struct MHD_IPCount *slots,
+                     unsigned int mask,
+                     unsigned int hole)
+{
+  struct MHD_IPCount *from;
+  struct MHD_IPCount *to;
+  unsigned int j;
+  unsigned int home;
+  unsigned int state;
+  unsigned int empty;
+
+  j = hole;
+  while (1)
+    {
+      j = (j + 1) & mask;
+      from = &slots[j];
+      if (0 == from->family)
+        break;
+      home = (from->hash >> 8) & mask;
+      /* the entry stays if its home slot is (cyclically) after
+         the hole and not after the entry itself */
+      if ( (hole <= j)
+           ? ( (hole < home) && (home <= j) )
+           : ( (hole < home) || (home <= j) ) )
+        continue;
+      /* lock-free updates of the count stop once they see
+         #MHD_IP_MOVING and wait for the lock instead */
+      do
+        state = MHD_ip_slot_state (from);
+      while (MHD_YES != MHD_ip_slot_cas (from, state, state | MHD_IP_MOVING));
+      to = &slots[hole];
+      to->family = from->family;
+      to->hash = from->hash;
+      memcpy (&to->addr, &from->addr, sizeof (from->addr));
+      empty = to->state;
+      if (MHD_YES != MHD_ip_slot_cas (to, empty,
+                                      empty + MHD_IP_GENERATION +
+                                      (state & MHD_IP_COUNT_MASK)))
+        MHD_PANIC ("Unused IP connection count slot changed\n");
+      if (MHD_YES != MHD_ip_slot_cas (from, state | MHD_IP_MOVING,
+                                      (state & ~MHD_IP_COUNT_MASK) +
+                                      MHD_IP_GENERATION))
+        MHD_PANIC ("Moved IP connection count slot changed\n");
+      hole = j;
+    }
+  slots[hole].family = 0;
+}
+
+
+/**
+ * Decrement connection count for IP address; the slot is emptied
+ * once the count reaches 0.
  *
  * @param daemon handle to daemon where connection counts are tracked
  * @param addr address to remove (or decrement counter)
@@ -370,49 +683,163 @@ MHD_ip_limit_del (struct MHD_Daemon *daemon,
 		  const struct sockaddr *addr,
 		  socklen_t addrlen)
 {
-  struct MHD_IPCount search_key;
-  struct MHD_IPCount *found_key;
-  void **nodep;
+  struct MHD_IPKey key;
+  struct MHD_IPCount *slots;
+  struct MHD_IPCount *slot;
+  unsigned int shard;
+  unsigned int mask;
+  unsigned int idx;
+  unsigned int i;
+  unsigned int state;
 
   daemon = MHD_get_master (daemon);
   /* Ignore if no connection limit assigned */
   if (0 == daemon->per_ip_connection_limit)
     return;
   /* Initialize search key */
-  if (MHD_NO == MHD_ip_addr_to_key (addr, addrlen, &search_key))
+  if (MHD_NO == MHD_ip_addr_to_key (daemon, addr, addrlen, &key))
     return;
+  shard = key.hash & (MHD_IP_SHARDS - 1);
+  mask = daemon->per_ip_shard_size - 1;
+  slots = &daemon->per_ip_slots[shard * daemon->per_ip_shard_size];
+  idx = (key.hash >> 8) & mask;
+
+#if HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  /* fast path: other connections of the address remain */
+  for (i = 0; i <= mask; i++)
+    {
+      slot = &slots[(idx + i) & mask];
+      if (0 == slot->family)
+        break;
+      if (! MHD_ip_slot_matches (slot, &key))
+        continue;
+      while (1)
+        {
+          state = MHD_ip_slot_state (slot);
+          if ( (0 != (state & MHD_IP_MOVING)) ||
+               ((state & MHD_IP_COUNT_MASK) <= 1) ||
+               (! MHD_ip_slot_matches (slot, &key)) )
+            break;
+          if (MHD_YES == MHD_ip_slot_cas (slot, state, state - 1))
+            return;
+        }
+      break;
+    }
+#endif
 
-  MHD_ip_count_lock (daemon);
-
-  /* Search for the IP address */
-  if (NULL == (nodep = tfind (&search_key,
-			      &daemon->per_ip_connection_count,
-			      &MHD_ip_addr_compare)))
+  /* slow path: last connection of the address (or no atomics, or
+     the slot is being moved); entries only move under the lock */
+  MHD_ip_count_lock (daemon, shard);
+  for (i = 0; i <= mask; i++)
     {
-      /* Something's wrong if we couldn't find an IP address
-       * that was previously added */
-      MHD_PANIC ("Failed to find previously-added IP address\n");
+      slot = &slots[(idx + i) & mask];
+      if (0 == slot->family)
+        break;
+      if (! MHD_ip_slot_matches (slot, &key))
+        continue;
+      do
+        {
+          state = MHD_ip_slot_state (slot);
+          /* Validate existing count for IP address */
+          if (0 == (state & MHD_IP_COUNT_MASK))
+            MHD_PANIC ("Previously-added IP address had 0 count\n");
+        }
+      while (MHD_YES !=
+             MHD_ip_slot_cas (slot, state,
+                              (1 == (state & MHD_IP_COUNT_MASK))
+                              ? (state & ~MHD_IP_COUNT_MASK) + MHD_IP_GENERATION
+                              : state - 1));
+      if (1 == (state & MHD_IP_COUNT_MASK))
+        MHD_ip_shard_remove (slots, mask, (idx + i) & mask);
+      MHD_ip_count_unlock (daemon, shard);
+      return;
     }
-  found_key = (struct MHD_IPCount *) *nodep;
-  /* Validate existing count for IP address */
-  if (0 == found_key->count)
+  /* Something's wrong if we couldn't find an IP address
+   * that was previously added */
+  MHD_PANIC ("Failed to find previously-added IP address\n");
+}
+
+
+/**
+ * Set up the table for the per-IP connection limit (if one was
+ * given).
+ *
+ * @param daemon master daemon
+ * @return #MHD_YES on success
+ */
+static int
+MHD_ip_limit_init (struct MHD_Daemon *daemon)
+{
+  unsigned int total;
+  unsigned int i;
+
+  if (0 == daemon->per_ip_connection_limit)
+    return MHD_YES;
+  /* every address in the table holds at least one connection,
+     keep the table at most half full */
+  daemon->per_ip_shard_size = MHD_IP_SHARD_MIN;
+  total = (daemon->connection_limit > MHD_IP_TABLE_MAX / 2)
+    ? MHD_IP_TABLE_MAX
+    : 2 * daemon->connection_limit;
+  while (daemon->per_ip_shard_size * MHD_IP_SHARDS < total)
+    daemon->per_ip_shard_size *= 2;
+  daemon->per_ip_slots = calloc (daemon->per_ip_shard_size * MHD_IP_SHARDS,
+                                 sizeof (struct MHD_IPCount));
+  daemon->per_ip_locks = malloc (MHD_IP_SHARDS * sizeof (MHD_mutex_));
+  if ( (NULL == daemon->per_ip_slots) ||
+       (NULL == daemon->per_ip_locks) )
     {
-      MHD_PANIC ("Previously-added IP address had 0 count\n");
+      free (daemon->per_ip_slots);
+      free (daemon->per_ip_locks);
+      daemon->per_ip_slots = NULL;
+      daemon->per_ip_locks = NULL;
+      return MHD_NO;
     }
-  /* Remove the node entirely if count reduces to 0 */
-  if (0 == --found_key->count)
+  for (i = 0; i < MHD_IP_SHARDS; i++)
     {
-      tdelete (found_key,
-	       &daemon->per_ip_connection_count,
-	       &MHD_ip_addr_compare);
-      free (found_key);
+      if (MHD_YES == MHD_mutex_create_ (&daemon->per_ip_locks[i]))
+        continue;
+      while (i > 0)
+        (void) MHD_mutex_destroy_ (&daemon->per_ip_locks[--i]);
+      free (daemon->per_ip_slots);
+      free (daemon->per_ip_locks);
+      daemon->per_ip_slots = NULL;
+      daemon->per_ip_locks = NULL;
+      return MHD_NO;
     }
+  daemon->per_ip_seed = (uint32_t) MHD_monotonic_time_ms () ^ (uint32_t) (uintptr_t) daemon;
+  return MHD_YES;
+}
+
+
+/**
+ * Release the table for the per-IP connection limit.
+ *
+ * @param daemon master daemon
+ */
+static void
+MHD_ip_limit_free (struct MHD_Daemon *daemon)
+{
+  unsigned int i;
 
-  MHD_ip_count_unlock (daemon);
+  if (NULL == daemon->per_ip_locks)
+    return;
+  for (i = 0; i < MHD_IP_SHARDS; i++)
+    (void) MHD_mutex_destroy_ (&daemon->per_ip_locks[i]);
+  free (daemon->per_ip_locks);
+  free (daemon->per_ip_slots);
+  daemon->per_ip_locks = NULL;
+  daemon->per_ip_slots = NULL;
 }
 
 
 #if HTTPS_SUPPORT
+static ssize_t
+send_param_adapter (struct MHD_Connection *connection,
+                    const void *other,
+		    size_t i);
+
+
 /**
  * Callback for receiving data from the socket.
  *
@@ -449,7 +876,10 @@ recv_tls_adapter (struct MHD_Connection *connection, void *other, size_t i)
       MHD_set_socket_errno_ (ECONNRESET);
       return res;
     }
-  if (res == i)
+  /* GnuTLS may hold (the rest of) a record that the socket will
+     not signal anymore; MHD_get_timeout() relies on this flag */
+  if ( (res == i) ||
+       (0 != gnutls_record_check_pending (connection->tls_session)) )
     {
       connection->tls_read_ready = MHD_YES;
       connection->daemon->num_tls_read_ready++;
@@ -472,6 +902,8 @@ send_tls_adapter (struct MHD_Connection *connection,
 {
   int res;
 
+  if (MHD_YES == connection->tls_ktls)
+    return send_param_adapter (connection, other, i);
   res = gnutls_record_send (connection->tls_session, other, i);
   if ( (GNUTLS_E_AGAIN == res) ||
        (GNUTLS_E_INTERRUPTED == res) )
@@ -568,13 +1000,17 @@ MHD_init_daemon_certificate (struct MHD_Daemon *daemon)
 static int
 MHD_TLS_init (struct MHD_Daemon *daemon)
 {
+  int ret;
+
   switch (daemon->cred_type)
     {
     case GNUTLS_CRD_CERTIFICATE:
       if (0 !=
           gnutls_certificate_allocate_credentials (&daemon->x509_cred))
         return GNUTLS_E_MEMORY_ERROR;
-      return MHD_init_daemon_certificate (daemon);
+      if (0 != (ret = MHD_init_daemon_certificate (daemon)))
+        return ret;
+      break;
     default:
 #if HAVE_MESSAGES
       MHD_DLOG (daemon,
@@ -583,6 +1019,21 @@ MHD_TLS_init (struct MHD_Daemon *daemon)
 #endif
       return -1;
     }
+  if ( (0 != daemon->tls_session_cache_size) &&
+       (NULL == (daemon->tls_session_cache =
+                 MHD_tls_session_cache_create_ (daemon->tls_session_cache_size))) )
+    return GNUTLS_E_MEMORY_ERROR;
+  if ( (0 != daemon->tls_ticket_lifetime) &&
+       (NULL == (daemon->tls_ticket_keys =
+                 MHD_tls_ticket_keys_create_ (daemon->tls_ticket_lifetime))) )
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Failed to create the TLS session ticket key\n");
+#endif
+      return -1;
+    }
+  return 0;
 }
 #endif
 
@@ -763,25 +1214,27 @@ MHD_handle_connection (void *data)
   MHD_socket max;
   struct timeval tv;
   struct timeval *tvp;
-  unsigned int timeout;
-  time_t now;
+  uint64_t timeout;
+  uint64_t now;
+  uint64_t left;
 #ifdef HAVE_POLL_H
   struct pollfd p[1];
 #endif
 
-  timeout = con->daemon->connection_timeout;
   while ( (MHD_YES != con->daemon->shutdown) &&
 	  (MHD_CONNECTION_CLOSED != con->state) )
     {
       tvp = NULL;
+      timeout = con->connection_timeout;
       if (timeout > 0)
 	{
-	  now = MHD_monotonic_time();
+	  now = MHD_monotonic_time_ms ();
 	  if (now - con->last_activity > timeout)
-	    tv.tv_sec = 0;
+	    left = 0;
 	  else
-	    tv.tv_sec = timeout - (now - con->last_activity);
-	  tv.tv_usec = 0;
+	    left = timeout - (now - con->last_activity);
+	  tv.tv_sec = left / 1000;
+	  tv.tv_usec = (left % 1000) * 1000;
 	  tvp = &tv;
 	}
 #if HTTPS_SUPPORT
@@ -887,7 +1340,7 @@ MHD_handle_connection (void *data)
 	      goto exit;
 	    }
 	  if (poll (p, 1,
-		    (NULL == tvp) ? -1 : tv.tv_sec * 1000) < 0)
+		    (NULL == tvp) ? -1 : tv.tv_sec * 1000 + tv.tv_usec / 1000) < 0)
 	    {
 	      if (EINTR == MHD_socket_errno_)
 		continue;
@@ -957,6 +1410,8 @@ recv_param_adapter (struct MHD_Connection *connection,
       return -1;
     }
   ret = recv (connection->socket_fd, other, i, MSG_NOSIGNAL);
+  if (ret > 0)
+    MHD_STATS_ADD_ (connection->daemon, bytes_received, ret);
 #if EPOLL_SUPPORT
   if (ret < (ssize_t) i)
     {
@@ -994,8 +1449,14 @@ send_param_adapter (struct MHD_Connection *connection,
       MHD_set_socket_errno_ (ENOTCONN);
       return -1;
     }
-  if (0 != (connection->daemon->options & MHD_USE_SSL))
-    return send (connection->socket_fd, other, i, MSG_NOSIGNAL);
+  if (! MHD_SENDS_PLAIN_ (connection))
+    {
+      /* TLS records from GnuTLS */
+      ret = send (connection->socket_fd, other, i, MSG_NOSIGNAL);
+      if (ret > 0)
+        MHD_STATS_ADD_ (connection->daemon, bytes_sent, ret);
+      return ret;
+    }
 #if LINUX
   if ( (connection->write_buffer_append_offset ==
 	connection->write_buffer_send_offset) &&
@@ -1012,6 +1473,7 @@ send_param_adapter (struct MHD_Connection *connection,
 				 &offset,
 				 (size_t) left)))
 	{
+          MHD_STATS_ADD_ (connection->daemon, bytes_sendfile, ret);
 #if EPOLL_SUPPORT
 	  if (ret < left)
 	    {
@@ -1033,6 +1495,8 @@ send_param_adapter (struct MHD_Connection *connection,
     }
 #endif
   ret = send (connection->socket_fd, other, i, MSG_NOSIGNAL);
+  if (ret > 0)
+    MHD_STATS_ADD_ (connection->daemon, bytes_sent, ret);
 #if EPOLL_SUPPORT
   if (ret < (ssize_t) i)
     {
@@ -1049,8 +1513,65 @@ send_param_adapter (struct MHD_Connection *connection,
 }
 
 
+#if HAVE_SENDMSG
 /**
- * Signature of main function for a thread.
+ * Callback for writing several buffers to the socket with a
+ * single system call.
+ *
+ * @param connection the MHD connection structure
+ * @param iov buffers to write
+ * @param iovcnt number of entries in @a iov
+ * @param more #MHD_YES if more data will follow right away, so
+ *        that the kernel may hold back a partial frame
+ * @return actual number of bytes written
+ */
+static ssize_t
+send_vec_param_adapter (struct MHD_Connection *connection,
+                        const struct iovec *iov,
+                        unsigned int iovcnt,
+                        int more)
+{
+  struct msghdr msg;
+  ssize_t ret;
+#if EPOLL_SUPPORT
+  size_t total;
+  unsigned int i;
+#endif
+
+  if ( (MHD_INVALID_SOCKET == connection->socket_fd) ||
+       (MHD_CONNECTION_CLOSED == connection->state) )
+    {
+      MHD_set_socket_errno_ (ENOTCONN);
+      return -1;
+    }
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = (struct iovec *) iov;
+  msg.msg_iovlen = iovcnt;
+  ret = sendmsg (connection->socket_fd,
+                 &msg,
+                 MSG_NOSIGNAL | ((MHD_YES == more) ? MSG_MORE : 0));
+  if (ret > 0)
+    MHD_STATS_ADD_ (connection->daemon, bytes_sent, ret);
+#if EPOLL_SUPPORT
+  total = 0;
+  for (i = 0; i < iovcnt; i++)
+    total += iov[i].iov_len;
+  if (ret < (ssize_t) total)
+    {
+      /* partial write --- no longer write-ready */
+      connection->epoll_state &= ~MHD_EPOLL_STATE_WRITE_READY;
+    }
+#endif
+  /* see send_param_adapter() */
+  if ( (-1 == ret) && (0 == errno) )
+    errno = ECONNRESET;
+  return ret;
+}
+#endif
+
+
+/**
+ * Signature of main function for a thread.
  *
  * @param cls closure argument for the function
  * @return termination code from the thread
@@ -1154,6 +1675,9 @@ internal_add_connection (struct MHD_Daemon *daemon,
   unsigned int i;
   int eno;
   struct MHD_Daemon *worker;
+  struct MemoryPool *pool;
+  struct sockaddr *cached_addr;
+  socklen_t cached_addr_len;
 #if OSX
   static int on = 1;
 #endif
@@ -1183,7 +1707,7 @@ internal_add_connection (struct MHD_Daemon *daemon,
 
 #ifndef WINDOWS
   if ( (client_socket >= FD_SETSIZE) &&
-       (0 == (daemon->options & (MHD_USE_POLL | MHD_USE_EPOLL_LINUX_ONLY))) )
+       (0 == (daemon->options & (MHD_USE_POLL | MHD_USE_EPOLL_LINUX_ONLY | MHD_USE_IO_URING))) )
     {
 #if HAVE_MESSAGES
       MHD_DLOG (daemon,
@@ -1254,22 +1778,54 @@ internal_add_connection (struct MHD_Daemon *daemon,
 #endif
 #endif
 
-  if (NULL == (connection = malloc (sizeof (struct MHD_Connection))))
+  /* try to recycle a connection object (with its memory pool) */
+  connection = NULL;
+  if (NULL != daemon->connection_cache_head)
     {
-      eno = errno;
+      if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
+           (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
+        MHD_PANIC ("Failed to acquire cleanup mutex\n");
+      if (NULL != (connection = daemon->connection_cache_head))
+        {
+          daemon->connection_cache_head = connection->next;
+          daemon->connection_cache_count--;
+        }
+      if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
+           (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
+        MHD_PANIC ("Failed to release cleanup mutex\n");
+    }
+  if (NULL != connection)
+    {
+      pool = connection->pool;
+      cached_addr = connection->addr;
+      cached_addr_len = connection->addr_len;
+      memset (connection, 0, sizeof (struct MHD_Connection));
+      connection->pool = pool;
+      if (cached_addr_len >= addrlen)
+        connection->addr = cached_addr;
+      else
+        free (cached_addr);
+    }
+  else
+    {
+      if (NULL == (connection = malloc (sizeof (struct MHD_Connection))))
+        {
+          eno = errno;
 #if HAVE_MESSAGES
-      MHD_DLOG (daemon,
-		"Error allocating memory: %s\n",
-		MHD_strerror_ (errno));
+          MHD_DLOG (daemon,
+                    "Error allocating memory: %s\n",
+                    MHD_strerror_ (errno));
 #endif
-      if (0 != MHD_socket_close_ (client_socket))
-	MHD_PANIC ("close failed\n");
-      MHD_ip_limit_del (daemon, addr, addrlen);
-      errno = eno;
-      return MHD_NO;
+          if (0 != MHD_socket_close_ (client_socket))
+            MHD_PANIC ("close failed\n");
+          MHD_ip_limit_del (daemon, addr, addrlen);
+          errno = eno;
+          return MHD_NO;
+        }
+      memset (connection, 0, sizeof (struct MHD_Connection));
     }
-  memset (connection, 0, sizeof (struct MHD_Connection));
-  connection->pool = MHD_pool_create (daemon->pool_size);
+  if (NULL == connection->pool)
+    connection->pool = MHD_pool_create (daemon->pool_size);
   if (NULL == connection->pool)
     {
 #if HAVE_MESSAGES
@@ -1280,6 +1836,8 @@ internal_add_connection (struct MHD_Daemon *daemon,
       if (0 != MHD_socket_close_ (client_socket))
 	MHD_PANIC ("close failed\n");
       MHD_ip_limit_del (daemon, addr, addrlen);
+      if (NULL != connection->addr)
+        free (connection->addr);
       free (connection);
 #if ENOMEM
       errno = ENOMEM;
@@ -1288,7 +1846,14 @@ internal_add_connection (struct MHD_Daemon *daemon,
     }
 
   connection->connection_timeout = daemon->connection_timeout;
-  if (NULL == (connection->addr = malloc (addrlen)))
+  if (NULL != daemon->latency)
+    {
+      connection->latency_stamps[MHD_LATENCY_STAMP_ACCEPTED] = MHD_monotonic_time_us ();
+      connection->latency_stamps[MHD_LATENCY_STAMP_IDLE]
+        = connection->latency_stamps[MHD_LATENCY_STAMP_ACCEPTED];
+    }
+  if ( (NULL == connection->addr) &&
+       (NULL == (connection->addr = malloc (addrlen))) )
     {
       eno = errno;
 #if HAVE_MESSAGES
@@ -1308,12 +1873,19 @@ internal_add_connection (struct MHD_Daemon *daemon,
   connection->addr_len = addrlen;
   connection->socket_fd = client_socket;
   connection->daemon = daemon;
-  connection->last_activity = MHD_monotonic_time();
+  connection->last_activity = MHD_monotonic_time_ms ();
 
   /* set default connection handlers  */
   MHD_set_http_callbacks_ (connection);
   connection->recv_cls = &recv_param_adapter;
+#if IO_URING_SUPPORT
+  if (0 != (daemon->options & MHD_USE_IO_URING))
+    connection->recv_cls = &MHD_uring_recv_;
+#endif
   connection->send_cls = &send_param_adapter;
+#if HAVE_SENDMSG
+  connection->sendv_cls = &send_vec_param_adapter;
+#endif
 
   if (0 == (connection->daemon->options & MHD_USE_EPOLL_TURBO))
     {
@@ -1356,6 +1928,9 @@ internal_add_connection (struct MHD_Daemon *daemon,
     {
       connection->recv_cls = &recv_tls_adapter;
       connection->send_cls = &send_tls_adapter;
+#if HAVE_SENDMSG
+      connection->sendv_cls = NULL;
+#endif
       connection->state = MHD_TLS_CONNECTION_INIT;
       MHD_set_https_callbacks (connection);
       gnutls_init (&connection->tls_session, GNUTLS_SERVER);
@@ -1386,6 +1961,18 @@ internal_add_connection (struct MHD_Daemon *daemon,
 #endif
  	  return MHD_NO;
         }
+      if (NULL != daemon->tls_session_cache)
+        MHD_tls_session_cache_setup_ (daemon->tls_session_cache,
+                                      connection->tls_session);
+      if ( (NULL != daemon->tls_ticket_keys) &&
+           (MHD_YES != MHD_tls_ticket_keys_setup_ (daemon->tls_ticket_keys,
+                                                   connection->tls_session)) )
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (connection->daemon,
+                    "Failed to enable TLS session tickets\n");
+#endif
+        }
       gnutls_transport_set_ptr (connection->tls_session,
 				(gnutls_transport_ptr_t) connection);
       gnutls_transport_set_pull_function (connection->tls_session,
@@ -1402,9 +1989,11 @@ internal_add_connection (struct MHD_Daemon *daemon,
   if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
        (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
     MHD_PANIC ("Failed to acquire cleanup mutex\n");
-  XDLL_insert (daemon->normal_timeout_head,
-	       daemon->normal_timeout_tail,
-	       connection);
+  if ( (0 == (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
+       (0 != connection->connection_timeout) )
+    MHD_timer_wheel_insert (&daemon->timer_wheel,
+                            connection,
+                            connection->last_activity + connection->connection_timeout);
   DLL_insert (daemon->connections_head,
 	      daemon->connections_tail,
 	      connection);
@@ -1471,8 +2060,20 @@ internal_add_connection (struct MHD_Daemon *daemon,
 		       connection);
 	}
     }
+#endif
+#if IO_URING_SUPPORT
+  if (0 != (daemon->options & MHD_USE_IO_URING))
+    {
+      /* the first round of processing will arm the operations */
+      connection->epoll_state |= MHD_EPOLL_STATE_READ_READY | MHD_EPOLL_STATE_WRITE_READY
+        | MHD_EPOLL_STATE_IN_EREADY_EDLL;
+      EDLL_insert (daemon->eready_head,
+                   daemon->eready_tail,
+                   connection);
+    }
 #endif
   daemon->connections++;
+  MHD_STATS_INC_ (daemon, connections_accepted);
   return MHD_YES;
  cleanup:
   if (0 != MHD_socket_close_ (client_socket))
@@ -1484,9 +2085,8 @@ internal_add_connection (struct MHD_Daemon *daemon,
   DLL_remove (daemon->connections_head,
 	      daemon->connections_tail,
 	      connection);
-  XDLL_remove (daemon->normal_timeout_head,
-	       daemon->normal_timeout_tail,
-	       connection);
+  MHD_timer_wheel_remove (&daemon->timer_wheel,
+                          connection);
   if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
        (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
     MHD_PANIC ("Failed to release cleanup mutex\n");
@@ -1501,40 +2101,15 @@ internal_add_connection (struct MHD_Daemon *daemon,
 
 
 /**
- * Suspend handling of network data for a given connection.  This can
- * be used to dequeue a connection from MHD's event loop (external
- * select, internal select or thread pool; not applicable to
- * thread-per-connection!) for a while.
- *
- * If you use this API in conjunction with a internal select or a
- * thread pool, you must set the option #MHD_USE_PIPE_FOR_SHUTDOWN to
- * ensure that a resumed connection is immediately processed by MHD.
- *
- * Suspended connections continue to count against the total number of
- * connections allowed (per daemon, as well as per IP, if such limits
- * are set).  Suspended connections will NOT time out; timeouts will
- * restart when the connection handling is resumed.  While a
- * connection is suspended, MHD will not detect disconnects by the
- * client.
- *
- * The only safe time to suspend a connection is from the
- * #MHD_AccessHandlerCallback.
- *
- * Finally, it is an API violation to call #MHD_stop_daemon while
- * having suspended connections (this will at least create memory and
- * socket leaks or lead to undefined behavior).  You must explicitly
- * resume all connections before stopping the daemon.
+ * Take @a connection out of the event loop of its daemon.
  *
  * @param connection the connection to suspend
  */
-void
-MHD_suspend_connection (struct MHD_Connection *connection)
+static void
+suspend_connection (struct MHD_Connection *connection)
 {
-  struct MHD_Daemon *daemon;
+  struct MHD_Daemon *daemon = connection->daemon;
 
-  daemon = connection->daemon;
-  if (MHD_USE_SUSPEND_RESUME != (daemon->options & MHD_USE_SUSPEND_RESUME))
-    MHD_PANIC ("Cannot suspend connections without enabling MHD_USE_SUSPEND_RESUME!\n");
   if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
        (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
     MHD_PANIC ("Failed to acquire cleanup mutex\n");
@@ -1544,16 +2119,10 @@ MHD_suspend_connection (struct MHD_Connection *connection)
   DLL_insert (daemon->suspended_connections_head,
               daemon->suspended_connections_tail,
               connection);
-  if (connection->connection_timeout == daemon->connection_timeout)
-    XDLL_remove (daemon->normal_timeout_head,
-                 daemon->normal_timeout_tail,
-                 connection);
-  else
-    XDLL_remove (daemon->manual_timeout_head,
-                 daemon->manual_timeout_tail,
-                 connection);
+  MHD_timer_wheel_remove (&daemon->timer_wheel,
+                          connection);
 #if EPOLL_SUPPORT
-  if (0 != (daemon->options & MHD_USE_EPOLL_LINUX_ONLY))
+  if (0 != (daemon->options & (MHD_USE_EPOLL_LINUX_ONLY | MHD_USE_IO_URING)))
     {
       if (0 != (connection->epoll_state & MHD_EPOLL_STATE_IN_EREADY_EDLL))
         {
@@ -1582,26 +2151,103 @@ MHD_suspend_connection (struct MHD_Connection *connection)
 
 
 /**
- * Resume handling of network data for suspended connection.  It is
- * safe to resume a suspended connection at any time.  Calling this function
- * on a connection that was not previously suspended will result
- * in undefined behavior.
+ * Suspend handling of network data for a given connection.  This can
+ * be used to dequeue a connection from MHD's event loop (external
+ * select, internal select or thread pool; not applicable to
+ * thread-per-connection!) for a while.
  *
- * @param connection the connection to resume
+ * If you use this API in conjunction with a internal select or a
+ * thread pool, you must set the option #MHD_USE_PIPE_FOR_SHUTDOWN to
+ * ensure that a resumed connection is immediately processed by MHD.
+ *
+ * Suspended connections continue to count against the total number of
+ * connections allowed (per daemon, as well as per IP, if such limits
+ * are set).  Suspended connections will NOT time out; timeouts will
+ * restart when the connection handling is resumed.  While a
+ * connection is suspended, MHD will not detect disconnects by the
+ * client.
+ *
+ * The only safe time to suspend a connection is from the
+ * #MHD_AccessHandlerCallback.
+ *
+ * Finally, it is an API violation to call #MHD_stop_daemon while
+ * having suspended connections (this will at least create memory and
+ * socket leaks or lead to undefined behavior).  You must explicitly
+ * resume all connections before stopping the daemon.
+ *
+ * @param connection the connection to suspend
  */
 void
-MHD_resume_connection (struct MHD_Connection *connection)
+MHD_suspend_connection (struct MHD_Connection *connection)
 {
   struct MHD_Daemon *daemon;
 
   daemon = connection->daemon;
+  if (MHD_USE_SUSPEND_RESUME != (daemon->options & MHD_USE_SUSPEND_RESUME))
+    MHD_PANIC ("Cannot suspend connections without enabling MHD_USE_SUSPEND_RESUME!\n");
+  /* the connection is not polled while suspended, give the client
+     what we already have for its earlier pipelined requests */
+  MHD_connection_flush_pipeline_ (connection);
+  suspend_connection (connection);
+  MHD_STATS_INC_ (daemon, suspended_connections);
+}
+
+
+/**
+ * Add a connection to the resume queue of its daemon.  The queue is a
+ * lock-free stack (if the compiler supports atomic compare-and-swap)
+ * onto which any number of threads may push, while only the thread
+ * running the event loop of the daemon takes connections off it.
+ *
+ * @param connection the connection to resume
+ * @return #MHD_YES if the queue was empty before and the daemon
+ *         must thus be woken up, #MHD_NO if a wake-up is
+ *         already pending (or the connection was already queued)
+ */
+static int
+enqueue_resume (struct MHD_Connection *connection)
+{
+  struct MHD_Daemon *daemon = connection->daemon;
+  struct MHD_Connection *head;
+
   if (MHD_USE_SUSPEND_RESUME != (daemon->options & MHD_USE_SUSPEND_RESUME))
     MHD_PANIC ("Cannot resume connections without enabling MHD_USE_SUSPEND_RESUME!\n");
-  if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
-       (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
+#if HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  if (! __sync_bool_compare_and_swap (&connection->resuming, MHD_NO, MHD_YES))
+    return MHD_NO;
+  do
+    {
+      head = daemon->resume_head;
+      connection->nextR = head;
+    }
+  while (! __sync_bool_compare_and_swap (&daemon->resume_head, head, connection));
+#else
+  if (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex))
     MHD_PANIC ("Failed to acquire cleanup mutex\n");
-  connection->resuming = MHD_YES;
-  daemon->resuming = MHD_YES;
+  if (MHD_YES == connection->resuming)
+    head = connection; /* already queued, no need to signal */
+  else
+    {
+      connection->resuming = MHD_YES;
+      head = daemon->resume_head;
+      connection->nextR = head;
+      daemon->resume_head = connection;
+    }
+  if (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex))
+    MHD_PANIC ("Failed to release cleanup mutex\n");
+#endif
+  return (NULL == head) ? MHD_YES : MHD_NO;
+}
+
+
+/**
+ * Wake up the event loop of a daemon to process resumed connections.
+ *
+ * @param daemon daemon to signal
+ */
+static void
+signal_resume (struct MHD_Daemon *daemon)
+{
   if ( (MHD_INVALID_PIPE_ != daemon->wpipe[1]) &&
        (1 != MHD_pipe_write_ (daemon->wpipe[1], "r", 1)) )
     {
@@ -1610,15 +2256,50 @@ MHD_resume_connection (struct MHD_Connection *connection)
                 "failed to signal resume via pipe");
 #endif
     }
-  if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
-       (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
-    MHD_PANIC ("Failed to release cleanup mutex\n");
 }
 
 
 /**
- * Run through the suspended connections and move any that are no
- * longer suspended back to the active state.
+ * Resume handling of network data for suspended connection.  It is
+ * safe to resume a suspended connection at any time.  Calling this function
+ * on a connection that was not previously suspended will result
+ * in undefined behavior.
+ *
+ * @param connection the connection to resume
+ */
+void
+MHD_resume_connection (struct MHD_Connection *connection)
+{
+  if (MHD_YES == enqueue_resume (connection))
+    signal_resume (connection->daemon);
+}
+
+
+/**
+ * Resume handling of network data for a set of suspended connections.
+ * Equivalent to calling #MHD_resume_connection() on each of them,
+ * except that the event loop of each daemon involved is only woken
+ * up once.
+ *
+ * @param connections array of connections to resume
+ * @param num_connections number of entries in @a connections
+ */
+void
+MHD_resume_connections (struct MHD_Connection *const *connections,
+                        unsigned int num_connections)
+{
+  unsigned int i;
+
+  for (i = 0; i < num_connections; i++)
+    if (MHD_YES == enqueue_resume (connections[i]))
+      signal_resume (connections[i]->daemon);
+}
+
+
+/**
+ * Move the connections from the resume queue of the daemon back to
+ * the active state.  Only the connections that were actually resumed
+ * are touched, not all suspended connections.
  *
  * @param daemon daemon context
  */
@@ -1626,37 +2307,48 @@ static void
 resume_suspended_connections (struct MHD_Daemon *daemon)
 {
   struct MHD_Connection *pos;
-  struct MHD_Connection *next = NULL;
+  struct MHD_Connection *next;
+  struct MHD_Connection *queue;
 
-  if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
-       (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
+  if (NULL == daemon->resume_head)
+    return;
+#if HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  do
+    queue = daemon->resume_head;
+  while (! __sync_bool_compare_and_swap (&daemon->resume_head, queue, NULL));
+#else
+  if (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex))
     MHD_PANIC ("Failed to acquire cleanup mutex\n");
-
-  if (MHD_YES == daemon->resuming)
-    next = daemon->suspended_connections_head;
+  queue = daemon->resume_head;
+  daemon->resume_head = NULL;
+  if (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex))
+    MHD_PANIC ("Failed to release cleanup mutex\n");
+#endif
+  /* the queue is LIFO, reverse it to resume in the order of requests */
+  next = NULL;
+  while (NULL != (pos = queue))
+    {
+      queue = pos->nextR;
+      pos->nextR = next;
+      next = pos;
+    }
 
   while (NULL != (pos = next))
     {
-      next = pos->next;
-      if (MHD_NO == pos->resuming)
-        continue;
-
+      next = pos->nextR;
+      pos->nextR = NULL;
       DLL_remove (daemon->suspended_connections_head,
                   daemon->suspended_connections_tail,
                   pos);
       DLL_insert (daemon->connections_head,
                   daemon->connections_tail,
                   pos);
-      if (pos->connection_timeout == daemon->connection_timeout)
-        XDLL_insert (daemon->normal_timeout_head,
-                     daemon->normal_timeout_tail,
-                     pos);
-      else
-        XDLL_insert (daemon->manual_timeout_head,
-                     daemon->manual_timeout_tail,
-                     pos);
+      if (0 != pos->connection_timeout)
+        MHD_timer_wheel_insert (&daemon->timer_wheel,
+                                pos,
+                                pos->last_activity + pos->connection_timeout);
 #if EPOLL_SUPPORT
-      if (0 != (daemon->options & MHD_USE_EPOLL_LINUX_ONLY))
+      if (0 != (daemon->options & (MHD_USE_EPOLL_LINUX_ONLY | MHD_USE_IO_URING)))
         {
           if (0 != (pos->epoll_state & MHD_EPOLL_STATE_IN_EREADY_EDLL))
             MHD_PANIC ("Resumed connection was already in EREADY set\n");
@@ -1671,14 +2363,313 @@ resume_suspended_connections (struct MHD_Daemon *daemon)
 #endif
       pos->suspended = MHD_NO;
       pos->resuming = MHD_NO;
+#if HTTPS_SUPPORT
+      /* back from a handshake thread, was not counted as suspended */
+      if (MHD_YES != pos->tls_handshake_offloaded)
+#endif
+        MHD_STATS_ADD_ (daemon, suspended_connections, -1);
     }
-  daemon->resuming = MHD_NO;
-  if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
-       (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
-    MHD_PANIC ("Failed to release cleanup mutex\n");
+}
+
+
+#if HTTPS_SUPPORT
+/**
+ * Threads that run TLS handshakes for the event loops of a daemon
+ * (see #MHD_OPTION_HTTPS_HANDSHAKE_THREADS).  A connection is
+ * suspended while it waits for and is processed by a handshake
+ * thread, which then resumes it like #MHD_resume_connection().
+ */
+struct MHD_TLS_HandshakePool
+{
+  /**
+   * Protects the queue, @e idle, @e shutdown and the statistics.
+   */
+  MHD_mutex_ lock;
+
+  /**
+   * Head of the queue of connections waiting for a handshake
+   * thread (linked via `nextH').
+   */
+  struct MHD_Connection *head;
+
+  /**
+   * Tail of the queue.
+   */
+  struct MHD_Connection *tail;
+
+  /**
+   * The handshake threads.
+   */
+  MHD_thread_handle_ *threads;
+
+  /**
+   * Number of threads in @e threads.
+   */
+  unsigned int num_threads;
+
+  /**
+   * Number of threads waiting for work on @e wpipe.
+   */
+  unsigned int idle;
+
+  /**
+   * Idle threads block reading from this pipe; each byte written
+   * to it wakes up one of them.
+   */
+  MHD_pipe wpipe[2];
+
+  /**
+   * Number of connections in the queue.
+   */
+  uint64_t queue_length;
+
+  /**
+   * Largest value @e queue_length ever had.
+   */
+  uint64_t queue_max;
+
+  /**
+   * #MHD_YES once the threads were told to terminate.
+   */
+  int shutdown;
+};
+
+
+/**
+ * Wake up one idle handshake thread.
+ *
+ * @param pool the handshake threads
+ */
+static void
+wake_handshake_thread (struct MHD_TLS_HandshakePool *pool)
+{
+  if (1 != MHD_pipe_write_ (pool->wpipe[1], "h", 1))
+    MHD_PANIC ("failed to wake up handshake thread via pipe\n");
 }
 
 
+/**
+ * Main function of a handshake thread: take connections off the
+ * queue, let GnuTLS process what the client sent and give the
+ * connections back to their event loops.
+ *
+ * @param cls the `struct MHD_TLS_HandshakePool`
+ * @return always 0
+ */
+static MHD_THRD_RTRN_TYPE_ MHD_THRD_CALL_SPEC_
+MHD_tls_handshake_thread (void *cls)
+{
+  struct MHD_TLS_HandshakePool *pool = cls;
+  struct MHD_Connection *pos;
+  char tmp;
+
+  while (1)
+    {
+      if (MHD_YES != MHD_mutex_lock_ (&pool->lock))
+        MHD_PANIC ("Failed to acquire handshake pool mutex\n");
+      if (MHD_YES == pool->shutdown)
+        {
+          if (MHD_YES != MHD_mutex_unlock_ (&pool->lock))
+            MHD_PANIC ("Failed to release handshake pool mutex\n");
+          break;
+        }
+      if (NULL != (pos = pool->head))
+        {
+          pool->head = pos->nextH;
+          if (NULL == pool->head)
+            pool->tail = NULL;
+          pos->nextH = NULL;
+          pool->queue_length--;
+        }
+      else
+        pool->idle++; /* whoever wakes us takes us off again */
+      if (MHD_YES != MHD_mutex_unlock_ (&pool->lock))
+        MHD_PANIC ("Failed to release handshake pool mutex\n");
+      if (NULL == pos)
+        {
+          (void) MHD_pipe_read_ (pool->wpipe[0], &tmp, sizeof (tmp));
+          continue;
+        }
+      pos->tls_handshake_result = gnutls_handshake (pos->tls_session);
+      MHD_resume_connection (pos);
+    }
+  return (MHD_THRD_RTRN_TYPE_) 0;
+}
+
+
+int
+MHD_tls_handshake_offload_ (struct MHD_Connection *connection)
+{
+  struct MHD_Daemon *daemon = connection->daemon;
+  struct MHD_TLS_HandshakePool *pool = daemon->tls_handshake_pool;
+  int wake;
+
+  if (MHD_YES != MHD_mutex_lock_ (&pool->lock))
+    MHD_PANIC ("Failed to acquire handshake pool mutex\n");
+  if (MHD_YES == pool->shutdown)
+    {
+      if (MHD_YES != MHD_mutex_unlock_ (&pool->lock))
+        MHD_PANIC ("Failed to release handshake pool mutex\n");
+      return MHD_NO;
+    }
+  /* suspend before a handshake thread can see the connection */
+  connection->tls_handshake_offloaded = MHD_YES;
+  suspend_connection (connection);
+  connection->nextH = NULL;
+  if (NULL == pool->tail)
+    pool->head = connection;
+  else
+    pool->tail->nextH = connection;
+  pool->tail = connection;
+  pool->queue_length++;
+  if (pool->queue_length > pool->queue_max)
+    pool->queue_max = pool->queue_length;
+  wake = MHD_NO;
+  if (pool->idle > 0)
+    {
+      pool->idle--;
+      wake = MHD_YES;
+    }
+  if (MHD_YES != MHD_mutex_unlock_ (&pool->lock))
+    MHD_PANIC ("Failed to release handshake pool mutex\n");
+  if (MHD_YES == wake)
+    wake_handshake_thread (pool);
+  MHD_STATS_INC_ (daemon, tls_handshakes_offloaded);
+  return MHD_YES;
+}
+
+
+/**
+ * Stop the handshake threads.  Connections still in the queue
+ * are given back to their event loops as if the handshake had
+ * not progressed.  Afterwards, #MHD_tls_handshake_offload_()
+ * refuses new connections.
+ *
+ * @param pool the handshake threads
+ */
+static void
+stop_handshake_pool (struct MHD_TLS_HandshakePool *pool)
+{
+  struct MHD_Connection *pos;
+  struct MHD_Connection *queue;
+  unsigned int idle;
+  unsigned int i;
+
+  if (MHD_YES != MHD_mutex_lock_ (&pool->lock))
+    MHD_PANIC ("Failed to acquire handshake pool mutex\n");
+  if (MHD_YES == pool->shutdown)
+    {
+      if (MHD_YES != MHD_mutex_unlock_ (&pool->lock))
+        MHD_PANIC ("Failed to release handshake pool mutex\n");
+      return;
+    }
+  pool->shutdown = MHD_YES;
+  idle = pool->idle;
+  pool->idle = 0;
+  queue = pool->head;
+  pool->head = NULL;
+  pool->tail = NULL;
+  pool->queue_length = 0;
+  if (MHD_YES != MHD_mutex_unlock_ (&pool->lock))
+    MHD_PANIC ("Failed to release handshake pool mutex\n");
+  for (i = 0; i < idle; i++)
+    wake_handshake_thread (pool);
+  for (i = 0; i < pool->num_threads; i++)
+    if (0 != MHD_join_thread_ (pool->threads[i]))
+      MHD_PANIC ("Failed to join a thread\n");
+  while (NULL != (pos = queue))
+    {
+      queue = pos->nextH;
+      pos->nextH = NULL;
+      pos->tls_handshake_result = GNUTLS_E_AGAIN;
+      MHD_resume_connection (pos);
+    }
+}
+
+
+/**
+ * Stop the handshake threads (if still running) and free them.
+ *
+ * @param pool the handshake threads, may be NULL
+ */
+static void
+destroy_handshake_pool (struct MHD_TLS_HandshakePool *pool)
+{
+  if (NULL == pool)
+    return;
+  stop_handshake_pool (pool);
+  if (0 != MHD_pipe_close_ (pool->wpipe[0]))
+    MHD_PANIC ("close failed\n");
+  if (0 != MHD_pipe_close_ (pool->wpipe[1]))
+    MHD_PANIC ("close failed\n");
+  (void) MHD_mutex_destroy_ (&pool->lock);
+  free (pool->threads);
+  free (pool);
+}
+
+
+/**
+ * Start the handshake threads of @a daemon.
+ *
+ * @param daemon daemon with #MHD_OPTION_HTTPS_HANDSHAKE_THREADS
+ * @return NULL on error
+ */
+static struct MHD_TLS_HandshakePool *
+create_handshake_pool (struct MHD_Daemon *daemon)
+{
+  struct MHD_TLS_HandshakePool *pool;
+  int res_thread_create;
+
+  if (NULL == (pool = malloc (sizeof (struct MHD_TLS_HandshakePool))))
+    return NULL;
+  memset (pool, 0, sizeof (struct MHD_TLS_HandshakePool));
+  if (NULL == (pool->threads = calloc (daemon->tls_handshake_threads,
+                                       sizeof (MHD_thread_handle_))))
+    {
+      free (pool);
+      return NULL;
+    }
+  if (MHD_YES != MHD_mutex_create_ (&pool->lock))
+    {
+      free (pool->threads);
+      free (pool);
+      return NULL;
+    }
+  if (0 != MHD_pipe_ (pool->wpipe))
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Failed to create handshake pool pipe: %s\n",
+                MHD_pipe_last_strerror_ ());
+#endif
+      (void) MHD_mutex_destroy_ (&pool->lock);
+      free (pool->threads);
+      free (pool);
+      return NULL;
+    }
+  while (pool->num_threads < daemon->tls_handshake_threads)
+    {
+      if (0 != (res_thread_create =
+                create_thread (&pool->threads[pool->num_threads],
+                               daemon,
+                               &MHD_tls_handshake_thread,
+                               pool)))
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (daemon,
+                    "Failed to create handshake thread: %s\n",
+                    MHD_strerror_ (res_thread_create));
+#endif
+          destroy_handshake_pool (pool);
+          return NULL;
+        }
+      pool->num_threads++;
+    }
+  return pool;
+}
+#endif
+
+
 /**
  * Change socket options to be non-blocking, non-inheritable.
  *
@@ -1770,12 +2761,17 @@ MHD_add_connection (struct MHD_Daemon *daemon,
 		    const struct sockaddr *addr,
 		    socklen_t addrlen)
 {
+  int ret;
+
   make_nonblocking_noninheritable (daemon,
 				   client_socket);
-  return internal_add_connection (daemon,
-				  client_socket,
-				  addr, addrlen,
-				  MHD_YES);
+  ret = internal_add_connection (daemon,
+                                 client_socket,
+                                 addr, addrlen,
+                                 MHD_YES);
+  if (MHD_NO == ret)
+    MHD_STATS_INC_ (daemon, connections_rejected);
+  return ret;
 }
 
 
@@ -1825,14 +2821,17 @@ MHD_accept_connection (struct MHD_Daemon *daemon)
 #endif
   if ((MHD_INVALID_SOCKET == s) || (addrlen <= 0))
     {
-#if HAVE_MESSAGES
       const int err = MHD_socket_errno_;
       /* This could be a common occurance with multiple worker threads */
       if ((EAGAIN != err) && (EWOULDBLOCK != err))
-        MHD_DLOG (daemon,
-		  "Error accepting connection: %s\n",
-		  MHD_socket_last_strerr_ ());
+        {
+          MHD_STATS_INC_ (daemon, accept_failures);
+#if HAVE_MESSAGES
+          MHD_DLOG (daemon,
+                    "Error accepting connection: %s\n",
+                    MHD_socket_last_strerr_ ());
 #endif
+        }
       if (MHD_INVALID_SOCKET != s)
         {
           if (0 != MHD_socket_close_ (s))
@@ -1851,9 +2850,10 @@ MHD_accept_connection (struct MHD_Daemon *daemon)
             s);
 #endif
 #endif
-  (void) internal_add_connection (daemon, s,
-				  addr, addrlen,
-				  MHD_NO);
+  if (MHD_NO == internal_add_connection (daemon, s,
+                                         addr, addrlen,
+                                         MHD_NO))
+    MHD_STATS_INC_ (daemon, connections_rejected);
   return MHD_YES;
 }
 
@@ -1878,6 +2878,21 @@ MHD_cleanup_connections (struct MHD_Daemon *daemon)
       DLL_remove (daemon->cleanup_head,
 		  daemon->cleanup_tail,
 		  pos);
+#if IO_URING_SUPPORT
+      if (NULL != daemon->uring)
+        {
+          if (0 != (pos->epoll_state & MHD_EPOLL_STATE_IN_EREADY_EDLL))
+            {
+              EDLL_remove (daemon->eready_head,
+                           daemon->eready_tail,
+                           pos);
+              pos->epoll_state &= ~MHD_EPOLL_STATE_IN_EREADY_EDLL;
+            }
+          /* the kernel may still write into the connection */
+          if (MHD_NO == MHD_uring_connection_release_ (pos))
+            continue;
+        }
+#endif
       if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
 	   (MHD_NO == pos->thread_joined) )
 	{
@@ -1886,7 +2901,6 @@ MHD_cleanup_connections (struct MHD_Daemon *daemon)
 	      MHD_PANIC ("Failed to join a thread\n");
 	    }
 	}
-      MHD_pool_destroy (pos->pool);
 #if HTTPS_SUPPORT
       if (pos->tls_session != NULL)
 	gnutls_deinit (pos->tls_session);
@@ -1925,6 +2939,11 @@ MHD_cleanup_connections (struct MHD_Daemon *daemon)
 	  MHD_destroy_response (pos->response);
 	  pos->response = NULL;
 	}
+      if (NULL != pos->pipeline_buffer)
+	{
+	  free (pos->pipeline_buffer);
+	  pos->pipeline_buffer = NULL;
+	}
       if (MHD_INVALID_SOCKET != pos->socket_fd)
 	{
 #ifdef WINDOWS
@@ -1933,10 +2952,28 @@ MHD_cleanup_connections (struct MHD_Daemon *daemon)
 	  if (0 != MHD_socket_close_ (pos->socket_fd))
 	    MHD_PANIC ("close failed\n");
 	}
+      daemon->connections--;
+      if ( (daemon->connection_cache_count < daemon->connection_cache_size) &&
+           (MHD_YES != daemon->shutdown) )
+        {
+          /* keep the object and its (emptied) pool for the next
+             connection instead of releasing the memory */
+          if (NULL != pos->pool)
+            {
+              (void) MHD_pool_reset (pos->pool, NULL, 0, 0);
+              if (0 != daemon->pool_release)
+                MHD_STATS_ADD_ (daemon, pool_bytes_released,
+                                MHD_pool_release_unused (pos->pool));
+            }
+          pos->next = daemon->connection_cache_head;
+          daemon->connection_cache_head = pos;
+          daemon->connection_cache_count++;
+          continue;
+        }
+      MHD_pool_destroy (pos->pool);
       if (NULL != pos->addr)
 	free (pos->addr);
       free (pos);
-      daemon->connections--;
     }
   if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
        (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
@@ -1962,10 +2999,8 @@ int
 MHD_get_timeout (struct MHD_Daemon *daemon,
 		 MHD_UNSIGNED_LONG_LONG *timeout)
 {
-  time_t earliest_deadline;
-  time_t now;
-  struct MHD_Connection *pos;
-  int have_timeout;
+  uint64_t earliest_deadline;
+  uint64_t now;
 
   if (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION))
     {
@@ -1980,56 +3015,70 @@ MHD_get_timeout (struct MHD_Daemon *daemon,
   if (0 != daemon->num_tls_read_ready)
     {
       /* if there is any TLS connection with data ready for
-	 reading, we must not block in the event loop */
+	 reading, we must not block in the event loop; as GnuTLS
+	 only buffers data in gnutls_record_recv(), the counter
+	 covers every connection for which
+	 gnutls_record_check_pending() would be non-zero */
       *timeout = 0;
       return MHD_YES;
     }
 #endif
 
-  have_timeout = MHD_NO;
-  earliest_deadline = 0; /* avoid compiler warnings */
-  for (pos = daemon->manual_timeout_head; NULL != pos; pos = pos->nextX)
-    {
-      if (0 != pos->connection_timeout)
-	{
-	  if ( (! have_timeout) ||
-	       (earliest_deadline > pos->last_activity + pos->connection_timeout) )
-	    earliest_deadline = pos->last_activity + pos->connection_timeout;
-#if HTTPS_SUPPORT
-	  if (  (0 != (daemon->options & MHD_USE_SSL)) &&
-		(0 != gnutls_record_check_pending (pos->tls_session)) )
-	    earliest_deadline = 0;
-#endif
-	  have_timeout = MHD_YES;
-	}
-    }
-  /* normal timeouts are sorted, so we only need to look at the 'head' */
-  pos = daemon->normal_timeout_head;
-  if ( (NULL != pos) &&
-       (0 != pos->connection_timeout) )
-    {
-      if ( (! have_timeout) ||
-	   (earliest_deadline > pos->last_activity + pos->connection_timeout) )
-	earliest_deadline = pos->last_activity + pos->connection_timeout;
-#if HTTPS_SUPPORT
-      if (  (0 != (daemon->options & MHD_USE_SSL)) &&
-	    (0 != gnutls_record_check_pending (pos->tls_session)) )
-	earliest_deadline = 0;
-#endif
-      have_timeout = MHD_YES;
-    }
-
-  if (MHD_NO == have_timeout)
+  if (MHD_NO == MHD_timer_wheel_next (&daemon->timer_wheel,
+                                      &earliest_deadline))
     return MHD_NO;
-  now = MHD_monotonic_time();
+  now = MHD_monotonic_time_ms ();
   if (earliest_deadline < now)
     *timeout = 0;
   else
-    *timeout = 1000 * (1 + earliest_deadline - now);
+    *timeout = earliest_deadline - now;
   return MHD_YES;
 }
 
 
+/**
+ * Process the connections whose timeout may have been reached
+ * according to the timer wheel.  Connections that saw activity since
+ * they were filed are re-filed under their new deadline; the others
+ * are passed to their idle handler, which closes them, and cleaned up.
+ *
+ * @param daemon daemon to process timeouts for
+ */
+static void
+process_timed_out_connections (struct MHD_Daemon *daemon)
+{
+  struct MHD_Connection *pos;
+  uint64_t now;
+
+  now = MHD_monotonic_time_ms ();
+  while (NULL != (pos = MHD_timer_wheel_pop_expired (&daemon->timer_wheel,
+                                                     now)))
+    {
+      if (0 == pos->connection_timeout)
+        continue;
+      if (pos->last_activity + pos->connection_timeout > now)
+        {
+          /* there was activity since, wait for the new deadline */
+          MHD_timer_wheel_insert (&daemon->timer_wheel,
+                                  pos,
+                                  pos->last_activity + pos->connection_timeout);
+          continue;
+        }
+      if (MHD_NO == pos->idle_handler (pos))
+        continue; /* connection is gone */
+      if (MHD_CONNECTION_CLOSED == pos->state)
+        {
+          /* closed due to the timeout, clean up right away */
+          (void) pos->idle_handler (pos);
+          continue;
+        }
+      MHD_timer_wheel_insert (&daemon->timer_wheel,
+                              pos,
+                              pos->last_activity + pos->connection_timeout);
+    }
+}
+
+
 /**
  * Run webserver operations. This method should be called by clients
  * in combination with #MHD_get_fdset if the client-controlled select
@@ -2120,6 +3169,7 @@ MHD_run_from_select (struct MHD_Daemon *daemon,
 	    }
 	  pos->idle_handler (pos);
         }
+      process_timed_out_connections (daemon);
     }
   MHD_cleanup_connections (daemon);
   return MHD_YES;
@@ -2364,6 +3414,7 @@ MHD_poll_all (struct MHD_Daemon *daemon,
 	 (0 != (p[poll_listen].revents & POLLIN)) )
       (void) MHD_accept_connection (daemon);
   }
+  process_timed_out_connections (daemon);
   return MHD_YES;
 }
 
@@ -2480,7 +3531,6 @@ MHD_epoll (struct MHD_Daemon *daemon,
 	   int may_block)
 {
   struct MHD_Connection *pos;
-  struct MHD_Connection *next;
   struct epoll_event events[MAX_EVENTS];
   struct epoll_event event;
   int timeout_ms;
@@ -2618,8 +3668,244 @@ MHD_epoll (struct MHD_Daemon *daemon,
 	}
     }
 
-  /* we handle resumes here because we may have ready connections
-     that will not be placed into the epoll list immediately. */
+  /* we handle resumes here because we may have ready connections
+     that will not be placed into the epoll list immediately. */
+  if (MHD_USE_SUSPEND_RESUME == (daemon->options & MHD_USE_SUSPEND_RESUME))
+    resume_suspended_connections (daemon);
+
+  /* process events for connections */
+  while (NULL != (pos = daemon->eready_tail))
+    {
+      EDLL_remove (daemon->eready_head,
+		   daemon->eready_tail,
+		   pos);
+      pos->epoll_state &= ~MHD_EPOLL_STATE_IN_EREADY_EDLL;
+      if (MHD_EVENT_LOOP_INFO_READ == pos->event_loop_info)
+	pos->read_handler (pos);
+      if (MHD_EVENT_LOOP_INFO_WRITE == pos->event_loop_info)
+	pos->write_handler (pos);
+      pos->idle_handler (pos);
+    }
+  /* Finally, handle timed-out connections; we need to do this here
+     as the epoll mechanism won't call the 'idle_handler' on everything,
+     as the other event loops do.  As timeouts do not get an explicit
+     event, the timer wheel tells us which connections might have
+     timed out. */
+  process_timed_out_connections (daemon);
+  return MHD_YES;
+}
+#endif
+
+
+#if IO_URING_SUPPORT
+/**
+ * Queue or cancel the accept operations on the listen socket, so
+ * that we accept as many connections as we may take on.
+ *
+ * @param daemon daemon to update
+ */
+static void
+uring_update_accepts (struct MHD_Daemon *daemon)
+{
+  struct MHD_Uring *ring = daemon->uring;
+  MHD_socket fd = daemon->socket_fd;
+  unsigned int armed;
+  unsigned int i;
+  int want;
+
+  if (MHD_YES == ring->accept_cancelling)
+    return; /* wait for the cancellation to complete first */
+  armed = 0;
+  for (i = 0; i < MHD_URING_ACCEPTS; i++)
+    if (MHD_YES == ring->accepts[i].armed)
+      armed++;
+  want = ( (MHD_INVALID_SOCKET != fd) &&
+           (MHD_NO == daemon->shutdown) &&
+           (daemon->connections < daemon->connection_limit) );
+  if ( (armed > 0) &&
+       ( (MHD_NO == want) ||
+         (ring->accept_fd != fd) ) )
+    {
+      /* at the connection limit or no longer listening */
+      for (i = 0; i < MHD_URING_ACCEPTS; i++)
+        if (MHD_YES == ring->accepts[i].armed)
+          (void) MHD_uring_prep_cancel_ (ring,
+                                         MHD_URING_ACCEPT_DATA (i));
+      ring->accept_cancelling = MHD_YES;
+      return;
+    }
+  if (MHD_NO == want)
+    return;
+  ring->accept_fd = fd;
+  for (i = 0; i < MHD_URING_ACCEPTS; i++)
+    {
+      if (armed >= daemon->connection_limit - daemon->connections)
+        break;
+      if (MHD_YES == ring->accepts[i].armed)
+        continue;
+      if (MHD_YES != MHD_uring_prep_accept_ (ring, fd, i))
+        break;
+      armed++;
+    }
+}
+
+
+/**
+ * Process all completions available on the ring of the daemon.
+ *
+ * @param daemon daemon to process completions for
+ */
+static void
+uring_dispatch (struct MHD_Daemon *daemon)
+{
+  struct MHD_Uring *ring = daemon->uring;
+  struct MHD_UringAccept *acc;
+  struct io_uring_cqe cqe;
+  enum MHD_UringTag tag;
+  unsigned int i;
+  char tmp[32];
+
+  while (MHD_YES == MHD_uring_next_cqe_ (ring, &cqe))
+    {
+      tag = (enum MHD_UringTag) (cqe.user_data & MHD_URING_TAG_MASK);
+      switch (tag)
+        {
+        case MHD_URING_TAG_CANCEL:
+          break;
+        case MHD_URING_TAG_ACCEPT:
+          acc = &ring->accepts[cqe.user_data >> 3];
+          acc->armed = MHD_NO;
+          if (cqe.res >= 0)
+            {
+              if (MHD_YES == daemon->shutdown)
+                {
+                  if (0 != MHD_socket_close_ (cqe.res))
+                    MHD_PANIC ("close failed\n");
+                }
+              else if (MHD_NO ==
+                       internal_add_connection (daemon,
+                                                cqe.res,
+                                                (const struct sockaddr *) &acc->addr,
+                                                acc->addrlen,
+                                                MHD_NO))
+                MHD_STATS_INC_ (daemon, connections_rejected);
+            }
+          else if ( (-ECANCELED != cqe.res) &&
+                    (-EAGAIN != cqe.res) &&
+                    (-EINTR != cqe.res) )
+            {
+              MHD_STATS_INC_ (daemon, accept_failures);
+#if HAVE_MESSAGES
+              MHD_DLOG (daemon,
+                        "Error accepting connection: %s\n",
+                        MHD_strerror_ (-cqe.res));
+#endif
+            }
+          if (MHD_YES == ring->accept_cancelling)
+            {
+              ring->accept_cancelling = MHD_NO;
+              for (i = 0; i < MHD_URING_ACCEPTS; i++)
+                if (MHD_YES == ring->accepts[i].armed)
+                  ring->accept_cancelling = MHD_YES;
+            }
+          break;
+        case MHD_URING_TAG_PIPE:
+          /* single shot; drained before it is armed again, so that
+             the next write is seen by the new poll */
+          ring->pipe_armed = MHD_NO;
+          if (cqe.res > 0)
+            while (0 < MHD_pipe_read_ (daemon->wpipe[0], tmp, sizeof (tmp)))
+              ;
+          break;
+        case MHD_URING_TAG_RECV:
+        case MHD_URING_TAG_POLLOUT:
+          MHD_uring_connection_complete_ ((struct MHD_Connection *)
+                                          (uintptr_t) (cqe.user_data & ~((uint64_t) MHD_URING_TAG_MASK)),
+                                          tag,
+                                          &cqe);
+          break;
+        }
+    }
+}
+
+
+/**
+ * Do io_uring-based processing (this function is allowed to
+ * block if @a may_block is set to #MHD_YES).
+ *
+ * @param daemon daemon to run the event loop for
+ * @param may_block #MHD_YES if blocking, #MHD_NO if non-blocking
+ * @return #MHD_NO on serious errors, #MHD_YES on success
+ */
+static int
+MHD_uring (struct MHD_Daemon *daemon,
+	   int may_block)
+{
+  struct MHD_Uring *ring = daemon->uring;
+  struct MHD_Connection *pos;
+  MHD_UNSIGNED_LONG_LONG timeout_ll;
+  int timeout_ms;
+
+  if (NULL == ring)
+    return MHD_NO; /* we're down! */
+  if (MHD_YES == daemon->shutdown)
+    return MHD_NO;
+  uring_update_accepts (daemon);
+  if ( (MHD_NO == ring->pipe_armed) &&
+       (MHD_INVALID_PIPE_ != daemon->wpipe[0]) )
+    {
+      /* the pipe is drained completely on each event */
+      if (MHD_NO == ring->pipe_nonblocking)
+        {
+          int fl = fcntl (daemon->wpipe[0], F_GETFL);
+
+          if ( (-1 != fl) &&
+               (0 == fcntl (daemon->wpipe[0], F_SETFL, fl | O_NONBLOCK)) )
+            ring->pipe_nonblocking = MHD_YES;
+        }
+      /* a multishot poll only fires when data arrives in an empty
+         pipe, so we could miss a write; a new single shot poll
+         completes right away if the pipe is not empty */
+      if ( (MHD_YES == ring->pipe_nonblocking) &&
+           (MHD_YES == MHD_uring_prep_poll_ (ring,
+                                             daemon->wpipe[0],
+                                             POLLIN,
+                                             MHD_NO,
+                                             MHD_URING_USER_DATA (daemon,
+                                                                  MHD_URING_TAG_PIPE))) )
+        ring->pipe_armed = MHD_YES;
+    }
+  /* never block if nobody can wake us up, or if we were told
+     to stop while we were busy */
+  if ( (MHD_YES == may_block) &&
+       (MHD_YES == ring->pipe_armed) &&
+       (MHD_YES != daemon->shutdown) &&
+       (NULL == daemon->eready_head) )
+    {
+      if (MHD_YES == MHD_get_timeout (daemon,
+				      &timeout_ll))
+	{
+	  if (timeout_ll >= (MHD_UNSIGNED_LONG_LONG) INT_MAX)
+	    timeout_ms = INT_MAX;
+	  else
+	    timeout_ms = (int) timeout_ll;
+	}
+      else
+	timeout_ms = -1;
+    }
+  else
+    timeout_ms = 0;
+  if (MHD_YES != MHD_uring_wait_ (ring, timeout_ms))
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Call to io_uring_enter failed: %s\n",
+                MHD_strerror_ (errno));
+#endif
+      return MHD_NO;
+    }
+  uring_dispatch (daemon);
+
   if (MHD_USE_SUSPEND_RESUME == (daemon->options & MHD_USE_SUSPEND_RESUME))
     resume_suspended_connections (daemon);
 
@@ -2636,33 +3922,54 @@ MHD_epoll (struct MHD_Daemon *daemon,
 	pos->write_handler (pos);
       pos->idle_handler (pos);
     }
-  /* Finally, handle timed-out connections; we need to do this here
-     as the epoll mechanism won't call the 'idle_handler' on everything,
-     as the other event loops do.  As timeouts do not get an explicit
-     event, we need to find those connections that might have timed out
-     here.
+  /* buffers were consumed, let waiting connections receive again */
+  MHD_uring_process_starved_ (daemon);
+  process_timed_out_connections (daemon);
+  return MHD_YES;
+}
 
-     Connections with custom timeouts must all be looked at, as we
-     do not bother to sort that (presumably very short) list. */
-  next = daemon->manual_timeout_head;
-  while (NULL != (pos = next))
-    {
-      next = pos->nextX;
-      pos->idle_handler (pos);
-    }
-  /* Connections with the default timeout are sorted by prepending
-     them to the head of the list whenever we touch the connection;
-     thus it sufficies to iterate from the tail until the first
-     connection is NOT timed out */
-  next = daemon->normal_timeout_tail;
-  while (NULL != (pos = next))
+
+/**
+ * Cancel all operations still pending on the ring of the daemon
+ * and wait for them to complete, so that the remaining connections
+ * can be freed and the ring destroyed.
+ *
+ * @param daemon daemon to shut down
+ */
+static void
+uring_drain (struct MHD_Daemon *daemon)
+{
+  struct MHD_Uring *ring = daemon->uring;
+  unsigned int rounds;
+  unsigned int i;
+  int busy;
+
+  for (i = 0; i < MHD_URING_ACCEPTS; i++)
+    if (MHD_YES == ring->accepts[i].armed)
+      (void) MHD_uring_prep_cancel_ (ring,
+                                     MHD_URING_ACCEPT_DATA (i));
+  if (MHD_YES == ring->pipe_armed)
+    (void) MHD_uring_prep_cancel_ (ring,
+                                   MHD_URING_USER_DATA (daemon,
+                                                        MHD_URING_TAG_PIPE));
+  for (rounds = 0; rounds < 50; rounds++)
     {
-      next = pos->prevX;
-      pos->idle_handler (pos);
-      if (MHD_CONNECTION_CLOSED != pos->state)
-	break; /* sorted by timeout, no need to visit the rest! */
+      busy = ( (NULL != daemon->uring_zombies_head) ||
+               (MHD_YES == ring->pipe_armed) ) ? MHD_YES : MHD_NO;
+      for (i = 0; i < MHD_URING_ACCEPTS; i++)
+        if (MHD_YES == ring->accepts[i].armed)
+          busy = MHD_YES;
+      if (MHD_NO == busy)
+        return;
+      if (MHD_YES != MHD_uring_wait_ (ring, 100))
+        break;
+      uring_dispatch (daemon);
+      MHD_cleanup_connections (daemon);
     }
-  return MHD_YES;
+#if HAVE_MESSAGES
+  MHD_DLOG (daemon,
+            "Failed to cancel pending io_uring operations\n");
+#endif
 }
 #endif
 
@@ -2714,6 +4021,48 @@ MHD_run (struct MHD_Daemon *daemon)
 }
 
 
+/**
+ * Accept the connections still queued on the own listen socket of
+ * a worker of the thread pool after #MHD_quiesce_daemon(), then
+ * close the socket.  Runs in the thread of the worker, so that the
+ * worker never waits on or accepts from a descriptor that was
+ * closed (and possibly reused) by another thread.
+ *
+ * @param daemon worker daemon
+ */
+static void
+close_quiesced_listen_socket (struct MHD_Daemon *daemon)
+{
+  MHD_socket fd = daemon->socket_fd;
+  unsigned int i;
+
+  daemon->quiesce_listen = MHD_NO;
+  if (MHD_INVALID_SOCKET == fd)
+    return;
+  /* closing the socket would reset the connections in its backlog */
+  for (i = 0; i < daemon->connection_limit; i++)
+    if ( (daemon->connections >= daemon->connection_limit) ||
+         (MHD_YES != MHD_accept_connection (daemon)) )
+      break;
+#if EPOLL_SUPPORT
+  if ( (0 != (daemon->options & MHD_USE_EPOLL_LINUX_ONLY)) &&
+       (-1 != daemon->epoll_fd) &&
+       (MHD_YES == daemon->listen_socket_in_epoll) )
+    {
+      if (0 != epoll_ctl (daemon->epoll_fd,
+                          EPOLL_CTL_DEL,
+                          fd,
+                          NULL))
+        MHD_PANIC ("Failed to remove listen FD from epoll set\n");
+      daemon->listen_socket_in_epoll = MHD_NO;
+    }
+#endif
+  daemon->socket_fd = MHD_INVALID_SOCKET;
+  if (0 != MHD_socket_close_ (fd))
+    MHD_PANIC ("close failed\n");
+}
+
+
 /**
  * Thread that runs the select loop until the daemon
  * is explicitly shut down.
@@ -2733,9 +4082,15 @@ MHD_select_thread (void *cls)
 #if EPOLL_SUPPORT
       else if (0 != (daemon->options & MHD_USE_EPOLL_LINUX_ONLY))
 	MHD_epoll (daemon, MHD_YES);
+#endif
+#if IO_URING_SUPPORT
+      else if (0 != (daemon->options & MHD_USE_IO_URING))
+	MHD_uring (daemon, MHD_YES);
 #endif
       else
 	MHD_select (daemon, MHD_YES);
+      if (MHD_YES == daemon->quiesce_listen)
+        close_quiesced_listen_socket (daemon);
       MHD_cleanup_connections (daemon);
     }
   return (MHD_THRD_RTRN_TYPE_)0;
@@ -2799,6 +4154,7 @@ MHD_quiesce_daemon (struct MHD_Daemon *daemon)
 {
   unsigned int i;
   MHD_socket ret;
+  MHD_socket fd;
 
   ret = daemon->socket_fd;
   if (MHD_INVALID_SOCKET == ret)
@@ -2816,20 +4172,37 @@ MHD_quiesce_daemon (struct MHD_Daemon *daemon)
   if (NULL != daemon->worker_pool)
     for (i = 0; i < daemon->worker_pool_size; i++)
       {
-	daemon->worker_pool[i].socket_fd = MHD_INVALID_SOCKET;
-#if EPOLL_SUPPORT
-	if ( (0 != (daemon->options & MHD_USE_EPOLL_LINUX_ONLY)) &&
-	     (-1 != daemon->worker_pool[i].epoll_fd) &&
-	     (MHD_YES == daemon->worker_pool[i].listen_socket_in_epoll) )
+	fd = daemon->worker_pool[i].socket_fd;
+	if ( (MHD_INVALID_SOCKET != fd) &&
+	     (ret != fd) )
 	  {
-	    if (0 != epoll_ctl (daemon->worker_pool[i].epoll_fd,
-				EPOLL_CTL_DEL,
-				ret,
-				NULL))
-	      MHD_PANIC ("Failed to remove listen FD from epoll set\n");
-	    daemon->worker_pool[i].listen_socket_in_epoll = MHD_NO;
+	    /* per-worker listen sockets are not returned to the
+	       caller; the worker may be waiting on (or about to
+	       accept from) its socket, so it closes it itself */
+	    daemon->worker_pool[i].quiesce_listen = MHD_YES;
 	  }
+	else
+	  {
+	    daemon->worker_pool[i].socket_fd = MHD_INVALID_SOCKET;
+#if EPOLL_SUPPORT
+	    if ( (0 != (daemon->options & MHD_USE_EPOLL_LINUX_ONLY)) &&
+		 (-1 != daemon->worker_pool[i].epoll_fd) &&
+		 (MHD_YES == daemon->worker_pool[i].listen_socket_in_epoll) )
+	      {
+		if (0 != epoll_ctl (daemon->worker_pool[i].epoll_fd,
+				    EPOLL_CTL_DEL,
+				    fd,
+				    NULL))
+		  MHD_PANIC ("Failed to remove listen FD from epoll set\n");
+		daemon->worker_pool[i].listen_socket_in_epoll = MHD_NO;
+	      }
 #endif
+	  }
+	/* wake up the worker; one byte per worker, as workers without
+	   #MHD_USE_SUSPEND_RESUME share the pipe of the master (with
+	   io_uring, the worker also cancels its accept operations) */
+	if (MHD_INVALID_PIPE_ != daemon->worker_pool[i].wpipe[1])
+	  (void) MHD_pipe_write_ (daemon->worker_pool[i].wpipe[1], "q", 1);
       }
   daemon->socket_fd = MHD_INVALID_SOCKET;
 #if EPOLL_SUPPORT
@@ -2844,6 +4217,11 @@ MHD_quiesce_daemon (struct MHD_Daemon *daemon)
 	MHD_PANIC ("Failed to remove listen FD from epoll set\n");
       daemon->listen_socket_in_epoll = MHD_NO;
     }
+#endif
+#if IO_URING_SUPPORT
+  if ( (0 != (daemon->options & MHD_USE_IO_URING)) &&
+       (NULL != daemon->uring) )
+    (void) MHD_pipe_write_ (daemon->wpipe[1], "q", 1);
 #endif
   return ret;
 }
@@ -2933,8 +4311,20 @@ parse_options_va (struct MHD_Daemon *daemon,
           daemon->connection_limit = va_arg (ap, unsigned int);
           break;
         case MHD_OPTION_CONNECTION_TIMEOUT:
+          daemon->connection_timeout = 1000 * (uint64_t) va_arg (ap, unsigned int);
+          break;
+        case MHD_OPTION_CONNECTION_TIMEOUT_MS:
           daemon->connection_timeout = va_arg (ap, unsigned int);
           break;
+        case MHD_OPTION_CONNECTION_CACHE_SIZE:
+          daemon->connection_cache_size = va_arg (ap, unsigned int);
+          break;
+        case MHD_OPTION_CONNECTION_MEMORY_RELEASE:
+          daemon->pool_release = va_arg (ap, unsigned int);
+          break;
+        case MHD_OPTION_LATENCY_HISTOGRAMS:
+          daemon->latency_histograms = va_arg (ap, unsigned int);
+          break;
         case MHD_OPTION_NOTIFY_COMPLETED:
           daemon->notify_completed =
             va_arg (ap, MHD_RequestCompletedCallback);
@@ -2997,6 +4387,56 @@ parse_options_va (struct MHD_Daemon *daemon,
 	case MHD_OPTION_HTTPS_CRED_TYPE:
 	  daemon->cred_type = (gnutls_credentials_type_t) va_arg (ap, int);
 	  break;
+        case MHD_OPTION_HTTPS_SESSION_TICKETS:
+	  if (0 != (daemon->options & MHD_USE_SSL))
+	    daemon->tls_ticket_lifetime = va_arg (ap, unsigned int);
+#if HAVE_MESSAGES
+	  else
+	    MHD_DLOG (daemon,
+		      "MHD HTTPS option %d passed to MHD but MHD_USE_SSL not set\n",
+		      opt);
+#endif
+          break;
+        case MHD_OPTION_HTTPS_SESSION_CACHE_SIZE:
+	  if (0 != (daemon->options & MHD_USE_SSL))
+	    daemon->tls_session_cache_size = va_arg (ap, unsigned int);
+#if HAVE_MESSAGES
+	  else
+	    MHD_DLOG (daemon,
+		      "MHD HTTPS option %d passed to MHD but MHD_USE_SSL not set\n",
+		      opt);
+#endif
+          break;
+        case MHD_OPTION_HTTPS_HANDSHAKE_THREADS:
+	  if (0 != (daemon->options & MHD_USE_SSL))
+	    daemon->tls_handshake_threads = va_arg (ap, unsigned int);
+#if HAVE_MESSAGES
+	  else
+	    MHD_DLOG (daemon,
+		      "MHD HTTPS option %d passed to MHD but MHD_USE_SSL not set\n",
+		      opt);
+#endif
+          break;
+        case MHD_OPTION_HTTPS_KTLS:
+	  if (0 != (daemon->options & MHD_USE_SSL))
+	    daemon->https_ktls = va_arg (ap, unsigned int);
+#if HAVE_MESSAGES
+	  else
+	    MHD_DLOG (daemon,
+		      "MHD HTTPS option %d passed to MHD but MHD_USE_SSL not set\n",
+		      opt);
+#endif
+#if ! KTLS_SUPPORT
+          if (0 != daemon->https_ktls)
+            {
+#if HAVE_MESSAGES
+              MHD_DLOG (daemon,
+                        "MHD_OPTION_HTTPS_KTLS is not supported by this build\n");
+#endif
+              daemon->https_ktls = 0;
+            }
+#endif
+          break;
         case MHD_OPTION_HTTPS_MEM_DHPARAMS:
           if (0 != (daemon->options & MHD_USE_SSL))
             {
@@ -3101,6 +4541,9 @@ parse_options_va (struct MHD_Daemon *daemon,
 	case MHD_OPTION_LISTENING_ADDRESS_REUSE:
 	  daemon->listening_address_reuse = va_arg (ap, unsigned int) ? 1 : -1;
 	  break;
+	case MHD_OPTION_THREAD_POOL_REUSEPORT:
+	  daemon->thread_pool_reuseport = va_arg (ap, unsigned int);
+	  break;
 	case MHD_OPTION_ARRAY:
 	  oa = va_arg (ap, struct MHD_OptionItem*);
 	  i = 0;
@@ -3123,10 +4566,19 @@ parse_options_va (struct MHD_Daemon *daemon,
 		case MHD_OPTION_NONCE_NC_SIZE:
 		case MHD_OPTION_CONNECTION_LIMIT:
 		case MHD_OPTION_CONNECTION_TIMEOUT:
+		case MHD_OPTION_CONNECTION_TIMEOUT_MS:
+		case MHD_OPTION_CONNECTION_CACHE_SIZE:
+		case MHD_OPTION_CONNECTION_MEMORY_RELEASE:
+		case MHD_OPTION_LATENCY_HISTOGRAMS:
+		case MHD_OPTION_HTTPS_KTLS:
+		case MHD_OPTION_HTTPS_SESSION_TICKETS:
+		case MHD_OPTION_HTTPS_SESSION_CACHE_SIZE:
+		case MHD_OPTION_HTTPS_HANDSHAKE_THREADS:
 		case MHD_OPTION_PER_IP_CONNECTION_LIMIT:
 		case MHD_OPTION_THREAD_POOL_SIZE:
                 case MHD_OPTION_TCP_FASTOPEN_QUEUE_SIZE:
 		case MHD_OPTION_LISTENING_ADDRESS_REUSE:
+		case MHD_OPTION_THREAD_POOL_REUSEPORT:
 		  if (MHD_YES != parse_options (daemon,
 						servaddr,
 						opt,
@@ -3217,42 +4669,253 @@ parse_options_va (struct MHD_Daemon *daemon,
 			opt);
             }
 #endif
-	  return MHD_NO;
-        }
+	  return MHD_NO;
+        }
+    }
+  return MHD_YES;
+}
+
+
+/**
+ * Create a listen socket, if possible with SOCK_CLOEXEC flag set.
+ *
+ * @param daemon daemon for which we create the socket
+ * @param domain socket domain (i.e. PF_INET)
+ * @param type socket type (usually SOCK_STREAM)
+ * @param protocol desired protocol, 0 for default
+ */
+static MHD_socket
+create_socket (struct MHD_Daemon *daemon,
+	       int domain, int type, int protocol)
+{
+  int ctype = type | SOCK_CLOEXEC;
+  MHD_socket fd;
+
+  /* use SOCK_STREAM rather than ai_socktype: some getaddrinfo
+   * implementations do not set ai_socktype, e.g. RHL6.2. */
+  fd = socket (domain, ctype, protocol);
+  if ( (MHD_INVALID_SOCKET == fd) && (EINVAL == MHD_socket_errno_) && (0 != SOCK_CLOEXEC) )
+  {
+    ctype = type;
+    fd = socket(domain, type, protocol);
+  }
+  if (MHD_INVALID_SOCKET == fd)
+    return MHD_INVALID_SOCKET;
+  if (type == ctype)
+    make_nonblocking_noninheritable (daemon, fd);
+  return fd;
+}
+
+
+#ifdef SO_REUSEPORT
+/**
+ * Create a listen socket for a worker of the thread pool that is
+ * bound to the same address as the listen socket of the master.
+ * Both sockets then form a SO_REUSEPORT group and the kernel
+ * distributes incoming connections among them, so that only one
+ * worker is woken up per connection.
+ *
+ * @param daemon master daemon
+ * @param master_fd listen socket of the master (with SO_REUSEPORT set)
+ * @return non-blocking listen socket for the worker,
+ *         #MHD_INVALID_SOCKET on error
+ */
+static MHD_socket
+create_worker_listen_socket (struct MHD_Daemon *daemon,
+                             MHD_socket master_fd)
+{
+  const int on = 1;
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+  MHD_socket fd;
+  int sk_flags;
+  int reuseaddr;
+  socklen_t optlen;
+
+  addrlen = sizeof (addr);
+  if (0 != getsockname (master_fd,
+                        (struct sockaddr *) &addr,
+                        &addrlen))
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Call to getsockname failed: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+      return MHD_INVALID_SOCKET;
+    }
+  fd = create_socket (daemon,
+                      addr.ss_family, SOCK_STREAM, 0);
+  if (MHD_INVALID_SOCKET == fd)
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Call to socket failed: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+      return MHD_INVALID_SOCKET;
+    }
+  if (0 > setsockopt (fd,
+                      SOL_SOCKET,
+                      SO_REUSEPORT,
+                      (void*)&on, sizeof (on)))
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "setsockopt failed: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+      goto fail;
+    }
+  /* use the same SO_REUSEADDR setting as the master socket */
+  optlen = sizeof (reuseaddr);
+  if ( (0 == getsockopt (master_fd,
+                         SOL_SOCKET, SO_REUSEADDR,
+                         &reuseaddr, &optlen)) &&
+       (0 != reuseaddr) &&
+       (0 > setsockopt (fd,
+                        SOL_SOCKET, SO_REUSEADDR,
+                        (void*)&on, sizeof (on))) )
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "setsockopt failed: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+    }
+#if HAVE_INET6 && defined(IPPROTO_IPV6) && defined(IPV6_V6ONLY)
+  if (AF_INET6 == addr.ss_family)
+    {
+      /* use the same dual-stack setting as the master socket */
+      int v6only;
+
+      optlen = sizeof (v6only);
+      if ( (0 == getsockopt (master_fd,
+                             IPPROTO_IPV6, IPV6_V6ONLY,
+                             &v6only, &optlen)) &&
+           (0 > setsockopt (fd,
+                            IPPROTO_IPV6, IPV6_V6ONLY,
+                            &v6only, optlen)) )
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (daemon,
+                    "setsockopt failed: %s\n",
+                    MHD_socket_last_strerr_ ());
+#endif
+        }
+    }
+#endif
+  if (-1 == bind (fd, (struct sockaddr *) &addr, addrlen))
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Failed to bind worker listen socket: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+      goto fail;
+    }
+#ifdef TCP_FASTOPEN
+  if ( (0 != (daemon->options & MHD_USE_TCP_FASTOPEN)) &&
+       (0 != setsockopt (fd,
+                         IPPROTO_TCP, TCP_FASTOPEN,
+                         &daemon->fastopen_queue_size,
+                         sizeof (daemon->fastopen_queue_size))) )
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "setsockopt failed: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+    }
+#endif
+  sk_flags = fcntl (fd, F_GETFL);
+  if ( (sk_flags < 0) ||
+       (0 != fcntl (fd, F_SETFL, sk_flags | O_NONBLOCK)) )
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Failed to make listen socket non-blocking: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+      goto fail;
+    }
+  if (listen (fd, 32) < 0)
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Failed to listen for connections: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+      goto fail;
+    }
+#ifndef WINDOWS
+  if ( (fd >= FD_SETSIZE) &&
+       (0 == (daemon->options & (MHD_USE_POLL | MHD_USE_EPOLL_LINUX_ONLY)) ) )
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Socket descriptor larger than FD_SETSIZE: %d > %d\n",
+                fd,
+                FD_SETSIZE);
+#endif
+      goto fail;
     }
-  return MHD_YES;
+#endif
+  return fd;
+
+ fail:
+  if (0 != MHD_socket_close_ (fd))
+    MHD_PANIC ("close failed\n");
+  return MHD_INVALID_SOCKET;
 }
+#endif
 
 
+#if defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
 /**
- * Create a listen socket, if possible with SOCK_CLOEXEC flag set.
+ * Attach a classic BPF program to the SO_REUSEPORT group of the
+ * thread pool that hands each new connection to the worker with
+ * the index "CPU that processed the SYN modulo pool size".  This
+ * keeps a connection on the CPU that received it if the workers
+ * (and the NIC queues) are pinned accordingly.
  *
- * @param daemon daemon for which we create the socket
- * @param domain socket domain (i.e. PF_INET)
- * @param type socket type (usually SOCK_STREAM)
- * @param protocol desired protocol, 0 for default
+ * @param daemon master daemon
+ * @param fd any listen socket of the group
+ * @param group_size number of sockets in the group
+ * @return #MHD_YES on success, #MHD_NO if the kernel refused the program
  */
-static MHD_socket
-create_socket (struct MHD_Daemon *daemon,
-	       int domain, int type, int protocol)
+static int
+attach_reuseport_cpu_steering (struct MHD_Daemon *daemon,
+                               MHD_socket fd,
+                               unsigned int group_size)
 {
-  int ctype = type | SOCK_CLOEXEC;
-  MHD_socket fd;
-
-  /* use SOCK_STREAM rather than ai_socktype: some getaddrinfo
-   * implementations do not set ai_socktype, e.g. RHL6.2. */
-  fd = socket (domain, ctype, protocol);
-  if ( (MHD_INVALID_SOCKET == fd) && (EINVAL == MHD_socket_errno_) && (0 != SOCK_CLOEXEC) )
-  {
-    ctype = type;
-    fd = socket(domain, type, protocol);
-  }
-  if (MHD_INVALID_SOCKET == fd)
-    return MHD_INVALID_SOCKET;
-  if (type == ctype)
-    make_nonblocking_noninheritable (daemon, fd);
-  return fd;
+  struct sock_filter code[] = {
+    /* A = number of the current CPU */
+    { BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+    /* A = A % group_size */
+    { BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size },
+    /* use A as index into the group */
+    { BPF_RET | BPF_A, 0, 0, 0 }
+  };
+  struct sock_fprog prog;
+
+  prog.len = sizeof (code) / sizeof (code[0]);
+  prog.filter = code;
+  if (0 != setsockopt (fd,
+                       SOL_SOCKET,
+                       SO_ATTACH_REUSEPORT_CBPF,
+                       &prog, sizeof (prog)))
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Failed to attach CPU steering program: %s\n",
+                MHD_socket_last_strerr_ ());
+#endif
+      return MHD_NO;
+    }
+  return MHD_YES;
 }
+#endif
 
 
 #if EPOLL_SUPPORT
@@ -3322,6 +4985,30 @@ setup_epoll_to_listen (struct MHD_Daemon *daemon)
 #endif
 
 
+#ifdef DAUTH_SUPPORT
+/**
+ * Release the nonce-nc map of a daemon (and its locks).
+ *
+ * @param daemon daemon to clean up
+ */
+static void
+free_nonce_nc (struct MHD_Daemon *daemon)
+{
+  unsigned int i;
+
+  if (NULL != daemon->nnc_locks)
+    {
+      for (i = 0; i < MHD_NONCE_NC_LOCKS; i++)
+        (void) MHD_mutex_destroy_ (&daemon->nnc_locks[i]);
+      free (daemon->nnc_locks);
+      daemon->nnc_locks = NULL;
+    }
+  free (daemon->nnc);
+  daemon->nnc = NULL;
+}
+#endif
+
+
 /**
  * Start a webserver on the given port.
  *
@@ -3412,12 +5099,44 @@ MHD_start_daemon_va (unsigned int flags,
   daemon->pool_increment = MHD_BUF_INC_SIZE;
   daemon->unescape_callback = &MHD_http_unescape;
   daemon->connection_timeout = 0;       /* no timeout */
+  MHD_timer_wheel_init (&daemon->timer_wheel,
+                        MHD_monotonic_time_ms ());
   daemon->wpipe[0] = MHD_INVALID_PIPE_;
   daemon->wpipe[1] = MHD_INVALID_PIPE_;
 #if HAVE_MESSAGES
   daemon->custom_error_log = (MHD_LogCallback) &vfprintf;
   daemon->custom_error_log_cls = stderr;
 #endif
+  if (0 != (flags & MHD_USE_IO_URING))
+    {
+      /* io_uring is an optimization; if it cannot be used, fall back
+         to epoll (or select) instead of failing */
+#if IO_URING_SUPPORT
+      if ( (0 != (flags & (MHD_USE_THREAD_PER_CONNECTION | MHD_USE_SSL | MHD_USE_POLL))) ||
+           (0 == (flags & MHD_USE_SELECT_INTERNALLY)) ||
+           (MHD_YES != MHD_uring_probe_ ()) )
+#endif
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (daemon,
+                    "io_uring cannot be used in this configuration, falling back\n");
+#endif
+          flags &= ~MHD_USE_IO_URING;
+#if EPOLL_SUPPORT
+          if (0 == (flags & (MHD_USE_THREAD_PER_CONNECTION | MHD_USE_POLL)))
+            flags |= MHD_USE_EPOLL_LINUX_ONLY;
+#endif
+        }
+#if IO_URING_SUPPORT
+      else
+        {
+          /* the event loop is woken up through the pipe */
+          flags &= ~MHD_USE_EPOLL_LINUX_ONLY;
+          flags |= MHD_USE_PIPE_FOR_SHUTDOWN;
+        }
+#endif
+      daemon->options = (enum MHD_OPTION) (flags | (daemon->options & MHD_USE_EPOLL_TURBO));
+    }
 #ifdef HAVE_LISTEN_SHUTDOWN
   use_pipe = (0 != (daemon->options & (MHD_USE_NO_LISTEN_SOCKET | MHD_USE_PIPE_FOR_SHUTDOWN)));
 #else
@@ -3475,11 +5194,68 @@ MHD_start_daemon_va (unsigned int flags,
       free (daemon);
       return NULL;
     }
+#if HTTPS_SUPPORT
+  if (0 != daemon->tls_handshake_threads)
+    {
+      if ( (0 != (flags & MHD_USE_THREAD_PER_CONNECTION)) ||
+           (0 == (flags & MHD_USE_SELECT_INTERNALLY)) )
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (daemon,
+                    "MHD_OPTION_HTTPS_HANDSHAKE_THREADS requires MHD_USE_SELECT_INTERNALLY without MHD_USE_THREAD_PER_CONNECTION, ignored\n");
+#endif
+          daemon->tls_handshake_threads = 0;
+        }
+      else
+        {
+          /* the handshake threads suspend connections and resume
+             them, which wakes up the event loop through the pipe */
+          flags |= MHD_USE_SUSPEND_RESUME;
+          daemon->options |= MHD_USE_SUSPEND_RESUME;
+          if (MHD_INVALID_PIPE_ == daemon->wpipe[1])
+            {
+              if (0 != MHD_pipe_ (daemon->wpipe))
+                {
+#if HAVE_MESSAGES
+                  MHD_DLOG (daemon,
+                            "Failed to create control pipe: %s\n",
+                            MHD_strerror_ (errno));
+#endif
+                  gnutls_priority_deinit (daemon->priority_cache);
+                  free (daemon);
+                  return NULL;
+                }
+#ifndef WINDOWS
+              if ( (0 == (flags & MHD_USE_POLL)) &&
+                   (daemon->wpipe[0] >= FD_SETSIZE) )
+                {
+#if HAVE_MESSAGES
+                  MHD_DLOG (daemon,
+                            "file descriptor for control pipe exceeds maximum value\n");
+#endif
+                  if (0 != MHD_pipe_close_ (daemon->wpipe[0]))
+                    MHD_PANIC ("close failed\n");
+                  if (0 != MHD_pipe_close_ (daemon->wpipe[1]))
+                    MHD_PANIC ("close failed\n");
+                  gnutls_priority_deinit (daemon->priority_cache);
+                  free (daemon);
+                  return NULL;
+                }
+#endif
+            }
+        }
+    }
+#endif
 #ifdef DAUTH_SUPPORT
   if (daemon->nonce_nc_size > 0)
     {
-      if ( ( (size_t) (daemon->nonce_nc_size * sizeof (struct MHD_NonceNc))) /
-	   sizeof(struct MHD_NonceNc) != daemon->nonce_nc_size)
+      unsigned int i;
+
+      daemon->nonce_nc_buckets
+        = (daemon->nonce_nc_size + MHD_NONCE_NC_WAYS - 1) / MHD_NONCE_NC_WAYS;
+      if ( (daemon->nonce_nc_buckets > UINT_MAX / MHD_NONCE_NC_WAYS) ||
+           ( ( (size_t) (daemon->nonce_nc_buckets * MHD_NONCE_NC_WAYS * sizeof (struct MHD_NonceNc))) /
+             sizeof(struct MHD_NonceNc) != daemon->nonce_nc_buckets * MHD_NONCE_NC_WAYS) )
 	{
 #if HAVE_MESSAGES
 	  MHD_DLOG (daemon,
@@ -3492,8 +5268,11 @@ MHD_start_daemon_va (unsigned int flags,
 	  free (daemon);
 	  return NULL;
 	}
-      daemon->nnc = malloc (daemon->nonce_nc_size * sizeof (struct MHD_NonceNc));
-      if (NULL == daemon->nnc)
+      daemon->nnc = calloc (daemon->nonce_nc_buckets * MHD_NONCE_NC_WAYS,
+                            sizeof (struct MHD_NonceNc));
+      daemon->nnc_locks = malloc (MHD_NONCE_NC_LOCKS * sizeof (MHD_mutex_));
+      if ( (NULL == daemon->nnc) ||
+           (NULL == daemon->nnc_locks) )
 	{
 #if HAVE_MESSAGES
 	  MHD_DLOG (daemon,
@@ -3504,27 +5283,54 @@ MHD_start_daemon_va (unsigned int flags,
 	  if (0 != (flags & MHD_USE_SSL))
 	    gnutls_priority_deinit (daemon->priority_cache);
 #endif
+	  free (daemon->nnc);
+	  free (daemon->nnc_locks);
 	  free (daemon);
 	  return NULL;
 	}
-    }
-
-  if (MHD_YES != MHD_mutex_create_ (&daemon->nnc_lock))
-    {
+      for (i = 0; i < MHD_NONCE_NC_LOCKS; i++)
+        {
+          if (MHD_YES == MHD_mutex_create_ (&daemon->nnc_locks[i]))
+            continue;
 #if HAVE_MESSAGES
-      MHD_DLOG (daemon,
-		"MHD failed to initialize nonce-nc mutex\n");
+          MHD_DLOG (daemon,
+                    "MHD failed to initialize nonce-nc mutex\n");
 #endif
+          while (i > 0)
+            (void) MHD_mutex_destroy_ (&daemon->nnc_locks[--i]);
 #if HTTPS_SUPPORT
-      if (0 != (flags & MHD_USE_SSL))
-	gnutls_priority_deinit (daemon->priority_cache);
+          if (0 != (flags & MHD_USE_SSL))
+            gnutls_priority_deinit (daemon->priority_cache);
 #endif
-      free (daemon->nnc);
-      free (daemon);
-      return NULL;
+          free (daemon->nnc);
+          free (daemon->nnc_locks);
+          free (daemon);
+          return NULL;
+        }
     }
 #endif
 
+  if (0 != daemon->latency_histograms)
+    {
+      daemon->latency = calloc (MHD_LATENCY_PHASE_COUNT,
+                                sizeof (struct MHD_LatencyHistogram));
+      daemon->latency_export = malloc (sizeof (struct MHD_LatencyHistogram));
+      if ( (NULL == daemon->latency) ||
+           (NULL == daemon->latency_export) ||
+           (MHD_YES != MHD_mutex_create_ (&daemon->latency_mutex)) )
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (daemon,
+                    "Failed to set up latency histograms: %s\n",
+                    MHD_strerror_ (errno));
+#endif
+          /* the mutex exists if and only if `latency_export` does */
+          free (daemon->latency_export);
+          daemon->latency_export = NULL;
+          goto free_and_fail;
+        }
+    }
+
   /* Thread pooling currently works only with internal select thread model */
   if ( (0 == (flags & MHD_USE_SELECT_INTERNALLY)) &&
        (daemon->worker_pool_size > 0) )
@@ -3536,6 +5342,28 @@ MHD_start_daemon_va (unsigned int flags,
       goto free_and_fail;
     }
 
+  if ( (0 != daemon->thread_pool_reuseport) &&
+       (daemon->worker_pool_size > 0) )
+    {
+#ifdef SO_REUSEPORT
+      /* all listen sockets of the pool must be in one SO_REUSEPORT group */
+      if (daemon->listening_address_reuse < 0)
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (daemon,
+                    "MHD_OPTION_THREAD_POOL_REUSEPORT requires reusing the listening address\n");
+#endif
+          goto free_and_fail;
+        }
+#else
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Per-worker listen sockets are not supported on this platform: SO_REUSEPORT not defined\n");
+#endif
+      goto free_and_fail;
+#endif
+    }
+
   if ( (MHD_USE_SUSPEND_RESUME == (flags & MHD_USE_SUSPEND_RESUME)) &&
        (0 != (flags & MHD_USE_THREAD_PER_CONNECTION)) )
     {
@@ -3585,10 +5413,31 @@ MHD_start_daemon_va (unsigned int flags,
                               SOL_SOCKET,
                               SO_REUSEADDR,
                               (void*)&on, sizeof (on)))
+            {
 #if HAVE_MESSAGES
-            MHD_DLOG (daemon,
-                      "setsockopt failed: %s\n",
-                      MHD_socket_last_strerr_ ());
+              MHD_DLOG (daemon,
+                        "setsockopt failed: %s\n",
+                        MHD_socket_last_strerr_ ());
+#endif
+            }
+#ifdef SO_REUSEPORT
+          /* per-worker listen sockets join this socket's group */
+          if ( (0 != daemon->thread_pool_reuseport) &&
+               (daemon->worker_pool_size > 0) &&
+               (0 > setsockopt (socket_fd,
+                                SOL_SOCKET,
+                                SO_REUSEPORT,
+                                (void*)&on, sizeof (on))) )
+            {
+#if HAVE_MESSAGES
+              MHD_DLOG (daemon,
+                        "setsockopt failed: %s\n",
+                        MHD_socket_last_strerr_ ());
+#endif
+              if (0 != MHD_socket_close_ (socket_fd))
+                MHD_PANIC ("close failed\n");
+              goto free_and_fail;
+            }
 #endif
         }
       else if (daemon->listening_address_reuse > 0)
@@ -3613,14 +5462,6 @@ MHD_start_daemon_va (unsigned int flags,
               goto free_and_fail;
             }
 #else
-#ifndef SO_REUSEPORT
-#ifdef LINUX
-/* Supported since Linux 3.9, but often not present (or commented out)
-   in the headers at this time; but 15 is reserved for this and
-   thus should be safe to use. */
-#define SO_REUSEPORT 15
-#endif
-#endif
 #ifdef SO_REUSEPORT
           if (0 > setsockopt (socket_fd,
                               SOL_SOCKET,
@@ -3799,7 +5640,7 @@ MHD_start_daemon_va (unsigned int flags,
     }
 #ifndef WINDOWS
   if ( (socket_fd >= FD_SETSIZE) &&
-       (0 == (flags & (MHD_USE_POLL | MHD_USE_EPOLL_LINUX_ONLY)) ) )
+       (0 == (flags & (MHD_USE_POLL | MHD_USE_EPOLL_LINUX_ONLY | MHD_USE_IO_URING)) ) )
     {
 #if HAVE_MESSAGES
       MHD_DLOG (daemon,
@@ -3839,12 +5680,28 @@ MHD_start_daemon_va (unsigned int flags,
       goto free_and_fail;
     }
 #endif
+#if IO_URING_SUPPORT
+  if ( (0 != (flags & MHD_USE_IO_URING)) &&
+       (0 == daemon->worker_pool_size) &&
+       (NULL == (daemon->uring = MHD_uring_create_ ())) )
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "Failed to set up io_uring: %s\n",
+                MHD_strerror_ (errno));
+#endif
+      if ( (MHD_INVALID_SOCKET != socket_fd) &&
+	   (0 != MHD_socket_close_ (socket_fd)) )
+	MHD_PANIC ("close failed\n");
+      goto free_and_fail;
+    }
+#endif
 
-  if (MHD_YES != MHD_mutex_create_ (&daemon->per_ip_connection_mutex))
+  if (MHD_YES != MHD_ip_limit_init (daemon))
     {
 #if HAVE_MESSAGES
       MHD_DLOG (daemon,
-               "MHD failed to initialize IP connection limit mutex\n");
+               "MHD failed to initialize IP connection limit table\n");
 #endif
       if ( (MHD_INVALID_SOCKET != socket_fd) &&
 	   (0 != MHD_socket_close_ (socket_fd)) )
@@ -3857,7 +5714,7 @@ MHD_start_daemon_va (unsigned int flags,
       MHD_DLOG (daemon,
                "MHD failed to initialize IP connection limit mutex\n");
 #endif
-      (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
+      MHD_ip_limit_free (daemon);
       if ( (MHD_INVALID_SOCKET != socket_fd) &&
 	   (0 != MHD_socket_close_ (socket_fd)) )
 	MHD_PANIC ("close failed\n");
@@ -3876,7 +5733,21 @@ MHD_start_daemon_va (unsigned int flags,
 	   (0 != MHD_socket_close_ (socket_fd)) )
 	MHD_PANIC ("close failed\n");
       (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
-      (void) MHD_mutex_destroy_ (&daemon->per_ip_connection_mutex);
+      MHD_ip_limit_free (daemon);
+      goto free_and_fail;
+    }
+  if ( (0 != daemon->tls_handshake_threads) &&
+       (NULL == (daemon->tls_handshake_pool = create_handshake_pool (daemon))) )
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+		"Failed to start the TLS handshake threads\n");
+#endif
+      if ( (MHD_INVALID_SOCKET != socket_fd) &&
+	   (0 != MHD_socket_close_ (socket_fd)) )
+	MHD_PANIC ("close failed\n");
+      (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
+      MHD_ip_limit_free (daemon);
       goto free_and_fail;
     }
 #endif
@@ -3893,7 +5764,7 @@ MHD_start_daemon_va (unsigned int flags,
 		MHD_strerror_ (res_thread_create));
 #endif
       (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
-      (void) MHD_mutex_destroy_ (&daemon->per_ip_connection_mutex);
+      MHD_ip_limit_free (daemon);
       if ( (MHD_INVALID_SOCKET != socket_fd) &&
 	   (0 != MHD_socket_close_ (socket_fd)) )
 	MHD_PANIC ("close failed\n");
@@ -3952,6 +5823,11 @@ MHD_start_daemon_va (unsigned int flags,
           d->master = daemon;
           d->worker_pool_size = 0;
           d->worker_pool = NULL;
+          d->latency_export = NULL;
+          if ( (NULL != daemon->latency) &&
+               (NULL == (d->latency = calloc (MHD_LATENCY_PHASE_COUNT,
+                                              sizeof (struct MHD_LatencyHistogram)))) )
+            goto thread_failed;
 
           if ( (MHD_USE_SUSPEND_RESUME == (flags & MHD_USE_SUSPEND_RESUME)) &&
                (0 != MHD_pipe_ (d->wpipe)) )
@@ -3986,10 +5862,26 @@ MHD_start_daemon_va (unsigned int flags,
           d->connection_limit = conns_per_thread;
           if (i < leftover_conns)
             ++d->connection_limit;
+#ifdef SO_REUSEPORT
+          /* The first worker keeps using the listen socket of the
+             master, all others get their own socket in the same
+             SO_REUSEPORT group. */
+          if ( (0 != daemon->thread_pool_reuseport) &&
+               (i > 0) &&
+               (MHD_INVALID_SOCKET ==
+                (d->socket_fd = create_worker_listen_socket (daemon,
+                                                             socket_fd))) )
+            goto thread_failed;
+#endif
 #if EPOLL_SUPPORT
 	  if ( (0 != (daemon->options & MHD_USE_EPOLL_LINUX_ONLY)) &&
 	       (MHD_YES != setup_epoll_to_listen (d)) )
 	    goto thread_failed;
+#endif
+#if IO_URING_SUPPORT
+	  if ( (0 != (daemon->options & MHD_USE_IO_URING)) &&
+	       (NULL == (d->uring = MHD_uring_create_ ())) )
+	    goto thread_failed;
 #endif
           /* Must init cleanup connection mutex for each worker */
           if (MHD_YES != MHD_mutex_create_ (&d->cleanup_connection_mutex))
@@ -4016,6 +5908,20 @@ MHD_start_daemon_va (unsigned int flags,
               goto thread_failed;
             }
         }
+#if defined(HAVE_LINUX_FILTER_H) && defined(SO_ATTACH_REUSEPORT_CBPF)
+      /* steering is optional; without it, the kernel hashes the
+         4-tuple to pick a socket of the group */
+      if (2 == daemon->thread_pool_reuseport)
+        (void) attach_reuseport_cpu_steering (daemon,
+                                              socket_fd,
+                                              daemon->worker_pool_size);
+#else
+#if HAVE_MESSAGES
+      if (2 == daemon->thread_pool_reuseport)
+        MHD_DLOG (daemon,
+                  "CPU steering of connections is not supported on this platform\n");
+#endif
+#endif
     }
   return daemon;
 
@@ -4030,12 +5936,19 @@ thread_failed:
 	   (0 != MHD_socket_close_ (socket_fd)) )
 	MHD_PANIC ("close failed\n");
       (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
-      (void) MHD_mutex_destroy_ (&daemon->per_ip_connection_mutex);
+      MHD_ip_limit_free (daemon);
       if (NULL != daemon->worker_pool)
         free (daemon->worker_pool);
       goto free_and_fail;
     }
 
+  /* The worker that failed to start may already own a listen socket. */
+  if ( (i < daemon->worker_pool_size) &&
+       (MHD_INVALID_SOCKET != daemon->worker_pool[i].socket_fd) &&
+       (socket_fd != daemon->worker_pool[i].socket_fd) &&
+       (0 != MHD_socket_close_ (daemon->worker_pool[i].socket_fd)) )
+    MHD_PANIC ("close failed\n");
+
   /* Shutdown worker threads we've already created. Pretend
      as though we had fully initialized our daemon, but
      with a smaller number of threads than had been
@@ -4051,13 +5964,25 @@ thread_failed:
   if (-1 != daemon->epoll_fd)
     close (daemon->epoll_fd);
 #endif
+#if IO_URING_SUPPORT
+  if (NULL != daemon->uring)
+    MHD_uring_destroy_ (daemon->uring);
+#endif
 #ifdef DAUTH_SUPPORT
-  free (daemon->nnc);
-  (void) MHD_mutex_destroy_ (&daemon->nnc_lock);
+  free_nonce_nc (daemon);
 #endif
+  free (daemon->latency);
+  if (NULL != daemon->latency_export)
+    (void) MHD_mutex_destroy_ (&daemon->latency_mutex);
+  free (daemon->latency_export);
 #if HTTPS_SUPPORT
   if (0 != (flags & MHD_USE_SSL))
-    gnutls_priority_deinit (daemon->priority_cache);
+    {
+      gnutls_priority_deinit (daemon->priority_cache);
+      destroy_handshake_pool (daemon->tls_handshake_pool);
+      MHD_tls_session_cache_destroy_ (daemon->tls_session_cache);
+      MHD_tls_ticket_keys_destroy_ (daemon->tls_ticket_keys);
+    }
 #endif
   free (daemon);
   return NULL;
@@ -4077,14 +6002,8 @@ close_connection (struct MHD_Connection *pos)
 
   MHD_connection_close (pos,
 			MHD_REQUEST_TERMINATED_DAEMON_SHUTDOWN);
-  if (pos->connection_timeout == pos->daemon->connection_timeout)
-    XDLL_remove (daemon->normal_timeout_head,
-		 daemon->normal_timeout_tail,
-		 pos);
-  else
-    XDLL_remove (daemon->manual_timeout_head,
-		 daemon->manual_timeout_tail,
-		 pos);
+  MHD_timer_wheel_remove (&daemon->timer_wheel,
+                          pos);
   DLL_remove (daemon->connections_head,
 	      daemon->connections_tail,
 	      pos);
@@ -4107,6 +6026,10 @@ close_all_connections (struct MHD_Daemon *daemon)
 {
   struct MHD_Connection *pos;
 
+  /* connections given back by the handshake threads after the
+     event loop terminated */
+  resume_suspended_connections (daemon);
+
   /* first, make sure all threads are aware of shutdown; need to
      traverse DLLs in peace... */
   if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
@@ -4134,6 +6057,21 @@ close_all_connections (struct MHD_Daemon *daemon)
   while (NULL != (pos = daemon->connections_head))
     close_connection (pos);
   MHD_cleanup_connections (daemon);
+#if IO_URING_SUPPORT
+  if (NULL != daemon->uring)
+    uring_drain (daemon);
+#endif
+
+  /* finally, release the connection objects kept for recycling */
+  while (NULL != (pos = daemon->connection_cache_head))
+    {
+      daemon->connection_cache_head = pos->next;
+      MHD_pool_destroy (pos->pool);
+      if (NULL != pos->addr)
+	free (pos->addr);
+      free (pos);
+    }
+  daemon->connection_cache_count = 0;
 }
 
 
@@ -4188,7 +6126,15 @@ MHD_stop_daemon (struct MHD_Daemon *daemon)
       for (i = 0; i < daemon->worker_pool_size; ++i)
 	{
 	  daemon->worker_pool[i].shutdown = MHD_YES;
-	  daemon->worker_pool[i].socket_fd = MHD_INVALID_SOCKET;
+	  /* per-worker listen sockets are closed after the worker
+	     terminated; shutting them down wakes up the worker */
+	  if (fd == daemon->worker_pool[i].socket_fd)
+	    daemon->worker_pool[i].socket_fd = MHD_INVALID_SOCKET;
+#ifdef HAVE_LISTEN_SHUTDOWN
+	  else if ( (MHD_INVALID_SOCKET != daemon->worker_pool[i].socket_fd) &&
+		    (MHD_INVALID_PIPE_ == daemon->wpipe[1]) )
+	    (void) shutdown (daemon->worker_pool[i].socket_fd, SHUT_RDWR);
+#endif
 #if EPOLL_SUPPORT
 	  if ( (0 != (daemon->options & MHD_USE_EPOLL_LINUX_ONLY)) &&
 	       (-1 != daemon->worker_pool[i].epoll_fd) &&
@@ -4224,6 +6170,12 @@ MHD_stop_daemon (struct MHD_Daemon *daemon)
 #endif
 #endif
 
+#if HTTPS_SUPPORT
+  /* connections must no longer be handed to other threads once
+     the event loops are gone */
+  if (NULL != daemon->tls_handshake_pool)
+    stop_handshake_pool (daemon->tls_handshake_pool);
+#endif
 
   /* Signal workers to stop and clean them up */
   if (NULL != daemon->worker_pool)
@@ -4239,12 +6191,20 @@ MHD_stop_daemon (struct MHD_Daemon *daemon)
 	  if (0 != MHD_join_thread_ (daemon->worker_pool[i].pid))
 	      MHD_PANIC ("Failed to join a thread\n");
 	  close_all_connections (&daemon->worker_pool[i]);
+	  if ( (MHD_INVALID_SOCKET != daemon->worker_pool[i].socket_fd) &&
+	       (0 != MHD_socket_close_ (daemon->worker_pool[i].socket_fd)) )
+	    MHD_PANIC ("close failed\n");
 	  (void) MHD_mutex_destroy_ (&daemon->worker_pool[i].cleanup_connection_mutex);
 #if EPOLL_SUPPORT
 	  if ( (-1 != daemon->worker_pool[i].epoll_fd) &&
 	       (0 != MHD_socket_close_ (daemon->worker_pool[i].epoll_fd)) )
 	    MHD_PANIC ("close failed\n");
 #endif
+#if IO_URING_SUPPORT
+	  if (NULL != daemon->worker_pool[i].uring)
+	    MHD_uring_destroy_ (daemon->worker_pool[i].uring);
+#endif
+          free (daemon->worker_pool[i].latency);
           if ( (MHD_USE_SUSPEND_RESUME == (daemon->options & MHD_USE_SUSPEND_RESUME)) )
             {
               if (MHD_INVALID_PIPE_ != daemon->worker_pool[i].wpipe[1])
@@ -4288,6 +6248,9 @@ MHD_stop_daemon (struct MHD_Daemon *daemon)
       gnutls_priority_deinit (daemon->priority_cache);
       if (daemon->x509_cred)
         gnutls_certificate_free_credentials (daemon->x509_cred);
+      destroy_handshake_pool (daemon->tls_handshake_pool);
+      MHD_tls_session_cache_destroy_ (daemon->tls_session_cache);
+      MHD_tls_ticket_keys_destroy_ (daemon->tls_ticket_keys);
     }
 #endif
 #if EPOLL_SUPPORT
@@ -4296,13 +6259,20 @@ MHD_stop_daemon (struct MHD_Daemon *daemon)
        (0 != MHD_socket_close_ (daemon->epoll_fd)) )
     MHD_PANIC ("close failed\n");
 #endif
+#if IO_URING_SUPPORT
+  if (NULL != daemon->uring)
+    MHD_uring_destroy_ (daemon->uring);
+#endif
 
 #ifdef DAUTH_SUPPORT
-  free (daemon->nnc);
-  (void) MHD_mutex_destroy_ (&daemon->nnc_lock);
+  free_nonce_nc (daemon);
 #endif
-  (void) MHD_mutex_destroy_ (&daemon->per_ip_connection_mutex);
+  MHD_ip_limit_free (daemon);
   (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
+  free (daemon->latency);
+  if (NULL != daemon->latency_export)
+    (void) MHD_mutex_destroy_ (&daemon->latency_mutex);
+  free (daemon->latency_export);
 
   if (MHD_INVALID_PIPE_ != daemon->wpipe[1])
     {
@@ -4358,12 +6328,113 @@ MHD_get_daemon_info (struct MHD_Daemon *daemon,
             }
         }
       return (const union MHD_DaemonInfo *) &daemon->connections;
+    case MHD_DAEMON_INFO_LATENCY_HISTOGRAM:
+      {
+        va_list ap;
+        int phase;
+        unsigned int i;
+
+        va_start (ap, info_type);
+        phase = va_arg (ap, int);
+        va_end (ap);
+        if ( (NULL == daemon->latency_export) ||
+             (phase < 0) ||
+             (phase >= MHD_LATENCY_PHASE_COUNT) )
+          return NULL;
+        /* the application may ask from several threads at once */
+        if (MHD_YES != MHD_mutex_lock_ (&daemon->latency_mutex))
+          MHD_PANIC ("Failed to acquire latency histogram mutex\n");
+        memset (daemon->latency_export, 0, sizeof (struct MHD_LatencyHistogram));
+        MHD_latency_merge_ (daemon->latency_export,
+                            &daemon->latency[phase]);
+        if (NULL != daemon->worker_pool)
+          for (i = 0; i < daemon->worker_pool_size; i++)
+            MHD_latency_merge_ (daemon->latency_export,
+                                &daemon->worker_pool[i].latency[phase]);
+        daemon->latency_info = daemon->latency_export;
+        if (MHD_YES != MHD_mutex_unlock_ (&daemon->latency_mutex))
+          MHD_PANIC ("Failed to release latency histogram mutex\n");
+        return (const union MHD_DaemonInfo *) &daemon->latency_info;
+      }
     default:
       return NULL;
     };
 }
 
 
+/**
+ * Add the counters of one daemon (or worker) to @a stats.
+ *
+ * @param stats statistics to update
+ * @param c counters to add
+ */
+static void
+add_daemon_counters (struct MHD_DaemonStats *stats,
+                     const struct MHD_DaemonCounters *c)
+{
+  stats->connections_accepted += c->connections_accepted;
+  stats->accept_failures += c->accept_failures;
+  stats->connections_rejected += c->connections_rejected;
+  stats->requests += c->requests;
+  stats->keepalive_reuses += c->keepalive_reuses;
+  stats->timeouts += c->timeouts;
+  stats->suspended_connections += c->suspended_connections;
+  stats->requests_too_large += c->requests_too_large;
+  stats->uris_too_long += c->uris_too_long;
+  stats->bytes_received += c->bytes_received;
+  stats->bytes_sent += c->bytes_sent;
+  stats->bytes_sendfile += c->bytes_sendfile;
+  stats->bytes_spliced += c->bytes_spliced;
+  stats->bytes_received_direct += c->bytes_received_direct;
+  stats->pool_bytes_released += c->pool_bytes_released;
+  stats->tls_handshakes_full += c->tls_handshakes_full;
+  stats->tls_handshakes_resumed += c->tls_handshakes_resumed;
+  stats->tls_handshakes_offloaded += c->tls_handshakes_offloaded;
+}
+
+
+/**
+ * Obtain the runtime statistics of the given daemon.  The counters
+ * are kept per worker thread without locking and are summed up by
+ * this call, so the result is only a consistent snapshot if the
+ * daemon is idle.  May be called from any thread.
+ *
+ * @param daemon daemon to get the statistics of
+ * @param stats where to store the statistics
+ * @return #MHD_YES on success, #MHD_NO if @a daemon or @a stats
+ *         is NULL
+ * @ingroup specialized
+ */
+int
+MHD_get_daemon_stats (struct MHD_Daemon *daemon,
+                      struct MHD_DaemonStats *stats)
+{
+  unsigned int i;
+
+  if ( (NULL == daemon) ||
+       (NULL == stats) )
+    return MHD_NO;
+  memset (stats, 0, sizeof (struct MHD_DaemonStats));
+  /* the master also counts connections it hands to the workers */
+  add_daemon_counters (stats, &daemon->counters);
+  if (NULL != daemon->worker_pool)
+    for (i = 0; i < daemon->worker_pool_size; i++)
+      add_daemon_counters (stats, &daemon->worker_pool[i].counters);
+#if HTTPS_SUPPORT
+  if (NULL != daemon->tls_handshake_pool)
+    {
+      if (MHD_YES != MHD_mutex_lock_ (&daemon->tls_handshake_pool->lock))
+        MHD_PANIC ("Failed to acquire handshake pool mutex\n");
+      stats->tls_handshake_queue_length = daemon->tls_handshake_pool->queue_length;
+      stats->tls_handshake_queue_max = daemon->tls_handshake_pool->queue_max;
+      if (MHD_YES != MHD_mutex_unlock_ (&daemon->tls_handshake_pool->lock))
+        MHD_PANIC ("Failed to release handshake pool mutex\n");
+    }
+#endif
+  return MHD_YES;
+}
+
+
 /**
  * Sets the global error handler to a different implementation.  @a cb
  * will only be called in the case of typically fatal, serious
@@ -4494,6 +6565,24 @@ MHD_is_feature_supported(enum MHD_FEATURE feature)
       return MHD_YES;
 #else
       return MHD_NO;
+#endif
+    case MHD_FEATURE_IO_URING:
+#if IO_URING_SUPPORT
+      return MHD_uring_probe_ ();
+#else
+      return MHD_NO;
+#endif
+    case MHD_FEATURE_COMPRESSION:
+#if COMPRESSION_SUPPORT
+      return MHD_YES;
+#else
+      return MHD_NO;
+#endif
+    case MHD_FEATURE_KTLS:
+#if KTLS_SUPPORT
+      return MHD_YES;
+#else
+      return MHD_NO;
 #endif
     }
   return MHD_NO;
@@ -288,10 +288,36 @@ lookup_sub_value (char *dest,
 }
 
 
+/**
+ * Compute the hash of a nonce to find its bucket in the
+ * nonce-nc map (FNV-1a).
+ *
+ * @param nonce zero-terminated nonce
+ * @return hash of @a nonce
+ */
+static uint32_t
+nonce_hash (const char *nonce)
+{
+  uint32_t hash;
+
+  hash = 2166136261U;
+  while ('\0' != *nonce)
+    hash = (hash ^ (unsigned char) *nonce++) * 16777619U;
+  return hash;
+}
+
+
 /**
  * Check nonce-nc map array with either new nonce counter
  * or a whole new nonce.
  *
+ * The map consists of buckets of #MHD_NONCE_NC_WAYS entries, each
+ * bucket guarded by one of #MHD_NONCE_NC_LOCKS locks.  For each nonce
+ * we remember the highest counter seen and which of the
+ * #MHD_NONCE_NC_WINDOW counters below it were used, so that
+ * requests that arrive out of order (i.e. pipelined or on parallel
+ * connections) are accepted while replays are still detected.
+ *
  * @param connection The MHD connection structure
  * @param nonce A pointer that referenced a zero-terminated array of nonce
  * @param nc The nonce counter, zero to add the nonce to the array
@@ -302,49 +328,92 @@ check_nonce_nc (struct MHD_Connection *connection,
 		const char *nonce,
 		unsigned long int nc)
 {
+  struct MHD_Daemon *daemon = connection->daemon;
+  struct MHD_NonceNc *bucket;
+  struct MHD_NonceNc *slot;
+  MHD_mutex_ *lock;
   uint32_t off;
-  uint32_t mod;
-  const char *np;
+  unsigned long int diff;
+  unsigned int i;
 
-  mod = connection->daemon->nonce_nc_size;
-  if (0 == mod)
+  if (0 == daemon->nonce_nc_size)
     return MHD_NO; /* no array! */
-  /* super-fast xor-based "hash" function for HT lookup in nonce array */
-  off = 0;
-  np = nonce;
-  while ('\0' != *np)
-    {
-      off = (off << 8) | (*np ^ (off >> 24));
-      np++;
-    }
-  off = off % mod;
-  /*
-   * Look for the nonce, if it does exist and its corresponding
-   * nonce counter is less than the current nonce counter by 1,
-   * then only increase the nonce counter by one.
-   */
-
-  (void) MHD_mutex_lock_ (&connection->daemon->nnc_lock);
+  if (strlen (nonce) >= MAX_NONCE_LENGTH)
+    return MHD_NO;
+  off = nonce_hash (nonce) % daemon->nonce_nc_buckets;
+  bucket = &daemon->nnc[off * MHD_NONCE_NC_WAYS];
+  lock = &daemon->nnc_locks[off % MHD_NONCE_NC_LOCKS];
+
+  (void) MHD_mutex_lock_ (lock);
+  slot = NULL;
+  for (i = 0; i < MHD_NONCE_NC_WAYS; i++)
+    if (0 == strcmp (bucket[i].nonce, nonce))
+      {
+	slot = &bucket[i];
+	break;
+      }
   if (0 == nc)
     {
-      strcpy(connection->daemon->nnc[off].nonce,
-	     nonce);
-      connection->daemon->nnc[off].nc = 0;
-      (void) MHD_mutex_unlock_ (&connection->daemon->nnc_lock);
+      if (NULL == slot)
+	{
+	  /* take a free slot, or else the least recently used one */
+	  slot = &bucket[0];
+	  for (i = 0; i < MHD_NONCE_NC_WAYS; i++)
+	    {
+	      if ('\0' == bucket[i].nonce[0])
+		{
+		  slot = &bucket[i];
+		  break;
+		}
+	      if (bucket[i].last_used < slot->last_used)
+		slot = &bucket[i];
+	    }
+	  strcpy (slot->nonce,
+		  nonce);
+	}
+      slot->nc = 0;
+      slot->nc_window = 1; /* counter zero is never valid */
+      slot->last_used = MHD_monotonic_time ();
+      (void) MHD_mutex_unlock_ (lock);
       return MHD_YES;
     }
-  if ( (nc <= connection->daemon->nnc[off].nc) ||
-       (0 != strcmp(connection->daemon->nnc[off].nonce, nonce)) )
+  if (NULL == slot)
     {
-      (void) MHD_mutex_unlock_ (&connection->daemon->nnc_lock);
+      (void) MHD_mutex_unlock_ (lock);
 #if HAVE_MESSAGES
-      MHD_DLOG (connection->daemon,
+      MHD_DLOG (daemon,
 		"Stale nonce received.  If this happens a lot, you should probably increase the size of the nonce array.\n");
 #endif
       return MHD_NO;
     }
-  connection->daemon->nnc[off].nc = nc;
-  (void) MHD_mutex_unlock_ (&connection->daemon->nnc_lock);
+  if (nc > slot->nc)
+    {
+      /* new highest counter, slide the window */
+      diff = nc - slot->nc;
+      if (diff >= MHD_NONCE_NC_WINDOW)
+	slot->nc_window = 1;
+      else
+	slot->nc_window = (slot->nc_window << diff) | 1;
+      slot->nc = nc;
+    }
+  else
+    {
+      diff = slot->nc - nc;
+      if ( (diff >= MHD_NONCE_NC_WINDOW) ||
+	   (0 != (slot->nc_window & (((uint64_t) 1) << diff))) )
+	{
+	  /* too old or already used: replay */
+	  (void) MHD_mutex_unlock_ (lock);
+#if HAVE_MESSAGES
+	  MHD_DLOG (daemon,
+		    "Stale nonce received.  If this happens a lot, you should probably increase the size of the nonce array.\n");
+#endif
+	  return MHD_NO;
+	}
+      slot->nc_window |= ((uint64_t) 1) << diff;
+    }
+  slot->last_used = MHD_monotonic_time ();
+  (void) MHD_mutex_unlock_ (lock);
   return MHD_YES;
 }
 
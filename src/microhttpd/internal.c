@@ -196,4 +196,97 @@ MHD_monotonic_time (void)
   return time (NULL);
 }
 
+
+/**
+ * Like #MHD_monotonic_time(), but with millisecond resolution.
+ *
+ * @return 'current' time in milliseconds
+ */
+uint64_t
+MHD_monotonic_time_ms (void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if (0 == clock_gettime (CLOCK_MONOTONIC, &ts))
+    return ((uint64_t) ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+#endif
+#endif
+  return ((uint64_t) time (NULL)) * 1000;
+}
+
+
+/**
+ * Like #MHD_monotonic_time(), but with microsecond resolution.
+ *
+ * @return 'current' time in microseconds
+ */
+uint64_t
+MHD_monotonic_time_us (void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if (0 == clock_gettime (CLOCK_MONOTONIC, &ts))
+    return ((uint64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+#endif
+  return ((uint64_t) time (NULL)) * 1000000;
+}
+
+
+/**
+ * Format @a t as an HTTP date ("IMF-fixdate" of RFC 7231),
+ * for example "Sun, 06 Nov 1994 08:49:37 GMT".
+ *
+ * @param date where to write the date, with at least
+ *        #MHD_HTTP_DATE_SIZE bytes of space; set to the
+ *        empty string if @a t cannot be converted
+ * @param t time to format
+ */
+void
+MHD_format_http_date_ (char *date,
+                       time_t t)
+{
+  static const char *const days[] =
+    { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  static const char *const mons[] =
+    { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct",
+    "Nov", "Dec"
+  };
+  struct tm now;
+#if defined(_WIN32) && !defined(HAVE_GMTIME_S) && !defined(__CYGWIN__)
+  struct tm* pNow;
+#endif
+
+  date[0] = 0;
+#if !defined(_WIN32)
+  if (NULL != gmtime_r (&t, &now))
+    {
+#elif defined(HAVE_GMTIME_S)
+  if (0 == gmtime_s (&now, &t))
+    {
+#elif defined(__CYGWIN__)
+  if (NULL != gmtime_r (&t, &now))
+    {
+#else
+  pNow = gmtime(&t);
+  if (NULL != pNow)
+    {
+      now = *pNow;
+#endif
+      sprintf (date,
+               "%3s, %02u %3s %04u %02u:%02u:%02u GMT",
+               days[now.tm_wday % 7],
+               (unsigned int) now.tm_mday,
+               mons[now.tm_mon % 12],
+               (unsigned int) (1900 + now.tm_year),
+               (unsigned int) now.tm_hour,
+               (unsigned int) now.tm_min,
+               (unsigned int) now.tm_sec);
+    }
+}
+
 /* end of internal.c */
@@ -36,6 +36,12 @@
 #include <gnutls/abstract.h>
 #endif
 #endif
+/* kernel TLS needs linux/tls.h and gnutls_record_get_state() */
+#if HTTPS_SUPPORT && HAVE_LINUX_TLS_H && (GNUTLS_VERSION_NUMBER >= 0x030400)
+#define KTLS_SUPPORT 1
+#else
+#define KTLS_SUPPORT 0
+#endif
 #if EPOLL_SUPPORT
 #include <sys/epoll.h>
 #endif
@@ -65,6 +71,24 @@
 #define MHD_BUF_INC_SIZE 1024
 
 
+/**
+ * Maximum number of bytes of responses to pipelined requests that we
+ * collect before writing them out.  Complete in-memory responses are
+ * appended to a per-connection buffer of this size while further
+ * requests are waiting in the read buffer, so that a batch of
+ * pipelined requests is answered with a single write.
+ */
+#define MHD_PIPELINE_BATCH_SIZE (16 * 1024)
+
+
+/**
+ * Maximum number of request body bytes that we move with one
+ * splice() from the socket to the upload file descriptor; the
+ * default capacity of a pipe on Linux.
+ */
+#define MHD_UPLOAD_SPLICE_SIZE (64 * 1024)
+
+
 /**
  * Handler for fatal errors.
  */
@@ -133,6 +157,49 @@ enum MHD_EpollState
   };
 
 
+#if IO_URING_SUPPORT
+/**
+ * State of the operations of a connection in the io_uring (bitmask).
+ */
+enum MHD_UringState
+  {
+
+    /**
+     * A (multishot) receive is pending.
+     */
+    MHD_URING_STATE_RECV_ARMED = 1,
+
+    /**
+     * A poll for the socket becoming writable is pending.
+     */
+    MHD_URING_STATE_POLLOUT_ARMED = 2,
+
+    /**
+     * The other side closed the connection (after the data we
+     * still have in our buffers).
+     */
+    MHD_URING_STATE_EOF = 4,
+
+    /**
+     * We asked for the pending receive to be cancelled.
+     */
+    MHD_URING_STATE_RECV_CANCELLING = 8,
+
+    /**
+     * We asked for all pending operations to be cancelled as the
+     * connection is being cleaned up.
+     */
+    MHD_URING_STATE_CANCELLING = 16,
+
+    /**
+     * The connection is waiting for receive buffers to become
+     * available (in the list linked via `nextU`).
+     */
+    MHD_URING_STATE_STARVED = 32
+  };
+#endif
+
+
 /**
  * What is this connection waiting for?
  */
@@ -169,6 +236,26 @@ enum MHD_ConnectionEventLoopInfo
 #define MAX_NONCE_LENGTH 129
 
 
+/**
+ * Number of slots in each bucket of the nonce-nc map.  A new nonce
+ * replaces the least recently used nonce of its bucket only.
+ */
+#define MHD_NONCE_NC_WAYS 4
+
+/**
+ * Number of locks protecting the nonce-nc map; bucket i is
+ * protected by lock (i % MHD_NONCE_NC_LOCKS).
+ */
+#define MHD_NONCE_NC_LOCKS 16
+
+/**
+ * Number of nonce counter values below the highest one seen
+ * for which we remember whether they were used (so that requests
+ * arriving out of order are not rejected).
+ */
+#define MHD_NONCE_NC_WINDOW 64
+
+
 /**
  * A structure representing the internal holder of the
  * nonce-nc map.
@@ -178,12 +265,24 @@ struct MHD_NonceNc
 
   /**
    * Nonce counter, a value that increases for each subsequent
-   * request for the same nonce.
+   * request for the same nonce.  Highest value seen so far.
    */
   unsigned long int nc;
 
   /**
-   * Nonce value:
+   * Bitmap of the nonce counter values seen; bit i is set
+   * if 'nc - i' was used.
+   */
+  uint64_t nc_window;
+
+  /**
+   * When was this entry last used (#MHD_monotonic_time()),
+   * for picking the entry to replace.
+   */
+  time_t last_used;
+
+  /**
+   * Nonce value, empty if the slot is unused.
    */
   char nonce[MAX_NONCE_LENGTH];
 
@@ -237,6 +336,17 @@ struct MHD_HTTP_Header
    */
   char *value;
 
+  /**
+   * Next header in the same bucket of the header index
+   * of the connection (only for request headers).
+   */
+  struct MHD_HTTP_Header *next_hash;
+
+  /**
+   * Case-insensitive hash of @e header (only for request headers).
+   */
+  uint32_t hash;
+
   /**
    * Type of the header (where in the HTTP
    * protocol is this header from).
@@ -246,6 +356,106 @@ struct MHD_HTTP_Header
 };
 
 
+/**
+ * Number of buckets in the header index of a connection,
+ * must be a power of two.
+ */
+#define MHD_HEADER_INDEX_BUCKETS 32
+
+
+/**
+ * Hash table over the headers, cookies and arguments received with
+ * a request, so that looking up a value does not have to compare
+ * against all of them.  Allocated from the pool of the connection.
+ * Each bucket lists its entries in the order in which they were
+ * received, so that lookups find the same entry as a walk over
+ * the list would.
+ */
+struct MHD_HeaderIndex
+{
+  /**
+   * Heads of the buckets.
+   */
+  struct MHD_HTTP_Header *head[MHD_HEADER_INDEX_BUCKETS];
+
+  /**
+   * Tails of the buckets.
+   */
+  struct MHD_HTTP_Header *tail[MHD_HEADER_INDEX_BUCKETS];
+};
+
+
+/**
+ * Facts about the headers set by the application for a response,
+ * determined once when the header block of the response is built.
+ */
+enum MHD_ResponseHeaderFlags
+{
+  /**
+   * No special headers.
+   */
+  MHD_RHF_NONE = 0,
+
+  /**
+   * Response has a "Connection: close" header.
+   */
+  MHD_RHF_HAS_CLOSE = 1,
+
+  /**
+   * Response has a "Connection: Keep-Alive" header.
+   */
+  MHD_RHF_HAS_KEEP_ALIVE = 2,
+
+  /**
+   * Response has a "Transfer-Encoding" header.
+   */
+  MHD_RHF_HAS_ENCODING = 4,
+
+  /**
+   * The "Transfer-Encoding" of the response is "identity".
+   */
+  MHD_RHF_ENCODING_IDENTITY = 8,
+
+  /**
+   * Response has a "Content-Length" header.
+   */
+  MHD_RHF_HAS_CONTENT_LENGTH = 16,
+
+  /**
+   * Response has a "Date" header.
+   */
+  MHD_RHF_HAS_DATE = 32
+};
+
+
+/**
+ * Content codings MHD can apply to response bodies
+ * (see #MHD_RF_COMPRESS).
+ */
+enum MHD_ContentCoding
+{
+  /**
+   * Send the body as it is.
+   */
+  MHD_CODING_IDENTITY = 0,
+
+  /**
+   * "gzip" (RFC 1952).
+   */
+  MHD_CODING_GZIP = 1,
+
+  /**
+   * "deflate", the zlib format (RFC 1950).
+   */
+  MHD_CODING_DEFLATE = 2,
+
+  /**
+   * Number of codings.
+   */
+  MHD_CODING_COUNT = 3
+};
+
+
 /**
  * Representation of a response.
  */
@@ -332,6 +542,67 @@ struct MHD_Response
    */
   enum MHD_ResponseFlags flags;
 
+  /**
+   * All of the headers (not footers) of the response, serialized
+   * as they go on the wire; NULL if not yet built.  Built on first
+   * use while holding @e mutex and discarded whenever the headers
+   * of the response are changed.
+   */
+  char *header_block;
+
+  /**
+   * Number of bytes in @e header_block.
+   */
+  size_t header_block_size;
+
+  /**
+   * Offset of the "Connection: Keep-Alive" line in @e header_block
+   * (which must be left out if we decide to close the connection).
+   */
+  size_t keep_alive_off;
+
+  /**
+   * Length of the "Connection: Keep-Alive" line in @e header_block,
+   * 0 if there is none.
+   */
+  size_t keep_alive_len;
+
+  /**
+   * Response size for which @e content_length_line was made.
+   */
+  uint64_t content_length_size;
+
+  /**
+   * Number of bytes in @e content_length_line.
+   */
+  size_t content_length_len;
+
+  /**
+   * "Content-Length" line to add if the application did not
+   * give one, valid if @e content_length_size matches @e total_size.
+   */
+  char content_length_line[64];
+
+  /**
+   * Facts about the headers in @e header_block.
+   */
+  enum MHD_ResponseHeaderFlags header_flags;
+
+#if COMPRESSION_SUPPORT
+  /**
+   * Compressed variants of this (buffer) response, indexed by
+   * `enum MHD_ContentCoding`.  Created on first use while holding
+   * @e mutex and released together with the response.
+   */
+  struct MHD_Response *compressed[MHD_CODING_COUNT];
+
+  /**
+   * Bitmask (1 << coding) of the codings for which compressing
+   * did not make the body smaller, so we do not try again.
+   */
+  unsigned int compress_useless;
+#endif
+
 };
 
 
@@ -511,6 +782,84 @@ typedef ssize_t (*TransmitCallback) (struct MHD_Connection * conn,
                                      const void *write_to, size_t max_bytes);
 
 
+#if HAVE_SENDMSG
+/**
+ * Function to transmit several buffers of plaintext data
+ * with a single system call.
+ *
+ * @param conn the connection struct
+ * @param iov buffers with the data to transmit
+ * @param iovcnt number of entries in @a iov
+ * @param more #MHD_YES if more data of the same response will
+ *        be transmitted right afterwards, #MHD_NO if not
+ * @return number of bytes transmitted
+ */
+typedef ssize_t (*TransmitVecCallback) (struct MHD_Connection * conn,
+                                        const struct iovec *iov,
+                                        unsigned int iovcnt,
+                                        int more);
+#endif
+
+
+/**
+ * Points in time of processing a request that are recorded for
+ * the latency histograms (#MHD_OPTION_LATENCY_HISTOGRAMS).
+ */
+enum MHD_LatencyStamp
+{
+  /**
+   * Connection was accepted.
+   */
+  MHD_LATENCY_STAMP_ACCEPTED = 0,
+
+  /**
+   * Connection was accepted, or the previous response on the
+   * connection was sent.
+   */
+  MHD_LATENCY_STAMP_IDLE = 1,
+
+  /**
+   * First byte of the request was received.
+   */
+  MHD_LATENCY_STAMP_FIRST_BYTE = 2,
+
+  /**
+   * Request headers were received.
+   */
+  MHD_LATENCY_STAMP_HEADERS_RECEIVED = 3,
+
+  /**
+   * Access handler was called for the first time.
+   */
+  MHD_LATENCY_STAMP_HANDLER_CALLED = 4,
+
+  /**
+   * Response was queued.
+   */
+  MHD_LATENCY_STAMP_RESPONSE_QUEUED = 5,
+
+  /**
+   * Response headers were sent.
+   */
+  MHD_LATENCY_STAMP_HEADERS_SENT = 6,
+
+  /**
+   * Number of stamps.
+   */
+  MHD_LATENCY_STAMP_COUNT = 7
+};
+
+
+/**
+ * Record the current time as @a stamp of connection @a c, if its
+ * daemon keeps latency histograms.
+ */
+#define MHD_LATENCY_STAMP_(c,stamp) do { \
+    if (NULL != (c)->daemon->latency) \
+      (c)->latency_stamps[stamp] = MHD_monotonic_time_us (); \
+  } while (0)
+
+
 /**
  * State kept for each HTTP request.
  */
@@ -541,10 +890,8 @@ struct MHD_Connection
 
   /**
    * Next pointer for the XDLL organizing connections by timeout.
-   * This DLL can be either the
-   * 'manual_timeout_head/manual_timeout_tail' or the
-   * 'normal_timeout_head/normal_timeout_tail', depending on whether a
-   * custom timeout is set for the connection.
+   * This is the list of the timer wheel slot the connection is
+   * currently scheduled in (see `timer_slot`).
    */
   struct MHD_Connection *nextX;
 
@@ -553,6 +900,12 @@ struct MHD_Connection
    */
   struct MHD_Connection *prevX;
 
+  /**
+   * Next pointer in the resume queue of the daemon
+   * (see `resume_head`).
+   */
+  struct MHD_Connection *nextR;
+
   /**
    * Reference to the MHD_Daemon struct.
    */
@@ -568,6 +921,12 @@ struct MHD_Connection
    */
   struct MHD_HTTP_Header *headers_received_tail;
 
+  /**
+   * Index over @e headers_received, NULL if we could not
+   * allocate one (then lookups walk the list).
+   */
+  struct MHD_HeaderIndex *header_index;
+
   /**
    * Response to transmit (initially NULL).
    */
@@ -682,6 +1041,23 @@ struct MHD_Connection
    */
   size_t write_buffer_append_offset;
 
+  /**
+   * Responses to pipelined requests that were generated but not yet
+   * sent (#MHD_PIPELINE_BATCH_SIZE bytes).  MALLOCED (not in pool!)
+   * on first use and kept until the connection is cleaned up.
+   */
+  char *pipeline_buffer;
+
+  /**
+   * Offset where we are with sending from pipeline_buffer.
+   */
+  size_t pipeline_buffer_send_offset;
+
+  /**
+   * Last valid location in pipeline_buffer.
+   */
+  size_t pipeline_buffer_append_offset;
+
   /**
    * How many more bytes of the body do we expect
    * to read? MHD_SIZE_UNKNOWN for unknown.
@@ -708,15 +1084,40 @@ struct MHD_Connection
 
   /**
    * Last time this connection had any activity
-   * (reading or writing).
+   * (reading or writing), in milliseconds of
+   * #MHD_monotonic_time_ms().
+   */
+  uint64_t last_activity;
+
+  /**
+   * Times (in microseconds of #MHD_monotonic_time_us()) at which
+   * the current request reached the points of `enum MHD_LatencyStamp`;
+   * zero if not (yet) reached.  Only used if the daemon keeps
+   * latency histograms.
    */
-  time_t last_activity;
+  uint64_t latency_stamps[MHD_LATENCY_STAMP_COUNT];
 
   /**
-   * After how many seconds of inactivity should
+   * After how many milliseconds of inactivity should
    * this connection time out?  Zero for no timeout.
    */
-  unsigned int connection_timeout;
+  uint64_t connection_timeout;
+
+  /**
+   * Deadline (in milliseconds of #MHD_monotonic_time_ms()) under
+   * which the connection is filed in the daemon's timer wheel.
+   * As activity only updates `last_activity`, the real deadline may
+   * be later than this; the wheel re-files the connection when the
+   * stale deadline is reached.
+   */
+  uint64_t timer_deadline;
+
+  /**
+   * Slot of the timer wheel the connection is in, plus one
+   * (level * #MHD_TIMER_WHEEL_SLOTS + slot + 1); zero if the
+   * connection is not in the timer wheel.
+   */
+  unsigned int timer_slot;
 
   /**
    * Did we ever call the "default_handler" on this connection?
@@ -757,6 +1158,48 @@ struct MHD_Connection
   enum MHD_EpollState epoll_state;
 #endif
 
+#if IO_URING_SUPPORT
+  /**
+   * Operations of this connection in the io_uring of the daemon
+   * (bitmask of `enum MHD_UringState` values).
+   */
+  unsigned int uring_state;
+
+  /**
+   * Error (errno value) reported by the last receive operation,
+   * 0 for none.
+   */
+  int uring_error;
+
+  /**
+   * First of the buffers (ID plus one) holding received data that
+   * was not yet consumed, 0 for none.
+   */
+  unsigned int uring_in_head;
+
+  /**
+   * Last of the buffers (ID plus one) holding received data that
+   * was not yet consumed, 0 for none.
+   */
+  unsigned int uring_in_tail;
+
+  /**
+   * Number of buffers in the list from `uring_in_head`.
+   */
+  unsigned int uring_in_count;
+
+  /**
+   * Number of bytes of the first buffer that were already consumed.
+   */
+  size_t uring_in_offset;
+
+  /**
+   * Next connection in the list of connections waiting for
+   * receive buffers to become available.
+   */
+  struct MHD_Connection *nextU;
+#endif
+
   /**
    * State in the FSM for this connection.
    */
@@ -805,6 +1248,48 @@ struct MHD_Connection
    */
   size_t current_chunk_offset;
 
+  /**
+   * File descriptor that receives the rest of the request body
+   * (see #MHD_CONNECTION_OPTION_UPLOAD_FD); only valid if
+   * @e upload_to_fd is #MHD_YES.
+   */
+  int upload_fd;
+
+  /**
+   * #MHD_YES if the request body goes to @e upload_fd instead
+   * of the access handler.
+   */
+  int upload_to_fd;
+
+  /**
+   * Pipe through which we splice() the request body from the
+   * socket to @e upload_fd; only valid if @e upload_splice is #MHD_YES.
+   */
+  int upload_pipe[2];
+
+  /**
+   * #MHD_YES if we have @e upload_pipe.
+   */
+  int upload_splice;
+
+  /**
+   * Buffer of the application into which we receive the request
+   * body (see #MHD_CONNECTION_OPTION_UPLOAD_BUFFER), NULL if the
+   * body goes through our read buffer.
+   */
+  char *upload_buffer;
+
+  /**
+   * Size of @e upload_buffer.
+   */
+  size_t upload_buffer_size;
+
+  /**
+   * Number of bytes at the beginning of @e upload_buffer that
+   * the access handler has not processed yet.
+   */
+  size_t upload_buffer_offset;
+
   /**
    * Handler used for processing read connection operations
    */
@@ -830,6 +1315,14 @@ struct MHD_Connection
    */
   TransmitCallback send_cls;
 
+#if HAVE_SENDMSG
+  /**
+   * Function used for writing the HTTP response header together
+   * with the response body; NULL if not supported (i.e. for TLS).
+   */
+  TransmitVecCallback sendv_cls;
+#endif
+
 #if HTTPS_SUPPORT
   /**
    * State required for HTTPS/SSL/TLS support.
@@ -851,6 +1344,30 @@ struct MHD_Connection
    * even though the socket is not?
    */
   int tls_read_ready;
+
+  /**
+   * #MHD_YES if the kernel encrypts the data we send on this
+   * connection (see #MHD_OPTION_HTTPS_KTLS), so that we can
+   * use plain `send()` and `sendfile()`.
+   */
+  int tls_ktls;
+
+  /**
+   * #MHD_YES from the moment the connection is handed to a handshake
+   * thread (see #MHD_OPTION_HTTPS_HANDSHAKE_THREADS) until the event
+   * loop took over @e tls_handshake_result.
+   */
+  int tls_handshake_offloaded;
+
+  /**
+   * Return value of `gnutls_handshake()` on the handshake thread.
+   */
+  int tls_handshake_result;
+
+  /**
+   * Next pointer in the queue of the handshake threads.
+   */
+  struct MHD_Connection *nextH;
 #endif
 
   /**
@@ -859,7 +1376,8 @@ struct MHD_Connection
   int suspended;
 
   /**
-   * Is the connection wanting to resume?
+   * Is the connection wanting to resume (that is, is it in
+   * the resume queue of the daemon)?
    */
   int resuming;
 };
@@ -891,11 +1409,169 @@ typedef size_t (*UnescapeCallback)(void *cls,
 
 
 /**
- * State kept for each MHD daemon.  All connections are kept in two
- * doubly-linked lists.  The first one reflects the state of the
- * connection in terms of what operations we are waiting for (read,
- * write, locally blocked, cleanup) whereas the second is about its
- * timeout state (default or custom).
+ * Number of bits of the deadline covered by each level of the
+ * timer wheel.
+ */
+#define MHD_TIMER_WHEEL_BITS 6
+
+/**
+ * Number of slots per level of the timer wheel.
+ */
+#define MHD_TIMER_WHEEL_SLOTS (1 << MHD_TIMER_WHEEL_BITS)
+
+/**
+ * Number of levels of the timer wheel; with 6 bits per level
+ * this covers deadlines up to 2^42 ms into the future.
+ */
+#define MHD_TIMER_WHEEL_LEVELS 7
+
+
+/**
+ * Hierarchical timer wheel for connection timeouts.  Level 'l'
+ * has #MHD_TIMER_WHEEL_SLOTS slots, each covering 2^(6*l)
+ * milliseconds; connections are filed by the most significant
+ * 6-bit group in which their deadline differs from the current
+ * time of the wheel, and moved down one or more levels when the
+ * wheel reaches the start of their slot.  Insertion and removal
+ * are O(1); finding the next deadline looks at one bitmap word
+ * per level.  See timerwheel.c.
+ */
+struct MHD_TimerWheel
+{
+  /**
+   * Heads of the XDLLs of connections per level and slot.
+   */
+  struct MHD_Connection *head[MHD_TIMER_WHEEL_LEVELS][MHD_TIMER_WHEEL_SLOTS];
+
+  /**
+   * Tails of the XDLLs of connections per level and slot.
+   */
+  struct MHD_Connection *tail[MHD_TIMER_WHEEL_LEVELS][MHD_TIMER_WHEEL_SLOTS];
+
+  /**
+   * Bitmap of the non-empty slots of each level.
+   */
+  uint64_t used[MHD_TIMER_WHEEL_LEVELS];
+
+  /**
+   * Time (in milliseconds) up to which the wheel has been advanced.
+   */
+  uint64_t now;
+
+  /**
+   * Number of connections in the wheel.
+   */
+  unsigned int count;
+};
+
+
+/**
+ * Size of a cache line; used to keep data that is updated by
+ * different threads apart.
+ */
+#define MHD_CACHE_LINE_SIZE 64
+
+
+/**
+ * Runtime counters of a daemon, or of one worker of a thread pool.
+ * Each worker only updates its own counters; they are summed up on
+ * demand by #MHD_get_daemon_stats().  The padding keeps the counters
+ * of neighbouring workers in the `worker_pool' array (and the fields
+ * around them) on different cache lines.  See also
+ * `struct MHD_DaemonStats' for the meaning of the fields.
+ */
+struct MHD_DaemonCounters
+{
+  char pad_before[MHD_CACHE_LINE_SIZE];
+
+  volatile uint64_t connections_accepted;
+
+  volatile uint64_t accept_failures;
+
+  volatile uint64_t connections_rejected;
+
+  volatile uint64_t requests;
+
+  volatile uint64_t keepalive_reuses;
+
+  volatile uint64_t timeouts;
+
+  volatile uint64_t suspended_connections;
+
+  volatile uint64_t requests_too_large;
+
+  volatile uint64_t uris_too_long;
+
+  volatile uint64_t bytes_received;
+
+  volatile uint64_t bytes_sent;
+
+  volatile uint64_t bytes_sendfile;
+
+  volatile uint64_t bytes_spliced;
+
+  volatile uint64_t bytes_received_direct;
+
+  volatile uint64_t pool_bytes_released;
+
+  volatile uint64_t tls_handshakes_full;
+
+  volatile uint64_t tls_handshakes_resumed;
+
+  volatile uint64_t tls_handshakes_offloaded;
+
+  char pad_after[MHD_CACHE_LINE_SIZE];
+};
+
+
+/**
+ * Atomically add @a n to the `uint64_t` at @a ptr.  Counters and
+ * histograms may be updated from several threads (thread-per-connection
+ * mode, external calls to #MHD_add_connection()), so we use an atomic
+ * add where 64-bit atomics are available natively; otherwise updates
+ * may occasionally be lost, which is acceptable for statistics.
+ */
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8) && defined(__ATOMIC_RELAXED)
+#define MHD_ATOMIC_ADD_U64_(ptr,n) \
+  ((void) __atomic_fetch_add ((ptr), (uint64_t) (n), __ATOMIC_RELAXED))
+#elif defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+#define MHD_ATOMIC_ADD_U64_(ptr,n) \
+  ((void) __sync_fetch_and_add ((ptr), (uint64_t) (n)))
+#else
+#define MHD_ATOMIC_ADD_U64_(ptr,n) \
+  ((void) (*(ptr) += (uint64_t) (n)))
+#endif
+
+/**
+ * Add @a n to the counter @a field of @a d.
+ */
+#define MHD_STATS_ADD_(d,field,n) MHD_ATOMIC_ADD_U64_ (&(d)->counters.field, n)
+
+/**
+ * Increment the counter @a field of @a d by one.
+ */
+#define MHD_STATS_INC_(d,field) MHD_STATS_ADD_(d, field, 1)
+
+/**
+ * Is the data we send on connection @a c written to the socket
+ * as-is, so that response bodies can be sent with `sendfile()`?
+ * True without TLS and with kernel TLS (#MHD_OPTION_HTTPS_KTLS).
+ */
+#if HTTPS_SUPPORT
+#define MHD_SENDS_PLAIN_(c) \
+  ( (0 == ((c)->daemon->options & MHD_USE_SSL)) || \
+    (MHD_YES == (c)->tls_ktls) )
+#else
+#define MHD_SENDS_PLAIN_(c) (0 == ((c)->daemon->options & MHD_USE_SSL))
+#endif
+
+
+/**
+ * State kept for each MHD daemon.  All connections are kept in a
+ * doubly-linked list that reflects the state of the connection in
+ * terms of what operations we are waiting for (read, write, locally
+ * blocked, cleanup); in addition, connections with a timeout are
+ * kept in the timer wheel of the daemon.
  */
 struct MHD_Daemon
 {
@@ -953,37 +1629,55 @@ struct MHD_Daemon
 #endif
 
   /**
-   * Head of the XDLL of ALL connections with a default ('normal')
-   * timeout, sorted by timeout (earliest at the tail, most recently
-   * used connection at the head).  MHD can just look at the tail of
-   * this list to determine the timeout for all of its elements;
-   * whenever there is an event of a connection, the connection is
-   * moved back to the tail of the list.
-   *
-   * All connections by default start in this list; if a custom
-   * timeout that does not match 'connection_timeout' is set, they
-   * are moved to the 'manual_timeout_head'-XDLL.
+   * Head of the list (linked via `next`) of connection objects kept
+   * for recycling, each with its emptied memory pool (or NULL).
+   */
+  struct MHD_Connection *connection_cache_head;
+
+  /**
+   * Number of entries in the `connection_cache_head` list.
+   */
+  unsigned int connection_cache_count;
+
+  /**
+   * Maximum number of connection objects to keep for recycling
+   * (per worker when using a thread pool); zero to disable.
+   */
+  unsigned int connection_cache_size;
+
+  /**
+   * Non-zero to give the unused memory of the pools of idle
+   * keep-alive connections (and of recycled connections) back to
+   * the operating system.
+   */
+  unsigned int pool_release;
+
+  /**
+   * Second (as returned by time()) for which @e date_line was
+   * generated.  Each worker of a thread pool has its own line;
+   * with #MHD_USE_THREAD_PER_CONNECTION, access is protected by
+   * @e cleanup_connection_mutex.
    */
-  struct MHD_Connection *normal_timeout_head;
+  time_t date_line_time;
 
   /**
-   * Tail of the XDLL of ALL connections with a default timeout,
-   * sorted by timeout (earliest timeout at the tail).
+   * Number of bytes in @e date_line.
    */
-  struct MHD_Connection *normal_timeout_tail;
+  size_t date_line_len;
 
   /**
-   * Head of the XDLL of ALL connections with a non-default/custom
-   * timeout, unsorted.  MHD will do a O(n) scan over this list to
-   * determine the current timeout.
+   * "Date:" header line for @e date_line_time, shared by all
+   * responses generated within the same second.
    */
-  struct MHD_Connection *manual_timeout_head;
+  char date_line[64];
 
   /**
-   * Tail of the XDLL of ALL connections with a non-default/custom
-   * timeout, unsorted.
+   * Timer wheel with the timeouts of all connections that are not
+   * suspended and have a timeout set (unused with
+   * #MHD_USE_THREAD_PER_CONNECTION, where each thread watches the
+   * timeout of its own connection).
    */
-  struct MHD_Connection *manual_timeout_tail;
+  struct MHD_TimerWheel timer_wheel;
 
   /**
    * Function to call to check if we should accept or reject an
@@ -1055,9 +1749,15 @@ struct MHD_Daemon
   struct MHD_Daemon *worker_pool;
 
   /**
-   * Table storing number of connections per IP
+   * Table storing number of connections per IP, split into
+   * #MHD_IP_SHARDS shards of @e per_ip_shard_size slots.
    */
-  void *per_ip_connection_count;
+  struct MHD_IPCount *per_ip_slots;
+
+  /**
+   * Locks for inserting into the shards of @e per_ip_slots.
+   */
+  MHD_mutex_ *per_ip_locks;
 
   /**
    * Size of the per-connection memory pools.
@@ -1084,11 +1784,6 @@ struct MHD_Daemon
    */
   MHD_thread_handle_ pid;
 
-  /**
-   * Mutex for per-IP connection counts.
-   */
-  MHD_mutex_ per_ip_connection_mutex;
-
   /**
    * Mutex for (modifying) access to the "cleanup" connection DLL.
    */
@@ -1108,6 +1803,33 @@ struct MHD_Daemon
    */
   int listening_address_reuse;
 
+  /**
+   * Listen socket setup of the thread pool:
+   * 0: all workers share the listen socket of the master;
+   * 1: every worker has its own listen socket (SO_REUSEPORT group);
+   * 2: as 1, and connections are steered to workers by CPU.
+   */
+  unsigned int thread_pool_reuseport;
+
+#if IO_URING_SUPPORT
+  /**
+   * Our io_uring instance, NULL if not using io_uring.
+   */
+  struct MHD_Uring *uring;
+
+  /**
+   * Head of DLL of closed connections that still have operations
+   * pending in the io_uring (and thus cannot be freed yet).
+   */
+  struct MHD_Connection *uring_zombies_head;
+
+  /**
+   * Tail of DLL of closed connections that still have operations
+   * pending in the io_uring.
+   */
+  struct MHD_Connection *uring_zombies_tail;
+#endif
+
 #if EPOLL_SUPPORT
   /**
    * File descriptor associated with our epoll loop.
@@ -1135,10 +1857,20 @@ struct MHD_Daemon
    */
   int shutdown;
 
-  /*
-   * Do we need to process resuming connections?
+  /**
+   * Set to #MHD_YES by #MHD_quiesce_daemon() for workers of the
+   * thread pool with their own listen socket; the worker then
+   * accepts what is left in the backlog and closes the socket.
    */
-  int resuming;
+  volatile int quiesce_listen;
+
+  /**
+   * Head of the queue of connections that were resumed but not yet
+   * moved back to the active connections.  Pushed to by
+   * #MHD_resume_connection() from any thread (lock-free if atomic
+   * compare-and-swap is available), emptied by the event loop.
+   */
+  struct MHD_Connection *volatile resume_head;
 
   /**
    * Number of active parallel connections.
@@ -1151,10 +1883,10 @@ struct MHD_Daemon
   unsigned int connection_limit;
 
   /**
-   * After how many seconds of inactivity should
+   * After how many milliseconds of inactivity should
    * connections time out?  Zero for no timeout.
    */
-  unsigned int connection_timeout;
+  uint64_t connection_timeout;
 
   /**
    * Maximum number of connections per IP, or 0 for
@@ -1162,6 +1894,16 @@ struct MHD_Daemon
    */
   unsigned int per_ip_connection_limit;
 
+  /**
+   * Number of slots per shard of @e per_ip_slots (power of 2).
+   */
+  unsigned int per_ip_shard_size;
+
+  /**
+   * Seed for hashing addresses into @e per_ip_slots.
+   */
+  uint32_t per_ip_seed;
+
   /**
    * Daemon's options.
    */
@@ -1235,6 +1977,50 @@ struct MHD_Daemon
    */
   unsigned int num_tls_read_ready;
 
+  /**
+   * Non-zero if #MHD_OPTION_HTTPS_KTLS was given (and not yet
+   * found to be unsupported by the kernel).  Cleared atomically
+   * as TLS handshakes may run in the threads of the handshake pool.
+   */
+  volatile unsigned int https_ktls;
+
+  /**
+   * Lifetime of session tickets in seconds (and interval for
+   * replacing the ticket key), 0 if tickets are disabled.
+   * See #MHD_OPTION_HTTPS_SESSION_TICKETS.
+   */
+  unsigned int tls_ticket_lifetime;
+
+  /**
+   * Maximum number of sessions in @e tls_session_cache.
+   * See #MHD_OPTION_HTTPS_SESSION_CACHE_SIZE.
+   */
+  unsigned int tls_session_cache_size;
+
+  /**
+   * Keys for session tickets, NULL if disabled.  Owned by the
+   * master daemon, shared by the workers of a thread pool.
+   */
+  struct MHD_TLS_TicketKeys *tls_ticket_keys;
+
+  /**
+   * Cache of sessions for resumption, NULL if disabled.  Owned by
+   * the master daemon, shared by the workers of a thread pool.
+   */
+  struct MHD_TLS_SessionCache *tls_session_cache;
+
+  /**
+   * Number of handshake threads, 0 to run handshakes in the event
+   * loop.  See #MHD_OPTION_HTTPS_HANDSHAKE_THREADS.
+   */
+  unsigned int tls_handshake_threads;
+
+  /**
+   * The handshake threads, NULL if disabled.  Owned by the master
+   * daemon, shared by the workers of a thread pool.
+   */
+  struct MHD_TLS_HandshakePool *tls_handshake_pool;
+
 #endif
 
 #ifdef DAUTH_SUPPORT
@@ -1245,14 +2031,22 @@ struct MHD_Daemon
   const char *digest_auth_random;
 
   /**
-   * An array that contains the map nonce-nc.
+   * An array that contains the map nonce-nc, organized as
+   * `nonce_nc_buckets' buckets of #MHD_NONCE_NC_WAYS entries.
    */
   struct MHD_NonceNc *nnc;
 
   /**
-   * A rw-lock for synchronizing access to `nnc'.
+   * Array of #MHD_NONCE_NC_LOCKS locks for synchronizing access
+   * to the buckets of `nnc'.  Allocated separately so that the
+   * workers of a thread pool share them with the master.
    */
-  MHD_mutex_ nnc_lock;
+  MHD_mutex_ *nnc_locks;
+
+  /**
+   * Number of buckets in `nnc'.
+   */
+  unsigned int nonce_nc_buckets;
 
   /**
    * Size of `digest_auth_random.
@@ -1272,6 +2066,40 @@ struct MHD_Daemon
    */
   unsigned int fastopen_queue_size;
 #endif
+  /**
+   * Runtime counters of this daemon (or worker).
+   */
+  struct MHD_DaemonCounters counters;
+
+  /**
+   * Latency histograms of this daemon (or worker), one per
+   * `enum MHD_LatencyPhase`; NULL if not enabled.
+   */
+  struct MHD_LatencyHistogram *latency;
+
+  /**
+   * Histogram returned by #MHD_get_daemon_info() for
+   * #MHD_DAEMON_INFO_LATENCY_HISTOGRAM; only allocated for the
+   * master daemon.
+   */
+  struct MHD_LatencyHistogram *latency_export;
+
+  /**
+   * Points to `latency_export`, so that we can return its address
+   * as a `union MHD_DaemonInfo`.
+   */
+  const struct MHD_LatencyHistogram *latency_info;
+
+  /**
+   * Protects `latency_export` while it is computed; only
+   * initialized if `latency_export` was allocated.
+   */
+  MHD_mutex_ latency_mutex;
+
+  /**
+   * Non-zero if #MHD_OPTION_LATENCY_HISTOGRAMS was given.
+   */
+  unsigned int latency_histograms;
 };
 
 
@@ -1422,6 +2250,45 @@ time_t
 MHD_monotonic_time(void);
 
 
+/**
+ * Like #MHD_monotonic_time(), but with millisecond resolution.
+ *
+ * @return 'current' time in milliseconds
+ */
+uint64_t
+MHD_monotonic_time_ms (void);
+
+
+/**
+ * Like #MHD_monotonic_time(), but with microsecond resolution.
+ *
+ * @return 'current' time in microseconds
+ */
+uint64_t
+MHD_monotonic_time_us (void);
+
+
+/**
+ * Space needed for an HTTP date formatted by
+ * #MHD_format_http_date_(), including the 0-terminator.
+ */
+#define MHD_HTTP_DATE_SIZE 32
+
+
+/**
+ * Format @a t as an HTTP date ("IMF-fixdate" of RFC 7231),
+ * for example "Sun, 06 Nov 1994 08:49:37 GMT".
+ *
+ * @param date where to write the date, with at least
+ *        #MHD_HTTP_DATE_SIZE bytes of space; set to the
+ *        empty string if @a t cannot be converted
+ * @param t time to format
+ */
+void
+MHD_format_http_date_ (char *date,
+                       time_t t);
+
+
 /**
  * Convert all occurences of '+' to ' '.
  *
@@ -1431,4 +2298,23 @@ void
 MHD_unescape_plus (char *arg);
 
 
+#if HTTPS_SUPPORT
+/**
+ * Hand the TLS handshake of @a connection to the handshake threads
+ * of its daemon (see #MHD_OPTION_HTTPS_HANDSHAKE_THREADS).  The
+ * connection is suspended until a handshake thread has called
+ * `gnutls_handshake()` on it and stored the result in its
+ * `tls_handshake_result`.  Must only be called from the event loop
+ * of the connection's daemon.
+ *
+ * @param connection connection in #MHD_TLS_CONNECTION_INIT state
+ * @return #MHD_YES if a handshake thread will process the connection,
+ *         #MHD_NO if the caller must run the handshake itself
+ *         (the daemon is shutting down)
+ */
+int
+MHD_tls_handshake_offload_ (struct MHD_Connection *connection);
+#endif
+
+
 #endif
@@ -0,0 +1,217 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file latency.c
+ * @brief log-linear histograms of request processing latencies
+ * @author Christian Grothoff
+ *
+ * Values below 2^SUB_BITS have a bucket each.  Above, the range
+ * [2^k, 2^(k+1)) is split into 2^SUB_BITS buckets of width
+ * 2^(k-SUB_BITS), so the relative error is bounded by 2^-SUB_BITS
+ * over the whole range, as in HDR histograms.
+ */
+
+#include "latency.h"
+
+/**
+ * Number of bits below the most significant bit that select the
+ * bucket within a power of two.
+ */
+#define SUB_BITS 4
+
+/**
+ * Number of buckets per power of two.
+ */
+#define SUB_BUCKETS (1U << SUB_BITS)
+
+/**
+ * Most significant bit of the largest value that still gets
+ * its own bucket.
+ */
+#define MAX_MSB (SUB_BITS - 1 + MHD_LATENCY_HISTOGRAM_BUCKETS / SUB_BUCKETS - 1)
+
+
+/**
+ * Find the index of the highest bit set.
+ *
+ * @param bits value, must not be zero
+ * @return index of the highest bit set in @a bits
+ */
+static unsigned int
+highest_bit (uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - (unsigned int) __builtin_clzll (bits);
+#else
+  unsigned int i;
+
+  for (i = 0; 0 != (bits >>= 1); i++)
+    ;
+  return i;
+#endif
+}
+
+
+/**
+ * Find the bucket of a latency histogram that counts @a value.
+ *
+ * @param value value in microseconds
+ * @return index of the bucket, less than #MHD_LATENCY_HISTOGRAM_BUCKETS
+ */
+unsigned int
+MHD_latency_bucket_ (uint64_t value)
+{
+  unsigned int msb;
+
+  if (value < SUB_BUCKETS)
+    return (unsigned int) value;
+  msb = highest_bit (value);
+  if (msb > MAX_MSB)
+    return MHD_LATENCY_HISTOGRAM_BUCKETS - 1;
+  return SUB_BUCKETS * (msb - SUB_BITS + 1)
+    + (unsigned int) (value >> (msb - SUB_BITS)) - SUB_BUCKETS;
+}
+
+
+/**
+ * Add a value to a latency histogram.  Safe to call from several
+ * threads at once for the same histogram (where 64-bit atomics
+ * are available).
+ *
+ * @param histogram histogram to update
+ * @param value value in microseconds
+ */
+void
+MHD_latency_record_ (struct MHD_LatencyHistogram *histogram,
+                     uint64_t value)
+{
+  uint64_t max;
+
+  MHD_ATOMIC_ADD_U64_ (&histogram->buckets[MHD_latency_bucket_ (value)], 1);
+  MHD_ATOMIC_ADD_U64_ (&histogram->count, 1);
+  MHD_ATOMIC_ADD_U64_ (&histogram->sum, value);
+  max = histogram->max;
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+  while ( (value > max) &&
+          (! __sync_bool_compare_and_swap (&histogram->max, max, value)) )
+    max = histogram->max;
+#else
+  if (value > max)
+    histogram->max = value;
+#endif
+}
+
+
+/**
+ * Add the values of histogram @a src to histogram @a dst.
+ *
+ * @param dst histogram to update
+ * @param src histogram to add
+ */
+void
+MHD_latency_merge_ (struct MHD_LatencyHistogram *dst,
+                    const struct MHD_LatencyHistogram *src)
+{
+  unsigned int i;
+
+  dst->count += src->count;
+  dst->sum += src->sum;
+  if (src->max > dst->max)
+    dst->max = src->max;
+  for (i = 0; i < MHD_LATENCY_HISTOGRAM_BUCKETS; i++)
+    dst->buckets[i] += src->buckets[i];
+}
+
+
+/**
+ * Obtain the largest value that is counted in the given bucket
+ * of a `struct MHD_LatencyHistogram`.  The smallest value of
+ * the bucket is one more than the limit of the previous bucket
+ * (or zero for the first bucket).
+ *
+ * @param bucket index of the bucket
+ * @return largest value (in microseconds) of the bucket,
+ *         UINT64_MAX for the last bucket
+ * @ingroup specialized
+ */
+uint64_t
+MHD_latency_histogram_bucket_limit (unsigned int bucket)
+{
+  unsigned int shift;
+
+  if (bucket >= MHD_LATENCY_HISTOGRAM_BUCKETS - 1)
+    return (uint64_t) -1;
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+  shift = bucket / SUB_BUCKETS - 1;
+  return (((uint64_t) (SUB_BUCKETS + bucket % SUB_BUCKETS + 1)) << shift) - 1;
+}
+
+
+/**
+ * Estimate a percentile of the values recorded in a latency
+ * histogram.  The result is the upper limit of the bucket that
+ * contains the percentile (but never more than the largest value
+ * recorded).
+ *
+ * @param histogram histogram to evaluate
+ * @param percentile percentile to compute, between 0 and 100
+ * @return estimated value in microseconds, 0 if the histogram
+ *         is empty
+ * @ingroup specialized
+ */
+uint64_t
+MHD_latency_histogram_percentile (const struct MHD_LatencyHistogram *histogram,
+                                  double percentile)
+{
+  uint64_t rank;
+  uint64_t seen;
+  uint64_t limit;
+  unsigned int i;
+
+  if ( (NULL == histogram) ||
+       (0 == histogram->count) )
+    return 0;
+  if (percentile <= 0.0)
+    rank = 1;
+  else if (percentile >= 100.0)
+    rank = histogram->count;
+  else
+    {
+      rank = (uint64_t) (percentile * histogram->count / 100.0);
+      if (rank < percentile * histogram->count / 100.0)
+        rank++; /* round up */
+      if (0 == rank)
+        rank = 1;
+    }
+  seen = 0;
+  for (i = 0; i < MHD_LATENCY_HISTOGRAM_BUCKETS; i++)
+    {
+      seen += histogram->buckets[i];
+      if (seen >= rank)
+        break;
+    }
+  if (MHD_LATENCY_HISTOGRAM_BUCKETS == i)
+    return histogram->max;
+  limit = MHD_latency_histogram_bucket_limit (i);
+  return (limit < histogram->max) ? limit : histogram->max;
+}
+
+/* end of latency.c */
@@ -0,0 +1,66 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file latency.h
+ * @brief log-linear histograms of request processing latencies
+ * @author Christian Grothoff
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "internal.h"
+
+
+/**
+ * Find the bucket of a latency histogram that counts @a value.
+ *
+ * @param value value in microseconds
+ * @return index of the bucket, less than #MHD_LATENCY_HISTOGRAM_BUCKETS
+ */
+unsigned int
+MHD_latency_bucket_ (uint64_t value);
+
+
+/**
+ * Add a value to a latency histogram.  Safe to call from several
+ * threads at once for the same histogram (where 64-bit atomics
+ * are available).
+ *
+ * @param histogram histogram to update
+ * @param value value in microseconds
+ */
+void
+MHD_latency_record_ (struct MHD_LatencyHistogram *histogram,
+                     uint64_t value);
+
+
+/**
+ * Add the values of histogram @a src to histogram @a dst.
+ *
+ * @param dst histogram to update
+ * @param src histogram to add
+ */
+void
+MHD_latency_merge_ (struct MHD_LatencyHistogram *dst,
+                    const struct MHD_LatencyHistogram *src);
+
+
+#endif
@@ -0,0 +1,352 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file linescan.c
+ * @brief scanning of request lines and headers for delimiters,
+ *        using SIMD instructions where the CPU has them
+ * @author Christian Grothoff
+ *
+ * All implementations only ever read the @a len bytes they are
+ * given; the vector loops stop before the last partial block,
+ * which is then handled with narrower loads.
+ */
+
+#include "linescan.h"
+
+#if MHD_LINESCAN_SSE2
+#include <emmintrin.h>
+#endif
+#if MHD_LINESCAN_AVX2
+#include <immintrin.h>
+#endif
+
+
+/**
+ * Portable implementation of #MHD_linescan_find2.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character to look for
+ * @param c2 second character to look for
+ * @return offset of the first @a c1 or @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_find2_scalar (const char *buf,
+                           size_t len,
+                           char c1,
+                           char c2)
+{
+  size_t pos;
+
+  for (pos = 0; pos < len; pos++)
+    if ( (c1 == buf[pos]) ||
+         (c2 == buf[pos]) )
+      break;
+  return pos;
+}
+
+
+#if MHD_LINESCAN_SSE2
+/**
+ * SSE2 implementation of #MHD_linescan_find2.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character to look for
+ * @param c2 second character to look for
+ * @return offset of the first @a c1 or @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_find2_sse2 (const char *buf,
+                         size_t len,
+                         char c1,
+                         char c2)
+{
+  const __m128i v1 = _mm_set1_epi8 (c1);
+  const __m128i v2 = _mm_set1_epi8 (c2);
+  __m128i data;
+  unsigned int mask;
+  size_t pos;
+
+  for (pos = 0; pos + 16 <= len; pos += 16)
+    {
+      data = _mm_loadu_si128 ((const __m128i *) &buf[pos]);
+      mask = (unsigned int) _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (data, v1),
+                                                             _mm_cmpeq_epi8 (data, v2)));
+      if (0 != mask)
+        return pos + __builtin_ctz (mask);
+    }
+  return pos + MHD_linescan_find2_scalar (&buf[pos], len - pos, c1, c2);
+}
+#endif
+
+
+#if MHD_LINESCAN_AVX2
+/**
+ * AVX2 implementation of #MHD_linescan_find2.  Must only be
+ * used if #MHD_linescan_have_avx2() returns #MHD_YES.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character to look for
+ * @param c2 second character to look for
+ * @return offset of the first @a c1 or @a c2 in @a buf,
+ *         @a len if there is none
+ */
+__attribute__ ((target ("avx2")))
+size_t
+MHD_linescan_find2_avx2 (const char *buf,
+                         size_t len,
+                         char c1,
+                         char c2)
+{
+  const __m256i v1 = _mm256_set1_epi8 (c1);
+  const __m256i v2 = _mm256_set1_epi8 (c2);
+  __m256i data;
+  __m128i half;
+  unsigned int mask;
+  size_t pos;
+
+  for (pos = 0; pos + 32 <= len; pos += 32)
+    {
+      data = _mm256_loadu_si256 ((const __m256i *) &buf[pos]);
+      mask = (unsigned int) _mm256_movemask_epi8 (_mm256_or_si256 (_mm256_cmpeq_epi8 (data, v1),
+                                                                   _mm256_cmpeq_epi8 (data, v2)));
+      if (0 != mask)
+        return pos + __builtin_ctz (mask);
+    }
+  /* handle a remaining half block here instead of calling the SSE2
+     version, as mixing VEX and legacy SSE code is expensive */
+  if (pos + 16 <= len)
+    {
+      half = _mm_loadu_si128 ((const __m128i *) &buf[pos]);
+      mask = (unsigned int) _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (half, _mm256_castsi256_si128 (v1)),
+                                                             _mm_cmpeq_epi8 (half, _mm256_castsi256_si128 (v2))));
+      if (0 != mask)
+        return pos + __builtin_ctz (mask);
+      pos += 16;
+    }
+  return pos + MHD_linescan_find2_scalar (&buf[pos], len - pos, c1, c2);
+}
+
+
+/**
+ * Check if the CPU supports AVX2.
+ *
+ * @return #MHD_YES if so, #MHD_NO if not
+ */
+int
+MHD_linescan_have_avx2 (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("avx2") ? MHD_YES : MHD_NO;
+}
+#endif
+
+
+/**
+ * Pick the best implementation for this CPU, install it as
+ * #MHD_linescan_find2 and run it.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character to look for
+ * @param c2 second character to look for
+ * @return offset of the first @a c1 or @a c2 in @a buf,
+ *         @a len if there is none
+ */
+static size_t
+find2_select (const char *buf,
+              size_t len,
+              char c1,
+              char c2)
+{
+  MHD_LineScanner impl;
+
+  impl = &MHD_linescan_find2_scalar;
+#if MHD_LINESCAN_SSE2
+  impl = &MHD_linescan_find2_sse2;
+#endif
+#if MHD_LINESCAN_AVX2
+  if (MHD_YES == MHD_linescan_have_avx2 ())
+    impl = &MHD_linescan_find2_avx2;
+#endif
+  /* all threads arrive at the same result, so racing here is harmless */
+  MHD_linescan_find2 = impl;
+  return impl (buf, len, c1, c2);
+}
+
+
+/**
+ * Find the first occurrence of either of two characters in a
+ * buffer, using the fastest implementation the CPU supports.
+ * The implementation is picked on the first call.
+ */
+MHD_LineScanner MHD_linescan_find2 = &find2_select;
+
+
+/**
+ * Portable implementation of #MHD_linescan_findpair.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character of the pair
+ * @param c2 second character of the pair
+ * @return offset of the first @a c1 followed by @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_findpair_scalar (const char *buf,
+                              size_t len,
+                              char c1,
+                              char c2)
+{
+  const char *pos;
+
+  if (len < 2)
+    return len;
+  pos = buf;
+  while (NULL != (pos = memchr (pos, c1, len - 1 - (pos - buf))))
+    {
+      if (c2 == pos[1])
+        return pos - buf;
+      pos++;
+    }
+  return len;
+}
+
+
+#if MHD_LINESCAN_SSE2
+/**
+ * SSE2 implementation of #MHD_linescan_findpair.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character of the pair
+ * @param c2 second character of the pair
+ * @return offset of the first @a c1 followed by @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_findpair_sse2 (const char *buf,
+                            size_t len,
+                            char c1,
+                            char c2)
+{
+  const __m128i v1 = _mm_set1_epi8 (c1);
+  const __m128i v2 = _mm_set1_epi8 (c2);
+  unsigned int mask;
+  size_t pos;
+
+  /* compare each block with c1, and the same block shifted by
+     one byte with c2 */
+  for (pos = 0; pos + 17 <= len; pos += 16)
+    {
+      mask = (unsigned int) _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) &buf[pos]), v1),
+                                                              _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) &buf[pos + 1]), v2)));
+      if (0 != mask)
+        return pos + __builtin_ctz (mask);
+    }
+  return pos + MHD_linescan_findpair_scalar (&buf[pos], len - pos, c1, c2);
+}
+#endif
+
+
+#if MHD_LINESCAN_AVX2
+/**
+ * AVX2 implementation of #MHD_linescan_findpair.  Must only be
+ * used if #MHD_linescan_have_avx2() returns #MHD_YES.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character of the pair
+ * @param c2 second character of the pair
+ * @return offset of the first @a c1 followed by @a c2 in @a buf,
+ *         @a len if there is none
+ */
+__attribute__ ((target ("avx2")))
+size_t
+MHD_linescan_findpair_avx2 (const char *buf,
+                            size_t len,
+                            char c1,
+                            char c2)
+{
+  const __m256i v1 = _mm256_set1_epi8 (c1);
+  const __m256i v2 = _mm256_set1_epi8 (c2);
+  unsigned int mask;
+  size_t pos;
+
+  for (pos = 0; pos + 33 <= len; pos += 32)
+    {
+      mask = (unsigned int) _mm256_movemask_epi8 (_mm256_and_si256 (_mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) &buf[pos]), v1),
+                                                                    _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) &buf[pos + 1]), v2)));
+      if (0 != mask)
+        return pos + __builtin_ctz (mask);
+    }
+  /* the rest is shorter than a block, and thus not worth
+     switching to SSE2 for */
+  return pos + MHD_linescan_findpair_scalar (&buf[pos], len - pos, c1, c2);
+}
+#endif
+
+
+/**
+ * Pick the best implementation for this CPU, install it as
+ * #MHD_linescan_findpair and run it.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character of the pair
+ * @param c2 second character of the pair
+ * @return offset of the first @a c1 followed by @a c2 in @a buf,
+ *         @a len if there is none
+ */
+static size_t
+findpair_select (const char *buf,
+                 size_t len,
+                 char c1,
+                 char c2)
+{
+  MHD_LineScanner impl;
+
+  impl = &MHD_linescan_findpair_scalar;
+#if MHD_LINESCAN_SSE2
+  impl = &MHD_linescan_findpair_sse2;
+#endif
+#if MHD_LINESCAN_AVX2
+  if (MHD_YES == MHD_linescan_have_avx2 ())
+    impl = &MHD_linescan_findpair_avx2;
+#endif
+  /* all threads arrive at the same result, so racing here is harmless */
+  MHD_linescan_findpair = impl;
+  return impl (buf, len, c1, c2);
+}
+
+
+/**
+ * Find the first occurrence of a character immediately followed
+ * by another one in a buffer, using the fastest implementation
+ * the CPU supports.  The implementation is picked on the first call.
+ */
+MHD_LineScanner MHD_linescan_findpair = &findpair_select;
+
+/* end of linescan.c */
@@ -0,0 +1,203 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file linescan.h
+ * @brief scanning of request lines and headers for delimiters,
+ *        using SIMD instructions where the CPU has them
+ * @author Christian Grothoff
+ */
+
+#ifndef LINESCAN_H
+#define LINESCAN_H
+
+#include "internal.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && HAVE_EMMINTRIN_H
+/**
+ * Build the SSE2 scanner.
+ */
+#define MHD_LINESCAN_SSE2 1
+#endif
+
+#if MHD_LINESCAN_SSE2 && HAVE_IMMINTRIN_H && HAVE_BUILTIN_CPU_SUPPORTS
+/**
+ * Build the AVX2 scanner (used only if the CPU supports it).
+ */
+#define MHD_LINESCAN_AVX2 1
+#endif
+
+
+/**
+ * Function that finds the first occurrence of either of two
+ * characters in a buffer (#MHD_linescan_find2), or of the two
+ * characters in a row (#MHD_linescan_findpair).
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character to look for
+ * @param c2 second character to look for
+ * @return offset of the first match in @a buf,
+ *         @a len if there is none
+ */
+typedef size_t
+(*MHD_LineScanner) (const char *buf,
+                    size_t len,
+                    char c1,
+                    char c2);
+
+
+/**
+ * Find the first occurrence of either of two characters in a
+ * buffer, using the fastest implementation the CPU supports.
+ * The implementation is picked on the first call.
+ */
+extern MHD_LineScanner MHD_linescan_find2;
+
+
+/**
+ * Portable implementation of #MHD_linescan_find2.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character to look for
+ * @param c2 second character to look for
+ * @return offset of the first @a c1 or @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_find2_scalar (const char *buf,
+                           size_t len,
+                           char c1,
+                           char c2);
+
+
+#if MHD_LINESCAN_SSE2
+/**
+ * SSE2 implementation of #MHD_linescan_find2.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character to look for
+ * @param c2 second character to look for
+ * @return offset of the first @a c1 or @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_find2_sse2 (const char *buf,
+                         size_t len,
+                         char c1,
+                         char c2);
+#endif
+
+
+#if MHD_LINESCAN_AVX2
+/**
+ * AVX2 implementation of #MHD_linescan_find2.  Must only be
+ * used if #MHD_linescan_have_avx2() returns #MHD_YES.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character to look for
+ * @param c2 second character to look for
+ * @return offset of the first @a c1 or @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_find2_avx2 (const char *buf,
+                         size_t len,
+                         char c1,
+                         char c2);
+
+
+/**
+ * Check if the CPU supports AVX2.
+ *
+ * @return #MHD_YES if so, #MHD_NO if not
+ */
+int
+MHD_linescan_have_avx2 (void);
+#endif
+
+
+/**
+ * Find the first occurrence of a character immediately followed
+ * by another one in a buffer, using the fastest implementation
+ * the CPU supports.  The implementation is picked on the first call.
+ */
+extern MHD_LineScanner MHD_linescan_findpair;
+
+
+/**
+ * Portable implementation of #MHD_linescan_findpair.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character of the pair
+ * @param c2 second character of the pair
+ * @return offset of the first @a c1 followed by @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_findpair_scalar (const char *buf,
+                              size_t len,
+                              char c1,
+                              char c2);
+
+
+#if MHD_LINESCAN_SSE2
+/**
+ * SSE2 implementation of #MHD_linescan_findpair.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character of the pair
+ * @param c2 second character of the pair
+ * @return offset of the first @a c1 followed by @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_findpair_sse2 (const char *buf,
+                            size_t len,
+                            char c1,
+                            char c2);
+#endif
+
+
+#if MHD_LINESCAN_AVX2
+/**
+ * AVX2 implementation of #MHD_linescan_findpair.  Must only be
+ * used if #MHD_linescan_have_avx2() returns #MHD_YES.
+ *
+ * @param buf buffer to search
+ * @param len number of bytes in @a buf
+ * @param c1 first character of the pair
+ * @param c2 second character of the pair
+ * @return offset of the first @a c1 followed by @a c2 in @a buf,
+ *         @a len if there is none
+ */
+size_t
+MHD_linescan_findpair_avx2 (const char *buf,
+                            size_t len,
+                            char c1,
+                            char c2);
+#endif
+
+
+#endif
@@ -107,7 +107,7 @@ MHD_pool_create (size_t max)
 #endif
   if ((pool->memory == MAP_FAILED) || (pool->memory == NULL))
     {
-      pool->memory = malloc (max);
+      pool->memory = calloc (1, max);
       if (pool->memory == NULL)
         {
           free (pool);
@@ -251,34 +251,90 @@ MHD_pool_reallocate (struct MemoryPool *pool,
 
 /**
  * Clear all entries from the memory pool except
- * for @a keep of the given @a size.
+ * for @a keep of the given @a new_size.  Only the first
+ * @a copy_bytes of @a keep are preserved, the rest of the
+ * kept block is zeroed.
+ *
+ * Memory outside of the allocated areas is always zero, so
+ * only the areas that were in use since the last reset have
+ * to be cleared.
  *
  * @param pool memory pool to use for the operation
  * @param keep pointer to the entry to keep (maybe NULL)
- * @param size how many bytes need to be kept at this address
+ * @param copy_bytes how many bytes need to be kept at this address,
+ *        must not exceed @a new_size
+ * @param new_size how many bytes to allocate for @a keep
  * @return addr new address of @a keep (if it had to change)
  */
 void *
 MHD_pool_reset (struct MemoryPool *pool,
 		void *keep,
-		size_t size)
+		size_t copy_bytes,
+		size_t new_size)
 {
-  size = ROUND_TO_ALIGN (size);
   if (NULL != keep)
     {
-      if (keep != pool->memory)
-        {
-          memmove (pool->memory, keep, size);
-          keep = pool->memory;
-        }
-      pool->pos = size;
+      if ( (keep != pool->memory) &&
+           (0 != copy_bytes) )
+        memmove (pool->memory, keep, copy_bytes);
+      keep = pool->memory;
     }
+  else
+    {
+      /* nothing to keep, empty the pool entirely */
+      copy_bytes = 0;
+      new_size = 0;
+    }
+  if (pool->end < pool->size)
+    memset (&pool->memory[pool->end],
+            0,
+            pool->size - pool->end);
+  if (pool->pos > copy_bytes)
+    memset (&pool->memory[copy_bytes],
+            0,
+            pool->pos - copy_bytes);
+  pool->pos = ROUND_TO_ALIGN (new_size);
   pool->end = pool->size;
-  memset (&pool->memory[size],
-	  0,
-	  pool->size - size);
   return keep;
 }
 
 
+/**
+ * Give the pages of the pool that are not allocated back to the
+ * operating system, so that an idle pool does not keep them
+ * resident.  The pool keeps its size: the pages read as zero (as
+ * unallocated memory should) once they are touched again, so the
+ * pool grows back without any further action.  Only supported on
+ * Linux, where MADV_DONTNEED has these semantics for anonymous
+ * memory, whether it was mmapped or malloc'ed.
+ *
+ * @param pool memory pool to use for the operation
+ * @return number of bytes released
+ */
+size_t
+MHD_pool_release_unused (struct MemoryPool *pool)
+{
+#if LINUX && defined(MADV_DONTNEED)
+  uintptr_t start;
+  uintptr_t stop;
+  long page_size;
+
+  page_size = sysconf (_SC_PAGESIZE);
+  if (page_size <= 0)
+    return 0;
+  start = ((uintptr_t) &pool->memory[pool->pos] + page_size - 1)
+    & ~((uintptr_t) page_size - 1);
+  stop = ((uintptr_t) &pool->memory[pool->end])
+    & ~((uintptr_t) page_size - 1);
+  if (stop <= start)
+    return 0;
+  if (0 != madvise ((void *) start, stop - start, MADV_DONTNEED))
+    return 0;
+  return stop - start;
+#else
+  return 0;
+#endif
+}
+
+
 /* end of memorypool.c */
@@ -99,16 +99,30 @@ MHD_pool_reallocate (struct MemoryPool *pool,
 
 /**
  * Clear all entries from the memory pool except
- * for "keep" of the given "size".
+ * for "keep" of the given "new_size".  Only the first
+ * "copy_bytes" of "keep" are preserved.
  *
  * @param pool memory pool to use for the operation
  * @param keep pointer to the entry to keep (maybe NULL)
- * @param size how many bytes need to be kept at this address
+ * @param copy_bytes how many bytes need to be kept at this address
+ * @param new_size how many bytes to allocate for "keep"
  * @return addr new address of "keep" (if it had to change)
  */
 void *
 MHD_pool_reset (struct MemoryPool *pool,
 		void *keep,
-		size_t size);
+		size_t copy_bytes,
+		size_t new_size);
+
+
+/**
+ * Give the pages of the pool that are not allocated back to the
+ * operating system.  They read as zero when they are used again.
+ *
+ * @param pool memory pool to use for the operation
+ * @return number of bytes released
+ */
+size_t
+MHD_pool_release_unused (struct MemoryPool *pool);
 
 #endif
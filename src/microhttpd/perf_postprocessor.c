@@ -0,0 +1,190 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file perf_postprocessor.c
+ * @brief benchmark the throughput of the post processor for large
+ *        multipart/form-data uploads, fed in chunks of the sizes
+ *        in which they typically arrive from the network
+ * @author Christian Grothoff
+ */
+
+#include "platform.h"
+#include "microhttpd.h"
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Size of the uploaded file.
+ */
+#define FILE_SIZE (1024 * 1024)
+
+/**
+ * How many times do we upload the file for each chunk size?
+ */
+#define ROUNDS 64
+
+
+/**
+ * Count the bytes of the file given to us.
+ */
+static int
+count_value (void *cls,
+             enum MHD_ValueKind kind,
+             const char *key,
+             const char *filename,
+             const char *content_type,
+             const char *transfer_encoding,
+             const char *data, uint64_t off, size_t size)
+{
+  uint64_t *total = cls;
+
+  *total += size;
+  return MHD_YES;
+}
+
+
+/**
+ * Get the current timestamp
+ *
+ * @return current time in microseconds
+ */
+static unsigned long long
+now ()
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (((unsigned long long) tv.tv_sec * 1000000LL) +
+	  ((unsigned long long) tv.tv_usec));
+}
+
+
+/**
+ * Upload @a body @a ROUNDS times in chunks of @a chunk_size bytes.
+ *
+ * @param desc description of the uploaded data
+ * @param body multipart body to upload
+ * @param body_len number of bytes in @a body
+ * @param chunk_size number of bytes to pass per MHD_post_process() call
+ * @return 0 on success
+ */
+static int
+run (const char *desc,
+     const char *body,
+     size_t body_len,
+     size_t chunk_size)
+{
+  struct MHD_Connection connection;
+  struct MHD_HTTP_Header header;
+  struct MHD_PostProcessor *pp;
+  unsigned long long start;
+  unsigned long long delta;
+  uint64_t total;
+  unsigned int round;
+  size_t pos;
+  size_t len;
+  int ret;
+
+  memset (&connection, 0, sizeof (struct MHD_Connection));
+  memset (&header, 0, sizeof (struct MHD_HTTP_Header));
+  connection.headers_received = &header;
+  header.header = MHD_HTTP_HEADER_CONTENT_TYPE;
+  header.value = MHD_HTTP_POST_ENCODING_MULTIPART_FORMDATA
+    "; boundary=----WebKitFormBoundary7MA4YWxkTrZu0gW";
+  header.kind = MHD_HEADER_KIND;
+  ret = 0;
+  total = 0;
+  start = now ();
+  for (round = 0; round < ROUNDS; round++)
+    {
+      pp = MHD_create_post_processor (&connection, 65536,
+                                      &count_value, &total);
+      if (NULL == pp)
+        return 1;
+      for (pos = 0; pos < body_len; pos += len)
+        {
+          len = body_len - pos;
+          if (len > chunk_size)
+            len = chunk_size;
+          if (MHD_YES != MHD_post_process (pp, &body[pos], len))
+            ret = 2;
+        }
+      if (MHD_YES != MHD_destroy_post_processor (pp))
+        ret = 4;
+    }
+  delta = now () - start;
+  if (0 == delta)
+    delta = 1;
+  fprintf (stderr,
+           "Uploading %s data in chunks of %7u bytes: %8.1f MB/s\n",
+           desc,
+           (unsigned int) chunk_size,
+           ((double) ROUNDS * FILE_SIZE) / (double) delta);
+  if (total != (uint64_t) ROUNDS * FILE_SIZE)
+    ret |= 8;
+  return ret;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  static const char head[] =
+    "------WebKitFormBoundary7MA4YWxkTrZu0gW\r\n"
+    "Content-Disposition: form-data; name=\"upload\"; filename=\"video.mp4\"\r\n"
+    "Content-Type: video/mp4\r\n"
+    "\r\n";
+  static const char tail[] =
+    "\r\n------WebKitFormBoundary7MA4YWxkTrZu0gW--\r\n";
+  static const char csv_line[] =
+    "2015-10-16,42,--,3.14159,\"Smith, John\"\r\n";
+  unsigned int errorCount = 0;
+  char *body;
+  size_t body_len;
+  size_t i;
+
+  body_len = strlen (head) + FILE_SIZE + strlen (tail);
+  if (NULL == (body = malloc (body_len)))
+    return 1;
+  memcpy (body, head, strlen (head));
+  memcpy (&body[strlen (head) + FILE_SIZE], tail, strlen (tail));
+  /* binary data, with as many CRs and dashes as random data has */
+  for (i = 0; i < FILE_SIZE; i++)
+    body[strlen (head) + i] = (char) (MHD_random_ () & 0xff);
+  errorCount += run ("binary", body, body_len, 1448);
+  errorCount += run ("binary", body, body_len, 16384);
+  errorCount += run ("binary", body, body_len, 65536);
+  errorCount += run ("binary", body, body_len, 1024 * 1024);
+  /* text with short CRLF-terminated lines, and a "--" in each */
+  for (i = 0; i < FILE_SIZE; i++)
+    body[strlen (head) + i] = csv_line[i % strlen (csv_line)];
+  errorCount += run ("CSV", body, body_len, 1448);
+  errorCount += run ("CSV", body, body_len, 16384);
+  errorCount += run ("CSV", body, body_len, 65536);
+  errorCount += run ("CSV", body, body_len, 1024 * 1024);
+  free (body);
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  return errorCount != 0;       /* 0 == pass */
+}
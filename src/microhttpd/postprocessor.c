@@ -24,6 +24,7 @@
  */
 
 #include "internal.h"
+#include "linescan.h"
 
 /**
  * Size of on-stack buffer that we use for un-escaping of the value.
@@ -110,6 +111,26 @@ enum NE_State
 };
 
 
+/**
+ * Delimiter between the parts of a multipart body ("\r\n--" followed
+ * by the boundary).
+ */
+struct PP_Delimiter
+{
+
+  /**
+   * The delimiter, NULL if not in use (not 0-terminated).
+   */
+  char *text;
+
+  /**
+   * Number of bytes in @e text.
+   */
+  size_t len;
+
+};
+
+
 /**
  * Internal state of the post-processor.  Note that the fields
  * are sorted by type to enable optimal packing by the compiler.
@@ -169,6 +190,17 @@ struct MHD_PostProcessor
    */
   char *content_transfer_encoding;
 
+  /**
+   * Delimiter for the primary boundary (text stored after our buffer).
+   */
+  struct PP_Delimiter delim;
+
+  /**
+   * Delimiter for the nested boundary (text allocated with the
+   * @e nested_boundary).
+   */
+  struct PP_Delimiter nested_delim;
+
   /**
    * Unprocessed value bytes due to escape
    * sequences (URL-encoding only).
@@ -243,6 +275,76 @@ struct MHD_PostProcessor
 };
 
 
+/**
+ * Set up @a d as the delimiter for @a boundary.
+ *
+ * @param d delimiter to initialize
+ * @param text where to store the delimiter, @a blen + 4 bytes
+ * @param boundary the boundary
+ * @param blen number of bytes in @a boundary
+ */
+static void
+init_delimiter (struct PP_Delimiter *d,
+                char *text,
+                const char *boundary,
+                size_t blen)
+{
+  memcpy (text, "\r\n--", 4);
+  memcpy (&text[4], boundary, blen);
+  d->text = text;
+  d->len = blen + 4;
+}
+
+
+/**
+ * Find the delimiter @a d in @a data.
+ *
+ * @param d delimiter to look for
+ * @param data data to search
+ * @param size number of bytes in @a data
+ * @return offset of the delimiter in @a data; if @a data does not
+ *         contain all of it, offset of the longest tail of @a data
+ *         that may be the beginning of the delimiter (@a size if none);
+ *         in both cases, everything before is part of the value
+ */
+static size_t
+find_delimiter (const struct PP_Delimiter *d,
+                const char *data,
+                size_t size)
+{
+  size_t last = d->len - 2;
+  size_t pos;
+  const char *cr;
+
+  /* look for the last two bytes of the delimiter, which (unlike
+     its "\r\n--" start) are rare in both text and binary data */
+  pos = 0;
+  while (pos + d->len <= size)
+    {
+      pos += MHD_linescan_findpair (&data[pos + last],
+                                    size - pos - last,
+                                    d->text[last],
+                                    d->text[last + 1]);
+      if (pos + d->len > size)
+        break;
+      if (0 == memcmp (&data[pos], d->text, last))
+        return pos;
+      pos++;
+    }
+  /* windows that would extend past the end of the data */
+  pos = (size >= d->len) ? size - d->len + 1 : 0;
+  while ( (pos < size) &&
+          (NULL != (cr = memchr (&data[pos], '\r', size - pos))) )
+    {
+      pos = cr - data;
+      if (0 == memcmp (cr, d->text, size - pos))
+        return pos;
+      pos++;
+    }
+  return size;
+}
+
+
 /**
  * Create a `struct MHD_PostProcessor`.
  *
@@ -314,10 +416,17 @@ MHD_create_post_processor (struct MHD_Connection *connection,
     blen = 0;
   buffer_size += 4; /* round up to get nice block sizes despite boundary search */
 
-  /* add +1 to ensure we ALWAYS have a zero-termination at the end */
-  if (NULL == (ret = malloc (sizeof (struct MHD_PostProcessor) + buffer_size + 1)))
+  /* add +1 to ensure we ALWAYS have a zero-termination at the end,
+     followed by the delimiter text */
+  if (NULL == (ret = malloc (sizeof (struct MHD_PostProcessor) + buffer_size + 1 +
+                             ((0 != blen) ? blen + 4 : 0))))
     return NULL;
   memset (ret, 0, sizeof (struct MHD_PostProcessor) + buffer_size + 1);
+  if (0 != blen)
+    init_delimiter (&ret->delim,
+                    &((char *) &ret[1])[buffer_size + 1],
+                    boundary,
+                    blen);
   ret->connection = connection;
   ret->ikvi = iter;
   ret->cls = iter_cls;
@@ -682,14 +791,45 @@ process_multipart_headers (struct MHD_PostProcessor *pp,
 }
 
 
+/**
+ * Pass @a size bytes of the current value to the iterator.
+ *
+ * @param pp post processor context
+ * @param data value bytes
+ * @param size number of bytes in @a data
+ * @return #MHD_YES on success, #MHD_NO if the iterator aborted
+ */
+static int
+call_value_iterator (struct MHD_PostProcessor *pp,
+                     const char *data,
+                     size_t size)
+{
+  if ( ( (MHD_YES == pp->must_ikvi) ||
+	 (0 != size) ) &&
+       (MHD_NO == pp->ikvi (pp->cls,
+			    MHD_POSTDATA_KIND,
+			    pp->content_name,
+			    pp->content_filename,
+			    pp->content_type,
+			    pp->content_transfer_encoding,
+			    data, pp->value_offset, size)) )
+    {
+      pp->state = PP_Error;
+      return MHD_NO;
+    }
+  pp->must_ikvi = MHD_NO;
+  pp->value_offset += size;
+  return MHD_YES;
+}
+
+
 /**
  * We have the value until we hit the given boundary;
  * process accordingly.
  *
  * @param pp post processor context
  * @param ioffptr incremented based on the number of bytes processed
- * @param boundary the boundary to look for
- * @param blen strlen(boundary)
+ * @param delim the delimiter to look for
  * @param next_state what state to go into after the
  *        boundary was found
  * @param next_dash_state state to go into if the next
@@ -701,90 +841,88 @@ process_multipart_headers (struct MHD_PostProcessor *pp,
 static int
 process_value_to_boundary (struct MHD_PostProcessor *pp,
                            size_t *ioffptr,
-                           const char *boundary,
-                           size_t blen,
+                           const struct PP_Delimiter *delim,
                            enum PP_State next_state,
                            enum PP_State next_dash_state)
 {
   char *buf = (char *) &pp[1];
   size_t newline;
-  const char *r;
 
   /* all data in buf until the boundary
      (\r\n--+boundary) is part of the value */
-  newline = 0;
-  while (1)
+  newline = find_delimiter (delim, buf, pp->buffer_pos);
+  if (newline + delim->len <= pp->buffer_pos)
     {
-      while (newline + 4 < pp->buffer_pos)
-        {
-          r = memchr (&buf[newline], '\r', pp->buffer_pos - newline - 4);
-          if (NULL == r)
-          {
-            newline = pp->buffer_pos - 4;
-            break;
-          }
-          newline = r - buf;
-          if (0 == memcmp ("\r\n--", &buf[newline], 4))
-            break;
-          newline++;
-        }
-      if (newline + pp->blen + 4 <= pp->buffer_pos)
-        {
-          /* can check boundary */
-          if (0 != memcmp (&buf[newline + 4], boundary, pp->blen))
-            {
-              /* no boundary, "\r\n--" is part of content, skip */
-              newline += 4;
-              continue;
-            }
-          else
-            {
-              /* boundary found, process until newline then
-                 skip boundary and go back to init */
-              pp->skip_rn = RN_Dash;
-              pp->state = next_state;
-              pp->dash_state = next_dash_state;
-              (*ioffptr) += pp->blen + 4;       /* skip boundary as well */
-              buf[newline] = '\0';
-              break;
-            }
-        }
-      else
-        {
-          /* cannot check for boundary, process content that
-             we have and check again later; except, if we have
-             no content, abort (out of memory) */
-          if ((0 == newline) && (pp->buffer_pos == pp->buffer_size))
-            {
-              pp->state = PP_Error;
-              return MHD_NO;
-            }
-          break;
-        }
+      /* boundary found, process until newline then
+         skip boundary and go back to init */
+      pp->skip_rn = RN_Dash;
+      pp->state = next_state;
+      pp->dash_state = next_dash_state;
+      (*ioffptr) += delim->len;       /* skip boundary as well */
+      buf[newline] = '\0';
     }
-  /* newline is either at beginning of boundary or
-     at least at the last character that we are sure
-     is not part of the boundary */
-  if ( ( (MHD_YES == pp->must_ikvi) ||
-	 (0 != newline) ) &&
-       (MHD_NO == pp->ikvi (pp->cls,
-			    MHD_POSTDATA_KIND,
-			    pp->content_name,
-			    pp->content_filename,
-			    pp->content_type,
-			    pp->content_transfer_encoding,
-			    buf, pp->value_offset, newline)) )
+  else if ((0 == newline) && (pp->buffer_pos == pp->buffer_size))
     {
+      /* cannot check for boundary and have no content
+         to process (out of memory) */
       pp->state = PP_Error;
       return MHD_NO;
     }
-  pp->must_ikvi = MHD_NO;
-  pp->value_offset += newline;
+  /* newline is either at beginning of boundary or
+     after the last character that we are sure
+     is not part of the boundary */
+  if (MHD_NO == call_value_iterator (pp, buf, newline))
+    return MHD_NO;
   (*ioffptr) += newline;
   return MHD_YES;
 }
 
 
+/**
+ * Like process_value_to_boundary(), but for value bytes that we
+ * did not copy to our buffer: processes @a data in place, so that
+ * the bulk of large uploads is never copied.  The data passed to
+ * the iterator is not 0-terminated.
+ *
+ * @param pp post processor context, with an empty buffer
+ * @param data input to process
+ * @param size number of bytes in @a data
+ * @param delim the delimiter to look for
+ * @param next_state what state to go into after the
+ *        boundary was found
+ * @param next_dash_state state to go into if the next
+ *        boundary ends with "--"
+ * @return number of bytes of @a data processed; 0 on error or if
+ *         all of @a data may be the beginning of the boundary
+ */
+static size_t
+process_value_in_place (struct MHD_PostProcessor *pp,
+                        const char *data,
+                        size_t size,
+                        const struct PP_Delimiter *delim,
+                        enum PP_State next_state,
+                        enum PP_State next_dash_state)
+{
+  size_t newline;
+
+  newline = find_delimiter (delim, data, size);
+  if (newline + delim->len <= size)
+    {
+      pp->skip_rn = RN_Dash;
+      pp->state = next_state;
+      pp->dash_state = next_dash_state;
+      if (MHD_NO == call_value_iterator (pp, data, newline))
+        return 0;
+      return newline + delim->len;
+    }
+  /* the rest goes through our buffer */
+  if ( (0 == newline) ||
+       (MHD_NO == call_value_iterator (pp, data, newline)) )
+    return 0;
+  return newline;
+}
+
+
 /**
  *
  * @param pp post processor context
@@ -831,6 +969,8 @@ post_process_multipart (struct MHD_PostProcessor *pp,
 			size_t post_data_len)
 {
   char *buf;
+  const struct PP_Delimiter *delim;
+  char *delim_text;
   size_t max;
   size_t ioff;
   size_t poff;
@@ -843,11 +983,52 @@ post_process_multipart (struct MHD_PostProcessor *pp,
   while ((poff < post_data_len) ||
          ((pp->buffer_pos > 0) && (state_changed != 0)))
     {
+      if ( (RN_Inactive == pp->skip_rn) &&
+           ( (PP_ProcessValueToBoundary == pp->state) ||
+             (PP_Nested_ProcessValueToBoundary == pp->state) ) )
+        delim = (PP_ProcessValueToBoundary == pp->state)
+          ? &pp->delim
+          : &pp->nested_delim;
+      else
+        delim = NULL;
+      /* values are processed where they are, only what may be
+         the beginning of the boundary goes through our buffer */
+      if ( (NULL != delim) &&
+           (0 == pp->buffer_pos) &&
+           (poff < post_data_len) )
+        {
+          if (PP_ProcessValueToBoundary == pp->state)
+            max = process_value_in_place (pp,
+                                          &post_data[poff],
+                                          post_data_len - poff,
+                                          delim,
+                                          PP_PerformCleanup,
+                                          PP_Done);
+          else
+            max = process_value_in_place (pp,
+                                          &post_data[poff],
+                                          post_data_len - poff,
+                                          delim,
+                                          PP_Nested_PerformCleanup,
+                                          PP_NextBoundary);
+          if (PP_Error == pp->state)
+            return MHD_NO;
+          if (0 != max)
+            {
+              poff += max;
+              state_changed = 1;
+              continue;
+            }
+        }
       /* first, move as much input data
-         as possible to our internal buffer */
+         as possible to our internal buffer
+         (in a value: just enough to complete the boundary) */
       max = pp->buffer_size - pp->buffer_pos;
       if (max > post_data_len - poff)
         max = post_data_len - poff;
+      if ( (NULL != delim) &&
+           (max > delim->len) )
+        max = delim->len;
       memcpy (&buf[pp->buffer_pos], &post_data[poff], max);
       poff += max;
       pp->buffer_pos += max;
@@ -992,6 +1173,19 @@ post_process_multipart (struct MHD_PostProcessor *pp,
               free (pp->content_type);
               pp->content_type = NULL;
               pp->nlen = strlen (pp->nested_boundary);
+              if (NULL != pp->nested_delim.text)
+                free (pp->nested_delim.text);
+              pp->nested_delim.text = NULL;
+              if (NULL == (delim_text = malloc (pp->nlen + 4)))
+                {
+                  /* out of memory */
+                  pp->state = PP_Error;
+                  return MHD_NO;
+                }
+              init_delimiter (&pp->nested_delim,
+                              delim_text,
+                              pp->nested_boundary,
+                              pp->nlen);
               pp->state = PP_Nested_Init;
               state_changed = 1;
               break;
@@ -1003,8 +1197,7 @@ post_process_multipart (struct MHD_PostProcessor *pp,
         case PP_ProcessValueToBoundary:
           if (MHD_NO == process_value_to_boundary (pp,
                                                    &ioff,
-                                                   pp->boundary,
-                                                   pp->blen,
+                                                   &pp->delim,
                                                    PP_PerformCleanup,
                                                    PP_Done))
             {
@@ -1022,6 +1215,11 @@ post_process_multipart (struct MHD_PostProcessor *pp,
               free (pp->nested_boundary);
               pp->nested_boundary = NULL;
             }
+          if (NULL != pp->nested_delim.text)
+            {
+              free (pp->nested_delim.text);
+              pp->nested_delim.text = NULL;
+            }
           pp->state = PP_ProcessEntryHeaders;
           state_changed = 1;
           break;
@@ -1074,8 +1272,7 @@ post_process_multipart (struct MHD_PostProcessor *pp,
         case PP_Nested_ProcessValueToBoundary:
           if (MHD_NO == process_value_to_boundary (pp,
                                                    &ioff,
-                                                   pp->nested_boundary,
-                                                   pp->nlen,
+                                                   &pp->nested_delim,
                                                    PP_Nested_PerformCleanup,
                                                    PP_NextBoundary))
             {
@@ -1186,6 +1383,8 @@ MHD_destroy_post_processor (struct MHD_PostProcessor *pp)
   free_unmarked (pp);
   if (pp->nested_boundary != NULL)
     free (pp->nested_boundary);
+  if (NULL != pp->nested_delim.text)
+    free (pp->nested_delim.text);
   free (pp);
   return ret;
 }
@@ -0,0 +1,725 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file range.c
+ * @brief answering "Range" requests from buffer and fd responses
+ * @author Christian Grothoff
+ *
+ * The response queued by the application stays the one object that
+ * owns the data; for a partial response we queue a small response
+ * that refers to it (and holds a reference).  For a single range of
+ * a buffer, that is a buffer response pointing into the original
+ * buffer; for a single range of a file, a response with the same
+ * file descriptor at a larger offset, so that it is sent with
+ * sendfile() like the full file would be.  Several ranges are sent
+ * as "multipart/byteranges" by a content reader that interleaves
+ * the part headers with the data.
+ */
+
+#include "range.h"
+#include "response.h"
+
+/**
+ * Requests for more ranges are answered with the full response.
+ */
+#define MHD_RANGE_MAX 16
+
+/**
+ * Block size for the content readers of partial responses.
+ */
+#define MHD_RANGE_BLOCK_SIZE (16 * 1024)
+
+
+/**
+ * One range of the body of the original response.
+ */
+struct ByteRange
+{
+  /**
+   * Offset of the first byte.
+   */
+  uint64_t start;
+
+  /**
+   * Number of bytes, at least one.
+   */
+  uint64_t length;
+};
+
+
+/**
+ * Part of a "multipart/byteranges" body.
+ */
+struct RangePart
+{
+  /**
+   * The range sent in this part.
+   */
+  struct ByteRange range;
+
+  /**
+   * Offset of the part (its headers) in the body.
+   */
+  uint64_t offset;
+
+  /**
+   * Delimiter and headers of the part.
+   */
+  const char *header;
+
+  /**
+   * Length of @e header.
+   */
+  size_t header_len;
+};
+
+
+/**
+ * Closure for the content readers of partial responses.
+ */
+struct RangeSource
+{
+  /**
+   * Response with the data; we hold a reference.
+   */
+  struct MHD_Response *source;
+
+  /**
+   * Offset of the range in @e source (single range).
+   */
+  uint64_t start;
+
+  /**
+   * Number of parts (multiple ranges).
+   */
+  unsigned int num_parts;
+
+  /**
+   * The parts (multiple ranges).
+   */
+  struct RangePart parts[MHD_RANGE_MAX];
+
+  /**
+   * Offset of the final delimiter in the body (multiple ranges).
+   */
+  uint64_t trailer_offset;
+
+  /**
+   * Length of @e trailer.
+   */
+  size_t trailer_len;
+
+  /**
+   * Final delimiter (multiple ranges).
+   */
+  char trailer[64];
+
+  /**
+   * Boundary of the parts (multiple ranges).
+   */
+  char boundary[40];
+
+  /**
+   * Headers of all parts follow (multiple ranges).
+   */
+  char headers[1];
+};
+
+
+/**
+ * Parse a decimal number.
+ *
+ * @param pos where to start, updated to the first character
+ *        after the number
+ * @param value set to the number
+ * @return #MHD_YES on success, #MHD_NO if there is no number
+ *         or it does not fit
+ */
+static int
+parse_number (const char **pos,
+              uint64_t *value)
+{
+  const char *p = *pos;
+  uint64_t v = 0;
+
+  if ( ('0' > *p) || ('9' < *p) )
+    return MHD_NO;
+  while ( ('0' <= *p) && ('9' >= *p) )
+    {
+      if (v > (UINT64_MAX - (uint64_t) (*p - '0')) / 10)
+        return MHD_NO;
+      v = v * 10 + (uint64_t) (*p - '0');
+      p++;
+    }
+  *pos = p;
+  *value = v;
+  return MHD_YES;
+}
+
+
+/**
+ * Parse the value of a "Range" header (RFC 7233, section 2.1).
+ *
+ * @param value value of the header
+ * @param total size of the full body
+ * @param ranges where to store the satisfiable ranges
+ * @param num set to the number of satisfiable ranges
+ * @return #MHD_YES on success, #MHD_NO if the header is
+ *         malformed or asks for too many ranges (and is
+ *         to be ignored)
+ */
+static int
+parse_ranges (const char *value,
+              uint64_t total,
+              struct ByteRange *ranges,
+              unsigned int *num)
+{
+  const char *pos;
+  uint64_t first;
+  uint64_t last;
+  int satisfiable;
+  int specs;
+
+  *num = 0;
+  specs = 0;
+  if (0 != strncasecmp (value, "bytes", strlen ("bytes")))
+    return MHD_NO;
+  pos = value + strlen ("bytes");
+  while ( (' ' == *pos) || ('\t' == *pos) )
+    pos++;
+  if ('=' != *pos++)
+    return MHD_NO;
+  while (1)
+    {
+      while ( (' ' == *pos) || ('\t' == *pos) || (',' == *pos) )
+        pos++;
+      if ('\0' == *pos)
+        break;
+      if ('-' == *pos)
+        {
+          /* suffix: the last N bytes */
+          pos++;
+          if (MHD_YES != parse_number (&pos, &last))
+            return MHD_NO;
+          satisfiable = (0 != last) && (0 != total);
+          if (last > total)
+            last = total;
+          first = total - last;
+          last = total - 1;
+        }
+      else
+        {
+          if ( (MHD_YES != parse_number (&pos, &first)) ||
+               ('-' != *pos++) )
+            return MHD_NO;
+          if ( ('0' <= *pos) && ('9' >= *pos) )
+            {
+              if ( (MHD_YES != parse_number (&pos, &last)) ||
+                   (last < first) )
+                return MHD_NO;
+            }
+          else
+            last = UINT64_MAX;
+          satisfiable = (first < total);
+          if (last >= total)
+            last = total - 1;
+        }
+      while ( (' ' == *pos) || ('\t' == *pos) )
+        pos++;
+      if ( (',' != *pos) && ('\0' != *pos) )
+        return MHD_NO;
+      specs++;
+      if (! satisfiable)
+        continue;
+      if (MHD_RANGE_MAX == *num)
+        return MHD_NO;
+      ranges[*num].start = first;
+      ranges[*num].length = last - first + 1;
+      (*num)++;
+    }
+  return (0 == specs) ? MHD_NO : MHD_YES;
+}
+
+
+/**
+ * Check the "If-Range" header of the request: ranges are only
+ * sent if the client's copy is still current.
+ *
+ * @param connection connection with the request
+ * @param response the full response
+ * @return #MHD_YES if the ranges should be sent
+ */
+static int
+if_range_matches (struct MHD_Connection *connection,
+                  struct MHD_Response *response)
+{
+  const char *if_range;
+  const char *current;
+
+  if_range = MHD_lookup_connection_value (connection,
+                                          MHD_HEADER_KIND,
+                                          MHD_HTTP_HEADER_IF_RANGE);
+  if (NULL == if_range)
+    return MHD_YES;
+  /* an entity tag (weak ones never match) or a date */
+  if ('"' == if_range[0])
+    current = MHD_get_response_header (response, MHD_HTTP_HEADER_ETAG);
+  else if (0 == strncmp (if_range, "W/", 2))
+    return MHD_NO;
+  else
+    current = MHD_get_response_header (response,
+                                       MHD_HTTP_HEADER_LAST_MODIFIED);
+  if ( (NULL == current) ||
+       (0 != strcmp (current, if_range)) )
+    return MHD_NO;
+  return MHD_YES;
+}
+
+
+/**
+ * Copy the headers and footers of the full response to a partial
+ * one, preserving their order.  "Content-Length" is computed for
+ * the partial response and "Content-Type" is replaced for
+ * "multipart/byteranges".
+ *
+ * @param variant response to add the headers to
+ * @param pos remaining headers to copy (in inverse order)
+ * @param skip_type #MHD_YES to skip "Content-Type"
+ * @return #MHD_YES on success, #MHD_NO on failure (out of memory)
+ */
+static int
+copy_headers (struct MHD_Response *variant,
+              const struct MHD_HTTP_Header *pos,
+              int skip_type)
+{
+  if (NULL == pos)
+    return MHD_YES;
+  if (MHD_YES != copy_headers (variant, pos->next, skip_type))
+    return MHD_NO;
+  if (MHD_FOOTER_KIND == pos->kind)
+    return MHD_add_response_footer (variant, pos->header, pos->value);
+  if ( (0 == strcasecmp (pos->header, MHD_HTTP_HEADER_CONTENT_LENGTH)) ||
+       ( (MHD_YES == skip_type) &&
+         (0 == strcasecmp (pos->header, MHD_HTTP_HEADER_CONTENT_TYPE)) ) )
+    return MHD_YES;
+  return MHD_add_response_header (variant, pos->header, pos->value);
+}
+
+
+/**
+ * Read data of the full response.
+ *
+ * @param rs closure of the partial response
+ * @param pos offset in the full body
+ * @param buf where to store the data
+ * @param max maximum number of bytes to read
+ * @return number of bytes read, #MHD_CONTENT_READER_END_WITH_ERROR
+ *         on error (including the end of the file)
+ */
+static ssize_t
+source_read (struct RangeSource *rs,
+             uint64_t pos,
+             char *buf,
+             size_t max)
+{
+  struct MHD_Response *source = rs->source;
+  ssize_t ret;
+
+  if (NULL == source->crc)
+    {
+      memcpy (buf, &source->data[pos], max);
+      return max;
+    }
+  (void) MHD_mutex_lock_ (&source->mutex);
+  ret = source->crc (source->crc_cls, pos, buf, max);
+  (void) MHD_mutex_unlock_ (&source->mutex);
+  if (ret <= 0)
+    return MHD_CONTENT_READER_END_WITH_ERROR; /* file got shorter */
+  return ret;
+}
+
+
+/**
+ * Content reader for a single range of a file (used where
+ * we cannot use sendfile()).
+ *
+ * @param cls our `struct RangeSource`
+ * @param pos offset in the range
+ * @param buf where to store the data
+ * @param max maximum number of bytes to return
+ * @return number of bytes stored in @a buf
+ */
+static ssize_t
+single_reader (void *cls,
+               uint64_t pos,
+               char *buf,
+               size_t max)
+{
+  struct RangeSource *rs = cls;
+
+  return source_read (rs, rs->start + pos, buf, max);
+}
+
+
+/**
+ * Content reader for a "multipart/byteranges" body.
+ *
+ * @param cls our `struct RangeSource`
+ * @param pos offset in the body
+ * @param buf where to store the data
+ * @param max maximum number of bytes to return
+ * @return number of bytes stored in @a buf
+ */
+static ssize_t
+multipart_reader (void *cls,
+                  uint64_t pos,
+                  char *buf,
+                  size_t max)
+{
+  struct RangeSource *rs = cls;
+  const struct RangePart *part;
+  unsigned int i;
+  uint64_t off;
+  size_t done;
+  size_t n;
+  ssize_t ret;
+
+  done = 0;
+  i = 0;
+  while (done < max)
+    {
+      /* find the part we are in */
+      while ( (i < rs->num_parts) &&
+              (pos >= rs->parts[i].offset + rs->parts[i].header_len
+               + rs->parts[i].range.length) )
+        i++;
+      if (i == rs->num_parts)
+        {
+          off = pos - rs->trailer_offset;
+          if (off >= rs->trailer_len)
+            break;
+          n = MHD_MIN (max - done, rs->trailer_len - (size_t) off);
+          memcpy (&buf[done], &rs->trailer[off], n);
+        }
+      else
+        {
+          part = &rs->parts[i];
+          off = pos - part->offset;
+          if (off < part->header_len)
+            {
+              n = MHD_MIN (max - done, part->header_len - (size_t) off);
+              memcpy (&buf[done], &part->header[off], n);
+            }
+          else
+            {
+              off -= part->header_len;
+              n = (size_t) MHD_MIN ((uint64_t) (max - done),
+                                    part->range.length - off);
+              ret = source_read (rs,
+                                 part->range.start + off,
+                                 &buf[done],
+                                 n);
+              if (ret < 0)
+                return (0 == done) ? ret : (ssize_t) done;
+              n = (size_t) ret;
+            }
+        }
+      done += n;
+      pos += n;
+    }
+  if (0 == done)
+    return MHD_CONTENT_READER_END_OF_STREAM;
+  return done;
+}
+
+
+/**
+ * Release the closure of a partial response.
+ *
+ * @param cls our `struct RangeSource`
+ */
+static void
+range_free (void *cls)
+{
+  struct RangeSource *rs = cls;
+
+  MHD_destroy_response (rs->source);
+  free (rs);
+}
+
+
+/**
+ * Release the reference a partial response of a buffer
+ * holds on the full response.
+ *
+ * @param cls the full response
+ */
+static void
+release_source (void *cls)
+{
+  MHD_destroy_response (cls);
+}
+
+
+/**
+ * Create the response for a single range.
+ *
+ * @param response the full response
+ * @param range the range
+ * @return the partial response, NULL on error
+ */
+static struct MHD_Response *
+single_range (struct MHD_Response *response,
+              const struct ByteRange *range)
+{
+  struct MHD_Response *variant;
+  struct RangeSource *rs;
+  char value[128];
+
+  if (NULL == response->crc)
+    {
+      variant = MHD_create_response_from_buffer ((size_t) range->length,
+                                                 &response->data[range->start],
+                                                 MHD_RESPMEM_PERSISTENT);
+      if (NULL == variant)
+        return NULL;
+      variant->crfc = &release_source;
+      variant->crc_cls = response;
+    }
+  else
+    {
+      if (NULL == (rs = malloc (sizeof (struct RangeSource))))
+        return NULL;
+      rs->source = response;
+      rs->start = range->start;
+      variant = MHD_create_response_from_callback (range->length,
+                                                   MHD_RANGE_BLOCK_SIZE,
+                                                   &single_reader,
+                                                   rs,
+                                                   &range_free);
+      if (NULL == variant)
+        {
+          free (rs);
+          return NULL;
+        }
+      /* same file, so that it is sent with sendfile() */
+      variant->fd = response->fd;
+      variant->fd_off = response->fd_off + range->start;
+    }
+  MHD_increment_response_rc (response);
+  variant->flags = (enum MHD_ResponseFlags) (response->flags & ~MHD_RF_COMPRESS);
+  sprintf (value,
+           "bytes " MHD_UNSIGNED_LONG_LONG_PRINTF "-"
+           MHD_UNSIGNED_LONG_LONG_PRINTF "/" MHD_UNSIGNED_LONG_LONG_PRINTF,
+           (MHD_UNSIGNED_LONG_LONG) range->start,
+           (MHD_UNSIGNED_LONG_LONG) (range->start + range->length - 1),
+           (MHD_UNSIGNED_LONG_LONG) response->total_size);
+  if ( (MHD_YES != copy_headers (variant, response->first_header, MHD_NO)) ||
+       (MHD_YES != MHD_add_response_header (variant,
+                                            MHD_HTTP_HEADER_CONTENT_RANGE,
+                                            value)) )
+    {
+      MHD_destroy_response (variant);
+      return NULL;
+    }
+  return variant;
+}
+
+
+/**
+ * Create the "multipart/byteranges" response for several ranges.
+ *
+ * @param response the full response
+ * @param ranges the ranges
+ * @param num number of @a ranges
+ * @return the partial response, NULL on error
+ */
+static struct MHD_Response *
+multiple_ranges (struct MHD_Response *response,
+                 const struct ByteRange *ranges,
+                 unsigned int num)
+{
+  struct MHD_Response *variant;
+  struct RangeSource *rs;
+  const char *type;
+  size_t type_len;
+  char *header;
+  char value[128];
+  uint64_t offset;
+  unsigned int i;
+  int len;
+
+  type = MHD_get_response_header (response, MHD_HTTP_HEADER_CONTENT_TYPE);
+  type_len = (NULL == type) ? 0 : strlen (type);
+  if (NULL == (rs = malloc (sizeof (struct RangeSource)
+                            + num * (192 + type_len))))
+    return NULL;
+  rs->source = response;
+  rs->num_parts = num;
+  snprintf (rs->boundary,
+            sizeof (rs->boundary),
+            "MHD-byteranges-%08X%08X",
+            (unsigned int) (uintptr_t) rs,
+            (unsigned int) MHD_monotonic_time_us ());
+  offset = 0;
+  header = rs->headers;
+  for (i = 0; i < num; i++)
+    {
+      len = sprintf (header,
+                     "%s--%s\r\n%s%s%s"
+                     "Content-Range: bytes " MHD_UNSIGNED_LONG_LONG_PRINTF
+                     "-" MHD_UNSIGNED_LONG_LONG_PRINTF
+                     "/" MHD_UNSIGNED_LONG_LONG_PRINTF "\r\n\r\n",
+                     (0 == i) ? "" : "\r\n",
+                     rs->boundary,
+                     (NULL == type) ? "" : MHD_HTTP_HEADER_CONTENT_TYPE ": ",
+                     (NULL == type) ? "" : type,
+                     (NULL == type) ? "" : "\r\n",
+                     (MHD_UNSIGNED_LONG_LONG) ranges[i].start,
+                     (MHD_UNSIGNED_LONG_LONG) (ranges[i].start
+                                               + ranges[i].length - 1),
+                     (MHD_UNSIGNED_LONG_LONG) response->total_size);
+      rs->parts[i].range = ranges[i];
+      rs->parts[i].offset = offset;
+      rs->parts[i].header = header;
+      rs->parts[i].header_len = (size_t) len;
+      offset += len + ranges[i].length;
+      header += len;
+    }
+  rs->trailer_offset = offset;
+  rs->trailer_len = sprintf (rs->trailer, "\r\n--%s--\r\n", rs->boundary);
+  variant = MHD_create_response_from_callback (offset + rs->trailer_len,
+                                               MHD_RANGE_BLOCK_SIZE,
+                                               &multipart_reader,
+                                               rs,
+                                               &range_free);
+  if (NULL == variant)
+    {
+      free (rs);
+      return NULL;
+    }
+  MHD_increment_response_rc (response);
+  variant->flags = (enum MHD_ResponseFlags) (response->flags & ~MHD_RF_COMPRESS);
+  snprintf (value,
+            sizeof (value),
+            "multipart/byteranges; boundary=%s",
+            rs->boundary);
+  if ( (MHD_YES != copy_headers (variant, response->first_header, MHD_YES)) ||
+       (MHD_YES != MHD_add_response_header (variant,
+                                            MHD_HTTP_HEADER_CONTENT_TYPE,
+                                            value)) )
+    {
+      MHD_destroy_response (variant);
+      return NULL;
+    }
+  return variant;
+}
+
+
+/**
+ * Create the response for a request with no satisfiable range.
+ *
+ * @param response the full response
+ * @return the "416" response, NULL on error
+ */
+static struct MHD_Response *
+unsatisfiable_range (struct MHD_Response *response)
+{
+  struct MHD_Response *variant;
+  char value[64];
+
+  variant = MHD_create_response_from_buffer (0,
+                                             NULL,
+                                             MHD_RESPMEM_PERSISTENT);
+  if (NULL == variant)
+    return NULL;
+  sprintf (value,
+           "bytes */" MHD_UNSIGNED_LONG_LONG_PRINTF,
+           (MHD_UNSIGNED_LONG_LONG) response->total_size);
+  if (MHD_YES != MHD_add_response_header (variant,
+                                          MHD_HTTP_HEADER_CONTENT_RANGE,
+                                          value))
+    {
+      MHD_destroy_response (variant);
+      return NULL;
+    }
+  return variant;
+}
+
+
+/**
+ * Find the response to send instead of the full @a response if
+ * the request on @a connection asks for a range of it.  Only
+ * applies to "GET" requests answered with 200 using a response
+ * for a buffer or a file descriptor.
+ *
+ * @param connection connection the response is queued for
+ * @param response response queued by the application
+ * @param status_code status code of the response, set to 206
+ *        (or 416) if a partial response is returned
+ * @return response to send, with a reference for the connection;
+ *         NULL to send @a response as it is
+ */
+struct MHD_Response *
+MHD_range_select_ (struct MHD_Connection *connection,
+                   struct MHD_Response *response,
+                   unsigned int *status_code)
+{
+  struct ByteRange ranges[MHD_RANGE_MAX];
+  struct MHD_Response *variant;
+  const char *range;
+  unsigned int num;
+
+  if ( (MHD_HTTP_OK != *status_code) ||
+       (NULL == connection->method) ||
+       (0 != strcasecmp (connection->method, MHD_HTTP_METHOD_GET)) ||
+       ( (NULL != response->crc) &&
+         (MHD_INVALID_SOCKET == response->fd) ) ||
+       (MHD_SIZE_UNKNOWN == response->total_size) )
+    return NULL;
+  range = MHD_lookup_connection_value (connection,
+                                       MHD_HEADER_KIND,
+                                       MHD_HTTP_HEADER_RANGE);
+  if ( (NULL == range) ||
+       (NULL != MHD_get_response_header (response,
+                                         MHD_HTTP_HEADER_CONTENT_RANGE)) ||
+       (MHD_YES != if_range_matches (connection, response)) ||
+       (MHD_YES != parse_ranges (range,
+                                 response->total_size,
+                                 ranges,
+                                 &num)) )
+    return NULL;
+  if (0 == num)
+    {
+      variant = unsatisfiable_range (response);
+      if (NULL != variant)
+        *status_code = MHD_HTTP_REQUESTED_RANGE_NOT_SATISFIABLE;
+      return variant;
+    }
+  if (1 == num)
+    variant = single_range (response, &ranges[0]);
+  else
+    variant = multiple_ranges (response, ranges, num);
+  if (NULL != variant)
+    *status_code = MHD_HTTP_PARTIAL_CONTENT;
+  return variant;
+}
+
+/* end of range.c */
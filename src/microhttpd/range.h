@@ -0,0 +1,51 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file range.h
+ * @brief answering "Range" requests from buffer and fd responses
+ * @author Christian Grothoff
+ */
+
+#ifndef RANGE_H
+#define RANGE_H
+
+#include "internal.h"
+
+
+/**
+ * Find the response to send instead of the full @a response if
+ * the request on @a connection asks for a range of it.  Only
+ * applies to "GET" requests answered with 200 using a response
+ * for a buffer or a file descriptor.
+ *
+ * @param connection connection the response is queued for
+ * @param response response queued by the application
+ * @param status_code status code of the response, set to 206
+ *        (or 416) if a partial response is returned
+ * @return response to send, with a reference for the connection;
+ *         NULL to send @a response as it is
+ */
+struct MHD_Response *
+MHD_range_select_ (struct MHD_Connection *connection,
+                   struct MHD_Response *response,
+                   unsigned int *status_code);
+
+
+#endif
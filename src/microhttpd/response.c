@@ -26,6 +26,9 @@
 
 #include "internal.h"
 #include "response.h"
+#if COMPRESSION_SUPPORT
+#include "compress.h"
+#endif
 
 #if defined(_WIN32) && defined(MHD_W32_MUTEX_)
 #ifndef WIN32_LEAN_AND_MEAN
@@ -35,6 +38,25 @@
 #endif /* _WIN32 && MHD_W32_MUTEX_ */
 
 
+/**
+ * Discard the pre-serialized header block of the response,
+ * as the headers were changed.  Does not take the mutex of
+ * the response, as headers may be changed from within the
+ * content reader callback (which is run with the mutex held).
+ *
+ * @param response response to update
+ */
+static void
+drop_header_block (struct MHD_Response *response)
+{
+  if (NULL != response->header_block)
+    {
+      free (response->header_block);
+      response->header_block = NULL;
+    }
+}
+
+
 /**
  * Add a header or footer line to the response.
  *
@@ -80,6 +102,8 @@ add_response_entry (struct MHD_Response *response,
   hdr->kind = kind;
   hdr->next = response->first_header;
   response->first_header = hdr;
+  if (MHD_HEADER_KIND == kind)
+    drop_header_block (response);
   return MHD_YES;
 }
 
@@ -157,6 +181,7 @@ MHD_del_response_header (struct MHD_Response *response,
           else
             prev->next = pos->next;
           free (pos);
+          drop_header_block (response);
           return MHD_YES;
         }
       prev = pos;
@@ -284,6 +309,15 @@ MHD_set_response_options (struct MHD_Response *response,
 
   ret = MHD_YES;
   response->flags = flags;
+#if COMPRESSION_SUPPORT
+  if ( (0 != (flags & MHD_RF_COMPRESS)) &&
+       (NULL == MHD_get_response_header (response,
+                                         MHD_HTTP_HEADER_VARY)) &&
+       (MHD_YES != MHD_add_response_header (response,
+                                            MHD_HTTP_HEADER_VARY,
+                                            MHD_HTTP_HEADER_ACCEPT_ENCODING)) )
+    ret = MHD_NO;
+#endif
   va_start (ap, flags);
   while (MHD_RO_END != (ro = va_arg (ap, enum MHD_ResponseOptions)))
   {
@@ -496,6 +530,9 @@ MHD_destroy_response (struct MHD_Response *response)
     }
   (void) MHD_mutex_unlock_ (&response->mutex);
   (void) MHD_mutex_destroy_ (&response->mutex);
+#if COMPRESSION_SUPPORT
+  MHD_compress_release_ (response);
+#endif
   if (response->crfc != NULL)
     response->crfc (response->crc_cls);
   while (NULL != response->first_header)
@@ -506,6 +543,8 @@ MHD_destroy_response (struct MHD_Response *response)
       free (pos->value);
       free (pos);
     }
+  if (NULL != response->header_block)
+    free (response->header_block);
   free (response);
 }
 
@@ -519,4 +558,108 @@ MHD_increment_response_rc (struct MHD_Response *response)
 }
 
 
+/**
+ * Make sure the headers of the response are available as a
+ * pre-serialized block in @a response, so that they do not
+ * have to be formatted again for every request the response
+ * is used for.
+ *
+ * @param response response to prepare
+ * @return #MHD_YES on success, #MHD_NO on failure (out of memory)
+ */
+int
+MHD_response_build_header_block (struct MHD_Response *response)
+{
+  struct MHD_HTTP_Header *pos;
+  const char *connection_value;
+  const char *encoding;
+  enum MHD_ResponseHeaderFlags flags;
+  size_t size;
+  size_t off;
+  size_t len;
+  char *block;
+
+  (void) MHD_mutex_lock_ (&response->mutex);
+  if (NULL != response->header_block)
+    {
+      (void) MHD_mutex_unlock_ (&response->mutex);
+      return MHD_YES;
+    }
+  flags = MHD_RHF_NONE;
+  connection_value = MHD_get_response_header (response,
+                                              MHD_HTTP_HEADER_CONNECTION);
+  if (NULL != connection_value)
+    {
+      if (0 == strcasecmp (connection_value, "close"))
+        flags |= MHD_RHF_HAS_CLOSE;
+      else if (0 == strcasecmp (connection_value, "Keep-Alive"))
+        flags |= MHD_RHF_HAS_KEEP_ALIVE;
+    }
+  encoding = MHD_get_response_header (response,
+                                      MHD_HTTP_HEADER_TRANSFER_ENCODING);
+  if (NULL != encoding)
+    {
+      flags |= MHD_RHF_HAS_ENCODING;
+      if (0 == strcasecmp (encoding, "identity"))
+        flags |= MHD_RHF_ENCODING_IDENTITY;
+    }
+  if (NULL != MHD_get_response_header (response,
+                                       MHD_HTTP_HEADER_CONTENT_LENGTH))
+    flags |= MHD_RHF_HAS_CONTENT_LENGTH;
+  if (NULL != MHD_get_response_header (response,
+                                       MHD_HTTP_HEADER_DATE))
+    flags |= MHD_RHF_HAS_DATE;
+
+  size = 0;
+  for (pos = response->first_header; NULL != pos; pos = pos->next)
+    if (MHD_HEADER_KIND == pos->kind)
+      size += strlen (pos->header) + strlen (pos->value) + 4; /* colon, space, linefeeds */
+  if (NULL == (block = malloc (size + 1)))
+    {
+      (void) MHD_mutex_unlock_ (&response->mutex);
+      return MHD_NO;
+    }
+  off = 0;
+  response->keep_alive_off = 0;
+  response->keep_alive_len = 0;
+  for (pos = response->first_header; NULL != pos; pos = pos->next)
+    {
+      if (MHD_HEADER_KIND != pos->kind)
+        continue;
+      if ( (pos->value == connection_value) &&
+           (0 != (flags & MHD_RHF_HAS_KEEP_ALIVE)) )
+        response->keep_alive_off = off;
+      len = strlen (pos->header);
+      memcpy (&block[off], pos->header, len);
+      off += len;
+      memcpy (&block[off], ": ", 2);
+      off += 2;
+      len = strlen (pos->value);
+      memcpy (&block[off], pos->value, len);
+      off += len;
+      memcpy (&block[off], "\r\n", 2);
+      off += 2;
+      if ( (pos->value == connection_value) &&
+           (0 != (flags & MHD_RHF_HAS_KEEP_ALIVE)) )
+        response->keep_alive_len = off - response->keep_alive_off;
+    }
+  block[off] = '\0';
+  EXTRA_CHECK (off == size);
+
+  response->content_length_size = response->total_size;
+  if (MHD_SIZE_UNKNOWN != response->total_size)
+    response->content_length_len
+      = sprintf (response->content_length_line,
+                 MHD_HTTP_HEADER_CONTENT_LENGTH ": " MHD_UNSIGNED_LONG_LONG_PRINTF "\r\n",
+                 (MHD_UNSIGNED_LONG_LONG) response->total_size);
+  else
+    response->content_length_len = 0;
+  response->header_flags = flags;
+  response->header_block_size = size;
+  response->header_block = block;
+  (void) MHD_mutex_unlock_ (&response->mutex);
+  return MHD_YES;
+}
+
+
 /* end of response.c */
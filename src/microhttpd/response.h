@@ -35,4 +35,15 @@ void
 MHD_increment_response_rc (struct MHD_Response *response);
 
 
+/**
+ * Make sure the headers of the response are available as a
+ * pre-serialized block in @a response.
+ *
+ * @param response response to prepare
+ * @return #MHD_YES on success, #MHD_NO on failure (out of memory)
+ */
+int
+MHD_response_build_header_block (struct MHD_Response *response);
+
+
 #endif
@@ -0,0 +1,1050 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file staticfiles.c
+ * @brief serving files from a directory, with a cache of open files
+ * @author Christian Grothoff
+ *
+ * Every cached file is an ordinary file descriptor response (plus a
+ * body-less response for 304) that is queued for all requests for
+ * the file; the cache holds one reference, so a file that is dropped
+ * from the cache is only closed once the last connection sending it
+ * is done.  The cache is a hash table over the URLs with an LRU list
+ * for eviction, protected by a single mutex.  The mutex is not held
+ * while we open or stat() a file: a missing file is loaded without
+ * it, and dropped again if another thread was faster.
+ *
+ * Each cached file has an inotify watch.  Pending events are read
+ * (with a single non-blocking read()) before the cache is consulted,
+ * and drop the files they are about; without inotify (or if adding
+ * the watch failed), the file is checked with stat() instead.
+ */
+
+#include "internal.h"
+#include <limits.h>
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+/**
+ * File served for URLs that end with a '/'.
+ */
+#define MHD_STATIC_INDEX "index.html"
+
+/**
+ * Content type for files with an unknown extension.
+ */
+#define MHD_STATIC_DEFAULT_TYPE "application/octet-stream"
+
+#if HAVE_SYS_INOTIFY_H
+/**
+ * Events that make us drop a cached file.  Replacing or removing
+ * a file changes its link count, which is reported as IN_ATTRIB
+ * (IN_DELETE_SELF only comes once we closed the file ourselves).
+ */
+#define MHD_STATIC_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#endif
+
+
+/**
+ * Content types by file name extension.
+ */
+static const struct
+{
+  const char *extension;
+  const char *type;
+} content_types[] =
+  {
+    { "html", "text/html" },
+    { "htm", "text/html" },
+    { "css", "text/css" },
+    { "js", "application/javascript" },
+    { "json", "application/json" },
+    { "txt", "text/plain" },
+    { "xml", "application/xml" },
+    { "svg", "image/svg+xml" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "ico", "image/x-icon" },
+    { "pdf", "application/pdf" },
+    { "wasm", "application/wasm" },
+    { NULL, NULL }
+  };
+
+
+/**
+ * A file in the cache.
+ */
+struct FileEntry
+{
+
+  /**
+   * Next entry in the LRU list (less recently used).
+   */
+  struct FileEntry *next;
+
+  /**
+   * Previous entry in the LRU list (more recently used).
+   */
+  struct FileEntry *prev;
+
+  /**
+   * Next entry in the same hash bucket.
+   */
+  struct FileEntry *hnext;
+
+  /**
+   * URL of the file (key of the cache).
+   */
+  char *url;
+
+  /**
+   * Hash of @e url.
+   */
+  unsigned int hash;
+
+  /**
+   * inotify watch for the file, -1 for none.
+   */
+  int wd;
+
+  /**
+   * Response with the file; we hold one reference.
+   */
+  struct MHD_Response *response;
+
+  /**
+   * Response for 304 "Not Modified"; we hold one reference.
+   */
+  struct MHD_Response *not_modified;
+
+  /**
+   * Modification time of the file.
+   */
+  time_t mtime;
+
+  /**
+   * Size of the file.
+   */
+  off_t size;
+
+  /**
+   * Inode of the file (to notice that it was replaced
+   * if we have no @e wd).
+   */
+  ino_t ino;
+
+  /**
+   * Value of the "ETag" header, including the quotes.
+   */
+  char etag[48];
+
+  /**
+   * Value of the "Last-Modified" header.
+   */
+  char last_modified[MHD_HTTP_DATE_SIZE];
+
+};
+
+
+/**
+ * Handle for serving files from a directory.
+ */
+struct MHD_StaticFiles
+{
+
+  /**
+   * Directory with the files, without trailing '/'.
+   */
+  char *root;
+
+  /**
+   * Length of @e root.
+   */
+  size_t root_len;
+
+  /**
+   * Hash table of the cached files, with @e table_mask + 1 buckets.
+   */
+  struct FileEntry **table;
+
+  /**
+   * Number of buckets of @e table minus one.
+   */
+  unsigned int table_mask;
+
+  /**
+   * Most recently used file.
+   */
+  struct FileEntry *head;
+
+  /**
+   * Least recently used file, dropped first.
+   */
+  struct FileEntry *tail;
+
+  /**
+   * Number of files in the cache.
+   */
+  unsigned int count;
+
+  /**
+   * Maximum number of files in the cache.
+   */
+  unsigned int max;
+
+  /**
+   * inotify file descriptor, -1 if we have none.
+   */
+  int inotify_fd;
+
+  /**
+   * Number of inotify events processed so far.  A file is loaded
+   * (and its watch added) without the mutex, so an event for it may
+   * be processed before it is in the cache; we do not cache a file
+   * if this changed while we loaded it.
+   */
+  unsigned int event_generation;
+
+  /**
+   * Response for 404.
+   */
+  struct MHD_Response *not_found;
+
+  /**
+   * Response for 405.
+   */
+  struct MHD_Response *not_allowed;
+
+  /**
+   * Protects the cache.
+   */
+  MHD_mutex_ mutex;
+
+};
+
+
+/**
+ * Hash a URL (FNV-1a).
+ *
+ * @param url the URL
+ * @return hash value
+ */
+static unsigned int
+hash_url (const char *url)
+{
+  unsigned int hash = 2166136261U;
+
+  while ('\0' != *url)
+    hash = (hash ^ (unsigned char) *url++) * 16777619U;
+  return hash;
+}
+
+
+/**
+ * Check that @a url starts with a '/' and does not leave
+ * the root directory.
+ *
+ * @param url the URL to check
+ * @return #MHD_YES if we can serve it
+ */
+static int
+url_is_safe (const char *url)
+{
+  const char *pos;
+
+  if ('/' != url[0])
+    return MHD_NO;
+  for (pos = url; NULL != pos; pos = strchr (pos + 1, '/'))
+    if ( ('.' == pos[1]) &&
+         ('.' == pos[2]) &&
+         ( ('/' == pos[3]) || ('\0' == pos[3]) ) )
+      return MHD_NO;
+#ifdef _WIN32
+  if (NULL != strchr (url, '\\'))
+    return MHD_NO;
+#endif
+  return MHD_YES;
+}
+
+
+/**
+ * Guess the content type of a file from the extension of its name.
+ *
+ * @param filename name of the file
+ * @return content type
+ */
+static const char *
+guess_content_type (const char *filename)
+{
+  const char *ext;
+  unsigned int i;
+
+  ext = strrchr (filename, '.');
+  if ( (NULL == ext) ||
+       (NULL != strchr (ext, '/')) )
+    return MHD_STATIC_DEFAULT_TYPE;
+  ext++;
+  for (i = 0; NULL != content_types[i].extension; i++)
+    if (0 == strcasecmp (ext, content_types[i].extension))
+      return content_types[i].type;
+  return MHD_STATIC_DEFAULT_TYPE;
+}
+
+
+#if HAVE_SYS_INOTIFY_H
+/**
+ * Check whether an inotify watch is used by a cached file.
+ *
+ * @param sf the cache
+ * @param wd watch to look for
+ * @return #MHD_YES if some file in the cache uses @a wd
+ */
+static int
+watch_in_use (struct MHD_StaticFiles *sf,
+              int wd)
+{
+  struct FileEntry *pos;
+
+  for (pos = sf->head; NULL != pos; pos = pos->next)
+    if (wd == pos->wd)
+      return MHD_YES;
+  return MHD_NO;
+}
+#endif
+
+
+/**
+ * Release an entry that is not (or no longer) in the cache.
+ * Must be called with the mutex held if the entry has a watch.
+ *
+ * @param sf the cache
+ * @param entry entry to release
+ */
+static void
+entry_destroy (struct MHD_StaticFiles *sf,
+               struct FileEntry *entry)
+{
+#if HAVE_SYS_INOTIFY_H
+  /* hard links (and the same file under several URLs) share
+     the watch */
+  if ( (-1 != entry->wd) &&
+       (MHD_NO == watch_in_use (sf, entry->wd)) )
+    (void) inotify_rm_watch (sf->inotify_fd, entry->wd);
+#endif
+  if (NULL != entry->response)
+    MHD_destroy_response (entry->response);
+  if (NULL != entry->not_modified)
+    MHD_destroy_response (entry->not_modified);
+  free (entry->url);
+  free (entry);
+}
+
+
+/**
+ * Drop a file from the cache.  Must be called with
+ * the mutex held.
+ *
+ * @param sf the cache
+ * @param entry entry to drop
+ */
+static void
+entry_evict (struct MHD_StaticFiles *sf,
+             struct FileEntry *entry)
+{
+  struct FileEntry **pos;
+
+  for (pos = &sf->table[entry->hash & sf->table_mask];
+       entry != *pos;
+       pos = &(*pos)->hnext)
+    ;
+  *pos = entry->hnext;
+  DLL_remove (sf->head,
+              sf->tail,
+              entry);
+  sf->count--;
+  entry_destroy (sf, entry);
+}
+
+
+/**
+ * Drop all files from the cache that use the given watch,
+ * or all files if @a wd is -1.  Must be called with the
+ * mutex held.
+ *
+ * @param sf the cache
+ * @param wd the watch
+ */
+static void
+evict_watch (struct MHD_StaticFiles *sf,
+             int wd)
+{
+  struct FileEntry *pos;
+  struct FileEntry *next;
+
+  next = sf->head;
+  while (NULL != (pos = next))
+    {
+      next = pos->next;
+      if ( (-1 == wd) ||
+           (wd == pos->wd) )
+        entry_evict (sf, pos);
+    }
+}
+
+
+/**
+ * Process pending inotify events.  Must be called
+ * with the mutex held.
+ *
+ * @param sf the cache
+ */
+static void
+process_events (struct MHD_StaticFiles *sf)
+{
+#if HAVE_SYS_INOTIFY_H
+  union
+  {
+    struct inotify_event event;
+    char buf[4096];
+  } u;
+  const struct inotify_event *event;
+  ssize_t len;
+  size_t off;
+
+  if (-1 == sf->inotify_fd)
+    return;
+  while (0 < (len = read (sf->inotify_fd, u.buf, sizeof (u.buf))))
+    {
+      for (off = 0;
+           off + sizeof (struct inotify_event) <= (size_t) len;
+           off += sizeof (struct inotify_event) + event->len)
+        {
+          event = (const struct inotify_event *) &u.buf[off];
+          sf->event_generation++;
+          if (0 != (event->mask & IN_Q_OVERFLOW))
+            evict_watch (sf, -1);
+          else
+            evict_watch (sf, event->wd);
+        }
+    }
+#endif
+}
+
+
+/**
+ * Find the cached file for @a url.  Must be called with
+ * the mutex held.
+ *
+ * @param sf the cache
+ * @param url URL of the file
+ * @param hash hash of @a url
+ * @return NULL if @a url is not in the cache
+ */
+static struct FileEntry *
+entry_lookup (struct MHD_StaticFiles *sf,
+              const char *url,
+              unsigned int hash)
+{
+  struct FileEntry *entry;
+
+  for (entry = sf->table[hash & sf->table_mask];
+       NULL != entry;
+       entry = entry->hnext)
+    if ( (hash == entry->hash) &&
+         (0 == strcmp (url, entry->url)) )
+      return entry;
+  return NULL;
+}
+
+
+/**
+ * Release an entry that was never in the cache.  Must be
+ * called without the mutex held.
+ *
+ * @param sf the cache
+ * @param entry entry to release
+ */
+static void
+entry_discard (struct MHD_StaticFiles *sf,
+               struct FileEntry *entry)
+{
+  if (-1 == entry->wd)
+    {
+      entry_destroy (sf, entry);
+      return;
+    }
+  /* the watch may be shared with a cached file */
+  if (MHD_YES != MHD_mutex_lock_ (&sf->mutex))
+    MHD_PANIC ("Failed to acquire static files mutex\n");
+  entry_destroy (sf, entry);
+  if (MHD_YES != MHD_mutex_unlock_ (&sf->mutex))
+    MHD_PANIC ("Failed to release static files mutex\n");
+}
+
+
+/**
+ * Check (with stat()) that a file we have no watch for
+ * is still the file we have open.  Called without the
+ * mutex, so we get the values of the entry.
+ *
+ * @param sf the cache
+ * @param url URL of the file
+ * @param mtime modification time of the open file
+ * @param size size of the open file
+ * @param ino inode of the open file
+ * @return #MHD_YES if the open file can be served
+ */
+static int
+file_is_current (struct MHD_StaticFiles *sf,
+                 const char *url,
+                 time_t mtime,
+                 off_t size,
+                 ino_t ino)
+{
+  char filename[PATH_MAX];
+  struct stat st;
+
+  if ( (sf->root_len + strlen (url) + strlen (MHD_STATIC_INDEX)
+        >= sizeof (filename)) )
+    return MHD_NO;
+  sprintf (filename,
+           "%s%s%s",
+           sf->root,
+           url,
+           ('/' == url[strlen (url) - 1])
+           ? MHD_STATIC_INDEX : "");
+  if (0 != stat (filename, &st))
+    return MHD_NO;
+  return ( (st.st_mtime == mtime) &&
+           (st.st_size == size) &&
+           (st.st_ino == ino) ) ? MHD_YES : MHD_NO;
+}
+
+
+/**
+ * Open the file for @a url and create the responses for it.
+ * Must be called without the mutex held.
+ *
+ * @param sf the cache
+ * @param url URL of the file
+ * @param hash hash of @a url
+ * @param watch #MHD_YES to add an inotify watch for the file
+ * @return NULL if the file does not exist (or is not
+ *         a regular file) or on error
+ */
+static struct FileEntry *
+entry_load (struct MHD_StaticFiles *sf,
+            const char *url,
+            unsigned int hash,
+            int watch)
+{
+  char filename[PATH_MAX];
+  struct FileEntry *entry;
+  struct stat st;
+  int flags;
+  int fd;
+
+  if (sf->root_len + strlen (url) + strlen (MHD_STATIC_INDEX)
+      >= sizeof (filename))
+    return NULL;
+  sprintf (filename,
+           "%s%s%s",
+           sf->root,
+           url,
+           ('/' == url[strlen (url) - 1]) ? MHD_STATIC_INDEX : "");
+  if (NULL == (entry = malloc (sizeof (struct FileEntry))))
+    return NULL;
+  memset (entry, 0, sizeof (struct FileEntry));
+  entry->wd = -1;
+  entry->hash = hash;
+  if (NULL == (entry->url = strdup (url)))
+    {
+      free (entry);
+      return NULL;
+    }
+#if HAVE_SYS_INOTIFY_H
+  /* add the watch before we open the file, so that we
+     cannot miss a change after we looked at it */
+  if ( (MHD_YES == watch) &&
+       (-1 != sf->inotify_fd) )
+    entry->wd = inotify_add_watch (sf->inotify_fd,
+                                   filename,
+                                   MHD_STATIC_EVENTS);
+#endif
+  flags = O_RDONLY;
+#ifdef O_CLOEXEC
+  flags |= O_CLOEXEC;
+#endif
+  fd = open (filename, flags);
+  if (-1 == fd)
+    {
+      entry_discard (sf, entry);
+      return NULL;
+    }
+  if ( (0 != fstat (fd, &st)) ||
+       (! S_ISREG (st.st_mode)) ||
+       ((uint64_t) st.st_size > (uint64_t) SIZE_MAX) ||
+       (NULL == (entry->response
+                 = MHD_create_response_from_fd ((size_t) st.st_size,
+                                                fd))) )
+    {
+      (void) close (fd);
+      entry_discard (sf, entry);
+      return NULL;
+    }
+  entry->mtime = st.st_mtime;
+  entry->size = st.st_size;
+  entry->ino = st.st_ino;
+  sprintf (entry->etag,
+           "\"%llx-%llx\"",
+           (unsigned long long) st.st_mtime,
+           (unsigned long long) st.st_size);
+  MHD_format_http_date_ (entry->last_modified,
+                         st.st_mtime);
+  if ( (NULL == (entry->not_modified
+                 = MHD_create_response_from_buffer (0,
+                                                    NULL,
+                                                    MHD_RESPMEM_PERSISTENT))) ||
+       (MHD_YES != MHD_add_response_header (entry->response,
+                                            MHD_HTTP_HEADER_CONTENT_TYPE,
+                                            guess_content_type (filename))) ||
+       (MHD_YES != MHD_add_response_header (entry->response,
+                                            MHD_HTTP_HEADER_ACCEPT_RANGES,
+                                            "bytes")) ||
+       (MHD_YES != MHD_add_response_header (entry->response,
+                                            MHD_HTTP_HEADER_ETAG,
+                                            entry->etag)) ||
+       (MHD_YES != MHD_add_response_header (entry->not_modified,
+                                            MHD_HTTP_HEADER_ETAG,
+                                            entry->etag)) ||
+       ( ('\0' != entry->last_modified[0]) &&
+         ( (MHD_YES != MHD_add_response_header (entry->response,
+                                                MHD_HTTP_HEADER_LAST_MODIFIED,
+                                                entry->last_modified)) ||
+           (MHD_YES != MHD_add_response_header (entry->not_modified,
+                                                MHD_HTTP_HEADER_LAST_MODIFIED,
+                                                entry->last_modified)) ) ) )
+    {
+      entry_discard (sf, entry);
+      return NULL;
+    }
+  return entry;
+}
+
+
+/**
+ * Check whether the "If-None-Match" header @a list
+ * matches @a etag (using the weak comparison).
+ *
+ * @param list value of the header
+ * @param etag our entity tag
+ * @return #MHD_YES on a match
+ */
+static int
+etag_matches (const char *list,
+              const char *etag)
+{
+  size_t elen = strlen (etag);
+  const char *end;
+
+  while (1)
+    {
+      while ( (' ' == *list) ||
+              ('\t' == *list) ||
+              (',' == *list) )
+        list++;
+      if ('\0' == *list)
+        return MHD_NO;
+      if ('*' == *list)
+        return MHD_YES;
+      if (0 == strncmp (list, "W/", 2))
+        list += 2;
+      if ('"' != *list)
+        return MHD_NO;          /* malformed */
+      if (NULL == (end = strchr (list + 1, '"')))
+        return MHD_NO;
+      if ( ((size_t) (end + 1 - list) == elen) &&
+           (0 == memcmp (list, etag, elen)) )
+        return MHD_YES;
+      list = end + 1;
+    }
+}
+
+
+/**
+ * Parse an HTTP date in the (only recommended) "IMF-fixdate"
+ * format, for example "Sun, 06 Nov 1994 08:49:37 GMT".
+ *
+ * @param date the date to parse
+ * @param t set to the time
+ * @return #MHD_YES on success
+ */
+static int
+parse_http_date (const char *date,
+                 time_t *t)
+{
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char mon[4];
+  const char *m;
+  unsigned int day;
+  unsigned int month;
+  unsigned int year;
+  unsigned int hour;
+  unsigned int min;
+  unsigned int sec;
+  unsigned int y;
+  unsigned int era;
+  unsigned int doy;
+  unsigned int doe;
+  uint64_t days;
+
+  if (6 != sscanf (date,
+                   "%*3s, %2u %3s %4u %2u:%2u:%2u GMT",
+                   &day, mon, &year, &hour, &min, &sec))
+    return MHD_NO;
+  if ( (3 != strlen (mon)) ||
+       (NULL == (m = strstr (months, mon))) ||
+       (0 != (m - months) % 3) ||
+       (year < 1970) ||
+       (day < 1) || (day > 31) ||
+       (hour > 23) || (min > 59) || (sec > 60) )
+    return MHD_NO;
+  month = (m - months) / 3 + 1;
+  /* days since the epoch for a date in the proleptic
+     Gregorian calendar (years start in March) */
+  y = year - ((month <= 2) ? 1 : 0);
+  era = y / 400;
+  doy = (153 * ((month > 2) ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  doe = (y - era * 400) * 365 + (y - era * 400) / 4
+    - (y - era * 400) / 100 + doy;
+  days = (uint64_t) era * 146097 + doe - 719468;
+  *t = (time_t) (days * 86400 + hour * 3600 + min * 60 + sec);
+  return MHD_YES;
+}
+
+
+/**
+ * Check whether the request on @a connection is conditional
+ * and the file did not change since the client got it.
+ *
+ * @param connection connection with the request
+ * @param entry the file
+ * @return #MHD_YES to answer with 304
+ */
+static int
+is_not_modified (struct MHD_Connection *connection,
+                 const struct FileEntry *entry)
+{
+  const char *inm;
+  const char *ims;
+  time_t t;
+
+  inm = MHD_lookup_connection_value (connection,
+                                     MHD_HEADER_KIND,
+                                     MHD_HTTP_HEADER_IF_NONE_MATCH);
+  if (NULL != inm)
+    return etag_matches (inm, entry->etag);
+  ims = MHD_lookup_connection_value (connection,
+                                     MHD_HEADER_KIND,
+                                     MHD_HTTP_HEADER_IF_MODIFIED_SINCE);
+  if (NULL == ims)
+    return MHD_NO;
+  /* clients usually send back what we told them */
+  if (0 == strcmp (ims, entry->last_modified))
+    return MHD_YES;
+  if (MHD_YES != parse_http_date (ims, &t))
+    return MHD_NO;
+  return (entry->mtime <= t) ? MHD_YES : MHD_NO;
+}
+
+
+/**
+ * Queue the response for a file.
+ *
+ * @param connection connection to answer
+ * @param entry the file
+ * @return #MHD_YES on success
+ */
+static int
+queue_entry (struct MHD_Connection *connection,
+             const struct FileEntry *entry)
+{
+  if (MHD_YES == is_not_modified (connection, entry))
+    return MHD_queue_response (connection,
+                               MHD_HTTP_NOT_MODIFIED,
+                               entry->not_modified);
+  return MHD_queue_response (connection,
+                             MHD_HTTP_OK,
+                             entry->response);
+}
+
+
+/**
+ * Create a `struct MHD_StaticFiles` for serving the files below
+ * @a root with #MHD_static_files_handler().
+ *
+ * @param root directory with the files to serve
+ * @param cache_size maximum number of files to keep open,
+ *        0 to open the file for every request
+ * @return NULL on error (out of memory)
+ * @ingroup response
+ */
+struct MHD_StaticFiles *
+MHD_static_files_create (const char *root,
+                         unsigned int cache_size)
+{
+  static const char not_found[] =
+    "<html><head><title>File not found</title></head>"
+    "<body>File not found</body></html>";
+  static const char not_allowed[] =
+    "<html><head><title>Method not allowed</title></head>"
+    "<body>Method not allowed</body></html>";
+  struct MHD_StaticFiles *sf;
+  unsigned int buckets;
+
+  if (NULL == (sf = malloc (sizeof (struct MHD_StaticFiles))))
+    return NULL;
+  memset (sf, 0, sizeof (struct MHD_StaticFiles));
+  sf->inotify_fd = -1;
+  sf->max = cache_size;
+  buckets = 16;
+  while ( (buckets < cache_size) &&
+          (buckets < (1U << 20)) )
+    buckets *= 2;
+  sf->table_mask = buckets - 1;
+  if (NULL == (sf->root = strdup (root)))
+    goto fail;
+  sf->root_len = strlen (sf->root);
+  while ( (sf->root_len > 0) &&
+          ('/' == sf->root[sf->root_len - 1]) )
+    sf->root[--sf->root_len] = '\0';
+  if (NULL == (sf->table = calloc (buckets, sizeof (struct FileEntry *))))
+    goto fail;
+  if ( (NULL == (sf->not_found
+                 = MHD_create_response_from_buffer (strlen (not_found),
+                                                    (void *) not_found,
+                                                    MHD_RESPMEM_PERSISTENT))) ||
+       (MHD_YES != MHD_add_response_header (sf->not_found,
+                                            MHD_HTTP_HEADER_CONTENT_TYPE,
+                                            "text/html")) ||
+       (NULL == (sf->not_allowed
+                 = MHD_create_response_from_buffer (strlen (not_allowed),
+                                                    (void *) not_allowed,
+                                                    MHD_RESPMEM_PERSISTENT))) ||
+       (MHD_YES != MHD_add_response_header (sf->not_allowed,
+                                            MHD_HTTP_HEADER_CONTENT_TYPE,
+                                            "text/html")) ||
+       (MHD_YES != MHD_add_response_header (sf->not_allowed,
+                                            MHD_HTTP_HEADER_ALLOW,
+                                            "GET, HEAD")) )
+    goto fail;
+  if (MHD_YES != MHD_mutex_create_ (&sf->mutex))
+    goto fail;
+#if HAVE_SYS_INOTIFY_H
+  /* without inotify, we fall back to stat() */
+  if (0 != cache_size)
+    sf->inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+#endif
+  return sf;
+ fail:
+  if (NULL != sf->not_found)
+    MHD_destroy_response (sf->not_found);
+  if (NULL != sf->not_allowed)
+    MHD_destroy_response (sf->not_allowed);
+  free (sf->table);
+  free (sf->root);
+  free (sf);
+  return NULL;
+}
+
+
+/**
+ * Answer a "GET" or "HEAD" request for @a url with the file
+ * "root/url".
+ *
+ * @param cls the `struct MHD_StaticFiles`
+ * @param connection connection with the request
+ * @param url URL of the request
+ * @param method method of the request
+ * @param version ignored
+ * @param upload_data ignored
+ * @param upload_data_size ignored
+ * @param con_cls ignored
+ * @return #MHD_YES if a response was queued, #MHD_NO on error
+ * @ingroup response
+ */
+int
+MHD_static_files_handler (void *cls,
+                          struct MHD_Connection *connection,
+                          const char *url,
+                          const char *method,
+                          const char *version,
+                          const char *upload_data,
+                          size_t *upload_data_size,
+                          void **con_cls)
+{
+  struct MHD_StaticFiles *sf = cls;
+  struct FileEntry *entry;
+  struct FileEntry *loaded;
+  struct FileEntry **bucket;
+  unsigned int hash;
+  unsigned int generation;
+  time_t mtime;
+  off_t size;
+  ino_t ino;
+  int current;
+  int ret;
+
+  if ( (0 != strcmp (method, MHD_HTTP_METHOD_GET)) &&
+       (0 != strcmp (method, MHD_HTTP_METHOD_HEAD)) )
+    return MHD_queue_response (connection,
+                               MHD_HTTP_METHOD_NOT_ALLOWED,
+                               sf->not_allowed);
+  if (MHD_YES != url_is_safe (url))
+    return MHD_queue_response (connection,
+                               MHD_HTTP_NOT_FOUND,
+                               sf->not_found);
+  if (0 == sf->max)
+    {
+      if (NULL == (entry = entry_load (sf, url, 0, MHD_NO)))
+        return MHD_queue_response (connection,
+                                   MHD_HTTP_NOT_FOUND,
+                                   sf->not_found);
+      ret = queue_entry (connection, entry);
+      entry_discard (sf, entry);
+      return ret;
+    }
+  hash = hash_url (url);
+  if (MHD_YES != MHD_mutex_lock_ (&sf->mutex))
+    MHD_PANIC ("Failed to acquire static files mutex\n");
+  process_events (sf);
+  entry = entry_lookup (sf, url, hash);
+  if ( (NULL != entry) &&
+       (-1 == entry->wd) &&
+       (MHD_YES != is_not_modified (connection, entry)) )
+    {
+      /* no watch, so check that the file did not change; a 304
+         does not need the check, and stat() does not need the mutex */
+      mtime = entry->mtime;
+      size = entry->size;
+      ino = entry->ino;
+      if (MHD_YES != MHD_mutex_unlock_ (&sf->mutex))
+        MHD_PANIC ("Failed to release static files mutex\n");
+      current = file_is_current (sf, url, mtime, size, ino);
+      if (MHD_YES != MHD_mutex_lock_ (&sf->mutex))
+        MHD_PANIC ("Failed to acquire static files mutex\n");
+      process_events (sf);
+      entry = entry_lookup (sf, url, hash);
+      /* unless another thread loaded the file again meanwhile */
+      if ( (NULL != entry) &&
+           (MHD_YES != current) &&
+           (mtime == entry->mtime) &&
+           (size == entry->size) &&
+           (ino == entry->ino) )
+        {
+          entry_evict (sf, entry);
+          entry = NULL;
+        }
+    }
+  if (NULL == entry)
+    {
+      generation = sf->event_generation;
+      if (MHD_YES != MHD_mutex_unlock_ (&sf->mutex))
+        MHD_PANIC ("Failed to release static files mutex\n");
+      if (NULL == (loaded = entry_load (sf, url, hash, MHD_YES)))
+        return MHD_queue_response (connection,
+                                   MHD_HTTP_NOT_FOUND,
+                                   sf->not_found);
+      if (MHD_YES != MHD_mutex_lock_ (&sf->mutex))
+        MHD_PANIC ("Failed to acquire static files mutex\n");
+      process_events (sf);
+      if (NULL != (entry = entry_lookup (sf, url, hash)))
+        {
+          /* another thread was faster, use its file */
+          entry_destroy (sf, loaded);
+        }
+      else if (generation != sf->event_generation)
+        {
+          /* an event for our watch may already be gone, so
+             serve the file, but do not cache it */
+          ret = queue_entry (connection, loaded);
+          entry_destroy (sf, loaded);
+          if (MHD_YES != MHD_mutex_unlock_ (&sf->mutex))
+            MHD_PANIC ("Failed to release static files mutex\n");
+          return ret;
+        }
+      else
+        {
+          entry = loaded;
+          bucket = &sf->table[hash & sf->table_mask];
+          entry->hnext = *bucket;
+          *bucket = entry;
+          sf->count++;
+          DLL_insert (sf->head,
+                      sf->tail,
+                      entry);
+        }
+    }
+  /* most recently used */
+  DLL_remove (sf->head,
+              sf->tail,
+              entry);
+  DLL_insert (sf->head,
+              sf->tail,
+              entry);
+  /* evict only now, so that a watch shared with the
+     new entry stays */
+  if (sf->count > sf->max)
+    entry_evict (sf, sf->tail);
+  /* queue while we hold the mutex, as an event processed by
+     another thread may release our reference */
+  ret = queue_entry (connection, entry);
+  if (MHD_YES != MHD_mutex_unlock_ (&sf->mutex))
+    MHD_PANIC ("Failed to release static files mutex\n");
+  return ret;
+}
+
+
+/**
+ * Release a `struct MHD_StaticFiles` and close the cached files.
+ *
+ * @param sf the handle to destroy
+ * @ingroup response
+ */
+void
+MHD_static_files_destroy (struct MHD_StaticFiles *sf)
+{
+  evict_watch (sf, -1);
+#if HAVE_SYS_INOTIFY_H
+  if (-1 != sf->inotify_fd)
+    (void) close (sf->inotify_fd);
+#endif
+  (void) MHD_mutex_destroy_ (&sf->mutex);
+  MHD_destroy_response (sf->not_found);
+  MHD_destroy_response (sf->not_allowed);
+  free (sf->table);
+  free (sf->root);
+  free (sf);
+}
+
+/* end of staticfiles.c */
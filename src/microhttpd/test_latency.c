@@ -0,0 +1,146 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_latency.c
+ * @brief  Testcase for the latency histograms
+ * @author Christian Grothoff
+ */
+
+#include "platform.h"
+#include "microhttpd.h"
+#include "internal.h"
+#include "latency.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+
+/**
+ * Check that every value falls into a bucket whose limits include
+ * it, and that the buckets are contiguous and increasing.
+ */
+static int
+testBuckets ()
+{
+  uint64_t v;
+  uint64_t low;
+  unsigned int b;
+  unsigned int i;
+
+  for (b = 0; b < MHD_LATENCY_HISTOGRAM_BUCKETS - 1; b++)
+    {
+      low = (0 == b) ? 0 : MHD_latency_histogram_bucket_limit (b - 1) + 1;
+      if (MHD_latency_histogram_bucket_limit (b) < low)
+        return 1;
+      if ( (b != MHD_latency_bucket_ (low)) ||
+           (b != MHD_latency_bucket_ (MHD_latency_histogram_bucket_limit (b))) )
+        {
+          fprintf (stderr,
+                   "Bucket %u does not cover [%llu, %llu]\n",
+                   b,
+                   (unsigned long long) low,
+                   (unsigned long long) MHD_latency_histogram_bucket_limit (b));
+          return 2;
+        }
+      /* relative width of a bucket is bounded */
+      if ( (b >= 16) &&
+           (MHD_latency_histogram_bucket_limit (b) - low + 1 > low / 16) )
+        return 4;
+    }
+  if (MHD_LATENCY_HISTOGRAM_BUCKETS - 1 !=
+      MHD_latency_bucket_ ((uint64_t) -1))
+    return 8;
+  if ((uint64_t) -1 !=
+      MHD_latency_histogram_bucket_limit (MHD_LATENCY_HISTOGRAM_BUCKETS - 1))
+    return 8;
+  /* some random values */
+  for (i = 0; i < 10000; i++)
+    {
+      v = ((uint64_t) random ()) >> (random () % 31);
+      b = MHD_latency_bucket_ (v);
+      low = (0 == b) ? 0 : MHD_latency_histogram_bucket_limit (b - 1) + 1;
+      if ( (v < low) ||
+           (v > MHD_latency_histogram_bucket_limit (b)) )
+        return 16;
+    }
+  return 0;
+}
+
+
+/**
+ * Check counting, merging and percentiles.
+ */
+static int
+testPercentiles ()
+{
+  static struct MHD_LatencyHistogram h;
+  static struct MHD_LatencyHistogram m;
+  uint64_t p;
+  unsigned int i;
+
+  if (0 != MHD_latency_histogram_percentile (&h, 50.0))
+    return 32;
+  /* 1..1000 microseconds */
+  for (i = 1; i <= 1000; i++)
+    MHD_latency_record_ (&h, i);
+  if ( (1000 != h.count) ||
+       (500500 != h.sum) ||
+       (1000 != h.max) )
+    return 64;
+  p = MHD_latency_histogram_percentile (&h, 50.0);
+  if ( (p < 500) || (p > 500 + 500 / 16) )
+    {
+      fprintf (stderr, "Median estimated as %llu\n", (unsigned long long) p);
+      return 128;
+    }
+  p = MHD_latency_histogram_percentile (&h, 99.0);
+  if ( (p < 990) || (p > 1000) )
+    return 256;
+  if ( (1000 != MHD_latency_histogram_percentile (&h, 100.0)) ||
+       (1 != MHD_latency_histogram_percentile (&h, 0.0)) )
+    return 512;
+  /* one outlier moves the maximum, but not the median */
+  MHD_latency_record_ (&h, 5000000);
+  if (5000000 != MHD_latency_histogram_percentile (&h, 100.0))
+    return 1024;
+  MHD_latency_merge_ (&m, &h);
+  MHD_latency_merge_ (&m, &h);
+  if ( (2002 != m.count) ||
+       (5000000 != m.max) ||
+       (MHD_latency_histogram_percentile (&h, 50.0) !=
+        MHD_latency_histogram_percentile (&m, 50.0)) )
+    return 2048;
+  return 0;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+
+  srandom (42);
+  errorCount += testBuckets ();
+  errorCount += testPercentiles ();
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  return errorCount != 0;       /* 0 == pass */
+}
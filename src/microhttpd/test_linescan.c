@@ -0,0 +1,185 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_linescan.c
+ * @brief  Testcase for the (SIMD) scanners for header delimiters
+ * @author Christian Grothoff
+ */
+
+#include "platform.h"
+#include "microhttpd.h"
+#include "internal.h"
+#include "linescan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define MAX_LEN 200
+
+
+/**
+ * Check @a impl against the scalar implementation for all lengths
+ * and offsets up to #MAX_LEN, with the characters we look for at
+ * every possible position (or not at all).
+ *
+ * @param name name of the implementation, for error messages
+ * @param impl implementation to check
+ * @return 0 on success
+ */
+static int
+check_impl (const char *name,
+            MHD_LineScanner impl)
+{
+  char buf[MAX_LEN + 32];
+  size_t len;
+  size_t off;
+  size_t at;
+  size_t want;
+  size_t got;
+  unsigned int i;
+
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = 'a' + (random () % 26);
+  for (off = 0; off < 32; off++)
+    for (len = 0; len <= MAX_LEN; len++)
+      for (at = 0; at <= len; at++)
+        {
+          /* place a '\n' at 'at' (if within the buffer) and a
+             '\r' right after the end, which must not be seen */
+          if (at < len)
+            buf[off + at] = (0 == at % 2) ? '\n' : '\r';
+          buf[off + len] = '\r';
+          want = MHD_linescan_find2_scalar (&buf[off], len, '\r', '\n');
+          got = impl (&buf[off], len, '\r', '\n');
+          if (at < len)
+            buf[off + at] = 'x';
+          buf[off + len] = 'y';
+          if ( (want != at) ||
+               (got != want) )
+            {
+              fprintf (stderr,
+                       "%s: offset %u, length %u, delimiter at %u: got %u, expected %u\n",
+                       name,
+                       (unsigned int) off,
+                       (unsigned int) len,
+                       (unsigned int) at,
+                       (unsigned int) got,
+                       (unsigned int) want);
+              return 1;
+            }
+        }
+  /* bytes with the high bit set must not be mistaken for anything */
+  memset (buf, 0xFF, sizeof (buf));
+  buf[MAX_LEN - 1] = ':';
+  if (MAX_LEN - 1 != impl (buf, MAX_LEN, ':', '\0'))
+    return 2;
+  return 0;
+}
+
+
+/**
+ * Check @a impl (an implementation of #MHD_linescan_findpair)
+ * for all lengths and offsets up to #MAX_LEN, with the pair at
+ * every possible position (or not at all).
+ *
+ * @param name name of the implementation, for error messages
+ * @param impl implementation to check
+ * @return 0 on success
+ */
+static int
+check_pair_impl (const char *name,
+                 MHD_LineScanner impl)
+{
+  char buf[MAX_LEN + 32];
+  size_t len;
+  size_t off;
+  size_t at;
+  size_t want;
+  size_t got;
+  unsigned int i;
+
+  for (i = 0; i < sizeof (buf); i++)
+    buf[i] = 'a' + (random () % 26);
+  for (off = 0; off < 32; off++)
+    for (len = 0; len <= MAX_LEN; len++)
+      for (at = 0; at <= len; at++)
+        {
+          /* place the pair at 'at' (if it fits), a lone '\r' right
+             before it, and a pair that crosses the end of the buffer,
+             which must not be seen */
+          if (len > 0)
+            buf[off + len - 1] = '\r';
+          buf[off + len] = '\n';
+          if (at > 0)
+            buf[off + at - 1] = '\r';
+          if (at + 1 < len)
+            memcpy (&buf[off + at], "\r\n", 2);
+          want = (at + 1 < len) ? at : len;
+          got = impl (&buf[off], len, '\r', '\n');
+          if (want != MHD_linescan_findpair_scalar (&buf[off], len, '\r', '\n'))
+            want = len + 1;
+          memset (&buf[off], 'x', len + 1);
+          if (got != want)
+            {
+              fprintf (stderr,
+                       "%s: offset %u, length %u, pair at %u: got %u, expected %u\n",
+                       name,
+                       (unsigned int) off,
+                       (unsigned int) len,
+                       (unsigned int) at,
+                       (unsigned int) got,
+                       (unsigned int) want);
+              return 1;
+            }
+        }
+  return 0;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+
+  srandom (42);
+  errorCount += check_impl ("dispatch", MHD_linescan_find2);
+  /* the first call installed the actual implementation */
+  errorCount += check_impl ("selected", MHD_linescan_find2);
+#if MHD_LINESCAN_SSE2
+  errorCount += check_impl ("sse2", &MHD_linescan_find2_sse2);
+#endif
+#if MHD_LINESCAN_AVX2
+  if (MHD_YES == MHD_linescan_have_avx2 ())
+    errorCount += check_impl ("avx2", &MHD_linescan_find2_avx2);
+#endif
+  errorCount += 8 * check_pair_impl ("pair dispatch", MHD_linescan_findpair);
+  errorCount += 8 * check_pair_impl ("pair selected", MHD_linescan_findpair);
+#if MHD_LINESCAN_SSE2
+  errorCount += 8 * check_pair_impl ("pair sse2", &MHD_linescan_findpair_sse2);
+#endif
+#if MHD_LINESCAN_AVX2
+  if (MHD_YES == MHD_linescan_have_avx2 ())
+    errorCount += 8 * check_pair_impl ("pair avx2", &MHD_linescan_findpair_avx2);
+#endif
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  return errorCount != 0;       /* 0 == pass */
+}
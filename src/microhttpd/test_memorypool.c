@@ -0,0 +1,150 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_memorypool.c
+ * @brief  Testcase for resetting memory pools and giving their
+ *         unused memory back to the operating system
+ * @author Christian Grothoff
+ */
+
+#include "platform.h"
+#include "microhttpd.h"
+#include "internal.h"
+#include "memorypool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/**
+ * Number of bytes we keep over a reset.
+ */
+#define KEEP 16
+
+
+/**
+ * Check whether any page in [@a start, @a start + @a size) is resident.
+ *
+ * @return 0 if none is (or if we cannot tell), 1 otherwise
+ */
+static int
+any_resident (char *start,
+              size_t size)
+{
+#if LINUX
+  long page_size = sysconf (_SC_PAGESIZE);
+  uintptr_t first;
+  uintptr_t last;
+  unsigned char vec[256];
+  size_t pages;
+  size_t i;
+
+  first = ((uintptr_t) start + page_size - 1) & ~((uintptr_t) page_size - 1);
+  last = ((uintptr_t) start + size) & ~((uintptr_t) page_size - 1);
+  if (last <= first)
+    return 0;
+  pages = (last - first) / page_size;
+  if ( (pages > sizeof (vec)) ||
+       (0 != mincore ((void *) first, last - first, vec)) )
+    return 0;
+  for (i = 0; i < pages; i++)
+    if (0 != (vec[i] & 1))
+      return 1;
+#endif
+  return 0;
+}
+
+
+/**
+ * Use most of a pool of @a size bytes, reset it keeping @a KEEP
+ * bytes, give the rest back and check that the pool can be used
+ * again, with all memory outside of the kept block zero.
+ *
+ * @param size size of the pool; small pools are malloc'ed,
+ *        larger ones mmapped
+ * @return 0 on success
+ */
+static int
+testRelease (size_t size)
+{
+  struct MemoryPool *pool;
+  char *head;
+  char *tail;
+  size_t released;
+  size_t i;
+  int ret;
+
+  if (NULL == (pool = MHD_pool_create (size)))
+    return 1;
+  ret = 0;
+  head = MHD_pool_allocate (pool, size / 2, MHD_NO);
+  tail = MHD_pool_allocate (pool, size / 4, MHD_YES);
+  if ( (NULL == head) || (NULL == tail) )
+    {
+      MHD_pool_destroy (pool);
+      return 2;
+    }
+  memset (head, 0x5a, size / 2);
+  memset (tail, 0xa5, size / 4);
+  head = MHD_pool_reset (pool, head, KEEP, KEEP);
+  released = MHD_pool_release_unused (pool);
+#if LINUX && defined(MADV_DONTNEED)
+  /* all but the pages at the edges of the free area */
+  if (released + 2 * sysconf (_SC_PAGESIZE) < size - KEEP)
+    ret |= 4;
+  if (any_resident (head + KEEP, size - KEEP))
+    ret |= 8;
+#else
+  if (0 != released)
+    ret |= 4;
+#endif
+  /* the pool has its full size again, and reads as zero */
+  tail = MHD_pool_allocate (pool, size - KEEP, MHD_NO);
+  if (tail != head + KEEP)
+    ret |= 16;
+  for (i = 0; i < KEEP; i++)
+    if (0x5a != head[i])
+      ret |= 32;
+  if (NULL != tail)
+    for (i = 0; i < size - KEEP; i++)
+      if (0 != tail[i])
+        {
+          ret |= 64;
+          break;
+        }
+  /* releasing a full pool gives nothing back */
+  if (0 != MHD_pool_release_unused (pool))
+    ret |= 128;
+  MHD_pool_destroy (pool);
+  return ret;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+
+  errorCount += testRelease (32 * 1024);
+  errorCount += 256 * testRelease (256 * 1024);
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  return errorCount != 0;       /* 0 == pass */
+}
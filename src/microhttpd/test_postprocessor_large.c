@@ -93,12 +93,179 @@ test_simple_large ()
   return 0;
 }
 
+
+/**
+ * Size of the file uploaded by test_multipart_large().
+ */
+#define FILE_SIZE (256 * 1024)
+
+/**
+ * Contents of the file, with plenty of bytes that look
+ * like the start of the boundary.
+ */
+static char file_data[FILE_SIZE];
+
+
+/**
+ * What we received for the upload of test_multipart_large().
+ */
+struct MultipartResult
+{
+  /**
+   * Number of bytes of the file received.
+   */
+  size_t file_pos;
+
+  /**
+   * Number of bytes of the "field" value received.
+   */
+  size_t field_pos;
+
+  /**
+   * Set to 1 if anything did not match.
+   */
+  int error;
+};
+
+
+static int
+multipart_checker (void *cls,
+                   enum MHD_ValueKind kind,
+                   const char *key,
+                   const char *filename,
+                   const char *content_type,
+                   const char *transfer_encoding,
+                   const char *data, uint64_t off, size_t size)
+{
+  struct MultipartResult *res = cls;
+
+  if (NULL == key)
+    {
+      res->error = 1;
+      return MHD_NO;
+    }
+  if (0 == strcmp (key, "field"))
+    {
+      if ( (off != res->field_pos) ||
+           (size > 5 - res->field_pos) ||
+           (0 != memcmp (data, &"value"[off], size)) )
+        {
+          res->error = 1;
+          return MHD_NO;
+        }
+      res->field_pos += size;
+      return MHD_YES;
+    }
+  if ( (0 != strcmp (key, "file")) ||
+       (NULL == filename) ||
+       (0 != strcmp (filename, "big.bin")) ||
+       (off != res->file_pos) ||
+       (size > FILE_SIZE - res->file_pos) ||
+       (0 != memcmp (data, &file_data[off], size)) )
+    {
+      res->error = 1;
+      return MHD_NO;
+    }
+  res->file_pos += size;
+  return MHD_YES;
+}
+
+
+/**
+ * Upload a large file with multipart/form-data in chunks
+ * of random size.
+ *
+ * @param buffer_size buffer size of the post processor
+ * @return 0 on success
+ */
+static int
+test_multipart_large (size_t buffer_size)
+{
+  static const char head[] =
+    "--AaB03x\r\n"
+    "Content-Disposition: form-data; name=\"field\"\r\n"
+    "\r\n"
+    "value\r\n"
+    "--AaB03x\r\n"
+    "Content-Disposition: form-data; name=\"file\"; filename=\"big.bin\"\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "\r\n";
+  static const char tail[] = "\r\n--AaB03x--\r\n";
+  static const char *const lookalikes[] = {
+    "\r\n--AaB03", "\r\r\n--", "\r\n--AaB03X", "\r\n-", "\r"
+  };
+  struct MHD_Connection connection;
+  struct MHD_HTTP_Header header;
+  struct MHD_PostProcessor *pp;
+  struct MultipartResult res;
+  char *body;
+  size_t body_len;
+  size_t i;
+  size_t delta;
+  size_t len;
+  int ret;
+
+  for (i = 0; i < FILE_SIZE; i++)
+    file_data[i] = (char) (MHD_random_ () & 0xff);
+  for (i = 0; i + 16 < FILE_SIZE; i += 1 + MHD_random_ () % 2000)
+    {
+      len = strlen (lookalikes[i % 5]);
+      memcpy (&file_data[i], lookalikes[i % 5], len);
+      file_data[i + len] = 'y';
+    }
+  body_len = strlen (head) + FILE_SIZE + strlen (tail);
+  if (NULL == (body = malloc (body_len)))
+    return 1;
+  memcpy (body, head, strlen (head));
+  memcpy (&body[strlen (head)], file_data, FILE_SIZE);
+  memcpy (&body[strlen (head) + FILE_SIZE], tail, strlen (tail));
+
+  memset (&res, 0, sizeof (res));
+  memset (&connection, 0, sizeof (struct MHD_Connection));
+  memset (&header, 0, sizeof (struct MHD_HTTP_Header));
+  connection.headers_received = &header;
+  header.header = MHD_HTTP_HEADER_CONTENT_TYPE;
+  header.value = MHD_HTTP_POST_ENCODING_MULTIPART_FORMDATA ", boundary=AaB03x";
+  header.kind = MHD_HEADER_KIND;
+  pp = MHD_create_post_processor (&connection, buffer_size,
+                                  &multipart_checker, &res);
+  ret = 0;
+  i = 0;
+  while (i < body_len)
+    {
+      /* mostly small chunks, so that boundaries get split */
+      if (0 == MHD_random_ () % 4)
+        delta = 1 + MHD_random_ () % (body_len - i);
+      else
+        delta = 1 + MHD_random_ () % 32;
+      if (delta > body_len - i)
+        delta = body_len - i;
+      if (MHD_YES != MHD_post_process (pp, &body[i], delta))
+        {
+          ret |= 2;
+          break;
+        }
+      i += delta;
+    }
+  if (MHD_YES != MHD_destroy_post_processor (pp))
+    ret |= 4;
+  free (body);
+  if ( (0 != res.error) ||
+       (5 != res.field_pos) ||
+       (FILE_SIZE != res.file_pos) )
+    ret |= 8;
+  return ret;
+}
+
+
 int
 main (int argc, char *const *argv)
 {
   unsigned int errorCount = 0;
 
   errorCount += test_simple_large ();
+  errorCount += 16 * test_multipart_large (1024);
+  errorCount += 256 * test_multipart_large (65536);
   if (errorCount != 0)
     fprintf (stderr, "Error (code: %u)\n", errorCount);
   return errorCount != 0;       /* 0 == pass */
@@ -0,0 +1,185 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_timerwheel.c
+ * @brief  Testcase for the timer wheel used for connection timeouts
+ * @author Christian Grothoff
+ */
+
+#include "platform.h"
+#include "microhttpd.h"
+#include "internal.h"
+#include "timerwheel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define NUM_CONNECTIONS 1000
+
+static struct MHD_Connection connections[NUM_CONNECTIONS];
+
+static uint64_t deadlines[NUM_CONNECTIONS];
+
+static int fired[NUM_CONNECTIONS];
+
+
+/**
+ * Advance the wheel from @a *last to @a now and check that exactly
+ * the connections with deadlines in (*last, now] come out.
+ */
+static int
+check_advance (struct MHD_TimerWheel *wheel,
+               uint64_t *last,
+               uint64_t now)
+{
+  struct MHD_Connection *pos;
+  unsigned int i;
+
+  while (NULL != (pos = MHD_timer_wheel_pop_expired (wheel, now)))
+    {
+      i = pos - connections;
+      if (fired[i])
+        {
+          fprintf (stderr, "connection %u fired twice\n", i);
+          return 1;
+        }
+      fired[i] = 1;
+      if ( (deadlines[i] > now) ||
+           (deadlines[i] <= *last) )
+        {
+          fprintf (stderr,
+                   "connection %u with deadline %llu fired at %llu (previous %llu)\n",
+                   i,
+                   (unsigned long long) deadlines[i],
+                   (unsigned long long) now,
+                   (unsigned long long) *last);
+          return 2;
+        }
+    }
+  for (i = 0; i < NUM_CONNECTIONS; i++)
+    if ( (! fired[i]) && (deadlines[i] <= now) )
+      {
+        fprintf (stderr, "connection %u did not fire\n", i);
+        return 4;
+      }
+  *last = now;
+  return 0;
+}
+
+
+static int
+testRandomDeadlines (uint64_t start)
+{
+  struct MHD_TimerWheel wheel;
+  uint64_t now;
+  uint64_t next;
+  unsigned int i;
+  int ret;
+
+  MHD_timer_wheel_init (&wheel, start);
+  memset (connections, 0, sizeof (connections));
+  memset (fired, 0, sizeof (fired));
+  for (i = 0; i < NUM_CONNECTIONS; i++)
+    {
+      /* mix of short, medium and long timeouts */
+      switch (i % 3)
+        {
+        case 0:
+          deadlines[i] = start + 1 + random () % 100;
+          break;
+        case 1:
+          deadlines[i] = start + 1 + random () % 10000;
+          break;
+        default:
+          deadlines[i] = start + 1 + random () % 10000000;
+          break;
+        }
+      MHD_timer_wheel_insert (&wheel, &connections[i], deadlines[i]);
+    }
+  now = start;
+  while (MHD_YES == MHD_timer_wheel_next (&wheel, &next))
+    {
+      if (next < now)
+        return 8;
+      /* sometimes jump exactly to the next event, sometimes further */
+      if (0 == random () % 2)
+        now = next;
+      else
+        now = next + random () % 5000;
+      if (0 != (ret = check_advance (&wheel, &start, now)))
+        return ret;
+    }
+  for (i = 0; i < NUM_CONNECTIONS; i++)
+    if (! fired[i])
+      return 16;
+  return 0;
+}
+
+
+static int
+testRemoveAndReschedule ()
+{
+  struct MHD_TimerWheel wheel;
+  uint64_t next;
+
+  MHD_timer_wheel_init (&wheel, 1000);
+  memset (connections, 0, sizeof (connections));
+  MHD_timer_wheel_insert (&wheel, &connections[0], 5000);
+  MHD_timer_wheel_insert (&wheel, &connections[1], 2000);
+  MHD_timer_wheel_remove (&wheel, &connections[1]);
+  MHD_timer_wheel_remove (&wheel, &connections[1]);
+  if (NULL != MHD_timer_wheel_pop_expired (&wheel, 4999))
+    return 32;
+  /* re-filing under a later deadline must delay expiration */
+  MHD_timer_wheel_remove (&wheel, &connections[0]);
+  MHD_timer_wheel_insert (&wheel, &connections[0], 6000);
+  if ( (MHD_YES != MHD_timer_wheel_next (&wheel, &next)) ||
+       (next > 6000) )
+    return 64;
+  if (NULL != MHD_timer_wheel_pop_expired (&wheel, 5999))
+    return 128;
+  if (&connections[0] != MHD_timer_wheel_pop_expired (&wheel, 6000))
+    return 256;
+  /* deadlines in the past are due right away */
+  MHD_timer_wheel_insert (&wheel, &connections[2], 10);
+  if (&connections[2] != MHD_timer_wheel_pop_expired (&wheel, 6000))
+    return 512;
+  if (MHD_NO != MHD_timer_wheel_next (&wheel, &next))
+    return 1024;
+  return 0;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+
+  srandom (42);
+  errorCount += testRandomDeadlines (0);
+  errorCount += testRandomDeadlines (1414141414141LL);
+  /* just before a carry across several levels */
+  errorCount += testRandomDeadlines ((((uint64_t) 1) << 36) - 3);
+  errorCount += testRemoveAndReschedule ();
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  return errorCount != 0;       /* 0 == pass */
+}
@@ -0,0 +1,255 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file timerwheel.c
+ * @brief hierarchical timer wheel for connection timeouts
+ * @author Christian Grothoff
+ *
+ * The wheel keeps the invariant that, relative to the current time
+ * of the wheel, level 0 only has entries in the current or later
+ * slots, and every other level only has entries in slots after the
+ * current one (within the current block of the next level).  Thus
+ * the first used slot of each level gives the next time at which
+ * that level needs attention.
+ */
+
+#include "timerwheel.h"
+
+/**
+ * Mask to extract the slot number from a shifted deadline.
+ */
+#define SLOT_MASK ((uint64_t) (MHD_TIMER_WHEEL_SLOTS - 1))
+
+/**
+ * Number of milliseconds covered by the whole wheel.
+ */
+#define WHEEL_SPAN (((uint64_t) 1) << (MHD_TIMER_WHEEL_BITS * MHD_TIMER_WHEEL_LEVELS))
+
+
+/**
+ * Find the index of the lowest bit set.
+ *
+ * @param bits bitmap, must not be zero
+ * @return index of the lowest bit set in @a bits
+ */
+static unsigned int
+lowest_bit (uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned int) __builtin_ctzll (bits);
+#else
+  unsigned int i;
+
+  for (i = 0; 0 == (bits & 1); i++)
+    bits >>= 1;
+  return i;
+#endif
+}
+
+
+/**
+ * Initialize an (empty) timer wheel.
+ *
+ * @param wheel wheel to initialize
+ * @param now current time in milliseconds
+ */
+void
+MHD_timer_wheel_init (struct MHD_TimerWheel *wheel,
+                      uint64_t now)
+{
+  memset (wheel, 0, sizeof (struct MHD_TimerWheel));
+  wheel->now = now;
+}
+
+
+/**
+ * Add a connection to the timer wheel.  The connection must
+ * not already be in the wheel.  Deadlines in the past are
+ * treated as due immediately.
+ *
+ * @param wheel wheel to add to
+ * @param connection connection to add
+ * @param deadline absolute deadline in milliseconds
+ */
+void
+MHD_timer_wheel_insert (struct MHD_TimerWheel *wheel,
+                        struct MHD_Connection *connection,
+                        uint64_t deadline)
+{
+  uint64_t diff;
+  unsigned int level;
+  unsigned int slot;
+
+  EXTRA_CHECK (0 == connection->timer_slot);
+  if (deadline < wheel->now)
+    deadline = wheel->now;
+  if ((deadline ^ wheel->now) >= WHEEL_SPAN)
+    {
+      /* beyond the range of the wheel, park it at the end; it
+         will be re-filed by the caller once this is reached */
+      deadline = wheel->now | (WHEEL_SPAN - 1);
+    }
+  level = 0;
+  for (diff = (deadline ^ wheel->now) >> MHD_TIMER_WHEEL_BITS;
+       0 != diff;
+       diff >>= MHD_TIMER_WHEEL_BITS)
+    level++;
+  slot = (unsigned int) ((deadline >> (MHD_TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+  connection->timer_deadline = deadline;
+  connection->timer_slot = level * MHD_TIMER_WHEEL_SLOTS + slot + 1;
+  XDLL_insert (wheel->head[level][slot],
+               wheel->tail[level][slot],
+               connection);
+  wheel->used[level] |= ((uint64_t) 1) << slot;
+  wheel->count++;
+}
+
+
+/**
+ * Remove a connection from the timer wheel.  Does nothing
+ * if the connection is not in the wheel.
+ *
+ * @param wheel wheel to remove from
+ * @param connection connection to remove
+ */
+void
+MHD_timer_wheel_remove (struct MHD_TimerWheel *wheel,
+                        struct MHD_Connection *connection)
+{
+  unsigned int level;
+  unsigned int slot;
+
+  if (0 == connection->timer_slot)
+    return;
+  level = (connection->timer_slot - 1) / MHD_TIMER_WHEEL_SLOTS;
+  slot = (connection->timer_slot - 1) % MHD_TIMER_WHEEL_SLOTS;
+  XDLL_remove (wheel->head[level][slot],
+               wheel->tail[level][slot],
+               connection);
+  if (NULL == wheel->head[level][slot])
+    wheel->used[level] &= ~(((uint64_t) 1) << slot);
+  connection->timer_slot = 0;
+  wheel->count--;
+}
+
+
+/**
+ * Obtain the earliest time at which the timer wheel may have
+ * work to do (a deadline is reached or a slot must be moved to
+ * a lower level).  This is never later than the earliest deadline
+ * in the wheel.
+ *
+ * @param wheel wheel to inspect
+ * @param when set to the time in milliseconds
+ * @return #MHD_YES on success, #MHD_NO if the wheel is empty
+ */
+int
+MHD_timer_wheel_next (const struct MHD_TimerWheel *wheel,
+                      uint64_t *when)
+{
+  unsigned int level;
+  unsigned int shift;
+  unsigned int cur;
+  uint64_t bits;
+  uint64_t block;
+  uint64_t t;
+  int found;
+
+  if (0 == wheel->count)
+    return MHD_NO;
+  found = MHD_NO;
+  for (level = 0; level < MHD_TIMER_WHEEL_LEVELS; level++)
+    {
+      if (0 == wheel->used[level])
+        continue;
+      shift = MHD_TIMER_WHEEL_BITS * level;
+      cur = (unsigned int) ((wheel->now >> shift) & SLOT_MASK);
+      /* level 0 may have entries in the current slot, all others
+         only in later slots */
+      if (0 == level)
+        bits = wheel->used[level] & ~((((uint64_t) 1) << cur) - 1);
+      else
+        bits = wheel->used[level] & ~((((uint64_t) 2) << cur) - 1);
+      if (0 == bits)
+        continue; /* cannot happen */
+      block = (wheel->now >> (shift + MHD_TIMER_WHEEL_BITS)) << (shift + MHD_TIMER_WHEEL_BITS);
+      t = block + (((uint64_t) lowest_bit (bits)) << shift);
+      if ( (MHD_NO == found) ||
+           (t < *when) )
+        *when = t;
+      found = MHD_YES;
+    }
+  return found;
+}
+
+
+/**
+ * Advance the timer wheel to @a now and remove one connection
+ * whose deadline was reached.  Call repeatedly until it returns
+ * NULL to process all expired connections.
+ *
+ * @param wheel wheel to advance
+ * @param now current time in milliseconds
+ * @return a connection with an expired deadline (already removed
+ *         from the wheel), NULL if there are none (left)
+ */
+struct MHD_Connection *
+MHD_timer_wheel_pop_expired (struct MHD_TimerWheel *wheel,
+                             uint64_t now)
+{
+  struct MHD_Connection *pos;
+  uint64_t next;
+  unsigned int level;
+  unsigned int slot;
+
+  while (1)
+    {
+      if ( (MHD_NO == MHD_timer_wheel_next (wheel, &next)) ||
+           (next > now) )
+        {
+          /* nothing is due before 'now', so we can safely jump there */
+          if (wheel->now < now)
+            wheel->now = now;
+          return NULL;
+        }
+      wheel->now = next;
+      /* move entries of higher levels whose slot starts now down */
+      for (level = MHD_TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+        {
+          if (0 != (next & ((((uint64_t) 1) << (MHD_TIMER_WHEEL_BITS * level)) - 1)))
+            continue;
+          slot = (unsigned int) ((next >> (MHD_TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+          while (NULL != (pos = wheel->head[level][slot]))
+            {
+              MHD_timer_wheel_remove (wheel, pos);
+              MHD_timer_wheel_insert (wheel, pos, pos->timer_deadline);
+            }
+        }
+      slot = (unsigned int) (next & SLOT_MASK);
+      pos = wheel->head[0][slot];
+      if (NULL != pos)
+        {
+          MHD_timer_wheel_remove (wheel, pos);
+          return pos;
+        }
+    }
+}
+
+/* end of timerwheel.c */
@@ -0,0 +1,100 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file timerwheel.h
+ * @brief hierarchical timer wheel for connection timeouts
+ * @author Christian Grothoff
+ */
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "internal.h"
+
+
+/**
+ * Initialize an (empty) timer wheel.
+ *
+ * @param wheel wheel to initialize
+ * @param now current time in milliseconds
+ */
+void
+MHD_timer_wheel_init (struct MHD_TimerWheel *wheel,
+                      uint64_t now);
+
+
+/**
+ * Add a connection to the timer wheel.  The connection must
+ * not already be in the wheel.  Deadlines in the past are
+ * treated as due immediately.
+ *
+ * @param wheel wheel to add to
+ * @param connection connection to add
+ * @param deadline absolute deadline in milliseconds
+ */
+void
+MHD_timer_wheel_insert (struct MHD_TimerWheel *wheel,
+                        struct MHD_Connection *connection,
+                        uint64_t deadline);
+
+
+/**
+ * Remove a connection from the timer wheel.  Does nothing
+ * if the connection is not in the wheel.
+ *
+ * @param wheel wheel to remove from
+ * @param connection connection to remove
+ */
+void
+MHD_timer_wheel_remove (struct MHD_TimerWheel *wheel,
+                        struct MHD_Connection *connection);
+
+
+/**
+ * Obtain the earliest time at which the timer wheel may have
+ * work to do (a deadline is reached or a slot must be moved to
+ * a lower level).  This is never later than the earliest deadline
+ * in the wheel.
+ *
+ * @param wheel wheel to inspect
+ * @param when set to the time in milliseconds
+ * @return #MHD_YES on success, #MHD_NO if the wheel is empty
+ */
+int
+MHD_timer_wheel_next (const struct MHD_TimerWheel *wheel,
+                      uint64_t *when);
+
+
+/**
+ * Advance the timer wheel to @a now and remove one connection
+ * whose deadline was reached.  Call repeatedly until it returns
+ * NULL to process all expired connections.
+ *
+ * @param wheel wheel to advance
+ * @param now current time in milliseconds
+ * @return a connection with an expired deadline (already removed
+ *         from the wheel), NULL if there are none (left)
+ */
+struct MHD_Connection *
+MHD_timer_wheel_pop_expired (struct MHD_TimerWheel *wheel,
+                             uint64_t now);
+
+
+#endif
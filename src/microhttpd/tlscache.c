@@ -0,0 +1,608 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file tlscache.c
+ * @brief TLS session resumption: session cache and session ticket keys
+ * @author Christian Grothoff
+ *
+ * The session cache is the GnuTLS session database (used for
+ * resumption by session ID).  It is split into #MHD_TLS_CACHE_SHARDS
+ * shards by the hash of the session ID, each with its own lock, hash
+ * table and LRU list, so that the threads of a thread pool rarely
+ * wait for each other.
+ *
+ * Session tickets are encrypted with a key that all threads share.
+ * The key is replaced once it is older than the configured lifetime;
+ * tickets encrypted with the previous key are then no longer accepted
+ * and the client does a full handshake.
+ */
+
+#include "tlscache.h"
+
+/**
+ * Number of shards of the session cache; must be a power of two.
+ */
+#define MHD_TLS_CACHE_SHARDS 16
+
+/**
+ * Largest session ID we store (TLS session IDs have at most
+ * 32 bytes).
+ */
+#define MHD_TLS_CACHE_MAX_KEY 32
+
+
+/**
+ * A session in the cache.
+ */
+struct CacheEntry
+{
+  /**
+   * Next (less recently used) entry in the LRU list.
+   */
+  struct CacheEntry *next;
+
+  /**
+   * Previous (more recently used) entry in the LRU list.
+   */
+  struct CacheEntry *prev;
+
+  /**
+   * Next entry in the same hash bucket.
+   */
+  struct CacheEntry *hnext;
+
+  /**
+   * Session data from GnuTLS.
+   */
+  unsigned char *data;
+
+  /**
+   * Number of bytes in @e data.
+   */
+  size_t data_size;
+
+  /**
+   * Hash of @e key.
+   */
+  uint32_t hash;
+
+  /**
+   * Number of bytes in @e key.
+   */
+  unsigned int key_size;
+
+  /**
+   * Session ID.
+   */
+  unsigned char key[MHD_TLS_CACHE_MAX_KEY];
+};
+
+
+/**
+ * One shard of the session cache.
+ */
+struct CacheShard
+{
+  /**
+   * Protects the shard.
+   */
+  MHD_mutex_ lock;
+
+  /**
+   * Hash table, @e mask + 1 buckets.
+   */
+  struct CacheEntry **table;
+
+  /**
+   * Most recently used entry.
+   */
+  struct CacheEntry *head;
+
+  /**
+   * Least recently used entry.
+   */
+  struct CacheEntry *tail;
+
+  /**
+   * Number of buckets of @e table minus one.
+   */
+  unsigned int mask;
+
+  /**
+   * Number of entries in the shard.
+   */
+  unsigned int count;
+
+  /**
+   * Maximum number of entries in the shard.
+   */
+  unsigned int max;
+
+  /**
+   * Keep the locks of different shards on different cache lines.
+   */
+  char pad[MHD_CACHE_LINE_SIZE];
+};
+
+
+/**
+ * Cache of TLS sessions.
+ */
+struct MHD_TLS_SessionCache
+{
+  /**
+   * The shards.
+   */
+  struct CacheShard shards[MHD_TLS_CACHE_SHARDS];
+};
+
+
+/**
+ * Keys for session tickets.
+ */
+struct MHD_TLS_TicketKeys
+{
+  /**
+   * Protects the keys.
+   */
+  MHD_mutex_ lock;
+
+  /**
+   * Current and previous key.  The previous key is kept until
+   * it is replaced in turn, as sessions that were set up with it
+   * may still be in their handshake.
+   */
+  gnutls_datum_t key[2];
+
+  /**
+   * Index of the current key in @e key.
+   */
+  unsigned int current;
+
+  /**
+   * When the current key was created (#MHD_monotonic_time_ms()).
+   */
+  uint64_t created;
+
+  /**
+   * Lifetime of a key (and of the tickets) in seconds.
+   */
+  unsigned int lifetime;
+};
+
+
+/**
+ * Hash a session ID (FNV-1a).
+ *
+ * @param key session ID
+ * @return hash value
+ */
+static uint32_t
+hash_key (const gnutls_datum_t *key)
+{
+  uint32_t hash = 2166136261U;
+  unsigned int i;
+
+  for (i = 0; i < key->size; i++)
+    hash = (hash ^ key->data[i]) * 16777619U;
+  return hash;
+}
+
+
+/**
+ * Find the shard for a key and lock it.
+ *
+ * @param cache the cache
+ * @param hash hash of the key
+ * @return the locked shard
+ */
+static struct CacheShard *
+lock_shard (struct MHD_TLS_SessionCache *cache,
+            uint32_t hash)
+{
+  struct CacheShard *shard;
+
+  shard = &cache->shards[hash & (MHD_TLS_CACHE_SHARDS - 1)];
+  if (MHD_YES != MHD_mutex_lock_ (&shard->lock))
+    MHD_PANIC ("Failed to acquire TLS session cache mutex\n");
+  return shard;
+}
+
+
+/**
+ * Release the lock of a shard.
+ *
+ * @param shard shard to unlock
+ */
+static void
+unlock_shard (struct CacheShard *shard)
+{
+  if (MHD_YES != MHD_mutex_unlock_ (&shard->lock))
+    MHD_PANIC ("Failed to release TLS session cache mutex\n");
+}
+
+
+/**
+ * Find an entry (with the shard locked).
+ *
+ * @param shard shard to search
+ * @param key session ID
+ * @param hash hash of @a key
+ * @return NULL if not found
+ */
+static struct CacheEntry *
+find_entry (struct CacheShard *shard,
+            const gnutls_datum_t *key,
+            uint32_t hash)
+{
+  struct CacheEntry *entry;
+
+  for (entry = shard->table[(hash >> 4) & shard->mask];
+       NULL != entry;
+       entry = entry->hnext)
+    if ( (hash == entry->hash) &&
+         (key->size == entry->key_size) &&
+         (0 == memcmp (key->data, entry->key, key->size)) )
+      return entry;
+  return NULL;
+}
+
+
+/**
+ * Remove an entry from the shard and free it (with the shard
+ * locked).
+ *
+ * @param shard shard with the entry
+ * @param entry entry to remove
+ */
+static void
+remove_entry (struct CacheShard *shard,
+              struct CacheEntry *entry)
+{
+  struct CacheEntry **pos;
+
+  for (pos = &shard->table[(entry->hash >> 4) & shard->mask];
+       *pos != entry;
+       pos = &(*pos)->hnext)
+    ;
+  *pos = entry->hnext;
+  DLL_remove (shard->head, shard->tail, entry);
+  shard->count--;
+  free (entry->data);
+  free (entry);
+}
+
+
+/**
+ * Store a session, called by GnuTLS after a full handshake.
+ *
+ * @param cls our `struct MHD_TLS_SessionCache`
+ * @param key session ID
+ * @param data session data
+ * @return 0 on success, -1 on error
+ */
+static int
+cache_store (void *cls,
+             gnutls_datum_t key,
+             gnutls_datum_t data)
+{
+  struct MHD_TLS_SessionCache *cache = cls;
+  struct CacheShard *shard;
+  struct CacheEntry *entry;
+  unsigned char *copy;
+  uint32_t hash;
+
+  if ( (key.size > MHD_TLS_CACHE_MAX_KEY) ||
+       (NULL == (copy = malloc (data.size))) )
+    return -1;
+  memcpy (copy, data.data, data.size);
+  hash = hash_key (&key);
+  shard = lock_shard (cache, hash);
+  entry = find_entry (shard, &key, hash);
+  if (NULL != entry)
+    {
+      free (entry->data);
+      DLL_remove (shard->head, shard->tail, entry);
+    }
+  else
+    {
+      if (NULL == (entry = malloc (sizeof (struct CacheEntry))))
+        {
+          unlock_shard (shard);
+          free (copy);
+          return -1;
+        }
+      entry->hash = hash;
+      entry->key_size = key.size;
+      memcpy (entry->key, key.data, key.size);
+      entry->hnext = shard->table[(hash >> 4) & shard->mask];
+      shard->table[(hash >> 4) & shard->mask] = entry;
+      shard->count++;
+    }
+  entry->data = copy;
+  entry->data_size = data.size;
+  DLL_insert (shard->head, shard->tail, entry);
+  if (shard->count > shard->max)
+    remove_entry (shard, shard->tail);
+  unlock_shard (shard);
+  return 0;
+}
+
+
+/**
+ * Look up a session, called by GnuTLS if a client asks to resume
+ * a session.
+ *
+ * @param cls our `struct MHD_TLS_SessionCache`
+ * @param key session ID
+ * @return copy of the session data (allocated with gnutls_malloc()),
+ *         NULL data if not found
+ */
+static gnutls_datum_t
+cache_retrieve (void *cls,
+                gnutls_datum_t key)
+{
+  struct MHD_TLS_SessionCache *cache = cls;
+  struct CacheShard *shard;
+  struct CacheEntry *entry;
+  gnutls_datum_t res;
+  uint32_t hash;
+
+  res.data = NULL;
+  res.size = 0;
+  if (key.size > MHD_TLS_CACHE_MAX_KEY)
+    return res;
+  hash = hash_key (&key);
+  shard = lock_shard (cache, hash);
+  entry = find_entry (shard, &key, hash);
+  if ( (NULL != entry) &&
+       (NULL != (res.data = gnutls_malloc (entry->data_size))) )
+    {
+      memcpy (res.data, entry->data, entry->data_size);
+      res.size = entry->data_size;
+      DLL_remove (shard->head, shard->tail, entry);
+      DLL_insert (shard->head, shard->tail, entry);
+    }
+  unlock_shard (shard);
+  return res;
+}
+
+
+/**
+ * Remove a session, called by GnuTLS for sessions that must no
+ * longer be resumed.
+ *
+ * @param cls our `struct MHD_TLS_SessionCache`
+ * @param key session ID
+ * @return 0 on success, -1 if not found
+ */
+static int
+cache_remove (void *cls,
+              gnutls_datum_t key)
+{
+  struct MHD_TLS_SessionCache *cache = cls;
+  struct CacheShard *shard;
+  struct CacheEntry *entry;
+  uint32_t hash;
+
+  if (key.size > MHD_TLS_CACHE_MAX_KEY)
+    return -1;
+  hash = hash_key (&key);
+  shard = lock_shard (cache, hash);
+  entry = find_entry (shard, &key, hash);
+  if (NULL != entry)
+    remove_entry (shard, entry);
+  unlock_shard (shard);
+  return (NULL != entry) ? 0 : -1;
+}
+
+
+/**
+ * Create a session cache.
+ *
+ * @param size maximum number of sessions to keep
+ * @return NULL on error (out of memory)
+ */
+struct MHD_TLS_SessionCache *
+MHD_tls_session_cache_create_ (unsigned int size)
+{
+  struct MHD_TLS_SessionCache *cache;
+  struct CacheShard *shard;
+  unsigned int buckets;
+  unsigned int i;
+
+  if (NULL == (cache = calloc (1, sizeof (struct MHD_TLS_SessionCache))))
+    return NULL;
+  for (i = 0; i < MHD_TLS_CACHE_SHARDS; i++)
+    {
+      shard = &cache->shards[i];
+      shard->max = (size + MHD_TLS_CACHE_SHARDS - 1) / MHD_TLS_CACHE_SHARDS;
+      buckets = 1;
+      while ( (buckets < shard->max) &&
+              (buckets < (1U << 20)) )
+        buckets *= 2;
+      shard->mask = buckets - 1;
+      if ( (NULL == (shard->table = calloc (buckets,
+                                            sizeof (struct CacheEntry *)))) ||
+           (MHD_YES != MHD_mutex_create_ (&shard->lock)) )
+        {
+          free (shard->table);
+          while (i-- > 0)
+            {
+              (void) MHD_mutex_destroy_ (&cache->shards[i].lock);
+              free (cache->shards[i].table);
+            }
+          free (cache);
+          return NULL;
+        }
+    }
+  return cache;
+}
+
+
+/**
+ * Make @a session store and look up sessions in @a cache.
+ *
+ * @param cache cache to use
+ * @param session new server session
+ */
+void
+MHD_tls_session_cache_setup_ (struct MHD_TLS_SessionCache *cache,
+                              gnutls_session_t session)
+{
+  gnutls_db_set_ptr (session, cache);
+  gnutls_db_set_store_function (session, &cache_store);
+  gnutls_db_set_retrieve_function (session, &cache_retrieve);
+  gnutls_db_set_remove_function (session, &cache_remove);
+}
+
+
+/**
+ * Destroy a session cache.
+ *
+ * @param cache cache to destroy, may be NULL
+ */
+void
+MHD_tls_session_cache_destroy_ (struct MHD_TLS_SessionCache *cache)
+{
+  struct CacheShard *shard;
+  unsigned int i;
+
+  if (NULL == cache)
+    return;
+  for (i = 0; i < MHD_TLS_CACHE_SHARDS; i++)
+    {
+      shard = &cache->shards[i];
+      while (NULL != shard->head)
+        remove_entry (shard, shard->head);
+      (void) MHD_mutex_destroy_ (&shard->lock);
+      free (shard->table);
+    }
+  free (cache);
+}
+
+
+/**
+ * Free a ticket key.
+ *
+ * @param key key to free
+ */
+static void
+free_key (gnutls_datum_t *key)
+{
+  if (NULL == key->data)
+    return;
+  memset (key->data, 0, key->size);
+  gnutls_free (key->data);
+  key->data = NULL;
+  key->size = 0;
+}
+
+
+/**
+ * Create the session ticket keys (and the first key).
+ *
+ * @param lifetime seconds after which the key is replaced,
+ *        also the lifetime of the tickets
+ * @return NULL on error
+ */
+struct MHD_TLS_TicketKeys *
+MHD_tls_ticket_keys_create_ (unsigned int lifetime)
+{
+  struct MHD_TLS_TicketKeys *keys;
+
+  if (NULL == (keys = calloc (1, sizeof (struct MHD_TLS_TicketKeys))))
+    return NULL;
+  if (GNUTLS_E_SUCCESS != gnutls_session_ticket_key_generate (&keys->key[0]))
+    {
+      free (keys);
+      return NULL;
+    }
+  if (MHD_YES != MHD_mutex_create_ (&keys->lock))
+    {
+      free_key (&keys->key[0]);
+      free (keys);
+      return NULL;
+    }
+  keys->lifetime = lifetime;
+  keys->created = MHD_monotonic_time_ms ();
+  return keys;
+}
+
+
+/**
+ * Enable session tickets on @a session with the current key,
+ * replacing the key first if it is too old.
+ *
+ * @param keys keys to use
+ * @param session new server session
+ * @return #MHD_YES on success
+ */
+int
+MHD_tls_ticket_keys_setup_ (struct MHD_TLS_TicketKeys *keys,
+                            gnutls_session_t session)
+{
+  uint64_t now;
+  unsigned int next;
+  int ret;
+
+  now = MHD_monotonic_time_ms ();
+  if (MHD_YES != MHD_mutex_lock_ (&keys->lock))
+    MHD_PANIC ("Failed to acquire TLS ticket key mutex\n");
+  if (now - keys->created >= 1000 * (uint64_t) keys->lifetime)
+    {
+      next = 1 - keys->current;
+      free_key (&keys->key[next]);
+      if (GNUTLS_E_SUCCESS ==
+          gnutls_session_ticket_key_generate (&keys->key[next]))
+        {
+          keys->current = next;
+          keys->created = now;
+        }
+      /* else: keep using the current key, try again next time */
+    }
+  ret = gnutls_session_ticket_enable_server (session,
+                                             &keys->key[keys->current]);
+  if (MHD_YES != MHD_mutex_unlock_ (&keys->lock))
+    MHD_PANIC ("Failed to release TLS ticket key mutex\n");
+  if (GNUTLS_E_SUCCESS != ret)
+    return MHD_NO;
+  gnutls_db_set_cache_expiration (session, (int) keys->lifetime);
+  return MHD_YES;
+}
+
+
+/**
+ * Destroy the session ticket keys.
+ *
+ * @param keys keys to destroy, may be NULL
+ */
+void
+MHD_tls_ticket_keys_destroy_ (struct MHD_TLS_TicketKeys *keys)
+{
+  if (NULL == keys)
+    return;
+  free_key (&keys->key[0]);
+  free_key (&keys->key[1]);
+  (void) MHD_mutex_destroy_ (&keys->lock);
+  free (keys);
+}
+
+/* end of tlscache.c */
@@ -0,0 +1,109 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file tlscache.h
+ * @brief TLS session resumption: session cache and session ticket keys
+ * @author Christian Grothoff
+ */
+
+#ifndef TLSCACHE_H
+#define TLSCACHE_H
+
+#include "internal.h"
+
+
+/**
+ * Cache of TLS sessions for resumption by session ID, shared by
+ * all threads of a daemon.
+ */
+struct MHD_TLS_SessionCache;
+
+
+/**
+ * Keys for encrypting TLS session tickets, shared by all threads
+ * of a daemon and replaced periodically.
+ */
+struct MHD_TLS_TicketKeys;
+
+
+/**
+ * Create a session cache.
+ *
+ * @param size maximum number of sessions to keep
+ * @return NULL on error (out of memory)
+ */
+struct MHD_TLS_SessionCache *
+MHD_tls_session_cache_create_ (unsigned int size);
+
+
+/**
+ * Make @a session store and look up sessions in @a cache.
+ *
+ * @param cache cache to use
+ * @param session new server session
+ */
+void
+MHD_tls_session_cache_setup_ (struct MHD_TLS_SessionCache *cache,
+                              gnutls_session_t session);
+
+
+/**
+ * Destroy a session cache.
+ *
+ * @param cache cache to destroy, may be NULL
+ */
+void
+MHD_tls_session_cache_destroy_ (struct MHD_TLS_SessionCache *cache);
+
+
+/**
+ * Create the session ticket keys (and the first key).
+ *
+ * @param lifetime seconds after which the key is replaced,
+ *        also the lifetime of the tickets
+ * @return NULL on error
+ */
+struct MHD_TLS_TicketKeys *
+MHD_tls_ticket_keys_create_ (unsigned int lifetime);
+
+
+/**
+ * Enable session tickets on @a session with the current key,
+ * replacing the key first if it is too old.
+ *
+ * @param keys keys to use
+ * @param session new server session
+ * @return #MHD_YES on success
+ */
+int
+MHD_tls_ticket_keys_setup_ (struct MHD_TLS_TicketKeys *keys,
+                            gnutls_session_t session);
+
+
+/**
+ * Destroy the session ticket keys.
+ *
+ * @param keys keys to destroy, may be NULL
+ */
+void
+MHD_tls_ticket_keys_destroy_ (struct MHD_TLS_TicketKeys *keys);
+
+
+#endif
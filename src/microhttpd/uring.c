@@ -0,0 +1,965 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file uring.c
+ * @brief io_uring based event loop support (Linux only)
+ * @author Christian Grothoff
+ *
+ * We talk to the kernel with the raw system calls (no liburing).
+ * Received data is placed by the kernel into buffers from a ring
+ * that we provide (so that no memory needs to be committed to
+ * connections waiting for data); the connection's receive callback
+ * then copies it from there into its read buffer.  Sending is still
+ * done directly from the connection's buffers (the state machine
+ * reuses them right away), only waiting for the socket to become
+ * writable goes through the ring.
+ */
+
+#include "uring.h"
+#include "connection.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+
+/**
+ * Number of entries in the submission queue.
+ */
+#define MHD_URING_ENTRIES 256
+
+/**
+ * Number of receive buffers (must be a power of two).
+ */
+#define MHD_URING_BUFFERS 512
+
+/**
+ * Size of each receive buffer.
+ */
+#define MHD_URING_BUFFER_SIZE 2048
+
+/**
+ * Buffer group ID of our receive buffers.
+ */
+#define MHD_URING_BGID 0
+
+/**
+ * Maximum number of buffers with unconsumed data per connection;
+ * receiving is paused when a connection has that many (so that a
+ * single connection cannot take all buffers).
+ */
+#define MHD_URING_QUEUE_MAX 8
+
+
+/**
+ * Call io_uring_setup(2).
+ */
+static int
+sys_setup (unsigned int entries,
+           struct io_uring_params *p)
+{
+  return (int) syscall (__NR_io_uring_setup, entries, p);
+}
+
+
+/**
+ * Call io_uring_enter(2).
+ */
+static int
+sys_enter (int fd,
+           unsigned int to_submit,
+           unsigned int min_complete,
+           unsigned int flags,
+           const void *arg,
+           size_t argsz)
+{
+  return (int) syscall (__NR_io_uring_enter, fd, to_submit,
+                        min_complete, flags, arg, argsz);
+}
+
+
+/**
+ * Call io_uring_register(2).
+ */
+static int
+sys_register (int fd,
+              unsigned int opcode,
+              const void *arg,
+              unsigned int nr_args)
+{
+  return (int) syscall (__NR_io_uring_register, fd, opcode,
+                        arg, nr_args);
+}
+
+
+/**
+ * Check that the kernel supports all operations we use.
+ *
+ * @param fd ring to check
+ * @return #MHD_YES if all are supported
+ */
+static int
+check_ops (int fd)
+{
+  static const unsigned char ops[] =
+    {
+      IORING_OP_ACCEPT,
+      IORING_OP_RECV,
+      IORING_OP_POLL_ADD,
+      IORING_OP_ASYNC_CANCEL
+    };
+  struct io_uring_probe *probe;
+  size_t size;
+  unsigned int i;
+  int ret;
+
+  size = sizeof (struct io_uring_probe) + 256 * sizeof (struct io_uring_probe_op);
+  if (NULL == (probe = malloc (size)))
+    return MHD_NO;
+  memset (probe, 0, size);
+  ret = MHD_NO;
+  if (0 == sys_register (fd, IORING_REGISTER_PROBE, probe, 256))
+    {
+      ret = MHD_YES;
+      for (i = 0; i < sizeof (ops) / sizeof (ops[0]); i++)
+        if ( (ops[i] > probe->last_op) ||
+             (0 == (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) )
+          ret = MHD_NO;
+    }
+  free (probe);
+  return ret;
+}
+
+
+/**
+ * Give a receive buffer (back) to the kernel.
+ *
+ * @param ring ring to use
+ * @param bid ID of the buffer
+ */
+static void
+recycle_buffer (struct MHD_Uring *ring,
+                unsigned int bid)
+{
+  struct io_uring_buf *buf;
+
+  buf = &ring->buf_ring->bufs[ring->buf_ring_tail & (MHD_URING_BUFFERS - 1)];
+  buf->addr = (uint64_t) (uintptr_t) &ring->buffers[bid * MHD_URING_BUFFER_SIZE];
+  buf->len = MHD_URING_BUFFER_SIZE;
+  buf->bid = (uint16_t) bid;
+  ring->buf_ring_tail++;
+  __atomic_store_n (&ring->buf_ring->tail,
+                    ring->buf_ring_tail,
+                    __ATOMIC_RELEASE);
+  ring->buffers_out--;
+}
+
+
+/**
+ * Check whether the running kernel supports everything we need.
+ *
+ * @return #MHD_YES if io_uring can be used
+ */
+int
+MHD_uring_probe_ (void)
+{
+  struct MHD_Uring *ring;
+
+  if (NULL == (ring = MHD_uring_create_ ()))
+    return MHD_NO;
+  MHD_uring_destroy_ (ring);
+  return MHD_YES;
+}
+
+
+/**
+ * Create an io_uring instance with its receive buffers.
+ *
+ * @return NULL on error (i.e. missing kernel support)
+ */
+struct MHD_Uring *
+MHD_uring_create_ (void)
+{
+  struct MHD_Uring *ring;
+  struct io_uring_params p;
+  struct io_uring_buf_reg reg;
+  size_t sq_size;
+  size_t cq_size;
+  unsigned int i;
+
+  if (NULL == (ring = malloc (sizeof (struct MHD_Uring))))
+    return NULL;
+  memset (ring, 0, sizeof (struct MHD_Uring));
+  ring->rings = MAP_FAILED;
+  ring->sqes = MAP_FAILED;
+  ring->buf_ring = MAP_FAILED;
+  ring->accept_fd = MHD_INVALID_SOCKET;
+  memset (&p, 0, sizeof (p));
+  p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+  p.cq_entries = 4 * MHD_URING_ENTRIES;
+  ring->fd = sys_setup (MHD_URING_ENTRIES, &p);
+  if ( (-1 == ring->fd) &&
+       (EINVAL == errno) )
+    {
+      /* older kernel, try without the optional flags */
+      memset (&p, 0, sizeof (p));
+      p.flags = IORING_SETUP_CQSIZE;
+      p.cq_entries = 4 * MHD_URING_ENTRIES;
+      ring->fd = sys_setup (MHD_URING_ENTRIES, &p);
+    }
+  if (-1 == ring->fd)
+    goto fail;
+  /* we rely on completions never being dropped and on waiting with
+     a timeout; both came before provided buffer rings, which we
+     check for below */
+  if ( (0 == (p.features & IORING_FEAT_SINGLE_MMAP)) ||
+       (0 == (p.features & IORING_FEAT_NODROP)) ||
+       (0 == (p.features & IORING_FEAT_EXT_ARG)) ||
+       (MHD_YES != check_ops (ring->fd)) )
+    goto fail;
+
+  sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+  cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  ring->rings_size = (sq_size > cq_size) ? sq_size : cq_size;
+  ring->rings = mmap (NULL, ring->rings_size,
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQ_RING);
+  if (MAP_FAILED == ring->rings)
+    goto fail;
+  ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+  ring->sqes = mmap (NULL, ring->sqes_size,
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring->fd, IORING_OFF_SQES);
+  if (MAP_FAILED == ring->sqes)
+    goto fail;
+  ring->sq_head = (unsigned int *) ((char *) ring->rings + p.sq_off.head);
+  ring->sq_tail = (unsigned int *) ((char *) ring->rings + p.sq_off.tail);
+  ring->sq_array = (unsigned int *) ((char *) ring->rings + p.sq_off.array);
+  ring->sq_mask = *(unsigned int *) ((char *) ring->rings + p.sq_off.ring_mask);
+  ring->sq_entries = p.sq_entries;
+  ring->sq_local_tail = *ring->sq_tail;
+  ring->cq_head = (unsigned int *) ((char *) ring->rings + p.cq_off.head);
+  ring->cq_tail = (unsigned int *) ((char *) ring->rings + p.cq_off.tail);
+  ring->cq_mask = *(unsigned int *) ((char *) ring->rings + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *) ((char *) ring->rings + p.cq_off.cqes);
+
+  /* receive buffers */
+  ring->buf_ring_size = MHD_URING_BUFFERS * sizeof (struct io_uring_buf);
+  ring->buf_ring = mmap (NULL, ring->buf_ring_size,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                         -1, 0);
+  if (MAP_FAILED == ring->buf_ring)
+    goto fail;
+  ring->buffers = malloc (MHD_URING_BUFFERS * MHD_URING_BUFFER_SIZE);
+  ring->buffer_next = malloc (MHD_URING_BUFFERS * sizeof (unsigned int));
+  ring->buffer_len = malloc (MHD_URING_BUFFERS * sizeof (unsigned int));
+  if ( (NULL == ring->buffers) ||
+       (NULL == ring->buffer_next) ||
+       (NULL == ring->buffer_len) )
+    goto fail;
+  memset (&reg, 0, sizeof (reg));
+  reg.ring_addr = (uint64_t) (uintptr_t) ring->buf_ring;
+  reg.ring_entries = MHD_URING_BUFFERS;
+  reg.bgid = MHD_URING_BGID;
+  if (0 != sys_register (ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1))
+    goto fail;
+  ring->buf_ring_tail = 0;
+  ring->buffers_out = MHD_URING_BUFFERS;
+  for (i = 0; i < MHD_URING_BUFFERS; i++)
+    recycle_buffer (ring, i);
+  return ring;
+
+ fail:
+  MHD_uring_destroy_ (ring);
+  return NULL;
+}
+
+
+/**
+ * Destroy an io_uring instance.  All operations must have completed.
+ *
+ * @param ring ring to destroy
+ */
+void
+MHD_uring_destroy_ (struct MHD_Uring *ring)
+{
+  if (-1 != ring->fd)
+    (void) close (ring->fd);
+  if (MAP_FAILED != ring->rings)
+    (void) munmap (ring->rings, ring->rings_size);
+  if (MAP_FAILED != ring->sqes)
+    (void) munmap (ring->sqes, ring->sqes_size);
+  if (MAP_FAILED != ring->buf_ring)
+    (void) munmap (ring->buf_ring, ring->buf_ring_size);
+  free (ring->buffers);
+  free (ring->buffer_next);
+  free (ring->buffer_len);
+  free (ring);
+}
+
+
+/**
+ * Get an (empty) submission queue entry, submitting the queued
+ * ones first if the queue is full.
+ *
+ * @param ring ring to use
+ * @return NULL on error
+ */
+static struct io_uring_sqe *
+get_sqe (struct MHD_Uring *ring)
+{
+  struct io_uring_sqe *sqe;
+  unsigned int head;
+  unsigned int idx;
+
+  head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+  if (ring->sq_local_tail - head >= ring->sq_entries)
+    {
+      __atomic_store_n (ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+      if (0 > sys_enter (ring->fd, ring->sq_local_tail - head, 0, 0, NULL, 0))
+        return NULL;
+      head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+      if (ring->sq_local_tail - head >= ring->sq_entries)
+        return NULL;
+    }
+  idx = ring->sq_local_tail & ring->sq_mask;
+  sqe = &ring->sqes[idx];
+  memset (sqe, 0, sizeof (struct io_uring_sqe));
+  ring->sq_array[idx] = idx;
+  ring->sq_local_tail++;
+  return sqe;
+}
+
+
+/**
+ * Queue an accept operation.
+ *
+ * @param ring ring to use
+ * @param fd listen socket
+ * @param slot index of the slot in `accepts` to use
+ * @return #MHD_YES on success, #MHD_NO if the queue is full
+ */
+int
+MHD_uring_prep_accept_ (struct MHD_Uring *ring,
+                        MHD_socket fd,
+                        unsigned int slot)
+{
+  struct MHD_UringAccept *acc = &ring->accepts[slot];
+  struct io_uring_sqe *sqe;
+
+  if (NULL == (sqe = get_sqe (ring)))
+    return MHD_NO;
+  acc->addrlen = sizeof (acc->addr);
+  memset (&acc->addr, 0, sizeof (acc->addr));
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t) (uintptr_t) &acc->addr;
+  sqe->addr2 = (uint64_t) (uintptr_t) &acc->addrlen;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = MHD_URING_ACCEPT_DATA (slot);
+  acc->armed = MHD_YES;
+  return MHD_YES;
+}
+
+
+/**
+ * Queue a poll operation.
+ *
+ * @param ring ring to use
+ * @param fd file descriptor to poll
+ * @param events poll events to wait for
+ * @param multishot #MHD_YES to keep polling after an event
+ * @param user_data tagged pointer for the completion
+ * @return #MHD_YES on success, #MHD_NO if the queue is full
+ */
+int
+MHD_uring_prep_poll_ (struct MHD_Uring *ring,
+                      int fd,
+                      unsigned int events,
+                      int multishot,
+                      uint64_t user_data)
+{
+  struct io_uring_sqe *sqe;
+
+  if (NULL == (sqe = get_sqe (ring)))
+    return MHD_NO;
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events;
+  if (MHD_YES == multishot)
+    sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = user_data;
+  return MHD_YES;
+}
+
+
+/**
+ * Queue the cancellation of the operation with the given user data.
+ *
+ * @param ring ring to use
+ * @param user_data user data of the operation to cancel
+ * @return #MHD_YES on success, #MHD_NO if the queue is full
+ */
+int
+MHD_uring_prep_cancel_ (struct MHD_Uring *ring,
+                        uint64_t user_data)
+{
+  struct io_uring_sqe *sqe;
+
+  if (NULL == (sqe = get_sqe (ring)))
+    return MHD_NO;
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = user_data;
+  sqe->user_data = MHD_URING_USER_DATA (NULL, MHD_URING_TAG_CANCEL);
+  return MHD_YES;
+}
+
+
+/**
+ * Queue the cancellation of all operations on a file descriptor.
+ *
+ * @param ring ring to use
+ * @param fd file descriptor
+ * @return #MHD_YES on success, #MHD_NO if the queue is full
+ */
+int
+MHD_uring_prep_cancel_fd_ (struct MHD_Uring *ring,
+                           int fd)
+{
+  struct io_uring_sqe *sqe;
+
+  if (NULL == (sqe = get_sqe (ring)))
+    return MHD_NO;
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = fd;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  sqe->user_data = MHD_URING_USER_DATA (NULL, MHD_URING_TAG_CANCEL);
+  return MHD_YES;
+}
+
+
+/**
+ * Queue a receive on a connection, into a buffer picked by the
+ * kernel.
+ *
+ * @param ring ring to use
+ * @param connection connection to receive on
+ * @return #MHD_YES on success, #MHD_NO if the queue is full
+ */
+static int
+prep_recv (struct MHD_Uring *ring,
+           struct MHD_Connection *connection)
+{
+  struct io_uring_sqe *sqe;
+
+  if (NULL == (sqe = get_sqe (ring)))
+    return MHD_NO;
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = connection->socket_fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = MHD_URING_BGID;
+  if (MHD_NO == ring->no_multishot_recv)
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->user_data = MHD_URING_USER_DATA (connection, MHD_URING_TAG_RECV);
+  return MHD_YES;
+}
+
+
+/**
+ * Submit the queued operations and wait for completions.
+ *
+ * @param ring ring to use
+ * @param timeout_ms how long to wait at most, 0 to not wait,
+ *        -1 to wait until something completes
+ * @return #MHD_YES on success, #MHD_NO on error
+ */
+int
+MHD_uring_wait_ (struct MHD_Uring *ring,
+                 int timeout_ms)
+{
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  unsigned int to_submit;
+  unsigned int min_complete;
+  unsigned int flags;
+
+  to_submit = ring->sq_local_tail - __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+  __atomic_store_n (ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+  min_complete = 0;
+  flags = 0;
+  memset (&arg, 0, sizeof (arg));
+  if ( (0 != timeout_ms) &&
+       (*ring->cq_head == __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE)) )
+    {
+      min_complete = 1;
+      flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+      if (timeout_ms > 0)
+        {
+          ts.tv_sec = timeout_ms / 1000;
+          ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+          arg.ts = (uint64_t) (uintptr_t) &ts;
+        }
+    }
+  if ( (0 == to_submit) &&
+       (0 == min_complete) )
+    return MHD_YES; /* nothing to do, save the system call */
+  if (0 > sys_enter (ring->fd,
+                     to_submit,
+                     min_complete,
+                     flags,
+                     (0 != flags) ? &arg : NULL,
+                     (0 != flags) ? sizeof (arg) : 0))
+    {
+      if ( (EINTR == errno) ||
+           (ETIME == errno) ||
+           (EAGAIN == errno) ||
+           (EBUSY == errno) )
+        return MHD_YES;
+      return MHD_NO;
+    }
+  return MHD_YES;
+}
+
+
+/**
+ * Take the next completion from the ring.
+ *
+ * @param ring ring to use
+ * @param cqe where to copy the completion
+ * @return #MHD_YES on success, #MHD_NO if there is none
+ */
+int
+MHD_uring_next_cqe_ (struct MHD_Uring *ring,
+                     struct io_uring_cqe *cqe)
+{
+  unsigned int head;
+
+  head = *ring->cq_head;
+  if (head == __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE))
+    return MHD_NO;
+  *cqe = ring->cqes[head & ring->cq_mask];
+  __atomic_store_n (ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  return MHD_YES;
+}
+
+
+/**
+ * Put a connection on the list of connections waiting for
+ * receive buffers.
+ *
+ * @param ring ring to use
+ * @param connection connection to add
+ */
+static void
+starve (struct MHD_Uring *ring,
+        struct MHD_Connection *connection)
+{
+  if (0 != (connection->uring_state & MHD_URING_STATE_STARVED))
+    return;
+  connection->uring_state |= MHD_URING_STATE_STARVED;
+  connection->nextU = ring->starved_head;
+  ring->starved_head = connection;
+}
+
+
+/**
+ * Queue the operations a connection needs: receiving (unless we
+ * have enough data buffered for it already) and waiting for the
+ * socket to become writable if the connection wants to write.
+ *
+ * @param connection connection to update
+ * @return #MHD_YES on success, #MHD_NO if the connection
+ *         cannot be served anymore
+ */
+int
+MHD_uring_connection_update_ (struct MHD_Connection *connection)
+{
+  struct MHD_Uring *ring = connection->daemon->uring;
+  unsigned int state = connection->uring_state;
+
+  if ( (MHD_CONNECTION_CLOSED == connection->state) ||
+       (0 != (state & MHD_URING_STATE_CANCELLING)) )
+    return MHD_YES;
+  if (0 == (state & MHD_URING_STATE_RECV_ARMED))
+    {
+      if ( (0 == (state & (MHD_URING_STATE_EOF | MHD_URING_STATE_STARVED))) &&
+           (0 == connection->uring_error) &&
+           (MHD_NO == connection->read_closed) &&
+           (connection->uring_in_count < MHD_URING_QUEUE_MAX) )
+        {
+          if (MHD_URING_BUFFERS == ring->buffers_out)
+            starve (ring, connection);
+          else if (MHD_YES != prep_recv (ring, connection))
+            return MHD_NO;
+          else
+            connection->uring_state |= MHD_URING_STATE_RECV_ARMED;
+        }
+    }
+  if ( (MHD_EVENT_LOOP_INFO_WRITE == connection->event_loop_info) &&
+       (MHD_NO == connection->suspended) &&
+       (0 == (connection->epoll_state & MHD_EPOLL_STATE_WRITE_READY)) &&
+       (0 == (state & MHD_URING_STATE_POLLOUT_ARMED)) )
+    {
+      if (MHD_YES != MHD_uring_prep_poll_ (ring,
+                                           connection->socket_fd,
+                                           POLLOUT,
+                                           MHD_NO,
+                                           MHD_URING_USER_DATA (connection,
+                                                           MHD_URING_TAG_POLLOUT)))
+        return MHD_NO;
+      connection->uring_state |= MHD_URING_STATE_POLLOUT_ARMED;
+    }
+  return MHD_YES;
+}
+
+
+/**
+ * Put a connection into the list of connections ready for
+ * processing, unless it is already there or not to be processed.
+ *
+ * @param connection connection to add
+ */
+static void
+mark_ready (struct MHD_Connection *connection)
+{
+  struct MHD_Daemon *daemon = connection->daemon;
+
+  if ( (MHD_YES == connection->suspended) ||
+       (MHD_EVENT_LOOP_INFO_CLEANUP == connection->event_loop_info) ||
+       (0 != (connection->epoll_state & MHD_EPOLL_STATE_IN_EREADY_EDLL)) )
+    return;
+  EDLL_insert (daemon->eready_head,
+               daemon->eready_tail,
+               connection);
+  connection->epoll_state |= MHD_EPOLL_STATE_IN_EREADY_EDLL;
+}
+
+
+/**
+ * Queue a new receive for a connection whose receive ended without
+ * data, as nothing else would: the connection is only updated after
+ * it was processed.  If we cannot queue it right now, process the
+ * connection, which queues it afterwards.
+ *
+ * @param connection connection to receive on
+ */
+static void
+rearm_recv (struct MHD_Connection *connection)
+{
+  if (0 != (connection->uring_state & MHD_URING_STATE_RECV_ARMED))
+    return; /* multishot receive still pending */
+  if (MHD_YES != MHD_uring_connection_update_ (connection))
+    mark_ready (connection);
+}
+
+
+/**
+ * Process the completion of a receive of a connection.
+ *
+ * @param connection connection concerned
+ * @param cqe the completion
+ */
+static void
+recv_complete (struct MHD_Connection *connection,
+               const struct io_uring_cqe *cqe)
+{
+  struct MHD_Uring *ring = connection->daemon->uring;
+  unsigned int bid;
+  int paused;
+
+  paused = (0 != (connection->uring_state & MHD_URING_STATE_RECV_CANCELLING));
+  if (0 == (cqe->flags & IORING_CQE_F_MORE))
+    connection->uring_state &= ~(MHD_URING_STATE_RECV_ARMED | MHD_URING_STATE_RECV_CANCELLING);
+  if (0 != (cqe->flags & IORING_CQE_F_BUFFER))
+    {
+      bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      ring->buffers_out++;
+      if ( (cqe->res <= 0) ||
+           (0 != (connection->uring_state & MHD_URING_STATE_CANCELLING)) )
+        {
+          recycle_buffer (ring, bid);
+        }
+      else
+        {
+          /* append to the data of the connection */
+          ring->buffer_len[bid] = (unsigned int) cqe->res;
+          ring->buffer_next[bid] = 0;
+          if (0 == connection->uring_in_tail)
+            connection->uring_in_head = bid + 1;
+          else
+            ring->buffer_next[connection->uring_in_tail - 1] = bid + 1;
+          connection->uring_in_tail = bid + 1;
+          connection->uring_in_count++;
+          if ( (connection->uring_in_count >= MHD_URING_QUEUE_MAX) &&
+               (0 != (cqe->flags & IORING_CQE_F_MORE)) &&
+               (0 == (connection->uring_state & MHD_URING_STATE_RECV_CANCELLING)) &&
+               (MHD_YES == MHD_uring_prep_cancel_ (ring,
+                                                   MHD_URING_USER_DATA (connection,
+                                                                        MHD_URING_TAG_RECV))) )
+            {
+              /* enough data buffered (maybe the connection is
+                 suspended), pause receiving until it was consumed */
+              connection->uring_state |= MHD_URING_STATE_RECV_CANCELLING;
+            }
+        }
+    }
+  if (0 != (connection->uring_state & MHD_URING_STATE_CANCELLING))
+    return;
+  if (cqe->res < 0)
+    {
+      switch (-cqe->res)
+        {
+        case ENOBUFS:
+          starve (ring, connection);
+          return;
+        case ECANCELED:
+          if (paused)
+            return; /* re-armed once the buffered data was consumed */
+          /* fall through */
+        case EINTR:
+        case EAGAIN:
+          rearm_recv (connection);
+          return;
+        case EINVAL:
+          if (MHD_NO == ring->no_multishot_recv)
+            {
+              /* kernel without multishot receive, use single shots */
+              ring->no_multishot_recv = MHD_YES;
+              rearm_recv (connection);
+              return;
+            }
+          /* fall through */
+        default:
+          connection->uring_error = -cqe->res;
+          break;
+        }
+    }
+  else if (0 == cqe->res)
+    {
+      connection->uring_state |= MHD_URING_STATE_EOF;
+    }
+  connection->epoll_state |= MHD_EPOLL_STATE_READ_READY;
+  if ( (MHD_EVENT_LOOP_INFO_READ == connection->event_loop_info) ||
+       (connection->read_buffer_size > connection->read_buffer_offset) )
+    mark_ready (connection);
+}
+
+
+/**
+ * Process the completion of an operation of a connection.
+ *
+ * @param connection connection concerned
+ * @param tag kind of the operation
+ * @param cqe the completion
+ */
+void
+MHD_uring_connection_complete_ (struct MHD_Connection *connection,
+                                enum MHD_UringTag tag,
+                                const struct io_uring_cqe *cqe)
+{
+  struct MHD_Daemon *daemon = connection->daemon;
+
+  switch (tag)
+    {
+    case MHD_URING_TAG_RECV:
+      recv_complete (connection, cqe);
+      break;
+    case MHD_URING_TAG_POLLOUT:
+      connection->uring_state &= ~MHD_URING_STATE_POLLOUT_ARMED;
+      if ( (-ECANCELED == cqe->res) ||
+           (0 != (connection->uring_state & MHD_URING_STATE_CANCELLING)) )
+        break;
+      /* on errors, let the next send find out what is wrong */
+      connection->epoll_state |= MHD_EPOLL_STATE_WRITE_READY;
+      if (MHD_EVENT_LOOP_INFO_WRITE == connection->event_loop_info)
+        mark_ready (connection);
+      break;
+    default:
+      break;
+    }
+  if ( (0 != (connection->uring_state & MHD_URING_STATE_CANCELLING)) &&
+       (0 == (connection->uring_state & (MHD_URING_STATE_RECV_ARMED |
+                                         MHD_URING_STATE_POLLOUT_ARMED))) )
+    {
+      /* all operations are done, can now really clean up */
+      DLL_remove (daemon->uring_zombies_head,
+                  daemon->uring_zombies_tail,
+                  connection);
+      DLL_insert (daemon->cleanup_head,
+                  daemon->cleanup_tail,
+                  connection);
+    }
+}
+
+
+/**
+ * Release the io_uring resources of a connection that is being
+ * cleaned up.  If operations are still pending, they are cancelled
+ * and the connection is moved to the zombie list of the daemon
+ * until they completed.
+ *
+ * @param connection connection to release
+ * @return #MHD_YES if the connection can be freed now, #MHD_NO
+ *         if it must wait for its operations
+ */
+int
+MHD_uring_connection_release_ (struct MHD_Connection *connection)
+{
+  struct MHD_Daemon *daemon = connection->daemon;
+  struct MHD_Uring *ring = daemon->uring;
+  struct MHD_Connection *pos;
+  unsigned int bid;
+
+  if (0 != (connection->uring_state & MHD_URING_STATE_STARVED))
+    {
+      if (ring->starved_head == connection)
+        ring->starved_head = connection->nextU;
+      else
+        for (pos = ring->starved_head; NULL != pos; pos = pos->nextU)
+          if (pos->nextU == connection)
+            {
+              pos->nextU = connection->nextU;
+              break;
+            }
+      connection->nextU = NULL;
+      connection->uring_state &= ~MHD_URING_STATE_STARVED;
+    }
+  while (0 != connection->uring_in_head)
+    {
+      bid = connection->uring_in_head - 1;
+      connection->uring_in_head = ring->buffer_next[bid];
+      recycle_buffer (ring, bid);
+    }
+  connection->uring_in_tail = 0;
+  connection->uring_in_count = 0;
+  connection->uring_in_offset = 0;
+  if (0 == (connection->uring_state & (MHD_URING_STATE_RECV_ARMED |
+                                       MHD_URING_STATE_POLLOUT_ARMED)))
+    return MHD_YES;
+  if (0 == (connection->uring_state & MHD_URING_STATE_CANCELLING))
+    {
+      if (MHD_YES != MHD_uring_prep_cancel_fd_ (ring, connection->socket_fd))
+        MHD_PANIC ("Failed to cancel io_uring operations\n");
+      connection->uring_state |= MHD_URING_STATE_CANCELLING;
+    }
+  DLL_insert (daemon->uring_zombies_head,
+              daemon->uring_zombies_tail,
+              connection);
+  return MHD_NO;
+}
+
+
+/**
+ * Re-arm receiving for connections that were waiting for receive
+ * buffers, as far as buffers are available now.
+ *
+ * @param daemon daemon to process
+ */
+void
+MHD_uring_process_starved_ (struct MHD_Daemon *daemon)
+{
+  struct MHD_Uring *ring = daemon->uring;
+  struct MHD_Connection *pos;
+
+  while ( (NULL != (pos = ring->starved_head)) &&
+          (ring->buffers_out < MHD_URING_BUFFERS) )
+    {
+      ring->starved_head = pos->nextU;
+      pos->nextU = NULL;
+      pos->uring_state &= ~MHD_URING_STATE_STARVED;
+      if (MHD_YES != MHD_uring_connection_update_ (pos))
+        MHD_connection_close (pos, MHD_REQUEST_TERMINATED_WITH_ERROR);
+    }
+}
+
+
+/**
+ * Callback for receiving data on a connection, from the data that
+ * the kernel already put in our buffers.
+ *
+ * @param connection the MHD connection structure
+ * @param other where to write received data to
+ * @param i maximum size of other (in bytes)
+ * @return number of bytes actually received
+ */
+ssize_t
+MHD_uring_recv_ (struct MHD_Connection *connection,
+                 void *other,
+                 size_t i)
+{
+  struct MHD_Uring *ring = connection->daemon->uring;
+  char *dst = other;
+  size_t done;
+  size_t n;
+  unsigned int bid;
+
+  if ( (MHD_INVALID_SOCKET == connection->socket_fd) ||
+       (MHD_CONNECTION_CLOSED == connection->state) )
+    {
+      MHD_set_socket_errno_ (ENOTCONN);
+      return -1;
+    }
+  done = 0;
+  while ( (done < i) &&
+          (0 != connection->uring_in_head) )
+    {
+      bid = connection->uring_in_head - 1;
+      n = ring->buffer_len[bid] - connection->uring_in_offset;
+      if (n > i - done)
+        n = i - done;
+      memcpy (&dst[done],
+              &ring->buffers[bid * MHD_URING_BUFFER_SIZE + connection->uring_in_offset],
+              n);
+      done += n;
+      connection->uring_in_offset += n;
+      if (connection->uring_in_offset == ring->buffer_len[bid])
+        {
+          /* buffer consumed, give it back to the kernel */
+          connection->uring_in_head = ring->buffer_next[bid];
+          if (0 == connection->uring_in_head)
+            connection->uring_in_tail = 0;
+          connection->uring_in_count--;
+          connection->uring_in_offset = 0;
+          recycle_buffer (ring, bid);
+        }
+    }
+  if ( (0 == connection->uring_in_head) &&
+       (0 == (connection->uring_state & MHD_URING_STATE_EOF)) &&
+       (0 == connection->uring_error) )
+    {
+      /* all received data consumed --- no longer read-ready */
+      connection->epoll_state &= ~MHD_EPOLL_STATE_READ_READY;
+    }
+  if (done > 0)
+    {
+      MHD_STATS_ADD_ (connection->daemon, bytes_received, done);
+      return (ssize_t) done;
+    }
+  if (0 != connection->uring_error)
+    {
+      MHD_set_socket_errno_ (connection->uring_error);
+      return -1;
+    }
+  if (0 != (connection->uring_state & MHD_URING_STATE_EOF))
+    return 0;
+  MHD_set_socket_errno_ (EAGAIN);
+  return -1;
+}
+
+/* end of uring.c */
@@ -0,0 +1,448 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff (and other contributing authors)
+
+     This library is free software; you can redistribute it and/or
+     modify it under the terms of the GNU Lesser General Public
+     License as published by the Free Software Foundation; either
+     version 2.1 of the License, or (at your option) any later version.
+
+     This library is distributed in the hope that it will be useful,
+     but WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     Lesser General Public License for more details.
+
+     You should have received a copy of the GNU Lesser General Public
+     License along with this library; if not, write to the Free Software
+     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * @file uring.h
+ * @brief io_uring based event loop support (Linux only)
+ * @author Christian Grothoff
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include "internal.h"
+
+#if IO_URING_SUPPORT
+#include <linux/io_uring.h>
+
+/**
+ * Number of accept operations we keep pending per listen socket.
+ */
+#define MHD_URING_ACCEPTS 8
+
+/**
+ * Kinds of operations, stored in the low bits of the user data
+ * of a submission (the rest is a pointer to the object concerned).
+ */
+enum MHD_UringTag
+  {
+
+    /**
+     * Cancellation requests, completions are ignored.
+     */
+    MHD_URING_TAG_CANCEL = 0,
+
+    /**
+     * Receive on a connection.
+     */
+    MHD_URING_TAG_RECV = 1,
+
+    /**
+     * Poll for a connection becoming writable.
+     */
+    MHD_URING_TAG_POLLOUT = 2,
+
+    /**
+     * Accept on the listen socket (pointer to the accept slot).
+     */
+    MHD_URING_TAG_ACCEPT = 3,
+
+    /**
+     * Poll on the signalling pipe of the daemon.
+     */
+    MHD_URING_TAG_PIPE = 4
+  };
+
+/**
+ * Mask for extracting the tag from the user data.
+ */
+#define MHD_URING_TAG_MASK 7
+
+/**
+ * Build the user data of a submission about object @a ptr (which
+ * must be aligned to at least 8 bytes).
+ */
+#define MHD_URING_USER_DATA(ptr,tag) (((uint64_t) (uintptr_t) (ptr)) | (uint64_t) (tag))
+
+/**
+ * Build the user data of an accept submission for slot @a i.
+ */
+#define MHD_URING_ACCEPT_DATA(i) ((((uint64_t) (i)) << 3) | (uint64_t) MHD_URING_TAG_ACCEPT)
+
+
+/**
+ * State of one of the pending accept operations.
+ */
+struct MHD_UringAccept
+{
+
+  /**
+   * Address of the client is written here.
+   */
+#if HAVE_INET6
+  struct sockaddr_in6 addr;
+#else
+  struct sockaddr_in addr;
+#endif
+
+  /**
+   * Length of @e addr.
+   */
+  socklen_t addrlen;
+
+  /**
+   * #MHD_YES if the accept is pending.
+   */
+  int armed;
+};
+
+
+/**
+ * An io_uring instance together with the buffers that the kernel
+ * picks from when data is received.
+ */
+struct MHD_Uring
+{
+
+  /**
+   * File descriptor of the ring.
+   */
+  int fd;
+
+  /**
+   * Mapping of the submission and completion queue rings.
+   */
+  void *rings;
+
+  /**
+   * Size of @e rings.
+   */
+  size_t rings_size;
+
+  /**
+   * Submission queue entries.
+   */
+  struct io_uring_sqe *sqes;
+
+  /**
+   * Size of the mapping of @e sqes.
+   */
+  size_t sqes_size;
+
+  /**
+   * Head of the submission queue (advanced by the kernel).
+   */
+  unsigned int *sq_head;
+
+  /**
+   * Tail of the submission queue (advanced by us).
+   */
+  unsigned int *sq_tail;
+
+  /**
+   * Index array of the submission queue.
+   */
+  unsigned int *sq_array;
+
+  /**
+   * Mask for indices into the submission queue.
+   */
+  unsigned int sq_mask;
+
+  /**
+   * Number of entries in the submission queue.
+   */
+  unsigned int sq_entries;
+
+  /**
+   * Our tail of the submission queue, including entries that we
+   * did not yet make visible to the kernel.
+   */
+  unsigned int sq_local_tail;
+
+  /**
+   * Head of the completion queue (advanced by us).
+   */
+  unsigned int *cq_head;
+
+  /**
+   * Tail of the completion queue (advanced by the kernel).
+   */
+  unsigned int *cq_tail;
+
+  /**
+   * Mask for indices into the completion queue.
+   */
+  unsigned int cq_mask;
+
+  /**
+   * Completion queue entries.
+   */
+  struct io_uring_cqe *cqes;
+
+  /**
+   * Ring of buffers provided to the kernel for receiving.
+   */
+  struct io_uring_buf_ring *buf_ring;
+
+  /**
+   * Size of the mapping of @e buf_ring.
+   */
+  size_t buf_ring_size;
+
+  /**
+   * Our tail of @e buf_ring.
+   */
+  uint16_t buf_ring_tail;
+
+  /**
+   * Memory of the receive buffers.
+   */
+  char *buffers;
+
+  /**
+   * For each receive buffer in use: ID plus one of the next
+   * buffer of the same connection (0 for none).
+   */
+  unsigned int *buffer_next;
+
+  /**
+   * For each receive buffer in use: number of bytes received.
+   */
+  unsigned int *buffer_len;
+
+  /**
+   * Number of receive buffers not available to the kernel.
+   */
+  unsigned int buffers_out;
+
+  /**
+   * Head of the list of connections waiting for receive buffers.
+   */
+  struct MHD_Connection *starved_head;
+
+  /**
+   * #MHD_YES if the kernel does not support multishot receives
+   * (then every receive must be re-armed after its completion).
+   */
+  int no_multishot_recv;
+
+  /**
+   * #MHD_YES if the poll on the signalling pipe is pending.
+   */
+  int pipe_armed;
+
+  /**
+   * #MHD_YES once we made the reading end of the signalling
+   * pipe non-blocking.
+   */
+  int pipe_nonblocking;
+
+  /**
+   * Listen socket the accept operations are pending on.
+   */
+  MHD_socket accept_fd;
+
+  /**
+   * #MHD_YES if we asked for the accept operations to be cancelled.
+   */
+  int accept_cancelling;
+
+  /**
+   * Pending accept operations.
+   */
+  struct MHD_UringAccept accepts[MHD_URING_ACCEPTS];
+};
+
+
+/**
+ * Check whether the running kernel supports everything we need.
+ *
+ * @return #MHD_YES if io_uring can be used
+ */
+int
+MHD_uring_probe_ (void);
+
+
+/**
+ * Create an io_uring instance with its receive buffers.
+ *
+ * @return NULL on error (i.e. missing kernel support)
+ */
+struct MHD_Uring *
+MHD_uring_create_ (void);
+
+
+/**
+ * Destroy an io_uring instance.  All operations must have completed.
+ *
+ * @param ring ring to destroy
+ */
+void
+MHD_uring_destroy_ (struct MHD_Uring *ring);
+
+
+/**
+ * Queue an accept operation.
+ *
+ * @param ring ring to use
+ * @param fd listen socket
+ * @param slot index of the slot in `accepts` to use
+ * @return #MHD_YES on success, #MHD_NO if the queue is full
+ */
+int
+MHD_uring_prep_accept_ (struct MHD_Uring *ring,
+                        MHD_socket fd,
+                        unsigned int slot);
+
+
+/**
+ * Queue a poll operation.
+ *
+ * @param ring ring to use
+ * @param fd file descriptor to poll
+ * @param events poll events to wait for
+ * @param multishot #MHD_YES to keep polling after an event
+ * @param user_data tagged pointer for the completion
+ * @return #MHD_YES on success, #MHD_NO if the queue is full
+ */
+int
+MHD_uring_prep_poll_ (struct MHD_Uring *ring,
+                      int fd,
+                      unsigned int events,
+                      int multishot,
+                      uint64_t user_data);
+
+
+/**
+ * Queue the cancellation of the operation with the given user data.
+ *
+ * @param ring ring to use
+ * @param user_data user data of the operation to cancel
+ * @return #MHD_YES on success, #MHD_NO if the queue is full
+ */
+int
+MHD_uring_prep_cancel_ (struct MHD_Uring *ring,
+                        uint64_t user_data);
+
+
+/**
+ * Queue the cancellation of all operations on a file descriptor.
+ *
+ * @param ring ring to use
+ * @param fd file descriptor
+ * @return #MHD_YES on success, #MHD_NO if the queue is full
+ */
+int
+MHD_uring_prep_cancel_fd_ (struct MHD_Uring *ring,
+                           int fd);
+
+
+/**
+ * Submit the queued operations and wait for completions.
+ *
+ * @param ring ring to use
+ * @param timeout_ms how long to wait at most, 0 to not wait,
+ *        -1 to wait until something completes
+ * @return #MHD_YES on success, #MHD_NO on error
+ */
+int
+MHD_uring_wait_ (struct MHD_Uring *ring,
+                 int timeout_ms);
+
+
+/**
+ * Take the next completion from the ring.
+ *
+ * @param ring ring to use
+ * @param cqe where to copy the completion
+ * @return #MHD_YES on success, #MHD_NO if there is none
+ */
+int
+MHD_uring_next_cqe_ (struct MHD_Uring *ring,
+                     struct io_uring_cqe *cqe);
+
+
+/**
+ * Queue the operations a connection needs: receiving (unless we
+ * have enough data buffered for it already) and waiting for the
+ * socket to become writable if the connection wants to write.
+ *
+ * @param connection connection to update
+ * @return #MHD_YES on success, #MHD_NO if the connection
+ *         cannot be served anymore
+ */
+int
+MHD_uring_connection_update_ (struct MHD_Connection *connection);
+
+
+/**
+ * Process the completion of an operation of a connection.
+ *
+ * @param connection connection concerned
+ * @param tag kind of the operation
+ * @param cqe the completion
+ */
+void
+MHD_uring_connection_complete_ (struct MHD_Connection *connection,
+                                enum MHD_UringTag tag,
+                                const struct io_uring_cqe *cqe);
+
+
+/**
+ * Release the io_uring resources of a connection that is being
+ * cleaned up.  If operations are still pending, they are cancelled
+ * and the connection is moved to the zombie list of the daemon
+ * until they completed.
+ *
+ * @param connection connection to release
+ * @return #MHD_YES if the connection can be freed now, #MHD_NO
+ *         if it must wait for its operations
+ */
+int
+MHD_uring_connection_release_ (struct MHD_Connection *connection);
+
+
+/**
+ * Re-arm receiving for connections that were waiting for receive
+ * buffers, as far as buffers are available now.
+ *
+ * @param daemon daemon to process
+ */
+void
+MHD_uring_process_starved_ (struct MHD_Daemon *daemon);
+
+
+/**
+ * Callback for receiving data on a connection, from the data that
+ * the kernel already put in our buffers.
+ *
+ * @param connection the MHD connection structure
+ * @param other where to write received data to
+ * @param i maximum size of other (in bytes)
+ * @return number of bytes actually received
+ */
+ssize_t
+MHD_uring_recv_ (struct MHD_Connection *connection,
+                 void *other,
+                 size_t i);
+
+#endif
+
+#endif
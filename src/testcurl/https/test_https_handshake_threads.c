@@ -0,0 +1,237 @@
+/*
+ This file is part of libmicrohttpd
+ (C) 2015 Christian Grothoff
+
+ libmicrohttpd is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 2, or (at your
+ option) any later version.
+
+ libmicrohttpd is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with libmicrohttpd; see the file COPYING.  If not, write to the
+ Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * @file test_https_handshake_threads.c
+ * @brief  Testcase for concurrent HTTPS connections whose handshakes
+ *         run on MHD_OPTION_HTTPS_HANDSHAKE_THREADS, and for stopping
+ *         the daemon while a handshake is incomplete
+ * @author Christian Grothoff
+ */
+
+#include "platform.h"
+#include "microhttpd.h"
+#include <limits.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+#include <gcrypt.h>
+#include "tls_test_common.h"
+
+extern const char srv_key_pem[];
+extern const char srv_self_signed_cert_pem[];
+
+/**
+ * Number of clients that connect at the same time.
+ */
+#define NUM_CLIENTS 16
+
+static int
+ahc_echo (void *cls,
+          struct MHD_Connection *connection,
+          const char *url,
+          const char *method,
+          const char *version,
+          const char *upload_data, size_t *upload_data_size,
+          void **unused)
+{
+  struct MHD_Response *response;
+  int ret;
+
+  response = MHD_create_response_from_buffer (strlen (test_data),
+                                              (void *) test_data,
+                                              MHD_RESPMEM_PERSISTENT);
+  ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+  MHD_destroy_response (response);
+  return ret;
+}
+
+
+/**
+ * Open a connection that starts a TLS handshake but never
+ * finishes it: only the header of the first record is sent.
+ *
+ * @return the socket, -1 on error
+ */
+static int
+connect_stalled ()
+{
+  static const char partial_record[] = { 0x16, 0x03, 0x01, 0x00, 0x40 };
+  struct sockaddr_in sa;
+  int fd;
+
+  if (-1 == (fd = socket (AF_INET, SOCK_STREAM, 0)))
+    return -1;
+  memset (&sa, 0, sizeof (sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons (DEAMON_TEST_PORT + 9);
+  sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if ( (0 != connect (fd, (struct sockaddr *) &sa, sizeof (sa))) ||
+       (sizeof (partial_record) !=
+        write (fd, partial_record, sizeof (partial_record))) )
+    {
+      close (fd);
+      return -1;
+    }
+  return fd;
+}
+
+
+/**
+ * Let @a NUM_CLIENTS clients connect at the same time and check
+ * their responses and the handshake statistics of the daemon.
+ *
+ * @param flags event loop to use
+ * @param pool_size value for #MHD_OPTION_THREAD_POOL_SIZE
+ * @return 0 on success
+ */
+static int
+testHandshakeThreads (int flags,
+                      unsigned int pool_size)
+{
+  struct MHD_Daemon *d;
+  struct MHD_DaemonStats stats;
+  CURLM *multi;
+  CURL *c[NUM_CLIENTS];
+  struct CBC cbc[NUM_CLIENTS];
+  char buf[NUM_CLIENTS][64];
+  char url[64];
+  CURLMsg *msg;
+  int running;
+  int stalled;
+  unsigned int i;
+  int ret;
+
+  d = MHD_start_daemon (MHD_USE_DEBUG | MHD_USE_SSL |
+                        MHD_USE_SELECT_INTERNALLY | flags,
+                        DEAMON_TEST_PORT + 9, NULL, NULL, &ahc_echo, NULL,
+                        MHD_OPTION_HTTPS_MEM_KEY, srv_key_pem,
+                        MHD_OPTION_HTTPS_MEM_CERT, srv_self_signed_cert_pem,
+                        MHD_OPTION_HTTPS_HANDSHAKE_THREADS, 2,
+                        MHD_OPTION_THREAD_POOL_SIZE, pool_size,
+                        MHD_OPTION_END);
+  if (NULL == d)
+    return 1;
+  /* still in the middle of its handshake when we stop the daemon */
+  if (-1 == (stalled = connect_stalled ()))
+    {
+      MHD_stop_daemon (d);
+      return 2;
+    }
+  if (NULL == (multi = curl_multi_init ()))
+    {
+      close (stalled);
+      MHD_stop_daemon (d);
+      return 2;
+    }
+  snprintf (url, sizeof (url), "https://127.0.0.1:%d/", DEAMON_TEST_PORT + 9);
+  for (i = 0; i < NUM_CLIENTS; i++)
+    {
+      cbc[i].buf = buf[i];
+      cbc[i].size = sizeof (buf[i]);
+      cbc[i].pos = 0;
+      c[i] = curl_easy_init ();
+      curl_easy_setopt (c[i], CURLOPT_URL, url);
+      curl_easy_setopt (c[i], CURLOPT_WRITEFUNCTION, &copyBuffer);
+      curl_easy_setopt (c[i], CURLOPT_WRITEDATA, &cbc[i]);
+      curl_easy_setopt (c[i], CURLOPT_SSL_VERIFYPEER, 0L);
+      curl_easy_setopt (c[i], CURLOPT_SSL_VERIFYHOST, 0L);
+      curl_easy_setopt (c[i], CURLOPT_FAILONERROR, 1L);
+      curl_easy_setopt (c[i], CURLOPT_TIMEOUT, 150L);
+      curl_easy_setopt (c[i], CURLOPT_CONNECTTIMEOUT, 150L);
+      /* NOTE: use of CONNECTTIMEOUT without also
+         setting NOSIGNAL results in really weird
+         crashes on my system! */
+      curl_easy_setopt (c[i], CURLOPT_NOSIGNAL, 1L);
+      curl_multi_add_handle (multi, c[i]);
+    }
+  do
+    {
+      if ( (CURLM_OK != curl_multi_perform (multi, &running)) ||
+           (CURLM_OK != curl_multi_wait (multi, NULL, 0, 100, NULL)) )
+        break;
+    }
+  while (0 != running);
+  ret = (0 == running) ? 0 : 4;
+  while (NULL != (msg = curl_multi_info_read (multi, &running)))
+    if ( (CURLMSG_DONE == msg->msg) &&
+         (CURLE_OK != msg->data.result) )
+      {
+        fprintf (stderr,
+                 "curl_multi_perform failed: `%s'\n",
+                 curl_easy_strerror (msg->data.result));
+        ret |= 8;
+      }
+  for (i = 0; i < NUM_CLIENTS; i++)
+    {
+      if ( (strlen (test_data) != cbc[i].pos) ||
+           (0 != memcmp (buf[i], test_data, cbc[i].pos)) )
+        ret |= 16;
+      curl_multi_remove_handle (multi, c[i]);
+      curl_easy_cleanup (c[i]);
+    }
+  curl_multi_cleanup (multi);
+  if (MHD_YES != MHD_get_daemon_stats (d, &stats))
+    ret |= 32;
+  MHD_stop_daemon (d);
+  close (stalled);
+  if (0 != ret)
+    return ret;
+  /* every handshake went through the handshake threads at least
+     once, and none is waiting for them once all are done */
+  if ( (NUM_CLIENTS != stats.tls_handshakes_full +
+        stats.tls_handshakes_resumed) ||
+       (stats.tls_handshakes_offloaded < NUM_CLIENTS) ||
+       (0 != stats.tls_handshake_queue_length) ||
+       (0 == stats.tls_handshake_queue_max) )
+    {
+      fprintf (stderr,
+               "%llu handshakes, %llu offloaded, queue %llu (max %llu)\n",
+               (unsigned long long) (stats.tls_handshakes_full +
+                                     stats.tls_handshakes_resumed),
+               (unsigned long long) stats.tls_handshakes_offloaded,
+               (unsigned long long) stats.tls_handshake_queue_length,
+               (unsigned long long) stats.tls_handshake_queue_max);
+      return 64;
+    }
+  return 0;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+
+  if (0 != curl_global_init (CURL_GLOBAL_ALL))
+    {
+      fprintf (stderr, "Error: %s\n", strerror (errno));
+      return -1;
+    }
+  errorCount += testHandshakeThreads (0, 0);
+  errorCount += 128 * testHandshakeThreads (0, 4);
+  errorCount += 16384 * testHandshakeThreads (MHD_USE_POLL, 0);
+#if EPOLL_SUPPORT
+  errorCount += 2097152 * testHandshakeThreads (MHD_USE_EPOLL_LINUX_ONLY, 4);
+#endif
+  if (0 != errorCount)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  curl_global_cleanup ();
+  return errorCount != 0;
+}
@@ -0,0 +1,236 @@
+/*
+ This file is part of libmicrohttpd
+ (C) 2015 Christian Grothoff
+
+ libmicrohttpd is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 2, or (at your
+ option) any later version.
+
+ libmicrohttpd is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with libmicrohttpd; see the file COPYING.  If not, write to the
+ Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * @file test_https_ktls.c
+ * @brief  Testcase for HTTPS GET operations with MHD_OPTION_HTTPS_KTLS;
+ *         passes both if the kernel encrypts and if MHD falls back
+ *         to GnuTLS
+ * @author Christian Grothoff
+ */
+
+#include "platform.h"
+#include "microhttpd.h"
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+#include <gcrypt.h>
+#include "tls_test_common.h"
+
+extern const char srv_key_pem[];
+extern const char srv_self_signed_cert_pem[];
+
+/**
+ * Size of the file we serve.
+ */
+#define FILE_SIZE (256 * 1024)
+
+/**
+ * Name of the file we serve.
+ */
+static char filename[256];
+
+/**
+ * Contents of the file we serve.
+ */
+static char body[FILE_SIZE];
+
+static int
+ahc_echo (void *cls,
+          struct MHD_Connection *connection,
+          const char *url,
+          const char *method,
+          const char *version,
+          const char *upload_data, size_t *upload_data_size,
+          void **unused)
+{
+  static int ptr;
+  struct MHD_Response *response;
+  int fd;
+  int ret;
+
+  if (0 != strcmp ("GET", method))
+    return MHD_NO;              /* unexpected method */
+  if (&ptr != *unused)
+    {
+      *unused = &ptr;
+      return MHD_YES;
+    }
+  *unused = NULL;
+  if (0 == strcmp (url, "/buffer"))
+    {
+      response = MHD_create_response_from_buffer (strlen (test_data),
+                                                  (void *) test_data,
+                                                  MHD_RESPMEM_PERSISTENT);
+    }
+  else
+    {
+      if (-1 == (fd = open (filename, O_RDONLY)))
+        return MHD_NO;
+      response = MHD_create_response_from_fd (FILE_SIZE, fd);
+    }
+  if (NULL == response)
+    abort ();
+  ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+  MHD_destroy_response (response);
+  return ret;
+}
+
+
+/**
+ * Fetch @a url with @a c (reusing its connection).
+ *
+ * @param c handle to use
+ * @param url path to request
+ * @param range value for the "Range" header, or NULL
+ * @param cbc where to store the body
+ * @return 0 on success
+ */
+static int
+fetch (CURL *c, const char *url, const char *range, struct CBC *cbc)
+{
+  char full_url[128];
+  CURLcode errornum;
+
+  cbc->pos = 0;
+  snprintf (full_url, sizeof (full_url),
+            "https://127.0.0.1:%d%s", DEAMON_TEST_PORT + 7, url);
+  curl_easy_setopt (c, CURLOPT_URL, full_url);
+  curl_easy_setopt (c, CURLOPT_RANGE, range);
+  if (CURLE_OK != (errornum = curl_easy_perform (c)))
+    {
+      fprintf (stderr,
+               "curl_easy_perform failed: `%s'\n",
+               curl_easy_strerror (errornum));
+      return 1;
+    }
+  return 0;
+}
+
+
+static int
+testKtlsGet (int flags)
+{
+  struct MHD_Daemon *d;
+  CURL *c;
+  char *buf;
+  struct CBC cbc;
+  int ret;
+
+  if (NULL == (buf = malloc (FILE_SIZE)))
+    return 1;
+  cbc.buf = buf;
+  cbc.size = FILE_SIZE;
+  d = MHD_start_daemon (MHD_USE_DEBUG | MHD_USE_SSL | flags,
+                        DEAMON_TEST_PORT + 7, NULL, NULL, &ahc_echo, NULL,
+                        MHD_OPTION_HTTPS_MEM_KEY, srv_key_pem,
+                        MHD_OPTION_HTTPS_MEM_CERT, srv_self_signed_cert_pem,
+                        MHD_OPTION_HTTPS_KTLS, 1,
+                        MHD_OPTION_END);
+  if (NULL == d)
+    {
+      free (buf);
+      return 2;
+    }
+  c = curl_easy_init ();
+  curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_WRITEDATA, &cbc);
+  curl_easy_setopt (c, CURLOPT_SSL_VERIFYPEER, 0L);
+  curl_easy_setopt (c, CURLOPT_SSL_VERIFYHOST, 0L);
+  curl_easy_setopt (c, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+  curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+  /* NOTE: use of CONNECTTIMEOUT without also
+     setting NOSIGNAL results in really weird
+     crashes on my system! */
+  curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1L);
+
+  ret = 0;
+  /* file body, then a buffer and a range on the same connection */
+  if ( (0 != fetch (c, "/file", NULL, &cbc)) ||
+       (FILE_SIZE != cbc.pos) ||
+       (0 != memcmp (buf, body, FILE_SIZE)) )
+    ret |= 4;
+  if ( (0 != fetch (c, "/buffer", NULL, &cbc)) ||
+       (strlen (test_data) != cbc.pos) ||
+       (0 != memcmp (buf, test_data, cbc.pos)) )
+    ret |= 8;
+  if ( (0 != fetch (c, "/file", "1000-100999", &cbc)) ||
+       (100000 != cbc.pos) ||
+       (0 != memcmp (buf, &body[1000], cbc.pos)) )
+    ret |= 16;
+  if ( (0 != fetch (c, "/file", NULL, &cbc)) ||
+       (FILE_SIZE != cbc.pos) ||
+       (0 != memcmp (buf, body, FILE_SIZE)) )
+    ret |= 32;
+  curl_easy_cleanup (c);
+  MHD_stop_daemon (d);
+  free (buf);
+  return ret;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+  const char *tmp;
+  unsigned int i;
+  FILE *f;
+
+  if (MHD_YES != MHD_is_feature_supported (MHD_FEATURE_KTLS))
+    return 77;                  /* skip, no kernel TLS in this build */
+  if ( (NULL == (tmp = getenv ("TMPDIR"))) &&
+       (NULL == (tmp = getenv ("TMP"))) &&
+       (NULL == (tmp = getenv ("TEMP"))) )
+    tmp = "/tmp";
+  snprintf (filename, sizeof (filename), "%s/test-mhd-ktls-%u",
+            tmp, (unsigned int) getpid ());
+  for (i = 0; i < FILE_SIZE; i++)
+    body[i] = 'a' + (i * 7 + i / 1024) % 26;
+  if (NULL == (f = fopen (filename, "w")))
+    return 2;
+  if (FILE_SIZE != fwrite (body, 1, FILE_SIZE, f))
+    {
+      fclose (f);
+      (void) unlink (filename);
+      return 2;
+    }
+  fclose (f);
+  if (0 != curl_global_init (CURL_GLOBAL_ALL))
+    {
+      fprintf (stderr, "Error: %s\n", strerror (errno));
+      (void) unlink (filename);
+      return 2;
+    }
+  errorCount += testKtlsGet (MHD_USE_SELECT_INTERNALLY);
+  errorCount += 64 * testKtlsGet (MHD_USE_THREAD_PER_CONNECTION);
+#if EPOLL_SUPPORT
+  errorCount += 4096 * testKtlsGet (MHD_USE_SELECT_INTERNALLY |
+                                    MHD_USE_EPOLL_LINUX_ONLY);
+#endif
+  if (0 != errorCount)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  curl_global_cleanup ();
+  (void) unlink (filename);
+  return errorCount != 0;       /* 0 == pass */
+}
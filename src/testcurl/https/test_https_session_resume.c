@@ -0,0 +1,247 @@
+/*
+ This file is part of libmicrohttpd
+ (C) 2015 Christian Grothoff
+
+ libmicrohttpd is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 2, or (at your
+ option) any later version.
+
+ libmicrohttpd is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with libmicrohttpd; see the file COPYING.  If not, write to the
+ Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * @file test_https_session_resume.c
+ * @brief  Testcase for TLS session resumption with session tickets
+ *         and the session cache, across the workers of a thread pool;
+ *         uses a GnuTLS client, as curl does not always offer tickets
+ * @author Christian Grothoff
+ */
+
+#include "platform.h"
+#include "microhttpd.h"
+#include <limits.h>
+#include <sys/stat.h>
+#include <gnutls/gnutls.h>
+#include "tls_test_common.h"
+
+extern const char srv_key_pem[];
+extern const char srv_self_signed_cert_pem[];
+
+/**
+ * Number of connections we make to each daemon.
+ */
+#define NUM_CONNECTIONS 8
+
+static int
+ahc_echo (void *cls,
+          struct MHD_Connection *connection,
+          const char *url,
+          const char *method,
+          const char *version,
+          const char *upload_data, size_t *upload_data_size,
+          void **unused)
+{
+  struct MHD_Response *response;
+  int ret;
+
+  response = MHD_create_response_from_buffer (strlen (test_data),
+                                              (void *) test_data,
+                                              MHD_RESPMEM_PERSISTENT);
+  ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+  MHD_destroy_response (response);
+  return ret;
+}
+
+
+/**
+ * Make one connection with a GnuTLS client, offering to resume
+ * the session in @a data (unless it is empty), and fetch "/".
+ *
+ * @param xcred client credentials
+ * @param priorities GnuTLS priority string of the client
+ * @param data session to offer, replaced with the new session
+ * @param resumed set to non-zero if the session was resumed
+ * @return 0 on success
+ */
+static int
+do_request (gnutls_certificate_credentials_t xcred,
+            const char *priorities,
+            gnutls_datum_t *data,
+            int *resumed)
+{
+  static const char request[] =
+    "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+  gnutls_session_t session;
+  struct sockaddr_in sa;
+  char buf[1024];
+  size_t pos;
+  ssize_t got;
+  int fd;
+  int ret;
+
+  if (-1 == (fd = socket (AF_INET, SOCK_STREAM, 0)))
+    return 1;
+  memset (&sa, 0, sizeof (sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons (DEAMON_TEST_PORT + 8);
+  sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (0 != connect (fd, (struct sockaddr *) &sa, sizeof (sa)))
+    {
+      close (fd);
+      return 1;
+    }
+  gnutls_init (&session, GNUTLS_CLIENT);
+  gnutls_priority_set_direct (session, priorities, NULL);
+  gnutls_credentials_set (session, GNUTLS_CRD_CERTIFICATE, xcred);
+  if (NULL != data->data)
+    gnutls_session_set_data (session, data->data, data->size);
+  gnutls_transport_set_ptr (session, (gnutls_transport_ptr_t) (intptr_t) fd);
+  do
+    ret = gnutls_handshake (session);
+  while ( (ret < 0) && (0 == gnutls_error_is_fatal (ret)) );
+  if (ret < 0)
+    {
+      fprintf (stderr, "Handshake failed: %s\n", gnutls_strerror (ret));
+      ret = 2;
+      goto cleanup;
+    }
+  if (sizeof (request) - 1 !=
+      gnutls_record_send (session, request, sizeof (request) - 1))
+    {
+      ret = 2;
+      goto cleanup;
+    }
+  /* read the whole response, but not up to the end of the stream:
+     MHD closes without a TLS close_notify, after which GnuTLS no
+     longer considers the session resumable */
+  pos = 0;
+  buf[0] = '\0';
+  while ( (NULL == strstr (buf, "\r\n\r\n" test_data)) &&
+          (pos < sizeof (buf) - 1) &&
+          ( (got = gnutls_record_recv (session, &buf[pos],
+                                       sizeof (buf) - 1 - pos)) > 0) )
+    {
+      pos += got;
+      buf[pos] = '\0';
+    }
+  if ( (0 != strncmp (buf, "HTTP/1.1 200", strlen ("HTTP/1.1 200"))) ||
+       (NULL == strstr (buf, "\r\n\r\n" test_data)) )
+    {
+      ret = 4;
+      goto cleanup;
+    }
+  *resumed = gnutls_session_is_resumed (session);
+  if (NULL != data->data)
+    gnutls_free (data->data);
+  data->data = NULL;
+  data->size = 0;
+  ret = (GNUTLS_E_SUCCESS == gnutls_session_get_data2 (session, data)) ? 0 : 8;
+ cleanup:
+  gnutls_deinit (session);
+  close (fd);
+  return ret;
+}
+
+
+/**
+ * Connect @a NUM_CONNECTIONS times to a daemon with a thread pool,
+ * each time offering to resume the previous session, and check
+ * both what the client saw and the handshake counters of the daemon.
+ *
+ * @param tickets lifetime for #MHD_OPTION_HTTPS_SESSION_TICKETS
+ * @param cache_size size for #MHD_OPTION_HTTPS_SESSION_CACHE_SIZE
+ * @param priorities GnuTLS priority string of the client
+ * @return 0 on success
+ */
+static int
+testResume (unsigned int tickets,
+            unsigned int cache_size,
+            const char *priorities)
+{
+  struct MHD_Daemon *d;
+  struct MHD_DaemonStats stats;
+  gnutls_certificate_credentials_t xcred;
+  gnutls_datum_t data;
+  unsigned int i;
+  unsigned int resumed;
+  int r;
+  int ret;
+
+  d = MHD_start_daemon (MHD_USE_DEBUG | MHD_USE_SSL |
+                        MHD_USE_SELECT_INTERNALLY,
+                        DEAMON_TEST_PORT + 8, NULL, NULL, &ahc_echo, NULL,
+                        MHD_OPTION_HTTPS_MEM_KEY, srv_key_pem,
+                        MHD_OPTION_HTTPS_MEM_CERT, srv_self_signed_cert_pem,
+                        MHD_OPTION_THREAD_POOL_SIZE, 4,
+                        MHD_OPTION_HTTPS_SESSION_TICKETS, tickets,
+                        MHD_OPTION_HTTPS_SESSION_CACHE_SIZE, cache_size,
+                        MHD_OPTION_END);
+  if (NULL == d)
+    return 1;
+  gnutls_certificate_allocate_credentials (&xcred);
+  data.data = NULL;
+  data.size = 0;
+  resumed = 0;
+  ret = 0;
+  for (i = 0; i < NUM_CONNECTIONS; i++)
+    {
+      r = 0;
+      if (0 != (ret = do_request (xcred, priorities, &data, &r)))
+        break;
+      if (0 != r)
+        resumed++;
+    }
+  if (NULL != data.data)
+    gnutls_free (data.data);
+  gnutls_certificate_free_credentials (xcred);
+  if (MHD_YES != MHD_get_daemon_stats (d, &stats))
+    ret = 16;
+  MHD_stop_daemon (d);
+  if (0 != ret)
+    return ret;
+  /* without resumption every handshake is a full one, otherwise
+     only the first one is */
+  if ( (0 == tickets) && (0 == cache_size) )
+    i = 0;
+  else
+    i = NUM_CONNECTIONS - 1;
+  if ( (resumed != i) ||
+       (stats.tls_handshakes_resumed != i) ||
+       (stats.tls_handshakes_full != NUM_CONNECTIONS - i) )
+    {
+      fprintf (stderr,
+               "%u resumed by the client, %llu full and %llu resumed by MHD\n",
+               resumed,
+               (unsigned long long) stats.tls_handshakes_full,
+               (unsigned long long) stats.tls_handshakes_resumed);
+      return 32;
+    }
+  return 0;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+
+  gnutls_global_init ();
+  errorCount += testResume (0, 0, "NORMAL");
+  errorCount += 64 * testResume (3600, 0, "NORMAL");
+  /* resumption by session ID only exists up to TLS 1.2 */
+  errorCount += 4096 * testResume (0, 1000,
+                                   "NORMAL:-VERS-ALL:+VERS-TLS1.2:%NO_TICKETS");
+  if (0 != errorCount)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  gnutls_global_deinit ();
+  return errorCount != 0;
+}
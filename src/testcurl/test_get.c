@@ -258,6 +258,209 @@ testMultithreadedPoolGet (int poll_flag)
 }
 
 
+/**
+ * Perform @a count GET requests for "/hello_world", each on a new
+ * connection, and check the responses.
+ *
+ * @param url URL to request
+ * @param count number of requests
+ * @return 0 on success, 1 if a request failed, 2 if a response
+ *         had the wrong body
+ */
+static int
+getOnFreshConnections (const char *url,
+                       unsigned int count)
+{
+  CURL *c;
+  char buf[2048];
+  struct CBC cbc;
+  CURLcode errornum;
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+    {
+      cbc.buf = buf;
+      cbc.size = 2048;
+      cbc.pos = 0;
+      c = curl_easy_init ();
+      curl_easy_setopt (c, CURLOPT_URL, url);
+      curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+      curl_easy_setopt (c, CURLOPT_WRITEDATA, &cbc);
+      curl_easy_setopt (c, CURLOPT_FAILONERROR, 1);
+      curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+      if (oneone)
+        curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+      else
+        curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
+      curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+      curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1);
+      errornum = curl_easy_perform (c);
+      curl_easy_cleanup (c);
+      if (CURLE_OK != errornum)
+        {
+          fprintf (stderr,
+                   "curl_easy_perform failed: `%s'\n",
+                   curl_easy_strerror (errornum));
+          return 1;
+        }
+      if ( (cbc.pos != strlen ("/hello_world")) ||
+           (0 != strncmp ("/hello_world", cbc.buf, strlen ("/hello_world"))) )
+        return 2;
+    }
+  return 0;
+}
+
+
+#ifdef LINUX
+static int
+testReusePortPoolGet (int poll_flag)
+{
+  struct MHD_Daemon *d;
+  char url[64];
+  int ret;
+  /* SO_REUSEPORT would let concurrently running tests (test_get
+     and test_get11) share the port, so use a distinct one each */
+  uint16_t port = oneone ? 1084 : 1083;
+
+  snprintf (url, sizeof (url), "http://127.0.0.1:%u/hello_world",
+            (unsigned int) port);
+  d = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG | poll_flag,
+                        port, NULL, NULL, &ahc_echo, "GET",
+                        MHD_OPTION_THREAD_POOL_SIZE, CPU_COUNT,
+                        MHD_OPTION_THREAD_POOL_REUSEPORT, 2,
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 16;
+  /* use a fresh connection each time, so that the requests
+     are distributed over the listen sockets of the workers */
+  ret = getOnFreshConnections (url, 4 * CPU_COUNT);
+  MHD_stop_daemon (d);
+  if (1 == ret)
+    return 32;
+  if (2 == ret)
+    return 64;
+  return 0;
+}
+#endif
+
+
+static int
+testCachedConnectionsGet (int flags)
+{
+  struct MHD_Daemon *d;
+  char url[64];
+  int ret;
+  uint16_t port = oneone ? 1086 : 1085;
+
+  snprintf (url, sizeof (url), "http://127.0.0.1:%u/hello_world",
+            (unsigned int) port);
+  d = MHD_start_daemon (flags | MHD_USE_DEBUG,
+                        port, NULL, NULL, &ahc_echo, "GET",
+                        MHD_OPTION_CONNECTION_CACHE_SIZE, 2,
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 256;
+  /* each request on a new connection, so that closed connection
+     objects (and their memory pools) get recycled */
+  ret = getOnFreshConnections (url, 8);
+  if (0 != ret)
+    {
+      MHD_stop_daemon (d);
+      return (1 == ret) ? 512 : 1024;
+    }
+  MHD_stop_daemon (d);
+  return 0;
+}
+
+
+static int
+testDaemonStats (int flags)
+{
+  struct MHD_Daemon *d;
+  char url[64];
+  int ret;
+  uint16_t port = oneone ? 1095 : 1094;
+  struct MHD_DaemonStats stats;
+
+  snprintf (url, sizeof (url), "http://127.0.0.1:%u/hello_world",
+            (unsigned int) port);
+  d = MHD_start_daemon (flags | MHD_USE_DEBUG,
+                        port, NULL, NULL, &ahc_echo, "GET",
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 256;
+  ret = getOnFreshConnections (url, 8);
+  if (0 != ret)
+    {
+      MHD_stop_daemon (d);
+      return (1 == ret) ? 512 : 1024;
+    }
+  if ( (MHD_YES != MHD_get_daemon_stats (d, &stats)) ||
+       (stats.connections_accepted < 8) ||
+       (stats.requests < 8) ||
+       (stats.bytes_received == 0) ||
+       (stats.bytes_sent < 8 * strlen ("/hello_world")) ||
+       (stats.suspended_connections != 0) )
+    {
+      fprintf (stderr,
+               "Unexpected daemon statistics: %llu accepted, %llu requests, %llu bytes sent\n",
+               (unsigned long long) stats.connections_accepted,
+               (unsigned long long) stats.requests,
+               (unsigned long long) stats.bytes_sent);
+      MHD_stop_daemon (d);
+      return 2048;
+    }
+  MHD_stop_daemon (d);
+  return 0;
+}
+
+
+static int
+testLatencyHistogram (int flags)
+{
+  struct MHD_Daemon *d;
+  char url[64];
+  int ret;
+  uint16_t port = oneone ? 1097 : 1096;
+  const union MHD_DaemonInfo *info;
+
+  snprintf (url, sizeof (url), "http://127.0.0.1:%u/hello_world",
+            (unsigned int) port);
+  d = MHD_start_daemon (flags | MHD_USE_DEBUG,
+                        port, NULL, NULL, &ahc_echo, "GET",
+                        MHD_OPTION_LATENCY_HISTOGRAMS, 1,
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 256;
+  ret = getOnFreshConnections (url, 8);
+  if (0 != ret)
+    {
+      MHD_stop_daemon (d);
+      return (1 == ret) ? 512 : 1024;
+    }
+  /* the last request may not be recorded yet */
+  info = MHD_get_daemon_info (d, MHD_DAEMON_INFO_LATENCY_HISTOGRAM,
+                              MHD_LATENCY_PHASE_REQUEST);
+  if ( (NULL == info) ||
+       (info->latency_histogram->count < 7) ||
+       (info->latency_histogram->count > 8) ||
+       (MHD_latency_histogram_percentile (info->latency_histogram, 50.0) >
+        info->latency_histogram->max) )
+    {
+      MHD_stop_daemon (d);
+      return 4096;
+    }
+  if (NULL != MHD_get_daemon_info (d, MHD_DAEMON_INFO_LATENCY_HISTOGRAM,
+                                   MHD_LATENCY_PHASE_COUNT))
+    {
+      MHD_stop_daemon (d);
+      return 4096;
+    }
+  MHD_stop_daemon (d);
+  return 0;
+}
+
+
 static int
 testExternalGet ()
 {
@@ -501,6 +704,91 @@ testStopRace (int poll_flag)
 }
 
 
+#ifndef WINDOWS
+static int
+testPipelinedGet (int poll_flag)
+{
+  struct sockaddr_in sin;
+  struct timeval tv;
+  struct MHD_Daemon *d;
+  struct MHD_DaemonStats stats;
+  MHD_socket fd;
+  char req[1024];
+  char buf[4096];
+  size_t off;
+  size_t pos;
+  ssize_t ret;
+  const char *p;
+  char url[32];
+  unsigned int i;
+
+  d = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG | poll_flag,
+                        1087, NULL, NULL, &ahc_echo, "GET",
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 67108864;
+  /* eight requests in one go, the last one asks us to close */
+  off = 0;
+  for (i = 0; i < 8; i++)
+    off += snprintf (&req[off], sizeof (req) - off,
+                     "GET /pipe%u HTTP/1.1\r\nHost: 127.0.0.1\r\n%s\r\n",
+                     i, (7 == i) ? "Connection: close\r\n" : "");
+  fd = socket (PF_INET, SOCK_STREAM, 0);
+  if (fd == MHD_INVALID_SOCKET)
+    {
+      MHD_stop_daemon (d);
+      return 134217728;
+    }
+  memset (&sin, 0, sizeof (sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (1087);
+  sin.sin_addr.s_addr = htonl (0x7f000001);
+  tv.tv_sec = 5;
+  tv.tv_usec = 0;
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+  if ( (connect (fd, (struct sockaddr *) &sin, sizeof (sin)) < 0) ||
+       (send (fd, req, off, 0) != (ssize_t) off) )
+    {
+      MHD_socket_close_ (fd);
+      MHD_stop_daemon (d);
+      return 134217728;
+    }
+  pos = 0;
+  while ( (pos < sizeof (buf) - 1) &&
+          (0 < (ret = recv (fd, &buf[pos], sizeof (buf) - 1 - pos, 0))) )
+    pos += ret;
+  buf[pos] = '\0';
+  MHD_socket_close_ (fd);
+  if ( (MHD_NO == MHD_get_daemon_stats (d, &stats)) ||
+       (8 != stats.requests) ||
+       (7 != stats.keepalive_reuses) )
+    {
+      MHD_stop_daemon (d);
+      return 268435456;
+    }
+  MHD_stop_daemon (d);
+  /* all responses must be there, complete and in order */
+  p = buf;
+  for (i = 0; i < 8; i++)
+    {
+      snprintf (url, sizeof (url), "\r\n\r\n/pipe%u", i);
+      if ( (0 != strncmp (p, "HTTP/1.1 200 OK\r\n", 17)) ||
+           (NULL == (p = strstr (p, url))) )
+        {
+          fprintf (stderr,
+                   "Pipelined response %u missing in `%s'\n",
+                   i, buf);
+          return 536870912;
+        }
+      p += strlen (url);
+    }
+  if ('\0' != *p)
+    return 536870912;
+  return 0;
+}
+#endif
+
+
 static int
 ahc_empty (void *cls,
           struct MHD_Connection *connection,
@@ -612,10 +900,22 @@ main (int argc, char *const *argv)
   errorCount += testInternalGet (0);
   errorCount += testMultithreadedGet (0);
   errorCount += testMultithreadedPoolGet (0);
+#ifdef LINUX
+  errorCount += testReusePortPoolGet (0);
+#endif
+  errorCount += testCachedConnectionsGet (MHD_USE_SELECT_INTERNALLY);
+  errorCount += testCachedConnectionsGet (MHD_USE_THREAD_PER_CONNECTION);
+  errorCount += testDaemonStats (MHD_USE_SELECT_INTERNALLY);
+  errorCount += testLatencyHistogram (MHD_USE_SELECT_INTERNALLY);
+  errorCount += testDaemonStats (MHD_USE_THREAD_PER_CONNECTION);
+  errorCount += testLatencyHistogram (MHD_USE_THREAD_PER_CONNECTION);
   errorCount += testUnknownPortGet (0);
   errorCount += testStopRace (0);
   errorCount += testExternalGet ();
   errorCount += testEmptyGet (0);
+#ifndef WINDOWS
+  errorCount += testPipelinedGet (0);
+#endif
 #ifndef WINDOWS
   errorCount += testInternalGet (MHD_USE_POLL);
   errorCount += testMultithreadedGet (MHD_USE_POLL);
@@ -623,12 +923,28 @@ main (int argc, char *const *argv)
   errorCount += testUnknownPortGet (MHD_USE_POLL);
   errorCount += testStopRace (MHD_USE_POLL);
   errorCount += testEmptyGet (MHD_USE_POLL);
+  errorCount += testPipelinedGet (MHD_USE_POLL);
 #endif
 #if EPOLL_SUPPORT
   errorCount += testInternalGet (MHD_USE_EPOLL_LINUX_ONLY);
   errorCount += testMultithreadedPoolGet (MHD_USE_EPOLL_LINUX_ONLY);
+  errorCount += testReusePortPoolGet (MHD_USE_EPOLL_LINUX_ONLY);
+  errorCount += testCachedConnectionsGet (MHD_USE_SELECT_INTERNALLY | MHD_USE_EPOLL_LINUX_ONLY);
+  errorCount += testDaemonStats (MHD_USE_SELECT_INTERNALLY | MHD_USE_EPOLL_LINUX_ONLY);
+  errorCount += testLatencyHistogram (MHD_USE_SELECT_INTERNALLY | MHD_USE_EPOLL_LINUX_ONLY);
   errorCount += testUnknownPortGet (MHD_USE_EPOLL_LINUX_ONLY);
   errorCount += testEmptyGet (MHD_USE_EPOLL_LINUX_ONLY);
+  errorCount += testPipelinedGet (MHD_USE_EPOLL_LINUX_ONLY);
+#endif
+#if IO_URING_SUPPORT
+  errorCount += testInternalGet (MHD_USE_IO_URING);
+  errorCount += testMultithreadedPoolGet (MHD_USE_IO_URING);
+  errorCount += testReusePortPoolGet (MHD_USE_IO_URING);
+  errorCount += testCachedConnectionsGet (MHD_USE_SELECT_INTERNALLY | MHD_USE_IO_URING);
+  errorCount += testDaemonStats (MHD_USE_SELECT_INTERNALLY | MHD_USE_IO_URING);
+  errorCount += testLatencyHistogram (MHD_USE_SELECT_INTERNALLY | MHD_USE_IO_URING);
+  errorCount += testEmptyGet (MHD_USE_IO_URING);
+  errorCount += testPipelinedGet (MHD_USE_IO_URING);
 #endif
   if (errorCount != 0)
     fprintf (stderr, "Error (code: %u)\n", errorCount);
@@ -0,0 +1,302 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_get_compressed.c
+ * @brief  Testcase for GET operations with compressed responses
+ *         (MHD_RF_COMPRESS); curl decodes the bodies for us
+ * @author Christian Grothoff
+ */
+
+#include "MHD_config.h"
+#include "platform.h"
+#include <curl/curl.h>
+#include <microhttpd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+/**
+ * Size of the body of the buffer response.
+ */
+#define BODY_SIZE (16 * 1024)
+
+/**
+ * Size of the body of the callback response.
+ */
+#define STREAM_SIZE (128 * 10)
+
+struct CBC
+{
+  char *buf;
+  size_t pos;
+  size_t size;
+};
+
+/**
+ * Body of the buffer response.
+ */
+static char body[BODY_SIZE];
+
+/**
+ * Buffer response shared by all requests for "/buffer".
+ */
+static struct MHD_Response *shared;
+
+static size_t
+copyBuffer (void *ptr, size_t size, size_t nmemb, void *ctx)
+{
+  struct CBC *cbc = ctx;
+
+  if (cbc->pos + size * nmemb > cbc->size)
+    return 0;                   /* overflow */
+  memcpy (&cbc->buf[cbc->pos], ptr, size * nmemb);
+  cbc->pos += size * nmemb;
+  return size * nmemb;
+}
+
+/**
+ * MHD content reader callback that returns
+ * data in chunks.
+ */
+static ssize_t
+crc (void *cls, uint64_t pos, char *buf, size_t max)
+{
+  if (pos == STREAM_SIZE)
+    return MHD_CONTENT_READER_END_OF_STREAM;
+  if (max < 128)
+    abort ();                   /* should not happen in this testcase... */
+  memset (buf, 'A' + (pos / 128), 128);
+  return 128;
+}
+
+static int
+ahc_echo (void *cls,
+          struct MHD_Connection *connection,
+          const char *url,
+          const char *method,
+          const char *version,
+          const char *upload_data, size_t *upload_data_size, void **ptr)
+{
+  static int aptr;
+  struct MHD_Response *response;
+  int ret;
+
+  if (0 != strcmp ("GET", method))
+    return MHD_NO;              /* unexpected method */
+  if (&aptr != *ptr)
+    {
+      /* do never respond on first call */
+      *ptr = &aptr;
+      return MHD_YES;
+    }
+  *ptr = NULL;
+  if (0 == strcmp (url, "/buffer"))
+    return MHD_queue_response (connection, MHD_HTTP_OK, shared);
+  response = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN,
+                                                1024,
+                                                &crc, NULL, NULL);
+  if ( (NULL == response) ||
+       (MHD_YES != MHD_set_response_options (response,
+                                             MHD_RF_COMPRESS,
+                                             MHD_RO_END)) )
+    abort ();
+  ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+  MHD_destroy_response (response);
+  return ret;
+}
+
+static int
+validate_stream (struct CBC *cbc)
+{
+  unsigned int i;
+  char buf[128];
+
+  if (cbc->pos != STREAM_SIZE)
+    return 1;
+  for (i = 0; i < 10; i++)
+    {
+      memset (buf, 'A' + i, 128);
+      if (0 != memcmp (buf, &cbc->buf[i * 128], 128))
+        return 1;
+    }
+  return 0;
+}
+
+/**
+ * Request @a url, asking for @a accept_encoding, and check that
+ * the response used @a coding and decodes to the right body.
+ *
+ * @param url "/buffer" or "/stream"
+ * @param accept_encoding "Accept-Encoding" to send, NULL for none
+ * @param coding expected "Content-Encoding", NULL for none
+ * @param ebase base of the error code to return
+ * @return 0 on success
+ */
+static int
+testGet (const char *url,
+         const char *accept_encoding,
+         const char *coding,
+         int ebase)
+{
+  CURL *c;
+  char buf[BODY_SIZE];
+  char hdr[2048];
+  char line[128];
+  struct CBC cbc;
+  struct CBC hbc;
+  struct curl_slist *headers;
+  CURLcode errornum;
+  char full_url[64];
+  const char *cl;
+
+  cbc.buf = buf;
+  cbc.size = sizeof (buf);
+  cbc.pos = 0;
+  hbc.buf = hdr;
+  hbc.size = sizeof (hdr) - 1;
+  hbc.pos = 0;
+  headers = NULL;
+  snprintf (full_url, sizeof (full_url), "http://127.0.0.1:1088%s", url);
+  c = curl_easy_init ();
+  curl_easy_setopt (c, CURLOPT_URL, full_url);
+  curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_WRITEDATA, &cbc);
+  curl_easy_setopt (c, CURLOPT_HEADERFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_HEADERDATA, &hbc);
+  /* let curl decode, but send our own header */
+  curl_easy_setopt (c, CURLOPT_ACCEPT_ENCODING, "");
+  snprintf (line, sizeof (line), "Accept-Encoding:%s%s",
+            (NULL == accept_encoding) ? "" : " ",
+            (NULL == accept_encoding) ? "" : accept_encoding);
+  headers = curl_slist_append (headers, line);
+  curl_easy_setopt (c, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt (c, CURLOPT_FAILONERROR, 1);
+  curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+  // NOTE: use of CONNECTTIMEOUT without also
+  //   setting NOSIGNAL results in really weird
+  //   crashes on my system!
+  curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1);
+  errornum = curl_easy_perform (c);
+  curl_easy_cleanup (c);
+  curl_slist_free_all (headers);
+  if (CURLE_OK != errornum)
+    {
+      fprintf (stderr,
+               "curl_easy_perform failed: `%s'\n",
+               curl_easy_strerror (errornum));
+      return ebase;
+    }
+  hdr[hbc.pos] = '\0';
+  if (NULL == strstr (hdr, "Vary: Accept-Encoding\r\n"))
+    return ebase * 2;
+  if (NULL == coding)
+    {
+      if (NULL != strstr (hdr, "Content-Encoding:"))
+        return ebase * 2;
+    }
+  else
+    {
+      snprintf (line, sizeof (line), "Content-Encoding: %s\r\n", coding);
+      if (NULL == strstr (hdr, line))
+        {
+          fprintf (stderr, "Expected `%s' in headers `%s'\n", coding, hdr);
+          return ebase * 2;
+        }
+    }
+  if (0 == strcmp (url, "/stream"))
+    return validate_stream (&cbc) ? ebase * 4 : 0;
+  if ( (cbc.pos != BODY_SIZE) ||
+       (0 != memcmp (buf, body, BODY_SIZE)) )
+    return ebase * 4;
+  /* the compressed body must be (much) smaller */
+  cl = strstr (hdr, "Content-Length: ");
+  if ( (NULL == cl) ||
+       ( (NULL != coding) &&
+         (atoi (cl + strlen ("Content-Length: ")) >= BODY_SIZE / 4) ) )
+    return ebase * 8;
+  return 0;
+}
+
+static int
+testCompressedGet (int poll_flag)
+{
+  struct MHD_Daemon *d;
+  int errorCount;
+
+  d = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG | poll_flag,
+                        1088, NULL, NULL, &ahc_echo, NULL, MHD_OPTION_END);
+  if (d == NULL)
+    return 1;
+  errorCount = 0;
+  errorCount += testGet ("/buffer", "gzip", "gzip", 2);
+  /* now served from the cached variant */
+  errorCount += testGet ("/buffer", "gzip, deflate", "gzip", 16);
+  errorCount += testGet ("/buffer", "deflate", "deflate", 128);
+  errorCount += testGet ("/buffer", "gzip;q=0, deflate;q=0.5", "deflate", 1024);
+  errorCount += testGet ("/buffer", "identity", NULL, 8192);
+  errorCount += testGet ("/buffer", NULL, NULL, 65536);
+  errorCount += testGet ("/stream", "gzip", "gzip", 524288);
+  errorCount += testGet ("/stream", "*;q=0", NULL, 4194304);
+  MHD_stop_daemon (d);
+  return errorCount;
+}
+
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+  unsigned int i;
+
+  if (MHD_YES != MHD_is_feature_supported (MHD_FEATURE_COMPRESSION))
+    return 77;                  /* skip, built without zlib */
+  if (0 != curl_global_init (CURL_GLOBAL_WIN32))
+    return 2;
+  for (i = 0; i < BODY_SIZE; i++)
+    body[i] = "The quick brown fox jumps over the lazy dog.\n"[i % 45];
+  shared = MHD_create_response_from_buffer (BODY_SIZE,
+                                            body,
+                                            MHD_RESPMEM_PERSISTENT);
+  if ( (NULL == shared) ||
+       (MHD_YES != MHD_set_response_options (shared,
+                                             MHD_RF_COMPRESS,
+                                             MHD_RO_END)) )
+    return 2;
+  errorCount += testCompressedGet (0);
+#ifndef WINDOWS
+  errorCount += testCompressedGet (MHD_USE_POLL);
+#endif
+#if EPOLL_SUPPORT
+  errorCount += testCompressedGet (MHD_USE_EPOLL_LINUX_ONLY);
+#endif
+  MHD_destroy_response (shared);
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  curl_global_cleanup ();
+  return errorCount != 0;       /* 0 == pass */
+}
@@ -0,0 +1,383 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_get_range.c
+ * @brief  Testcase for "Range" requests answered from shared
+ *         buffer and file descriptor responses
+ * @author Christian Grothoff
+ */
+
+#include "MHD_config.h"
+#include "platform.h"
+#include <curl/curl.h>
+#include <microhttpd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/**
+ * Size of the body of the responses.
+ */
+#define BODY_SIZE 1000
+
+struct CBC
+{
+  char *buf;
+  size_t pos;
+  size_t size;
+};
+
+/**
+ * Body of the responses.
+ */
+static char body[BODY_SIZE];
+
+/**
+ * Response for "/buffer".
+ */
+static struct MHD_Response *buffer_response;
+
+/**
+ * Response for "/file".
+ */
+static struct MHD_Response *file_response;
+
+static size_t
+copyBuffer (void *ptr, size_t size, size_t nmemb, void *ctx)
+{
+  struct CBC *cbc = ctx;
+
+  if (cbc->pos + size * nmemb > cbc->size)
+    return 0;                   /* overflow */
+  memcpy (&cbc->buf[cbc->pos], ptr, size * nmemb);
+  cbc->pos += size * nmemb;
+  return size * nmemb;
+}
+
+static int
+ahc_echo (void *cls,
+          struct MHD_Connection *connection,
+          const char *url,
+          const char *method,
+          const char *version,
+          const char *upload_data, size_t *upload_data_size,
+          void **unused)
+{
+  if (0 != strcmp ("GET", method))
+    return MHD_NO;              /* unexpected method */
+  return MHD_queue_response (connection,
+                             MHD_HTTP_OK,
+                             (0 == strcmp (url, "/file"))
+                             ? file_response
+                             : buffer_response);
+}
+
+/**
+ * Request @a url with the request headers @a h1 and @a h2 (may
+ * be NULL) and store the response in @a cbc and @a hbc.
+ *
+ * @return HTTP status code, 0 on error
+ */
+static long
+request (const char *url,
+         const char *h1,
+         const char *h2,
+         struct CBC *cbc,
+         struct CBC *hbc)
+{
+  CURL *c;
+  char full_url[64];
+  struct curl_slist *headers;
+  CURLcode errornum;
+  long code;
+
+  cbc->pos = 0;
+  hbc->pos = 0;
+  headers = NULL;
+  snprintf (full_url, sizeof (full_url), "http://127.0.0.1:1091%s", url);
+  c = curl_easy_init ();
+  curl_easy_setopt (c, CURLOPT_URL, full_url);
+  curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_WRITEDATA, cbc);
+  curl_easy_setopt (c, CURLOPT_HEADERFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_HEADERDATA, hbc);
+  if (NULL != h1)
+    headers = curl_slist_append (headers, h1);
+  if (NULL != h2)
+    headers = curl_slist_append (headers, h2);
+  curl_easy_setopt (c, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+  // NOTE: use of CONNECTTIMEOUT without also
+  //   setting NOSIGNAL results in really weird
+  //   crashes on my system!
+  curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1);
+  errornum = curl_easy_perform (c);
+  code = 0;
+  if (CURLE_OK != errornum)
+    fprintf (stderr,
+             "curl_easy_perform failed: `%s'\n",
+             curl_easy_strerror (errornum));
+  else
+    curl_easy_getinfo (c, CURLINFO_RESPONSE_CODE, &code);
+  curl_easy_cleanup (c);
+  curl_slist_free_all (headers);
+  hbc->buf[hbc->pos] = '\0';
+  return code;
+}
+
+/**
+ * Request @a url with the request headers @a h1 and @a h2 and
+ * check the status code, the body (unless @a expect is NULL) and
+ * that the response headers contain @a expect_header (unless NULL).
+ *
+ * @return 0 on success
+ */
+static int
+testRange (const char *url,
+           const char *h1,
+           const char *h2,
+           long status,
+           const char *expect,
+           size_t expect_len,
+           const char *expect_header)
+{
+  char buf[2 * BODY_SIZE];
+  char hdr[2048];
+  struct CBC cbc;
+  struct CBC hbc;
+  long code;
+
+  cbc.buf = buf;
+  cbc.size = sizeof (buf);
+  hbc.buf = hdr;
+  hbc.size = sizeof (hdr) - 1;
+  code = request (url, h1, h2, &cbc, &hbc);
+  if ( (code != status) ||
+       ( (NULL != expect) &&
+         ( (cbc.pos != expect_len) ||
+           (0 != memcmp (buf, expect, expect_len)) ) ) ||
+       ( (NULL != expect_header) &&
+         (NULL == strstr (hdr, expect_header)) ) )
+    {
+      fprintf (stderr,
+               "Unexpected response to %s (%s): %ld, headers `%s'\n",
+               url,
+               (NULL == h2) ? "no range" : h2,
+               code,
+               hdr);
+      return 1;
+    }
+  return 0;
+}
+
+/**
+ * Request several ranges of @a url and check the
+ * "multipart/byteranges" body.
+ *
+ * @return 0 on success
+ */
+static int
+testMultipart (const char *url)
+{
+  static const char ctype[] =
+    "Content-Type: multipart/byteranges; boundary=";
+  char buf[2 * BODY_SIZE];
+  char hdr[2048];
+  char expect[1024];
+  char boundary[128];
+  const char *pos;
+  const char *end;
+  struct CBC cbc;
+  struct CBC hbc;
+  int len;
+
+  cbc.buf = buf;
+  cbc.size = sizeof (buf);
+  hbc.buf = hdr;
+  hbc.size = sizeof (hdr) - 1;
+  if ( (206 != request (url, NULL, "Range: bytes=0-9, 100-109, 995-",
+                        &cbc, &hbc)) ||
+       (NULL == (pos = strstr (hdr, ctype))) ||
+       (NULL == (end = strstr (pos, "\r\n"))) ||
+       (end - pos - strlen (ctype) >= sizeof (boundary)) )
+    {
+      fprintf (stderr, "Unexpected multipart response: `%s'\n", hdr);
+      return 1;
+    }
+  pos += strlen (ctype);
+  memcpy (boundary, pos, end - pos);
+  boundary[end - pos] = '\0';
+  len = snprintf (expect, sizeof (expect),
+                  "--%s\r\n"
+                  "Content-Type: text/plain\r\n"
+                  "Content-Range: bytes 0-9/1000\r\n\r\n%.10s\r\n"
+                  "--%s\r\n"
+                  "Content-Type: text/plain\r\n"
+                  "Content-Range: bytes 100-109/1000\r\n\r\n%.10s\r\n"
+                  "--%s\r\n"
+                  "Content-Type: text/plain\r\n"
+                  "Content-Range: bytes 995-999/1000\r\n\r\n%.5s\r\n"
+                  "--%s--\r\n",
+                  boundary, body,
+                  boundary, &body[100],
+                  boundary, &body[995],
+                  boundary);
+  if ( (cbc.pos != (size_t) len) ||
+       (0 != memcmp (buf, expect, len)) )
+    {
+      fprintf (stderr,
+               "Unexpected multipart body `%.*s'\n",
+               (int) cbc.pos, buf);
+      return 1;
+    }
+  return 0;
+}
+
+static int
+testRanges (const char *url)
+{
+  int errorCount = 0;
+
+  errorCount += testRange (url, NULL, NULL, 200, body, BODY_SIZE, NULL);
+  errorCount += testRange (url, NULL, "Range: bytes=0-99",
+                           206, body, 100,
+                           "Content-Range: bytes 0-99/1000\r\n");
+  errorCount += testRange (url, NULL, "Range: bytes=500-599",
+                           206, &body[500], 100,
+                           "Content-Length: 100\r\n");
+  errorCount += testRange (url, NULL, "Range: bytes=990-",
+                           206, &body[990], 10,
+                           "Content-Range: bytes 990-999/1000\r\n");
+  errorCount += testRange (url, NULL, "Range: bytes=-10",
+                           206, &body[990], 10,
+                           "Content-Range: bytes 990-999/1000\r\n");
+  errorCount += testRange (url, NULL, "Range: bytes=900-5000",
+                           206, &body[900], 100,
+                           "ETag: \"v1\"\r\n");
+  errorCount += testRange (url, NULL, "Range: bytes=1000-",
+                           416, NULL, 0,
+                           "Content-Range: bytes */1000\r\n");
+  /* malformed, ignored */
+  errorCount += testRange (url, NULL, "Range: bytes=20-10",
+                           200, body, BODY_SIZE, NULL);
+  errorCount += testRange (url, NULL, "Range: lines=1-2",
+                           200, body, BODY_SIZE, NULL);
+  /* only if the client's copy is current */
+  errorCount += testRange (url, "If-Range: \"v1\"", "Range: bytes=0-99",
+                           206, body, 100, NULL);
+  errorCount += testRange (url, "If-Range: \"v0\"", "Range: bytes=0-99",
+                           200, body, BODY_SIZE, NULL);
+  errorCount += testMultipart (url);
+  return errorCount;
+}
+
+static int
+testGetRange (int flags)
+{
+  struct MHD_Daemon *d;
+  int errorCount;
+
+  d = MHD_start_daemon (flags | MHD_USE_DEBUG,
+                        1091, NULL, NULL, &ahc_echo, NULL, MHD_OPTION_END);
+  if (NULL == d)
+    return 1;
+  errorCount = testRanges ("/buffer");
+  errorCount += testRanges ("/file");
+  MHD_stop_daemon (d);
+  return errorCount;
+}
+
+static struct MHD_Response *
+setup_response (struct MHD_Response *response)
+{
+  if ( (NULL == response) ||
+       (MHD_YES != MHD_add_response_header (response,
+                                            MHD_HTTP_HEADER_CONTENT_TYPE,
+                                            "text/plain")) ||
+       (MHD_YES != MHD_add_response_header (response,
+                                            MHD_HTTP_HEADER_ETAG,
+                                            "\"v1\"")) )
+    return NULL;
+  return response;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+  unsigned int i;
+  const char *tmp;
+  char fn[512];
+  int fd;
+
+  if ( (NULL == (tmp = getenv ("TMPDIR"))) &&
+       (NULL == (tmp = getenv ("TMP"))) &&
+       (NULL == (tmp = getenv ("TEMP"))) )
+    tmp = "/tmp";
+  snprintf (fn, sizeof (fn), "%s/test-mhd-range-%u",
+            tmp, (unsigned int) getpid ());
+  for (i = 0; i < BODY_SIZE; i++)
+    body[i] = 'A' + (i * 7) % 53;
+  fd = open (fn, O_CREAT | O_TRUNC | O_RDWR | O_BINARY, 0600);
+  if (-1 == fd)
+    return 2;
+  (void) unlink (fn);
+  if (BODY_SIZE != write (fd, body, BODY_SIZE))
+    return 2;
+  buffer_response
+    = setup_response (MHD_create_response_from_buffer (BODY_SIZE,
+                                                       body,
+                                                       MHD_RESPMEM_PERSISTENT));
+  file_response
+    = setup_response (MHD_create_response_from_fd (BODY_SIZE, fd));
+  if ( (NULL == buffer_response) ||
+       (NULL == file_response) )
+    return 2;
+  if (0 != curl_global_init (CURL_GLOBAL_WIN32))
+    return 2;
+  errorCount += testGetRange (MHD_USE_SELECT_INTERNALLY);
+  errorCount += testGetRange (MHD_USE_THREAD_PER_CONNECTION);
+#ifndef WINDOWS
+  errorCount += testGetRange (MHD_USE_SELECT_INTERNALLY | MHD_USE_POLL);
+#endif
+#if EPOLL_SUPPORT
+  errorCount += testGetRange (MHD_USE_SELECT_INTERNALLY
+                              | MHD_USE_EPOLL_LINUX_ONLY);
+#endif
+  MHD_destroy_response (buffer_response);
+  MHD_destroy_response (file_response);
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  curl_global_cleanup ();
+  return errorCount != 0;       /* 0 == pass */
+}
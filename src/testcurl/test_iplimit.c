@@ -299,6 +299,72 @@ testMultithreadedPoolGet ()
   return 0;
 }
 
+/**
+ * Connect from many different source addresses one after another,
+ * so that each shard of the table of the daemon sees far more
+ * addresses than it has slots.
+ */
+static int
+testChurnAddresses ()
+{
+  struct MHD_Daemon *d;
+  char buf[2048];
+  char ip[32];
+  struct CBC cbc;
+  CURL *c;
+  CURLcode errornum;
+  unsigned int i;
+
+  d = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG,
+                        1081, NULL, NULL, &ahc_echo, "GET",
+                        MHD_OPTION_PER_IP_CONNECTION_LIMIT, 2,
+                        MHD_OPTION_CONNECTION_LIMIT, 64,
+                        MHD_OPTION_THREAD_POOL_SIZE, CPU_COUNT,
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 1024;
+  for (i = 0; i < 2048; i++)
+    {
+      snprintf (ip, sizeof (ip), "127.1.%u.%u", i >> 8, i & 255);
+      cbc.buf = buf;
+      cbc.size = sizeof (buf);
+      cbc.pos = 0;
+      c = curl_easy_init ();
+      curl_easy_setopt (c, CURLOPT_URL, "http://127.0.0.1:1081/hello_world");
+      curl_easy_setopt (c, CURLOPT_INTERFACE, ip);
+      curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+      curl_easy_setopt (c, CURLOPT_WRITEDATA, &cbc);
+      curl_easy_setopt (c, CURLOPT_FAILONERROR, 1L);
+      curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+      curl_easy_setopt (c, CURLOPT_FORBID_REUSE, 1L);
+      curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
+      curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+      curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1L);
+      errornum = curl_easy_perform (c);
+      curl_easy_cleanup (c);
+      if ( (CURLE_INTERFACE_FAILED == errornum) &&
+           (0 == i) )
+        break; /* cannot bind to other loopback addresses here */
+      if (CURLE_OK != errornum)
+        {
+          fprintf (stderr,
+                   "curl_easy_perform from %s failed: `%s'\n",
+                   ip,
+                   curl_easy_strerror (errornum));
+          MHD_stop_daemon (d);
+          return 2048;
+        }
+      if ( (cbc.pos != strlen ("/hello_world")) ||
+           (0 != strncmp ("/hello_world", cbc.buf, strlen ("/hello_world"))) )
+        {
+          MHD_stop_daemon (d);
+          return 4096;
+        }
+    }
+  MHD_stop_daemon (d);
+  return 0;
+}
+
 int
 main (int argc, char *const *argv)
 {
@@ -309,6 +375,7 @@ main (int argc, char *const *argv)
     return 2;
   errorCount += testMultithreadedGet ();
   errorCount += testMultithreadedPoolGet ();
+  errorCount += testChurnAddresses ();
   if (errorCount != 0)
     fprintf (stderr, "Error (code: %u)\n", errorCount);
   curl_global_cleanup ();
@@ -115,12 +115,28 @@ ahc_echo (void *cls,
                                      MHD_HEADER_KIND, MHD_HTTP_HEADER_HOST);
   if ((hdr == NULL) || (0 != strcmp (hdr, "127.0.0.1:21080")))
     abort ();
+  /* header names are case-insensitive */
+  hdr = MHD_lookup_connection_value (connection,
+                                     MHD_HEADER_KIND, "hOST");
+  if ((hdr == NULL) || (0 != strcmp (hdr, "127.0.0.1:21080")))
+    abort ();
+  hdr = MHD_lookup_connection_value (connection,
+                                     MHD_GET_ARGUMENT_KIND, "Host");
+  if (hdr != NULL)
+    abort ();
   MHD_set_connection_value (connection,
                             MHD_HEADER_KIND, "FakeHeader", "NowPresent");
   hdr = MHD_lookup_connection_value (connection,
                                      MHD_HEADER_KIND, "FakeHeader");
   if ((hdr == NULL) || (0 != strcmp (hdr, "NowPresent")))
     abort ();
+  /* the first of several values with the same name wins */
+  MHD_set_connection_value (connection,
+                            MHD_HEADER_KIND, "fakeheader", "Shadowed");
+  hdr = MHD_lookup_connection_value (connection,
+                                     MHD_HEADER_KIND, "FAKEHEADER");
+  if ((hdr == NULL) || (0 != strcmp (hdr, "NowPresent")))
+    abort ();
 
   response = MHD_create_response_from_buffer (strlen (url),
 					      (void *) url,
@@ -417,6 +433,165 @@ testExternalGet ()
 
 
 
+/**
+ * Response shared by all requests of #testSharedResponse().
+ */
+static struct MHD_Response *shared;
+
+
+static ssize_t
+once_reader (void *cls, uint64_t pos, char *buf, size_t max)
+{
+  if (0 != pos)
+    return MHD_CONTENT_READER_END_OF_STREAM;
+  buf[0] = 'x';
+  return 1;
+}
+
+
+static int
+ahc_shared (void *cls,
+            struct MHD_Connection *connection,
+            const char *url,
+            const char *method,
+            const char *version,
+            const char *upload_data, size_t *upload_data_size,
+            void **unused)
+{
+  static int ptr;
+  struct MHD_Response *response;
+  int ret;
+
+  if (&ptr != *unused)
+    {
+      *unused = &ptr;
+      return MHD_YES;
+    }
+  *unused = NULL;
+  if (0 != strcmp (url, "/unknown"))
+    return MHD_queue_response (connection, MHD_HTTP_OK, shared);
+  response = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN,
+                                                1024,
+                                                &once_reader,
+                                                NULL,
+                                                NULL);
+  MHD_add_response_header (response, MHD_HTTP_HEADER_CONNECTION, "Keep-Alive");
+  ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+  MHD_destroy_response (response);
+  return ret;
+}
+
+
+/**
+ * Fetch @a url, storing the response headers in @a hdr.
+ *
+ * @return 0 on success
+ */
+static int
+getHeaders (CURL *c,
+            const char *url,
+            struct CBC *hdr)
+{
+  char buf[2048];
+  struct CBC cbc;
+
+  cbc.buf = buf;
+  cbc.size = sizeof (buf);
+  cbc.pos = 0;
+  hdr->pos = 0;
+  curl_easy_setopt (c, CURLOPT_URL, url);
+  curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_WRITEDATA, &cbc);
+  curl_easy_setopt (c, CURLOPT_HEADERFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_HEADERDATA, hdr);
+  curl_easy_setopt (c, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1L);
+  if (CURLE_OK != curl_easy_perform (c))
+    return 1;
+  if (hdr->pos == hdr->size)
+    return 2;
+  hdr->buf[hdr->pos] = '\0';
+  return 0;
+}
+
+
+/**
+ * Check that a response used for many requests keeps producing
+ * correct headers, also after its headers were changed.
+ */
+static int
+testSharedResponse ()
+{
+  struct MHD_Daemon *d;
+  CURL *c;
+  char buf[2048];
+  struct CBC hdr;
+  unsigned int i;
+  int ret;
+
+  hdr.buf = buf;
+  hdr.size = sizeof (buf);
+  shared = MHD_create_response_from_buffer (strlen ("shared"),
+                                            "shared",
+                                            MHD_RESPMEM_PERSISTENT);
+  if (NULL == shared)
+    return 32768;
+  MHD_add_response_header (shared, "X-Shared", "yes");
+  d = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG,
+                        21084, NULL, NULL, &ahc_shared, NULL, MHD_OPTION_END);
+  if (d == NULL)
+    {
+      MHD_destroy_response (shared);
+      return 65536;
+    }
+  c = curl_easy_init ();
+  if (oneone)
+    curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+  else
+    curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
+  ret = 0;
+  for (i = 0; i < 3; i++)
+    {
+      if (0 != getHeaders (c, "http://127.0.0.1:21084/", &hdr))
+        {
+          ret = 131072;
+          break;
+        }
+      if ( (NULL == strstr (buf, "\r\nX-Shared: yes\r\n")) ||
+           (NULL == strstr (buf, "\r\nContent-Length: 6\r\n")) ||
+           (NULL != strstr (strstr (buf, "X-Shared") + 1, "X-Shared")) )
+        {
+          ret = 262144;
+          break;
+        }
+      if ( (2 == i) &&
+           (NULL == strstr (buf, "\r\nX-Later: added\r\n")) )
+        {
+          ret = 524288;
+          break;
+        }
+      if (1 == i)
+        MHD_add_response_header (shared, "X-Later", "added");
+    }
+  if (0 == ret)
+    {
+      /* HTTP 1.0 with unknown size, so the application's keep-alive must go */
+      curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
+      if (0 != getHeaders (c, "http://127.0.0.1:21084/unknown", &hdr))
+        ret = 1048576;
+      else if ( (NULL == strstr (buf, "\r\nConnection: close\r\n")) ||
+                (NULL != strstr (buf, "Keep-Alive")) )
+        ret = 2097152;
+    }
+  curl_easy_cleanup (c);
+  MHD_stop_daemon (d);
+  MHD_destroy_response (shared);
+  return ret;
+}
+
+
 int
 main (int argc, char *const *argv)
 {
@@ -429,6 +604,7 @@ main (int argc, char *const *argv)
   errorCount += testMultithreadedGet ();
   errorCount += testMultithreadedPoolGet ();
   errorCount += testExternalGet ();
+  errorCount += testSharedResponse ();
   if (errorCount != 0)
     fprintf (stderr, "Error (code: %u)\n", errorCount);
   curl_global_cleanup ();
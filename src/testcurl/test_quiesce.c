@@ -38,6 +38,8 @@
 #ifndef WINDOWS
 #include <unistd.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #endif
 
 #if defined(CPU_COUNT) && (CPU_COUNT+0) < 2
@@ -305,6 +307,121 @@ testGet (int type, int pool_count, int poll_flag)
 }
 
 
+#ifdef LINUX
+/**
+ * Number of connections opened before quiescing.
+ */
+#define OPEN_CONNECTIONS (4 * CPU_COUNT)
+
+/**
+ * Quiesce a thread pool where every worker has its own listen
+ * socket: connections accepted before must still be served, and
+ * afterwards no worker may accept connections anymore.
+ */
+static int
+testReusePortGet (int poll_flag)
+{
+  struct MHD_Daemon *d;
+  CURL *c;
+  char buf[2048];
+  struct CBC cbc;
+  MHD_socket fd;
+  MHD_socket socks[OPEN_CONNECTIONS];
+  struct sockaddr_in sin;
+  static const char req[] = "GET /hello_world HTTP/1.0\r\n\r\n";
+  unsigned int i;
+  unsigned int failed;
+  ssize_t got;
+  size_t len;
+  int ret;
+
+  d = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG |
+                        MHD_USE_PIPE_FOR_SHUTDOWN | poll_flag,
+                        1098, NULL, NULL, &ahc_echo, "GET",
+                        MHD_OPTION_THREAD_POOL_SIZE, CPU_COUNT,
+                        MHD_OPTION_THREAD_POOL_REUSEPORT, 1,
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 32;
+  memset (&sin, 0, sizeof (sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (1098);
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  ret = 0;
+  for (i = 0; i < OPEN_CONNECTIONS; i++)
+    {
+      socks[i] = socket (AF_INET, SOCK_STREAM, 0);
+      if ( (MHD_INVALID_SOCKET == socks[i]) ||
+           (0 != connect (socks[i], (struct sockaddr *) &sin, sizeof (sin))) )
+        ret = 64;
+    }
+  /* let the workers accept the connections (the one on the socket
+     of the master would otherwise stay in its backlog) */
+  usleep (100000);
+  fd = MHD_quiesce_daemon (d);
+  if (MHD_INVALID_SOCKET == fd)
+    ret = 64;
+  for (i = 0; i < OPEN_CONNECTIONS; i++)
+    {
+      if (MHD_INVALID_SOCKET == socks[i])
+        continue;
+      if (sizeof (req) - 1 != send (socks[i], req, sizeof (req) - 1, 0))
+        ret = 64;
+      len = 0;
+      while ( (len < sizeof (buf) - 1) &&
+              (0 < (got = recv (socks[i], &buf[len], sizeof (buf) - 1 - len, 0))) )
+        len += got;
+      buf[len] = '\0';
+      if ( (NULL == strstr (buf, " 200 ")) ||
+           (len < strlen ("/hello_world")) ||
+           (0 != strcmp (&buf[len - strlen ("/hello_world")], "/hello_world")) )
+        {
+          fprintf (stderr, "Connection accepted before quiescing failed\n");
+          ret = 128;
+        }
+      MHD_socket_close_ (socks[i]);
+    }
+  if (0 != ret)
+    {
+      MHD_stop_daemon (d);
+      if (MHD_INVALID_SOCKET != fd)
+        MHD_socket_close_ (fd);
+      return ret;
+    }
+
+  /* the workers close their sockets once they wake up; then all
+     connections go to the socket we got back, where nobody accepts */
+  usleep (100000);
+  cbc.buf = buf;
+  cbc.size = 2048;
+  c = curl_easy_init ();
+  curl_easy_setopt (c, CURLOPT_URL, "http://127.0.0.1:1098/hello_world");
+  curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_WRITEDATA, &cbc);
+  curl_easy_setopt (c, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt (c, CURLOPT_TIMEOUT_MS, 150L);
+  curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT_MS, 150L);
+  curl_easy_setopt (c, CURLOPT_FORBID_REUSE, 1L);
+  curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1L);
+  for (failed = 0; failed < 8; failed++)
+    {
+      cbc.pos = 0;
+      if (CURLE_OK == curl_easy_perform (c))
+        break;
+    }
+  curl_easy_cleanup (c);
+  MHD_stop_daemon (d);
+  MHD_socket_close_ (fd);
+  if (failed < 8)
+    {
+      fprintf (stderr, "Worker accepted connections after quiescing\n");
+      return 256;
+    }
+  return 0;
+}
+#endif
+
+
 static int
 testExternalGet ()
 {
@@ -445,15 +562,27 @@ main (int argc, char *const *argv)
   errorCount += testGet (MHD_USE_SELECT_INTERNALLY, 0, 0);
   errorCount += testGet (MHD_USE_THREAD_PER_CONNECTION, 0, 0);
   errorCount += testGet (MHD_USE_SELECT_INTERNALLY, CPU_COUNT, 0);
+#ifdef LINUX
+  errorCount += testReusePortGet (0);
+#endif
   errorCount += testExternalGet ();
 #ifndef WINDOWS
   errorCount += testGet (MHD_USE_SELECT_INTERNALLY, 0, MHD_USE_POLL);
   errorCount += testGet (MHD_USE_THREAD_PER_CONNECTION, 0, MHD_USE_POLL);
   errorCount += testGet (MHD_USE_SELECT_INTERNALLY, CPU_COUNT, MHD_USE_POLL);
+#ifdef LINUX
+  errorCount += testReusePortGet (MHD_USE_POLL);
+#endif
 #endif
 #if EPOLL_SUPPORT
   errorCount += testGet (MHD_USE_SELECT_INTERNALLY, 0, MHD_USE_EPOLL_LINUX_ONLY);
   errorCount += testGet (MHD_USE_SELECT_INTERNALLY, CPU_COUNT, MHD_USE_EPOLL_LINUX_ONLY);
+  errorCount += testReusePortGet (MHD_USE_EPOLL_LINUX_ONLY);
+#endif
+#if IO_URING_SUPPORT
+  errorCount += testGet (MHD_USE_SELECT_INTERNALLY, 0, MHD_USE_IO_URING);
+  errorCount += testGet (MHD_USE_SELECT_INTERNALLY, CPU_COUNT, MHD_USE_IO_URING);
+  errorCount += testReusePortGet (MHD_USE_IO_URING);
 #endif
   if (errorCount != 0)
     fprintf (stderr, "Error (code: %u)\n", errorCount);
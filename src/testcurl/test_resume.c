@@ -0,0 +1,246 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_resume.c
+ * @brief  Testcase for suspending connections and resuming them
+ *         in a batch with MHD_resume_connections()
+ * @author Christian Grothoff
+ */
+
+#include "MHD_config.h"
+#include "platform.h"
+#include <curl/curl.h>
+#include <microhttpd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+/**
+ * Number of concurrent requests; all but the last one are
+ * suspended until the last one arrives.
+ */
+#define NUM_REQUESTS 8
+
+static int oneone;
+
+static struct MHD_Connection *suspended[NUM_REQUESTS];
+
+static unsigned int num_suspended;
+
+struct CBC
+{
+  char *buf;
+  size_t pos;
+  size_t size;
+};
+
+
+static size_t
+copyBuffer (void *ptr, size_t size, size_t nmemb, void *ctx)
+{
+  struct CBC *cbc = ctx;
+
+  if (cbc->pos + size * nmemb > cbc->size)
+    return 0;                   /* overflow */
+  memcpy (&cbc->buf[cbc->pos], ptr, size * nmemb);
+  cbc->pos += size * nmemb;
+  return size * nmemb;
+}
+
+
+static int
+ahc_echo (void *cls,
+          struct MHD_Connection *connection,
+          const char *url,
+          const char *method,
+          const char *version,
+          const char *upload_data, size_t *upload_data_size,
+          void **unused)
+{
+  static int first;
+  static int resumed;
+  struct MHD_Response *response;
+  int ret;
+
+  if (0 != strcmp ("GET", method))
+    return MHD_NO;              /* unexpected method */
+  if (NULL == *unused)
+    {
+      *unused = &first;
+      return MHD_YES;
+    }
+  if (&first == *unused)
+    {
+      if (num_suspended < NUM_REQUESTS - 1)
+        {
+          suspended[num_suspended++] = connection;
+          *unused = &resumed;
+          MHD_suspend_connection (connection);
+          return MHD_YES;
+        }
+      /* last request: wake up all the others at once */
+      MHD_resume_connections (suspended, num_suspended);
+      num_suspended = 0;
+    }
+  response = MHD_create_response_from_buffer (strlen (url),
+					      (void *) url,
+					      MHD_RESPMEM_MUST_COPY);
+  ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+  MHD_destroy_response (response);
+  return ret;
+}
+
+
+static int
+testBatchResume (int poll_flag)
+{
+  struct MHD_Daemon *d;
+  CURL *c[NUM_REQUESTS];
+  char buf[NUM_REQUESTS][2048];
+  struct CBC cbc[NUM_REQUESTS];
+  CURLM *multi;
+  fd_set rs;
+  fd_set ws;
+  fd_set es;
+  int max;
+  int running;
+  struct CURLMsg *msg;
+  time_t start;
+  struct timeval tv;
+  unsigned int i;
+  int ret;
+
+  num_suspended = 0;
+  d = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG |
+                        MHD_USE_SUSPEND_RESUME | MHD_USE_PIPE_FOR_SHUTDOWN |
+                        poll_flag,
+                        1090, NULL, NULL, &ahc_echo, NULL,
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 1;
+  multi = curl_multi_init ();
+  if (multi == NULL)
+    {
+      MHD_stop_daemon (d);
+      return 2;
+    }
+  for (i = 0; i < NUM_REQUESTS; i++)
+    {
+      cbc[i].buf = buf[i];
+      cbc[i].size = sizeof (buf[i]);
+      cbc[i].pos = 0;
+      c[i] = curl_easy_init ();
+      curl_easy_setopt (c[i], CURLOPT_URL, "http://127.0.0.1:1090/hello_world");
+      curl_easy_setopt (c[i], CURLOPT_WRITEFUNCTION, &copyBuffer);
+      curl_easy_setopt (c[i], CURLOPT_WRITEDATA, &cbc[i]);
+      curl_easy_setopt (c[i], CURLOPT_FAILONERROR, 1L);
+      curl_easy_setopt (c[i], CURLOPT_FRESH_CONNECT, 1L);
+      if (oneone)
+        curl_easy_setopt (c[i], CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+      else
+        curl_easy_setopt (c[i], CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
+      curl_easy_setopt (c[i], CURLOPT_TIMEOUT, 150L);
+      curl_easy_setopt (c[i], CURLOPT_CONNECTTIMEOUT, 150L);
+      curl_easy_setopt (c[i], CURLOPT_NOSIGNAL, 1L);
+      curl_multi_add_handle (multi, c[i]);
+    }
+  ret = 0;
+  running = NUM_REQUESTS;
+  start = time (NULL);
+  while ( (time (NULL) - start < 10) && (running > 0) )
+    {
+      max = 0;
+      FD_ZERO (&rs);
+      FD_ZERO (&ws);
+      FD_ZERO (&es);
+      curl_multi_perform (multi, &running);
+      if (CURLM_OK != curl_multi_fdset (multi, &rs, &ws, &es, &max))
+        {
+          ret = 4;
+          break;
+        }
+      tv.tv_sec = 0;
+      tv.tv_usec = 1000;
+      select (max + 1, &rs, &ws, &es, &tv);
+      curl_multi_perform (multi, &running);
+    }
+  if ( (0 == ret) && (0 != running) )
+    ret = 8; /* some request never completed */
+  while (NULL != (msg = curl_multi_info_read (multi, &running)))
+    if ( (CURLMSG_DONE == msg->msg) &&
+         (CURLE_OK != msg->data.result) )
+      {
+        printf ("%s failed at %s:%d: `%s'\n",
+                "curl_multi_perform",
+                __FILE__,
+                __LINE__, curl_easy_strerror (msg->data.result));
+        ret |= 16;
+      }
+  for (i = 0; i < NUM_REQUESTS; i++)
+    {
+      curl_multi_remove_handle (multi, c[i]);
+      curl_easy_cleanup (c[i]);
+      if ( (0 == ret) &&
+           ( (cbc[i].pos != strlen ("/hello_world")) ||
+             (0 != strncmp ("/hello_world", cbc[i].buf, strlen ("/hello_world"))) ) )
+        ret = 32;
+    }
+  curl_multi_cleanup (multi);
+  if (0 != num_suspended)
+    {
+      /* do not stop the daemon with suspended connections */
+      MHD_resume_connections (suspended, num_suspended);
+      (void) sleep (1);
+    }
+  MHD_stop_daemon (d);
+  if (0 != ret)
+    fprintf (stderr, "Batch resume failed with flags %d\n", poll_flag);
+  return ret;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+
+  oneone = NULL != strstr (argv[0], "11");
+  if (0 != curl_global_init (CURL_GLOBAL_WIN32))
+    return 2;
+  errorCount += testBatchResume (0);
+#ifndef WINDOWS
+  errorCount += testBatchResume (MHD_USE_POLL);
+#endif
+#if EPOLL_SUPPORT
+  errorCount += testBatchResume (MHD_USE_EPOLL_LINUX_ONLY);
+#endif
+#if IO_URING_SUPPORT
+  errorCount += testBatchResume (MHD_USE_IO_URING);
+#endif
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  curl_global_cleanup ();
+  return errorCount != 0;       /* 0 == pass */
+}
@@ -120,6 +120,10 @@ main (int argc, char *const *argv)
 #if EPOLL_SUPPORT
   errorCount += testInternalGet (MHD_USE_EPOLL_LINUX_ONLY);
   errorCount += testMultithreadedPoolGet (MHD_USE_EPOLL_LINUX_ONLY);
+#endif
+#if IO_URING_SUPPORT
+  errorCount += testInternalGet (MHD_USE_IO_URING);
+  errorCount += testMultithreadedPoolGet (MHD_USE_IO_URING);
 #endif
   if (errorCount != 0)
     fprintf (stderr, "Error (code: %u)\n", errorCount);
@@ -0,0 +1,313 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_static_files.c
+ * @brief  Testcase for MHD_static_files_handler(): cached files,
+ *         conditional requests and invalidation of changed files
+ * @author Christian Grothoff
+ */
+
+#include "MHD_config.h"
+#include "platform.h"
+#include <curl/curl.h>
+#include <microhttpd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+#define INDEX_STR "<html><body>Hello, static world!</body></html>"
+
+#define DATA_STR "Some data to be served from a file."
+
+#define DATA_STR2 "Other data, with a different length."
+
+struct CBC
+{
+  char *buf;
+  size_t pos;
+  size_t size;
+};
+
+/**
+ * Directory with the files we serve.
+ */
+static char dir[256];
+
+static size_t
+copyBuffer (void *ptr, size_t size, size_t nmemb, void *ctx)
+{
+  struct CBC *cbc = ctx;
+
+  if (cbc->pos + size * nmemb > cbc->size)
+    return 0;                   /* overflow */
+  memcpy (&cbc->buf[cbc->pos], ptr, size * nmemb);
+  cbc->pos += size * nmemb;
+  return size * nmemb;
+}
+
+static int
+write_file (const char *name, const char *data)
+{
+  char fn[512];
+  char tmp[512];
+  FILE *f;
+
+  /* replace the file like editors and deployment tools do */
+  snprintf (fn, sizeof (fn), "%s/%s", dir, name);
+  snprintf (tmp, sizeof (tmp), "%s/.%s.tmp", dir, name);
+  if (NULL == (f = fopen (tmp, "w")))
+    return 1;
+  if (strlen (data) != fwrite (data, 1, strlen (data), f))
+    {
+      fclose (f);
+      return 1;
+    }
+  fclose (f);
+  return (0 == rename (tmp, fn)) ? 0 : 1;
+}
+
+/**
+ * Copy the value of header @a name from the response
+ * headers in @a hdr to @a value.
+ */
+static int
+get_header (const char *hdr, const char *name, char *value, size_t size)
+{
+  const char *pos;
+  const char *end;
+
+  if (NULL == (pos = strstr (hdr, name)))
+    return 1;
+  pos += strlen (name);
+  if ( (':' != pos[0]) || (' ' != pos[1]) )
+    return 1;
+  pos += 2;
+  if ( (NULL == (end = strstr (pos, "\r\n"))) ||
+       ((size_t) (end - pos) >= size) )
+    return 1;
+  memcpy (value, pos, end - pos);
+  value[end - pos] = '\0';
+  return 0;
+}
+
+/**
+ * Run a request against our daemon.
+ *
+ * @param url path to request
+ * @param header extra request header, or NULL
+ * @param post data to POST, or NULL for a GET
+ * @param cbc where to store the body
+ * @param hdr where to store the response headers (0-terminated)
+ * @return HTTP status code, 0 on error
+ */
+static long
+request (const char *url, const char *header, const char *post,
+         struct CBC *cbc, struct CBC *hbc)
+{
+  CURL *c;
+  char full_url[128];
+  struct curl_slist *headers;
+  CURLcode errornum;
+  long code;
+
+  cbc->pos = 0;
+  hbc->pos = 0;
+  headers = NULL;
+  snprintf (full_url, sizeof (full_url), "http://127.0.0.1:1089%s", url);
+  c = curl_easy_init ();
+  curl_easy_setopt (c, CURLOPT_URL, full_url);
+  curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_WRITEDATA, cbc);
+  curl_easy_setopt (c, CURLOPT_HEADERFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_HEADERDATA, hbc);
+  if (NULL != header)
+    {
+      headers = curl_slist_append (headers, header);
+      curl_easy_setopt (c, CURLOPT_HTTPHEADER, headers);
+    }
+  if (NULL != post)
+    curl_easy_setopt (c, CURLOPT_POSTFIELDS, post);
+#if LIBCURL_VERSION_NUM >= 0x072a00
+  /* we want to send ".." to the server */
+  curl_easy_setopt (c, CURLOPT_PATH_AS_IS, 1L);
+#endif
+  curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+  // NOTE: use of CONNECTTIMEOUT without also
+  //   setting NOSIGNAL results in really weird
+  //   crashes on my system!
+  curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1);
+  errornum = curl_easy_perform (c);
+  code = 0;
+  if (CURLE_OK != errornum)
+    fprintf (stderr,
+             "curl_easy_perform failed: `%s'\n",
+             curl_easy_strerror (errornum));
+  else
+    curl_easy_getinfo (c, CURLINFO_RESPONSE_CODE, &code);
+  curl_easy_cleanup (c);
+  curl_slist_free_all (headers);
+  hbc->buf[hbc->pos] = '\0';
+  return code;
+}
+
+static int
+testStaticFiles (int flags)
+{
+  struct MHD_StaticFiles *sf;
+  struct MHD_Daemon *d;
+  char buf[2048];
+  char hdr[2048];
+  char etag[128];
+  char last_modified[128];
+  char line[256];
+  struct CBC cbc;
+  struct CBC hbc;
+
+  cbc.buf = buf;
+  cbc.size = sizeof (buf);
+  hbc.buf = hdr;
+  hbc.size = sizeof (hdr) - 1;
+  if ( (0 != write_file ("index.html", INDEX_STR)) ||
+       (0 != write_file ("data.txt", DATA_STR)) )
+    return 1;
+  sf = MHD_static_files_create (dir, 4);
+  if (NULL == sf)
+    return 2;
+  d = MHD_start_daemon (flags | MHD_USE_DEBUG,
+                        1089, NULL, NULL,
+                        &MHD_static_files_handler, sf, MHD_OPTION_END);
+  if (NULL == d)
+    {
+      MHD_static_files_destroy (sf);
+      return 4;
+    }
+
+  /* plain GET, then again from the cache */
+  if ( (200 != request ("/data.txt", NULL, NULL, &cbc, &hbc)) ||
+       (cbc.pos != strlen (DATA_STR)) ||
+       (0 != memcmp (buf, DATA_STR, cbc.pos)) ||
+       (NULL == strstr (hdr, "Content-Type: text/plain\r\n")) ||
+       (0 != get_header (hdr, "ETag", etag, sizeof (etag))) ||
+       (0 != get_header (hdr, "Last-Modified",
+                         last_modified, sizeof (last_modified))) )
+    goto fail;
+  if ( (200 != request ("/data.txt", NULL, NULL, &cbc, &hbc)) ||
+       (cbc.pos != strlen (DATA_STR)) ||
+       (0 != memcmp (buf, DATA_STR, cbc.pos)) )
+    goto fail;
+
+  /* conditional requests */
+  snprintf (line, sizeof (line), "If-None-Match: \"x\", %s", etag);
+  if ( (304 != request ("/data.txt", line, NULL, &cbc, &hbc)) ||
+       (0 != cbc.pos) ||
+       (NULL == strstr (hdr, etag)) )
+    goto fail;
+  snprintf (line, sizeof (line), "If-Modified-Since: %s", last_modified);
+  if (304 != request ("/data.txt", line, NULL, &cbc, &hbc))
+    goto fail;
+  if (304 != request ("/data.txt",
+                      "If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT",
+                      NULL, &cbc, &hbc))
+    goto fail;
+  if (200 != request ("/data.txt",
+                      "If-Modified-Since: Thu, 01 Jan 1970 00:00:00 GMT",
+                      NULL, &cbc, &hbc))
+    goto fail;
+  if (200 != request ("/data.txt", "If-None-Match: \"x\"",
+                      NULL, &cbc, &hbc))
+    goto fail;
+
+  /* index, missing files and other methods */
+  if ( (200 != request ("/", NULL, NULL, &cbc, &hbc)) ||
+       (cbc.pos != strlen (INDEX_STR)) ||
+       (0 != memcmp (buf, INDEX_STR, cbc.pos)) ||
+       (NULL == strstr (hdr, "Content-Type: text/html\r\n")) )
+    goto fail;
+  if (404 != request ("/missing", NULL, NULL, &cbc, &hbc))
+    goto fail;
+#if LIBCURL_VERSION_NUM >= 0x072a00
+  if (404 != request ("/../etc/passwd", NULL, NULL, &cbc, &hbc))
+    goto fail;
+#endif
+  if ( (405 != request ("/data.txt", NULL, "x", &cbc, &hbc)) ||
+       (NULL == strstr (hdr, "Allow: GET, HEAD\r\n")) )
+    goto fail;
+
+  /* a replaced file must not be served from the cache */
+  if (0 != write_file ("data.txt", DATA_STR2))
+    goto fail;
+  snprintf (line, sizeof (line), "If-None-Match: %s", etag);
+  if ( (200 != request ("/data.txt", line, NULL, &cbc, &hbc)) ||
+       (cbc.pos != strlen (DATA_STR2)) ||
+       (0 != memcmp (buf, DATA_STR2, cbc.pos)) )
+    goto fail;
+
+  MHD_stop_daemon (d);
+  MHD_static_files_destroy (sf);
+  return 0;
+ fail:
+  fprintf (stderr, "Unexpected response, headers: `%s'\n", hdr);
+  MHD_stop_daemon (d);
+  MHD_static_files_destroy (sf);
+  return 8;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+  const char *tmp;
+  char fn[512];
+
+  if ( (NULL == (tmp = getenv ("TMPDIR"))) &&
+       (NULL == (tmp = getenv ("TMP"))) &&
+       (NULL == (tmp = getenv ("TEMP"))) )
+    tmp = "/tmp";
+  snprintf (dir, sizeof (dir), "%s/test-mhd-static-%u",
+            tmp, (unsigned int) getpid ());
+#ifndef WINDOWS
+  if (0 != mkdir (dir, 0700))
+#else
+  if (0 != mkdir (dir))
+#endif
+    return 2;
+  if (0 != curl_global_init (CURL_GLOBAL_WIN32))
+    return 2;
+  errorCount += testStaticFiles (MHD_USE_SELECT_INTERNALLY);
+  errorCount += 16 * testStaticFiles (MHD_USE_THREAD_PER_CONNECTION);
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  curl_global_cleanup ();
+  snprintf (fn, sizeof (fn), "%s/index.html", dir);
+  (void) unlink (fn);
+  snprintf (fn, sizeof (fn), "%s/data.txt", dir);
+  (void) unlink (fn);
+  (void) rmdir (dir);
+  return errorCount != 0;       /* 0 == pass */
+}
@@ -42,6 +42,8 @@ static int withTimeout = 1;
 
 static int withoutTimeout = 1;
 
+static int withTimeoutMs = 1;
+
 struct CBC
 {
   char *buf;
@@ -74,6 +76,10 @@ termination_cb (void *cls,
 	{
 	  withTimeout = 0;
 	}
+      if (test == &withTimeoutMs)
+	{
+	  withTimeoutMs = 0;
+	}
       break;
     case MHD_REQUEST_TERMINATED_DAEMON_SHUTDOWN:
       break;
@@ -271,6 +277,64 @@ testWithTimeout ()
 }
 
 
+static int
+testWithTimeoutMs (int poll_flag)
+{
+  struct MHD_Daemon *d;
+  CURL *c;
+  char buf[2048];
+  struct CBC cbc;
+  int done_flag = 0;
+  CURLcode errornum;
+  double total;
+
+  cbc.buf = buf;
+  cbc.size = 2048;
+  cbc.pos = 0;
+  withTimeoutMs = 1;
+  d = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG | poll_flag,
+                        1080,
+                        NULL, NULL, &ahc_echo, &done_flag,
+                        MHD_OPTION_CONNECTION_TIMEOUT_MS, 250,
+                        MHD_OPTION_NOTIFY_COMPLETED, &termination_cb, &withTimeoutMs,
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 128;
+  c = curl_easy_init ();
+  curl_easy_setopt (c, CURLOPT_URL, "http://127.0.0.1:1080/hello_world");
+  curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_WRITEDATA, &cbc);
+  curl_easy_setopt (c, CURLOPT_READFUNCTION, &putBuffer_fail);
+  curl_easy_setopt (c, CURLOPT_READDATA, &testWithTimeout);
+  curl_easy_setopt (c, CURLOPT_UPLOAD, 1L);
+  curl_easy_setopt (c, CURLOPT_INFILESIZE_LARGE, (curl_off_t) 8L);
+  curl_easy_setopt (c, CURLOPT_FAILONERROR, 1);
+  curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+  if (oneone)
+    curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+  else
+    curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
+  curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1);
+  errornum = curl_easy_perform (c);
+  if ( (CURLE_OK != curl_easy_getinfo (c, CURLINFO_TOTAL_TIME, &total)) ||
+       (total > 1.5) )
+    {
+      /* timeout was not honoured with sub-second precision */
+      curl_easy_cleanup (c);
+      MHD_stop_daemon (d);
+      return 256;
+    }
+  curl_easy_cleanup (c);
+  MHD_stop_daemon (d);
+  if (errornum != CURLE_GOT_NOTHING)
+    return 512;
+  if (0 != withTimeoutMs)
+    return 1024;
+  return 0;
+}
+
+
 
 int
 main (int argc, char *const *argv)
@@ -282,6 +346,10 @@ main (int argc, char *const *argv)
     return 16;
   errorCount += testWithoutTimeout ();
   errorCount += testWithTimeout ();
+  errorCount += testWithTimeoutMs (0);
+#if EPOLL_SUPPORT
+  errorCount += testWithTimeoutMs (MHD_USE_EPOLL_LINUX_ONLY);
+#endif
   if (errorCount != 0)
     fprintf (stderr, 
 	     "Error during test execution (code: %u)\n",
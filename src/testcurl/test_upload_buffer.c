@@ -0,0 +1,315 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_upload_buffer.c
+ * @brief  Testcase for PUT uploads received into a buffer of the
+ *         application with MHD_CONNECTION_OPTION_UPLOAD_BUFFER, with
+ *         and without chunked encoding
+ * @author Christian Grothoff
+ */
+
+#include "MHD_config.h"
+#include "platform.h"
+#include <curl/curl.h>
+#include <microhttpd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+/**
+ * Size of the body we upload.
+ */
+#define PUT_SIZE (2 * 1024 * 1024)
+
+/**
+ * Size of the buffer we receive the body into; larger
+ * than the memory pool of the connection.
+ */
+#define UPLOAD_BUFFER_SIZE (256 * 1024)
+
+static char *put_buffer;
+
+/**
+ * Set to 1 by the access handler if the upload was not
+ * as expected.
+ */
+static int upload_error;
+
+/**
+ * State of one upload.
+ */
+struct Upload
+{
+  /**
+   * Buffer we passed to MHD.
+   */
+  char buf[UPLOAD_BUFFER_SIZE];
+
+  /**
+   * Number of body bytes we processed so far.
+   */
+  size_t pos;
+
+  /**
+   * Largest number of bytes we were passed at once from
+   * our buffer.
+   */
+  size_t max_size;
+};
+
+struct CBC
+{
+  char *buf;
+  size_t pos;
+  size_t size;
+};
+
+/**
+ * Give curl the upload in pieces of random size, so that
+ * chunked uploads consist of many chunks.
+ */
+static size_t
+putBuffer (void *stream, size_t size, size_t nmemb, void *ptr)
+{
+  size_t *pos = ptr;
+  size_t wrt;
+
+  wrt = size * nmemb;
+  if (wrt > PUT_SIZE - (*pos))
+    wrt = PUT_SIZE - (*pos);
+  if (wrt > 1)
+    wrt = 1 + random () % wrt;
+  memcpy (stream, &put_buffer[*pos], wrt);
+  (*pos) += wrt;
+  return wrt;
+}
+
+static size_t
+copyBuffer (void *ptr, size_t size, size_t nmemb, void *ctx)
+{
+  struct CBC *cbc = ctx;
+
+  if (cbc->pos + size * nmemb > cbc->size)
+    return 0;                   /* overflow */
+  memcpy (&cbc->buf[cbc->pos], ptr, size * nmemb);
+  cbc->pos += size * nmemb;
+  return size * nmemb;
+}
+
+
+/**
+ * Receives each upload into a `struct Upload`.  If @a cls is
+ * non-NULL, we only process half of the bytes we are passed
+ * from our buffer, so that MHD has to keep the rest for us;
+ * but not at the end of the body, as MHD only calls us again
+ * once more data arrived.
+ */
+static int
+ahc_echo (void *cls,
+          struct MHD_Connection *connection,
+          const char *url,
+          const char *method,
+          const char *version,
+          const char *upload_data, size_t *upload_data_size,
+          void **con_cls)
+{
+  struct Upload *up = *con_cls;
+  struct MHD_Response *response;
+  const char *result;
+  size_t size;
+  int ret;
+
+  if (0 != strcmp ("PUT", method))
+    return MHD_NO;              /* unexpected method */
+  if (NULL == up)
+    {
+      if (NULL == (up = malloc (sizeof (struct Upload))))
+        return MHD_NO;
+      up->pos = 0;
+      up->max_size = 0;
+      *con_cls = up;
+      if (MHD_YES != MHD_set_connection_option (connection,
+                                                MHD_CONNECTION_OPTION_UPLOAD_BUFFER,
+                                                up->buf,
+                                                sizeof (up->buf)))
+        upload_error = 1;
+      return MHD_YES;
+    }
+  if (0 != *upload_data_size)
+    {
+      size = *upload_data_size;
+      if ( (upload_data >= up->buf) &&
+           (upload_data < &up->buf[sizeof (up->buf)]) )
+        {
+          if ( (upload_data != up->buf) ||
+               (size > sizeof (up->buf)) )
+            upload_error = 1;
+          if (size > up->max_size)
+            up->max_size = size;
+          if ( (NULL != cls) &&
+               (up->pos + size < PUT_SIZE) )
+            size /= 2;
+        }
+      if ( (size > PUT_SIZE - up->pos) ||
+           (0 != memcmp (upload_data, &put_buffer[up->pos], size)) )
+        upload_error = 1;
+      up->pos += size;
+      *upload_data_size -= size;
+      return MHD_YES;
+    }
+  /* reads into our buffer can be larger than the whole pool */
+  if ( (PUT_SIZE != up->pos) ||
+       (up->max_size <= 32 * 1024) )
+    {
+      fprintf (stderr,
+               "Got %u bytes, at most %u at once\n",
+               (unsigned int) up->pos,
+               (unsigned int) up->max_size);
+      upload_error = 1;
+    }
+  free (up);
+  *con_cls = NULL;
+  result = (0 == upload_error) ? "ok" : "bad";
+  response = MHD_create_response_from_buffer (strlen (result),
+					      (void *) result,
+					      MHD_RESPMEM_PERSISTENT);
+  ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+  MHD_destroy_response (response);
+  return ret;
+}
+
+
+/**
+ * Upload @a PUT_SIZE bytes and check that they arrived,
+ * and how they got to the access handler.
+ *
+ * @param flags event loop to use
+ * @param chunked non-zero to upload with chunked encoding
+ * @param partial non-zero to have the access handler leave
+ *        bytes in its buffer
+ * @return 0 on success
+ */
+static int
+testUploadBuffer (int flags,
+                  int chunked,
+                  int partial)
+{
+  struct MHD_Daemon *d;
+  struct MHD_DaemonStats stats;
+  CURL *c;
+  struct CBC cbc;
+  size_t pos = 0;
+  CURLcode errornum;
+  char buf[2048];
+
+  cbc.buf = buf;
+  cbc.size = sizeof (buf);
+  cbc.pos = 0;
+  upload_error = 0;
+  d = MHD_start_daemon (flags | MHD_USE_DEBUG,
+                        1093,
+                        NULL, NULL, &ahc_echo, partial ? "partial" : NULL,
+                        MHD_OPTION_CONNECTION_MEMORY_LIMIT, (size_t) (32 * 1024),
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 1;
+  c = curl_easy_init ();
+  curl_easy_setopt (c, CURLOPT_URL, "http://127.0.0.1:1093/upload");
+  curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_WRITEDATA, &cbc);
+  curl_easy_setopt (c, CURLOPT_READFUNCTION, &putBuffer);
+  curl_easy_setopt (c, CURLOPT_READDATA, &pos);
+  curl_easy_setopt (c, CURLOPT_UPLOAD, 1L);
+  if (! chunked)
+    curl_easy_setopt (c, CURLOPT_INFILESIZE_LARGE, (curl_off_t) PUT_SIZE);
+  curl_easy_setopt (c, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+  curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+  // NOTE: use of CONNECTTIMEOUT without also
+  //   setting NOSIGNAL results in really weird
+  //   crashes on my system!
+  curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1L);
+  if (CURLE_OK != (errornum = curl_easy_perform (c)))
+    {
+      fprintf (stderr,
+               "curl_easy_perform failed: `%s'\n",
+               curl_easy_strerror (errornum));
+      curl_easy_cleanup (c);
+      MHD_stop_daemon (d);
+      return 2;
+    }
+  curl_easy_cleanup (c);
+  if (MHD_YES != MHD_get_daemon_stats (d, &stats))
+    {
+      MHD_stop_daemon (d);
+      return 4;
+    }
+  MHD_stop_daemon (d);
+  if ( (0 != upload_error) ||
+       (cbc.pos != strlen ("ok")) ||
+       (0 != strncmp ("ok", cbc.buf, strlen ("ok"))) )
+    return 8;
+  /* most of the body must have bypassed our read buffer */
+  if ( (stats.bytes_received_direct > PUT_SIZE) ||
+       (stats.bytes_received_direct < PUT_SIZE / 2) )
+    {
+      fprintf (stderr,
+               "%llu bytes received directly\n",
+               (unsigned long long) stats.bytes_received_direct);
+      return 16;
+    }
+  return 0;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+  unsigned int i;
+
+  if (0 != curl_global_init (CURL_GLOBAL_WIN32))
+    return 2;
+  put_buffer = malloc (PUT_SIZE);
+  if (NULL == put_buffer)
+    return 1;
+  srandom (42);
+  for (i = 0; i < PUT_SIZE; i++)
+    put_buffer[i] = (char) random ();
+  errorCount += testUploadBuffer (MHD_USE_SELECT_INTERNALLY, 0, 0);
+  errorCount += 32 * testUploadBuffer (MHD_USE_SELECT_INTERNALLY, 1, 0);
+  errorCount += 1024 * testUploadBuffer (MHD_USE_SELECT_INTERNALLY, 0, 1);
+  errorCount += 32768 * testUploadBuffer (MHD_USE_THREAD_PER_CONNECTION, 0, 1);
+#if EPOLL_SUPPORT
+  errorCount += 1048576 * testUploadBuffer (MHD_USE_SELECT_INTERNALLY |
+                                            MHD_USE_EPOLL_LINUX_ONLY, 0, 0);
+#endif
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  free (put_buffer);
+  curl_global_cleanup ();
+  return errorCount != 0;       /* 0 == pass */
+}
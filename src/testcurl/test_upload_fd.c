@@ -0,0 +1,319 @@
+/*
+     This file is part of libmicrohttpd
+     (C) 2015 Christian Grothoff
+
+     libmicrohttpd is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     libmicrohttpd is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with libmicrohttpd; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file test_upload_fd.c
+ * @brief  Testcase for PUT uploads written to a file descriptor
+ *         with MHD_CONNECTION_OPTION_UPLOAD_FD, with and without
+ *         chunked encoding
+ * @author Christian Grothoff
+ */
+
+#include "MHD_config.h"
+#include "platform.h"
+#include <curl/curl.h>
+#include <microhttpd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+/**
+ * Size of the body we upload.
+ */
+#define PUT_SIZE (2 * 1024 * 1024)
+
+static char *put_buffer;
+
+/**
+ * Set to 1 by the access handler if the upload was not
+ * as expected.
+ */
+static int upload_error;
+
+/**
+ * State of one upload.
+ */
+struct Upload
+{
+  /**
+   * File we store the upload in.
+   */
+  FILE *f;
+
+  /**
+   * Non-zero once we passed the file descriptor to MHD.
+   */
+  int fd_set;
+};
+
+struct CBC
+{
+  char *buf;
+  size_t pos;
+  size_t size;
+};
+
+/**
+ * Give curl the upload in pieces of random size, so that
+ * chunked uploads consist of many chunks.
+ */
+static size_t
+putBuffer (void *stream, size_t size, size_t nmemb, void *ptr)
+{
+  size_t *pos = ptr;
+  size_t wrt;
+
+  wrt = size * nmemb;
+  if (wrt > PUT_SIZE - (*pos))
+    wrt = PUT_SIZE - (*pos);
+  if (wrt > 1)
+    wrt = 1 + random () % wrt;
+  memcpy (stream, &put_buffer[*pos], wrt);
+  (*pos) += wrt;
+  return wrt;
+}
+
+static size_t
+copyBuffer (void *ptr, size_t size, size_t nmemb, void *ctx)
+{
+  struct CBC *cbc = ctx;
+
+  if (cbc->pos + size * nmemb > cbc->size)
+    return 0;                   /* overflow */
+  memcpy (&cbc->buf[cbc->pos], ptr, size * nmemb);
+  cbc->pos += size * nmemb;
+  return size * nmemb;
+}
+
+
+/**
+ * Check that @a f contains exactly our upload.
+ *
+ * @param f file to check
+ * @return 0 if it does
+ */
+static int
+check_file (FILE *f)
+{
+  char buf[4096];
+  size_t pos;
+  size_t got;
+
+  if (0 != fseek (f, 0, SEEK_SET))
+    return 1;
+  pos = 0;
+  while (0 != (got = fread (buf, 1, sizeof (buf), f)))
+    {
+      if ( (got > PUT_SIZE - pos) ||
+           (0 != memcmp (buf, &put_buffer[pos], got)) )
+        return 1;
+      pos += got;
+    }
+  return (PUT_SIZE == pos) ? 0 : 1;
+}
+
+
+/**
+ * Stores each upload in a temporary file.  If @a cls is non-NULL,
+ * the file descriptor is only set once the first body bytes were
+ * passed to us, which we then leave for MHD to write.
+ */
+static int
+ahc_echo (void *cls,
+          struct MHD_Connection *connection,
+          const char *url,
+          const char *method,
+          const char *version,
+          const char *upload_data, size_t *upload_data_size,
+          void **con_cls)
+{
+  struct Upload *up = *con_cls;
+  struct MHD_Response *response;
+  const char *result;
+  int ret;
+
+  if (0 != strcmp ("PUT", method))
+    return MHD_NO;              /* unexpected method */
+  if (NULL == up)
+    {
+      if (NULL == (up = malloc (sizeof (struct Upload))))
+        return MHD_NO;
+      if (NULL == (up->f = tmpfile ()))
+        {
+          free (up);
+          return MHD_NO;
+        }
+      up->fd_set = 0;
+      *con_cls = up;
+      if (NULL != cls)
+        return MHD_YES;
+    }
+  if ( (! up->fd_set) &&
+       ( (NULL == cls) ||
+         (0 != *upload_data_size) ) )
+    {
+      if (MHD_YES != MHD_set_connection_option (connection,
+                                                MHD_CONNECTION_OPTION_UPLOAD_FD,
+                                                fileno (up->f)))
+        upload_error = 1;
+      up->fd_set = 1;
+      /* if we set it late, MHD writes the bytes we leave unprocessed */
+      return MHD_YES;
+    }
+  if (0 != *upload_data_size)
+    {
+      /* MHD should have written the body to the file */
+      upload_error = 1;
+      *upload_data_size = 0;
+      return MHD_YES;
+    }
+  if (0 != check_file (up->f))
+    upload_error = 1;
+  fclose (up->f);
+  free (up);
+  *con_cls = NULL;
+  result = (0 == upload_error) ? "ok" : "bad";
+  response = MHD_create_response_from_buffer (strlen (result),
+					      (void *) result,
+					      MHD_RESPMEM_PERSISTENT);
+  ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+  MHD_destroy_response (response);
+  return ret;
+}
+
+
+/**
+ * Upload @a PUT_SIZE bytes and check that they arrived in
+ * the file, and how they got there.
+ *
+ * @param flags event loop to use
+ * @param chunked non-zero to upload with chunked encoding
+ * @param late non-zero to set the file descriptor only once
+ *        the access handler got the first body bytes
+ * @return 0 on success
+ */
+static int
+testUploadFd (int flags,
+              int chunked,
+              int late)
+{
+  struct MHD_Daemon *d;
+  struct MHD_DaemonStats stats;
+  CURL *c;
+  struct CBC cbc;
+  size_t pos = 0;
+  CURLcode errornum;
+  char buf[2048];
+
+  cbc.buf = buf;
+  cbc.size = sizeof (buf);
+  cbc.pos = 0;
+  upload_error = 0;
+  d = MHD_start_daemon (flags | MHD_USE_DEBUG,
+                        1092,
+                        NULL, NULL, &ahc_echo, late ? "late" : NULL,
+                        MHD_OPTION_END);
+  if (d == NULL)
+    return 1;
+  c = curl_easy_init ();
+  curl_easy_setopt (c, CURLOPT_URL, "http://127.0.0.1:1092/upload");
+  curl_easy_setopt (c, CURLOPT_WRITEFUNCTION, &copyBuffer);
+  curl_easy_setopt (c, CURLOPT_WRITEDATA, &cbc);
+  curl_easy_setopt (c, CURLOPT_READFUNCTION, &putBuffer);
+  curl_easy_setopt (c, CURLOPT_READDATA, &pos);
+  curl_easy_setopt (c, CURLOPT_UPLOAD, 1L);
+  if (! chunked)
+    curl_easy_setopt (c, CURLOPT_INFILESIZE_LARGE, (curl_off_t) PUT_SIZE);
+  curl_easy_setopt (c, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt (c, CURLOPT_TIMEOUT, 150L);
+  curl_easy_setopt (c, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+  curl_easy_setopt (c, CURLOPT_CONNECTTIMEOUT, 150L);
+  // NOTE: use of CONNECTTIMEOUT without also
+  //   setting NOSIGNAL results in really weird
+  //   crashes on my system!
+  curl_easy_setopt (c, CURLOPT_NOSIGNAL, 1L);
+  if (CURLE_OK != (errornum = curl_easy_perform (c)))
+    {
+      fprintf (stderr,
+               "curl_easy_perform failed: `%s'\n",
+               curl_easy_strerror (errornum));
+      curl_easy_cleanup (c);
+      MHD_stop_daemon (d);
+      return 2;
+    }
+  curl_easy_cleanup (c);
+  if (MHD_YES != MHD_get_daemon_stats (d, &stats))
+    {
+      MHD_stop_daemon (d);
+      return 4;
+    }
+  MHD_stop_daemon (d);
+  if ( (0 != upload_error) ||
+       (cbc.pos != strlen ("ok")) ||
+       (0 != strncmp ("ok", cbc.buf, strlen ("ok"))) )
+    return 8;
+#if LINUX
+  /* most of the body must have bypassed our buffers */
+  if ( (stats.bytes_spliced > PUT_SIZE) ||
+       ( (! chunked) &&
+         (stats.bytes_spliced < PUT_SIZE / 2) ) )
+    {
+      fprintf (stderr,
+               "%llu bytes spliced\n",
+               (unsigned long long) stats.bytes_spliced);
+      return 16;
+    }
+#endif
+  return 0;
+}
+
+
+int
+main (int argc, char *const *argv)
+{
+  unsigned int errorCount = 0;
+  unsigned int i;
+
+  if (0 != curl_global_init (CURL_GLOBAL_WIN32))
+    return 2;
+  put_buffer = malloc (PUT_SIZE);
+  if (NULL == put_buffer)
+    return 1;
+  srandom (42);
+  for (i = 0; i < PUT_SIZE; i++)
+    put_buffer[i] = (char) random ();
+  errorCount += testUploadFd (MHD_USE_SELECT_INTERNALLY, 0, 0);
+  errorCount += 32 * testUploadFd (MHD_USE_SELECT_INTERNALLY, 1, 0);
+  errorCount += 1024 * testUploadFd (MHD_USE_SELECT_INTERNALLY, 0, 1);
+  errorCount += 32768 * testUploadFd (MHD_USE_THREAD_PER_CONNECTION, 1, 1);
+#if EPOLL_SUPPORT
+  errorCount += 1048576 * testUploadFd (MHD_USE_SELECT_INTERNALLY |
+                                        MHD_USE_EPOLL_LINUX_ONLY, 0, 0);
+#endif
+  if (errorCount != 0)
+    fprintf (stderr, "Error (code: %u)\n", errorCount);
+  free (put_buffer);
+  curl_global_cleanup ();
+  return errorCount != 0;       /* 0 == pass */
+}